@@ -11,6 +11,75 @@
 
 #include "packet_rx_simulate.h"
 
+#define BAR_COUNT 8
+#define GREY_LEVEL 128
+
+// RGB of each bar, 1 is full scale
+static
+const uint8_t colour_bars[BAR_COUNT][3] = {
+  {1, 1, 1}, // white
+  {1, 1, 0}, // yellow
+  {0, 1, 1}, // cyan
+  {0, 1, 0}, // green
+  {1, 0, 1}, // magenta
+  {1, 0, 0}, // red
+  {0, 0, 1}, // blue
+  {0, 0, 0}, // black
+};
+
+static uint16_t pn9_state = 0x1FF;
+
+static
+uint8_t pn9_next()
+{
+  // x^9 + x^5 + 1, one byte per pixel
+  for (unsigned k = 0; k < 8; k++) {
+    unsigned bit = ((pn9_state >> 8) ^ (pn9_state >> 4)) & 1;
+    pn9_state = ((pn9_state << 1) | bit) & 0x1FF;
+  }
+  return (uint8_t)pn9_state;
+}
+
+void packet_rx_test_pattern_row(
+    uint8_t* row,
+    const unsigned row_index,
+    const unsigned width,
+    const unsigned height,
+    const sensor_test_pattern_t pattern)
+{
+  if (row_index == 0) {
+    pn9_state = 0x1FF;
+  }
+  // RGGB: R G R G ... / G B G B ...
+  const unsigned odd_row = row_index & 1;
+
+  for (unsigned col = 0; col < width; col++) {
+    const unsigned odd_col = col & 1;
+    const unsigned chan = odd_row + odd_col; // 0 R, 1 G, 2 B
+    uint8_t val;
+    switch (pattern)
+    {
+    case TEST_PATTERN_SOLID:
+      val = TEST_PATTERN_SOLID_VALUE >> 2;
+      break;
+    case TEST_PATTERN_COLOUR_BARS:
+    case TEST_PATTERN_GREY_BARS:
+      val = colour_bars[(col * BAR_COUNT) / width][chan] ? 255 : 0;
+      if (pattern == TEST_PATTERN_GREY_BARS) {
+        val = (val * (height - row_index) + GREY_LEVEL * row_index) / height;
+      }
+      break;
+    case TEST_PATTERN_PN9:
+      val = pn9_next();
+      break;
+    default:
+      assert(0 && "Invalid test pattern");
+      val = 0;
+      break;
+    }
+    row[col] = val;
+  }
+}
 
 void MipiPacketRx_simulate(
   in_buffered_port_32_t p_mipi_rxd,
@@ -18,8 +87,11 @@ void MipiPacketRx_simulate(
   streaming_chanend_t c_pkt,
   streaming_chanend_t c_ctrl)
 {
-  const char* filename = "tmp.raw";
-  io_open_file(filename);
+  const sensor_test_pattern_t pattern = SIMULATE_TEST_PATTERN;
+  if (pattern == TEST_PATTERN_NONE) {
+    const char* filename = "tmp.raw";
+    io_open_file(filename);
+  }
 
   while (1) {
     // send data
@@ -42,14 +114,26 @@ void MipiPacketRx_simulate(
 
       default:
         pkt->header = (uint32_t)MIPI_DT_RAW8; // header type RAW8
-        io_fill_array_from_file((uint8_t*)&pkt->payload[0], MIPI_IMAGE_WIDTH_BYTES);
+        if (pattern == TEST_PATTERN_NONE) {
+          io_fill_array_from_file((uint8_t*)&pkt->payload[0], MIPI_IMAGE_WIDTH_BYTES);
+        }
+        else {
+          packet_rx_test_pattern_row(
+            (uint8_t*)&pkt->payload[0],
+            row - 1,
+            MIPI_IMAGE_WIDTH_PIXELS,
+            MIPI_IMAGE_HEIGHT_PIXELS,
+            pattern);
+        }
         break;
       }
       // send back the data
       s_chan_out_word(c_pkt, (unsigned)pkt);
       delay_milliseconds(2); // LB
     }
-    io_rewind_file();
+    if (pattern == TEST_PATTERN_NONE) {
+      io_rewind_file();
+    }
     delay_milliseconds(10); // FB
   }
 }
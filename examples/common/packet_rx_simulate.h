@@ -7,8 +7,38 @@
 #include <stdint.h>
 #include <assert.h>
 
+#include "sensor.h"
+
+// Input of the simulated receiver: TEST_PATTERN_NONE reads "tmp.raw",
+// any other pattern is generated without a file.
+#ifndef SIMULATE_TEST_PATTERN
+#define SIMULATE_TEST_PATTERN TEST_PATTERN_NONE
+#endif
+
+/**
+ * @brief Fill a RAW8 Bayer (RGGB) row with a test pattern. The same input can
+ * be generated off-board for bit-exactness checks of the pipeline.
+ * 
+ * Colour bars are 8 vertical bars (white, yellow, cyan, green, magenta, red,
+ * blue, black), grey bars fade them to mid-grey from top to bottom and PN9 is
+ * an x^9 + x^5 + 1 LFSR, restarted at row 0.
+ * 
+ * @param row         Row to fill
+ * @param row_index   Row index in the frame
+ * @param width       Row width in pixels
+ * @param height      Frame height in rows
+ * @param pattern     Test pattern, TEST_PATTERN_NONE is not valid
+ */
+void packet_rx_test_pattern_row(
+    uint8_t* row,
+    const unsigned row_index,
+    const unsigned width,
+    const unsigned height,
+    const sensor_test_pattern_t pattern);
+
 /**
- * @brief Mipi packet reciever that takes an image from a file and injects to the board
+ * @brief Mipi packet reciever that takes an image from a file (or a generated
+ * test pattern, see SIMULATE_TEST_PATTERN) and injects to the board
  * 
  * @param p_mipi_rxd    High-Speed Receive Data
  * @param p_mipi_rxa    RxActiveHS (Output): High-Speed Reception Active. This active high signal indicates that the lane module is actively receiving a high-speed transmission from the lane interconnect.
@@ -3,8 +3,18 @@
 
 #pragma once
 
+#include <stdint.h>
+#include <stddef.h>
+
 // user
 #include "sensor.h"
+#include "isp_demosaic.h"
+#include "isp_ccm.h"
+#include "isp_lsc.h"
+#include "isp_dpc.h"
+#include "isp_tnr.h"
+#include "isp_sharpen.h"
+#include "isp_yuv_rgb.h"
 
 
 #if defined(__XC__) || defined(__cplusplus)
@@ -34,6 +44,344 @@ void camera_stop();
  */
 unsigned camera_check_stop();
 
+/**
+ * CLIENT SIDE
+ * 
+ * Request a new sensor mode (resolution, RAW format and binning) without
+ * rebuilding. The request is applied between frames: the current frame is
+ * completed and the pipeline is reconfigured at the next frame start.
+ * Every mode produces the same decimated output size [H][W], unless a
+ * decimation factor was set with camera_set_decimation().
+ * 
+ * @note Raw capture buffers are sized for the build-time mode (W_RAW, H_RAW),
+ * raw rows of a larger mode are truncated.
+ * 
+ * @param mode The new sensor mode
+ * 
+ * @return 0 if the request was sent, -1 if the resolution, format or binning
+ *         is unknown
+ */
+int camera_set_mode(
+    const camera_mode_t mode);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Request a new sensor frame rate. The sensor frame length is computed from
+ * the current line length. Applied between frames, rejected by the sensor
+ * (with a warning) if out of range.
+ * 
+ * @param fps Frames per second, 1 to 65535
+ * 
+ * @return 0 if the request was sent, -1 if `fps` doesn't fit the command
+ */
+int camera_set_fps(
+    const unsigned fps);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Request a new sensor line length, in pixel clocks (minimum 3448). Longer
+ * lines give the ISP more time per row. If a frame rate has been set, it is
+ * kept. Rejected by the sensor (with a warning) if the worst-case ISP row time
+ * measured so far doesn't fit in the resulting line period.
+ * 
+ * @param line_length Line length in pixel clocks, up to 65535
+ * 
+ * @return 0 if the request was sent, -1 if `line_length` doesn't fit the
+ *         command
+ */
+int camera_set_line_length(
+    const unsigned line_length);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Replace the sensor image with a built-in test pattern, or go back to the
+ * image with TEST_PATTERN_NONE. Applied between frames, and kept across
+ * camera_set_mode() with its window resized to the new mode. Gives the
+ * pipeline identical input on every frame, for benchmarks and bit-exactness
+ * checks.
+ * 
+ * @param pattern Test pattern
+ * 
+ * @return 0 if the request was sent, -1 if the pattern is unknown
+ */
+int camera_set_test_pattern(
+    const sensor_test_pattern_t pattern);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Request a decimation factor of 2, 4 or 8, changing the output size to the
+ * sensor mode size divided by `dec_factor`. Applied at the next frame start,
+ * each factor has its own precomputed filters. With 0 the factor follows the
+ * sensor mode again, giving the default [H][W] output.
+ * 
+ * Buffers sized with H and W only fit the default output: use
+ * camera_get_image_size() and camera_capture_image_scaled(), or
+ * camera_capture_row_scaled(), for the other sizes.
+ * 
+ * @param dec_factor 0, 2, 4 or 8, not below APP_DECIMATION_FACTOR_MIN
+ * 
+ * @return 0 if the request was sent, -1 if the factor is not supported
+ */
+int camera_set_decimation(
+    const unsigned dec_factor);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Turn the full resolution RGB output on (DEMOSAIC_BILINEAR or
+ * DEMOSAIC_GRADIENT) or off (DEMOSAIC_NONE). Applied at the next frame start,
+ * only in RAW8 sensor modes up to APP_DEMOSAIC_MAX_WIDTH_PIXELS wide. While
+ * it is on, the ISP demosaics every raw row and camera_capture_row_rgb()
+ * returns the rows.
+ * 
+ * @param mode The interpolation, or DEMOSAIC_NONE
+ * 
+ * @return 0 if the request was sent, -1 if the demosaic isn't built in
+ *         (APP_DEMOSAIC_MAX_WIDTH_PIXELS is 0) or the mode is unknown
+ */
+int camera_set_demosaic(
+    const demosaic_mode_t mode);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Set the threshold of the dynamic defective pixel correction, see
+ * isp_dpc_row(). Applied at the next frame start, only in RAW8 sensor modes.
+ * Raw pixels brighter or darker than both their same-colour neighbours in the
+ * row by more than `threshold` are clamped, before any other stage but the
+ * raw row capture. The correction starts at APP_DPC_THRESHOLD.
+ * 
+ * @param threshold Threshold in raw uint8 units up to 127, 0 turns the
+ *                  dynamic correction off
+ * 
+ * @return 0 if the request was sent, -1 if the correction isn't built in
+ *         (APP_DPC_ENABLED is 0) or the threshold is out of range
+ */
+int camera_set_dpc(
+    const unsigned threshold);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Set the temporal denoise of the decimated output, see isp_tnr_set().
+ * Applied at the next frame start, to outputs up to the default [H][W] size.
+ * Each row is blended with the same row of the previous output frame, kept in
+ * a TNR_PREV_BYTES buffer. The denoise starts at APP_TNR_STRENGTH and
+ * APP_TNR_THRESHOLD.
+ * 
+ * @param strength  Share of the previous frame in 1/128, 0 turns it off
+ * @param threshold Motion threshold in uint8 units, 2 to TNR_THRESHOLD_MAX
+ * 
+ * @return 0 if the request was sent, -1 if the denoise isn't built in
+ *         (APP_TNR_ENABLED is 0) or a setting is out of range
+ */
+int camera_set_temporal_denoise(
+    const unsigned strength,
+    const unsigned threshold);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Set the sharpening of the decimated output, see isp_sharpen_frame_init().
+ * Applied at the next frame start, after the colour correction. The sharpened
+ * rows are also the ones the pyramid is built from. The sharpening starts at
+ * APP_SHARPEN_STRENGTH.
+ * 
+ * @param strength Strength in 1/16 up to SHARPEN_STRENGTH_MAX, 0 turns it off
+ * 
+ * @return 0 if the request was sent, -1 if the sharpening isn't built in
+ *         (APP_SHARPEN_ENABLED is 0) or the strength is out of range
+ */
+int camera_set_sharpen(
+    const unsigned strength);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Turn the luma-only mode on or off, applied at the next frame start. In this
+ * mode the ISP weights both colours of each raw row into a single BT.601 luma
+ * channel inside the horizontal filter, with the white balance gains, and runs
+ * a single set of vertical accumulators: 2 filter passes per Bayer row pair
+ * instead of 3, and a third of the output bytes of the RGB rows. The rows go
+ * to camera_capture_row_gray() and camera_capture_image_gray() only, and skip
+ * the denoise, lens shading, colour correction, sharpening, pyramid and YUV
+ * stages. The RGB captures get no rows until the mode is turned off.
+ * 
+ * @param enable 1 for luma-only rows, 0 for the RGB rows
+ * 
+ * @return 0 if the request was sent, -1 if `enable` isn't 0 or 1
+ */
+int camera_set_luma(
+    const unsigned enable);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Set the static defect list, usually at boot, see
+ * isp_dpc_defect_list_init(). Each listed pixel is replaced by the mean of
+ * its same-colour neighbours in the row, whatever the dynamic threshold, only
+ * in RAW8 sensor modes. The
+ * list isn't copied, it must stay valid while the camera runs. The ISP takes
+ * it at the next frame start, this only returns once it has, so the camera
+ * must be running.
+ * 
+ * @param defects      Defects sorted by row then column, in the raw frames of
+ *                     the sensor mode, or NULL
+ * @param defect_count The number of defects
+ * 
+ * @return 0 once the ISP has the list, -1 if the correction isn't built in
+ *         or the defects aren't sorted
+ */
+int camera_set_defect_list(
+    const dpc_defect_t defects[],
+    const unsigned defect_count);
+
+/**
+ * SERVER SIDE
+ * 
+ * Check for a new static defect list, at a frame start.
+ * 
+ * @param list Overwritten with the client list if there is one
+ * 
+ * @return 1 if `list` was updated, 0 otherwise
+ */
+unsigned camera_check_defect_list(
+    dpc_defect_list_t* list);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Set the colour correction matrix of the decimated output (rows, images and
+ * pyramids), see isp_ccm_init(). The ISP takes it at the next frame start,
+ * this only returns once it has, so the camera must be running. The
+ * statistics and AWB gains keep working on the uncorrected colours.
+ * 
+ * @param matrix [out channel][in channel] on uint8 pixel values, or NULL to
+ *               turn the correction off
+ * 
+ * @return 0 once the ISP has the matrix, -1 if the correction isn't built in
+ *         (APP_CCM_ENABLED is 0) or the matrix can't be quantised
+ */
+int camera_set_ccm(
+    const float matrix[CH][CH]);
+
+/**
+ * SERVER SIDE
+ * 
+ * Check for a new colour correction matrix, at a frame start.
+ * 
+ * @param ccm Overwritten with the client matrix if there is one
+ * 
+ * @return 1 if `ccm` was updated, 0 otherwise
+ */
+unsigned camera_check_ccm(
+    isp_ccm_t* ccm);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Set the lens shading gain grid of the decimated output, see isp_lsc_init().
+ * The grid covers the whole output frame, whatever its size. It is applied
+ * before the colour correction and the statistics. The ISP takes it at the
+ * next frame start, this only returns once it has, so the camera must be
+ * running.
+ * 
+ * @param gains [channel][node row][node column] gains, or NULL to turn the
+ *              correction off
+ * 
+ * @return 0 once the ISP has the grid, -1 if the correction isn't built in
+ *         (APP_LSC_ENABLED is 0) or a gain is out of range
+ */
+int camera_set_lens_shading(
+    const float gains[CH][LSC_GRID_H][LSC_GRID_W]);
+
+/**
+ * SERVER SIDE
+ * 
+ * Check for a new lens shading grid, at a frame start.
+ * 
+ * @param lsc Overwritten with the client grid if there is one
+ * 
+ * @return 1 if `lsc` was updated, 0 otherwise
+ */
+unsigned camera_check_lens_shading(
+    isp_lsc_t* lsc);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Get the size of the decimated output frames, as last set by the ISP at a
+ * frame start.
+ * 
+ * @param width  Filled with the width in pixels
+ * @param height Filled with the height in pixels
+ */
+void camera_get_image_size(
+    unsigned* width,
+    unsigned* height);
+
+/**
+ * SERVER SIDE
+ * 
+ * Called by the ISP at each frame start with the decimated output size.
+ */
+void camera_new_frame_size(
+    const unsigned width,
+    const unsigned height);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Make camera_capture_image() and the transpose, cropped, scaled and gray
+ * captures write pixels already quantised for a model input, so the
+ * captured buffer is the input tensor. Per channel c:
+ *   real = (pixel / 255 - mean[c]) / std[c]
+ *   q    = round(real / scale[c]) + zero_point[c]
+ * where pixel is the uint8 value each capture would otherwise return: after
+ * gamma for camera_capture_image() (when APPLY_GAMMA is set), without it for
+ * the transpose, cropped, scaled and gray captures. Gamma and quantisation
+ * are composed into one lookup table per channel, so quantised captures
+ * cost the same as the default ones. The gray capture uses the BT.601 mix of
+ * the channel quantisations, which is the channel one when all three match.
+ * 
+ * The quantisation is applied on the client, by the capture functions as
+ * they copy each row into the buffer. The ISP and the row captures
+ * (camera_capture_row() and similar) still give int8 pixels.
+ * 
+ * @param mean       Per channel mean, on [0, 1] pixels (0 to skip)
+ * @param std        Per channel standard deviation, on [0, 1] pixels (1 to skip)
+ * @param scale      Per channel scale of the int8 tensor
+ * @param zero_point Per channel zero point of the int8 tensor
+ */
+void camera_set_output_quant(
+    const float mean[CH],
+    const float std[CH],
+    const float scale[CH],
+    const int32_t zero_point[CH]);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Go back to the default output, int8 pixels (uint8 value - 128).
+ */
+void camera_clear_output_quant();
+
+/**
+ * SERVER SIDE
+ * 
+ * Check if the client has requested a sensor change.
+ * 
+ * @param encoded_cmd Filled with the encoded sensor command if there is one
+ * 
+ * @return 1 if the client has requested a sensor change, 0 otherwise
+ */
+unsigned camera_check_sensor_cmd(
+    uint32_t* encoded_cmd);
+
 /**
  * SERVER SIDE
  * 
@@ -48,11 +396,13 @@ void camera_new_row(
  * SERVER SIDE
  * 
  * Called by the packet handler when a new row of decimated image data is
- * available.
+ * available. `pixel_data` holds the [CH][width] channel rows.
+ * Rows wider than the client buffer are truncated.
  */
 void camera_new_row_decimated(
-    const int8_t pixel_data[CH][W],
-    const unsigned row_index);
+    const int8_t* pixel_data,
+    const unsigned row_index,
+    const unsigned width);
 
 /**
  * CLIENT SIDE
@@ -78,6 +428,51 @@ unsigned camera_capture_row(
 unsigned camera_capture_row_decimated(
     int8_t pixel_data[CH][W]);
 
+/**
+ * CLIENT SIDE
+ * 
+ * Capture a row of decimated image data of any runtime size. Channel c of
+ * the row starts at `pixel_data[c * max_width]`, the width is given by
+ * camera_get_image_size().
+ * 
+ * @param pixel_data The buffer to store the row of pixels in, [CH][max_width]
+ * @param max_width  Width of the buffer rows, usually APP_MAX_IMAGE_WIDTH_PIXELS
+ * 
+ * @return The row index of the captured row of pixels
+ */
+unsigned camera_capture_row_scaled(
+    int8_t* pixel_data,
+    const unsigned max_width);
+
+/**
+ * SERVER SIDE
+ * 
+ * Called by the ISP when a full resolution RGB row is available (see
+ * camera_set_demosaic()). `pixel_data` holds the [CH][width] channel rows.
+ * Rows wider than the client buffer are truncated.
+ */
+void camera_new_row_rgb(
+    const int8_t* pixel_data,
+    const unsigned row_index,
+    const unsigned width);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Capture a full resolution RGB row, demosaiced by the ISP. Channel c of
+ * the row starts at `pixel_data[c * max_width]`, the width is the sensor mode
+ * width. Pixels are int8 (uint8 value - 128), without white balance or gamma.
+ * Only returns while camera_set_demosaic() has turned the output on.
+ * 
+ * @param pixel_data The buffer to store the row of pixels in, [CH][max_width]
+ * @param max_width  Width of the buffer rows
+ * 
+ * @return The row index of the captured row of pixels
+ */
+unsigned camera_capture_row_rgb(
+    int8_t* pixel_data,
+    const unsigned max_width);
+
 /**
  * CLIENT SIDE
  * 
@@ -97,7 +492,8 @@ unsigned camera_capture_image_raw(
  * 
  * @param image_buff The buffer to store the image in
  * 
- * @return Returns 0 on success, non-zero on failure
+ * @return Returns 0 on success, non-zero on failure or if the output size
+ *         isn't the default [H][W] (see camera_set_decimation())
  */
 unsigned camera_capture_image_transpose(
     int8_t image_buff[CH][H][W]);
@@ -109,11 +505,32 @@ unsigned camera_capture_image_transpose(
  * 
  * @param image_buff The buffer to store the image in
  * 
- * @return Returns 0 on success, non-zero on failure
+ * @return Returns 0 on success, non-zero on failure or if the output size
+ *         isn't the default [H][W] (see camera_set_decimation())
  */
 unsigned camera_capture_image(
     int8_t image_buff[H][W][CH]);
 
+/**
+ * CLIENT SIDE
+ * 
+ * Capture a decimated image at the runtime output size (see
+ * camera_set_decimation()), in [channel][height][width] format.
+ * 
+ * @param image_buff The buffer to store the image in
+ * @param buff_size  Size of `image_buff` in bytes
+ * @param width      Filled with the image width
+ * @param height     Filled with the image height
+ * 
+ * @return Returns 0 on success, non-zero on failure or if the image doesn't
+ *         fit in `buff_size`
+ */
+unsigned camera_capture_image_scaled(
+    int8_t* image_buff,
+    const size_t buff_size,
+    unsigned* width,
+    unsigned* height);
+
 typedef struct {
   struct {
     unsigned row;
@@ -138,12 +555,146 @@ typedef struct {
  * @param image_buff The buffer to store the image in
  * @param crop_params The parameters of the crop
  * 
- * @return Returns 0 on success, non-zero on failure
+ * @return Returns 0 on success, non-zero on failure or if the output size
+ *         isn't the default [H][W] (see camera_set_decimation())
  */
 unsigned camera_capture_image_cropped(
     int8_t* image_buff,
     const image_crop_params_t crop_params);
 
+/**
+ * CLIENT SIDE
+ * 
+ * Capture all the levels of an image pyramid from a single frame. Level 0 is
+ * the decimated image, each further level halves the width and height of the
+ * previous one with the 2x2 mean of isp_pyramid_downscale_row(). The levels are written by the ISP while the frame is
+ * decimated, so the frame is never read again.
+ * 
+ * `levels[k]` must be a word aligned buffer of
+ * `[CH][APP_PYRAMID_HEIGHT(k)][APP_PYRAMID_WIDTH(k)]`.
+ * Pixels are int8 without gamma, as in camera_capture_image_transpose().
+ * 
+ * @param levels The buffers of the APP_PYRAMID_LEVELS levels
+ * 
+ * @return Returns 0 on success, non-zero on failure or if the output size
+ *         isn't the default [H][W] (see camera_set_decimation())
+ */
+unsigned camera_capture_pyramid(
+    int8_t* levels[APP_PYRAMID_LEVELS]);
+
+/**
+ * SERVER SIDE
+ * 
+ * Check if the client is waiting for a pyramid.
+ * 
+ * @param levels Filled with the client level buffers if there is a request
+ * 
+ * @return 1 if the client has requested a pyramid, 0 otherwise
+ */
+unsigned camera_check_pyramid(
+    int8_t* levels[APP_PYRAMID_LEVELS]);
+
+/**
+ * SERVER SIDE
+ * 
+ * Release the client once all the levels have been written.
+ * 
+ * @param status 0 if the pyramid is complete
+ */
+void camera_pyramid_done(
+    const unsigned status);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Capture a semi-planar YUV image from a single frame, see isp_yuv_pack_row().
+ * The ISP converts the decimated rows as they leave it, after all the other
+ * stages, and writes them straight into `image`: a [H][W] Y plane then the
+ * U V plane, of [H][W] bytes in YUV_FORMAT_422 and [H / 2][W] bytes in
+ * YUV_FORMAT_NV12. Pixels are uint8, U and V centred on 128, without gamma.
+ * The image size is that of camera_get_image_size() at the frame start.
+ * 
+ * @param image       Word aligned buffer
+ * @param image_bytes Size of `image` in bytes, at least
+ *                    YUV_IMAGE_BYTES(format, width, height)
+ * @param format      YUV_FORMAT_422 or YUV_FORMAT_NV12
+ * 
+ * @return Returns 0 on success, non-zero on failure, if the image doesn't
+ *         fit `image` or if YUV images aren't built in (APP_YUV_ENABLED is 0)
+ */
+unsigned camera_capture_image_yuv(
+    uint8_t* image,
+    const unsigned image_bytes,
+    const yuv_format_t format);
+
+/**
+ * SERVER SIDE
+ * 
+ * Check if the client is waiting for a YUV image.
+ * 
+ * @param image       Filled with the client buffer if there is a request
+ * @param image_bytes Filled with its size in bytes
+ * @param format      Filled with the requested layout
+ * 
+ * @return 1 if the client has requested an image, 0 otherwise
+ */
+unsigned camera_check_yuv(
+    uint8_t** image,
+    unsigned* image_bytes,
+    yuv_format_t* format);
+
+/**
+ * SERVER SIDE
+ * 
+ * Release the client once the image has been written.
+ * 
+ * @param status 0 if the image is complete
+ */
+void camera_yuv_done(
+    const unsigned status);
+
+/**
+ * SERVER SIDE
+ * 
+ * Called by the ISP when a luma row is available, see camera_set_luma().
+ * Rows wider than the client buffer are truncated.
+ */
+void camera_new_row_gray(
+    const int8_t* pixel_data,
+    const unsigned row_index,
+    const unsigned width);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Capture a luma row of any runtime size, see camera_set_luma(). Pixels are
+ * int8 (uint8 value - 128), without gamma. Only returns while the luma-only
+ * mode is on.
+ * 
+ * @param pixel_data The buffer to store the row of pixels in, [max_width]
+ * @param max_width  Width of the buffer
+ * 
+ * @return The row index of the captured row of pixels
+ */
+unsigned camera_capture_row_gray(
+    int8_t* pixel_data,
+    const unsigned max_width);
+
+/**
+ * CLIENT SIDE
+ * 
+ * Capture a luma image in [height][width] format, see camera_set_luma(). The
+ * output quantisation applies with the BT.601 mix of the channel settings
+ * (camera_set_output_quant()).
+ * 
+ * @param image The buffer to store the image in
+ * 
+ * @return Returns 0 on success, non-zero on failure or if the output size
+ *         isn't the default [H][W] (see camera_set_decimation())
+ */
+unsigned camera_capture_image_gray(
+    int8_t image[H][W]);
+
 #if defined(__XC__) || defined(__cplusplus)
 }
 #endif
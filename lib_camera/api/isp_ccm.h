@@ -0,0 +1,73 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#pragma once
+
+#include <stdint.h>
+
+#include "sensor.h"
+
+// Colour correction of the decimated rows (camera_set_ccm()). 0 leaves it
+// out, saving its output row buffer.
+#ifndef APP_CCM_ENABLED
+# define APP_CCM_ENABLED        (0)
+#endif
+
+// Matrix coefficients are quantised to int8 with this many fractional bits,
+// so each of them must be in [-2.0, 1.98]
+#define CCM_SHIFT     (6)
+// Taps of an output channel: the input channels, then the bias row
+#define CCM_TAPS      (APP_IMAGE_CHANNEL_COUNT + 1)
+// Pixel value of the bias row, its coefficient carries the int8 offset
+#define CCM_BIAS      (64)
+
+#if defined(__XC__) || defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * 3x3 colour correction matrix, quantised for isp_ccm_apply().
+ */
+typedef struct {
+  /// @brief 0 leaves the rows unchanged
+  unsigned enabled;
+  /// @brief Coefficients of each output channel and tap, on all 16 lanes
+  int8_t coef[APP_IMAGE_CHANNEL_COUNT][CCM_TAPS][16] __attribute__((aligned(4)));
+  int16_t shifts[16] __attribute__((aligned(4)));
+} isp_ccm_t;
+
+/**
+ * @brief Quantise a colour correction matrix.
+ *
+ * The matrix works on uint8 pixel values, out[c] = sum_j matrix[c][j] * in[j].
+ * The offset that this becomes on int8 pixels is folded into the bias tap, so
+ * each row of the matrix must sum to between 0 and 1.98.
+ *
+ * @param ccm    The matrix to fill
+ * @param matrix [out channel][in channel], or NULL to disable the correction
+ * @return int 0 on success, -1 if a coefficient or row sum is out of range
+ */
+int isp_ccm_init(
+    isp_ccm_t* ccm,
+    const float matrix[APP_IMAGE_CHANNEL_COUNT][APP_IMAGE_CHANNEL_COUNT]);
+
+/**
+ * @brief Apply a colour correction matrix to a planar row, on the VPU.
+ *
+ * Outputs saturate to [-127, 127].
+ *
+ * @param output Word aligned [CH][width] output row, not `input`
+ * @param input  Word aligned [CH][width] input row
+ * @param ccm    The matrix, enabled
+ * @param width  Row width in pixels, a multiple of 16 up to
+ *               APP_MAX_IMAGE_WIDTH_PIXELS
+ */
+void isp_ccm_apply(
+    int8_t output[],
+    const int8_t input[],
+    const isp_ccm_t* ccm,
+    const unsigned width);
+
+#if defined(__XC__) || defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,155 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#pragma once
+
+#include <stdint.h>
+
+#include "sensor.h"
+
+// Raw rows held by the line buffer, enough for the 5x5 gradient-corrected kernels
+#define DEMOSAIC_ROWS       (5)
+// The VPU only loads from word aligned addresses, so a tap one or two columns
+// off the output pixel can't point into its raw row. It reads a shifted copy
+// instead, built for DEMOSAIC_CHUNK columns at a time after the raw rows.
+// DEMOSAIC_SHIFTED is the most (row, shift) pairs of an output row.
+#define DEMOSAIC_SHIFTED    (8)
+#define DEMOSAIC_CHUNK      (64)
+// Most taps of an output channel, over both pixels of a Bayer row
+#define DEMOSAIC_TAP_MAX    (11)
+// The kernels sum to 1 << DEMOSAIC_SHIFT
+#define DEMOSAIC_SHIFT      (4)
+
+// Line buffer size in bytes for rows of `width` pixels
+#define DEMOSAIC_LINES_BYTES(width)  (DEMOSAIC_ROWS * (width) + DEMOSAIC_SHIFTED * DEMOSAIC_CHUNK)
+
+#if defined(__XC__) || defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef enum {
+  DEMOSAIC_NONE = 0,
+  DEMOSAIC_BILINEAR,  // 3x3 bilinear interpolation
+  DEMOSAIC_GRADIENT,  // 5x5 gradient-corrected bilinear (Malvar, He and Cutler)
+} demosaic_mode_t;
+
+/**
+ * A tap of the demosaic kernel, for pixel_demosaic_macc().
+ */
+typedef struct {
+  /// @brief Input row, at the tap column of the first output pixel
+  const int8_t* pix;
+  /// @brief Coefficients of the tap, 16 lanes alternating even and odd columns
+  const int8_t* coef;
+} demosaic_tap_t;
+
+/**
+ * Streaming demosaic of RGGB Bayer rows, see isp_demosaic_init().
+ */
+typedef struct {
+  /// @brief Interpolation
+  demosaic_mode_t mode;
+  /// @brief Row width in pixels
+  unsigned width;
+  /// @brief Raw rows pushed in the current frame
+  unsigned rows_in;
+  /// @brief Rows output in the current frame
+  unsigned rows_out;
+  /// @brief Rows above and below an output row that the kernels use
+  unsigned radius;
+  /// @brief Line buffer, [DEMOSAIC_ROWS][width] raw rows then
+  /// [DEMOSAIC_SHIFTED][DEMOSAIC_CHUNK] shifted copies
+  int8_t* lines;
+  /// @brief Shifted copies built for each row parity, as (dy, dx) from the
+  /// output pixel
+  unsigned shifted_count[2];
+  int8_t shifted_dy[2][DEMOSAIC_SHIFTED];
+  int8_t shifted_dx[2][DEMOSAIC_SHIFTED];
+  /// @brief Taps of each row parity and channel, and the shifted copy each
+  /// one reads (-1 for the raw row)
+  unsigned tap_count[2][APP_IMAGE_CHANNEL_COUNT];
+  int8_t tap_dy[2][APP_IMAGE_CHANNEL_COUNT][DEMOSAIC_TAP_MAX];
+  int8_t tap_shifted[2][APP_IMAGE_CHANNEL_COUNT][DEMOSAIC_TAP_MAX];
+  int8_t tap_coef[2][APP_IMAGE_CHANNEL_COUNT][DEMOSAIC_TAP_MAX][16] __attribute__((aligned(4)));
+  int16_t shifts[16] __attribute__((aligned(4)));
+} demosaic_state_t;
+
+/**
+ * Sum of taps over a row, with the VPU in 8-bit mode.
+ *
+ * For each output pixel k:
+ *
+ *    pix_out[k] = sat8((sum_t taps[t].pix[k] * taps[t].coef[k % 16]) >> shifts[k % 16])
+ *
+ * with a rounding shift and saturation to [-127, 127] as in
+ * pixel_vfilter_complete(). The accumulators stay in the VPU.
+ *
+ * `pix_count` must be a multiple of 16, and the rows and coefficients of
+ * `taps` must be 4-byte aligned.
+ *
+ * @param pix_out   The output pixels
+ * @param taps      The taps, at least one
+ * @param tap_count The number of taps
+ * @param shifts    The right-shifts applied to the sums
+ * @param pix_count The number of output pixels
+ */
+void pixel_demosaic_macc(
+    int8_t pix_out[],
+    const demosaic_tap_t taps[],
+    const unsigned tap_count,
+    const int16_t shifts[16],
+    const unsigned pix_count);
+
+/**
+ * @brief Prepare a demosaic state, call at the start of each frame.
+ *
+ * Rows are RGGB Bayer rows of int8 pixels (even rows R G R G ..., odd rows
+ * G B G B ...). The image is mirrored at its edges.
+ *
+ * @param state The state to initialise
+ * @param mode  DEMOSAIC_BILINEAR or DEMOSAIC_GRADIENT
+ * @param width Row width in pixels, a multiple of 16
+ * @param lines Word aligned line buffer of DEMOSAIC_LINES_BYTES(width) bytes
+ */
+void isp_demosaic_init(
+    demosaic_state_t* state,
+    const demosaic_mode_t mode,
+    const unsigned width,
+    int8_t* lines);
+
+/**
+ * @brief Add the next raw row of the frame to the line buffer.
+ *
+ * Output rows lag the input by `state->radius` rows: 1 for DEMOSAIC_BILINEAR,
+ * 2 for DEMOSAIC_GRADIENT.
+ *
+ * @param state     The demosaic state
+ * @param output    Word aligned [CH][width] output row
+ * @param raw       The raw row, `width` pixels
+ * @param row_index Filled with the index of the output row, if any
+ * @return unsigned 1 if an output row was written
+ */
+unsigned isp_demosaic_push_row(
+    demosaic_state_t* state,
+    int8_t output[],
+    const int8_t raw[],
+    unsigned* row_index);
+
+/**
+ * @brief Output the rows left after the last raw row of the frame.
+ *
+ * Keep calling this until it returns 0.
+ *
+ * @param state     The demosaic state
+ * @param output    Word aligned [CH][width] output row
+ * @param row_index Filled with the index of the output row, if any
+ * @return unsigned 1 if an output row was written
+ */
+unsigned isp_demosaic_drain(
+    demosaic_state_t* state,
+    int8_t output[],
+    unsigned* row_index);
+
+#if defined(__XC__) || defined(__cplusplus)
+}
+#endif
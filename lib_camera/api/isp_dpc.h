@@ -0,0 +1,172 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#pragma once
+
+#include <stdint.h>
+
+#include "sensor.h"
+
+// Defective pixel correction of the raw rows, in RAW8 modes only
+// (camera_set_dpc()). 0 leaves it out, saving the 2.5 KB of row buffers.
+//
+// Both corrections only look at the same-colour neighbours in the row, x - 2
+// and x + 2, not the 8 over rows y - 2 to y + 2. The ISP corrects and
+// decimates each raw row as it arrives and keeps no raw rows; the rows above
+// and below would take a 5 row raw buffer (6.4 KB at 1280) and delay every
+// later stage by 2 raw rows. A defect is caught when it stands out from both
+// row neighbours, and so is a detail one pixel wide in one colour.
+#ifndef APP_DPC_ENABLED
+# define APP_DPC_ENABLED        (0)
+#endif
+// Threshold of the dynamic detection when built in, in raw uint8 units
+#ifndef APP_DPC_THRESHOLD
+# define APP_DPC_THRESHOLD      (32)
+#endif
+
+// Buffer size in bytes of the left neighbours of a row of `width` pixels,
+// pixel_dpc() reads 16 bytes past the last block
+#define DPC_LEFT_BYTES(width)   ((width) + 20)
+
+#if defined(__XC__) || defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * A defective pixel, in raw frame coordinates of the sensor mode.
+ */
+typedef struct {
+  uint16_t x;
+  uint16_t y;
+} dpc_defect_t;
+
+/**
+ * Static defect list, see isp_dpc_defect_list_init().
+ */
+typedef struct {
+  /// @brief Defects sorted by row then column, not copied
+  const dpc_defect_t* defects;
+  unsigned count;
+} dpc_defect_list_t;
+
+/**
+ * Defective pixel correction of the raw rows of a frame, see isp_dpc_init().
+ */
+typedef struct {
+  /// @brief Dynamic detection threshold, 0 when off
+  unsigned threshold;
+  /// @brief Half the threshold on all 32 lanes, for pixel_dpc()
+  int8_t threshold_half[32] __attribute__((aligned(4)));
+  /// @brief Static defects
+  dpc_defect_list_t list;
+  /// @brief First static defect at or below the next row
+  unsigned next;
+  /// @brief Left neighbours of the row, DPC_LEFT_BYTES(width) bytes
+  int8_t* left;
+} dpc_state_t;
+
+/**
+ * Clamp each pixel of a Bayer row between its same-colour neighbours, with the
+ * VPU in 8-bit mode.
+ *
+ * With l = pix_in[k - 2] and r = pix_in[k + 2], the pixel is clamped to
+ * [min(l, r) - threshold, max(l, r) + threshold]. The comparisons are made on
+ * halved pixels so the differences can't saturate: a clamped pixel may be
+ * 1 off the bound, pixels that aren't clamped are unchanged (but saturated to
+ * [-127, 127]).
+ *
+ * `pix_left[k]` holds `pix_in[k - 2]` for k up to `pix_count + 3`, so every
+ * load is word aligned. The element-wise VPU ops work on 32 lanes in 8-bit
+ * mode, so `pix_in` and `pix_left` are read 16 bytes past those ends.
+ *
+ * `pix_count` must be a multiple of 16 and the rows must be 4-byte aligned.
+ *
+ * @param pix_out        The output pixels, not `pix_in`
+ * @param pix_in         The input row
+ * @param pix_left       The input row, 2 pixels to the right
+ * @param threshold_half Half the threshold, on 32 lanes
+ * @param pix_count      The number of pixels
+ */
+void pixel_dpc(
+    int8_t pix_out[],
+    const int8_t pix_in[],
+    const int8_t pix_left[],
+    const int8_t threshold_half[32],
+    const unsigned pix_count);
+
+/**
+ * @brief Check and wrap a static defect list.
+ *
+ * Defects are usually found from dark frames, hot pixels, and flat bright
+ * frames, dead pixels. The list isn't copied and must outlive its use.
+ *
+ * @param list         The list to fill
+ * @param defects      Defects sorted by row then column, or NULL
+ * @param defect_count The number of defects
+ * @return int 0 on success, -1 if the defects aren't sorted
+ */
+int isp_dpc_defect_list_init(
+    dpc_defect_list_t* list,
+    const dpc_defect_t defects[],
+    const unsigned defect_count);
+
+/**
+ * @brief Prepare the defective pixel correction, with no static defects.
+ *
+ * @param state     The state to initialise
+ * @param threshold Dynamic detection threshold in raw uint8 units, up to 127,
+ *                  0 turns it off
+ * @param left      Word aligned buffer of DPC_LEFT_BYTES(width) bytes, for the
+ *                  widest row
+ */
+void isp_dpc_init(
+    dpc_state_t* state,
+    const unsigned threshold,
+    int8_t* left);
+
+/**
+ * @brief Change the dynamic detection threshold, between frames.
+ *
+ * @param state     The state
+ * @param threshold Threshold in raw uint8 units up to 127, 0 turns it off
+ */
+void isp_dpc_set_threshold(
+    dpc_state_t* state,
+    const unsigned threshold);
+
+/**
+ * @brief Call at the start of each frame.
+ *
+ * @param state The state
+ */
+void isp_dpc_frame_start(
+    dpc_state_t* state);
+
+/**
+ * @brief Correct a raw RGGB row.
+ *
+ * Pixels brighter or darker than both their left and right same-colour
+ * neighbours by more than the threshold are clamped. The two pixels at each
+ * end of the row have a single neighbour and are left alone. The static
+ * defects of the row are then replaced by the mean of their neighbours.
+ * Rows must come in order, from the start of the frame. Rows are RAW8 pixels,
+ * the ISP doesn't call this in RAW10 modes.
+ *
+ * The input row is read from 4 bytes before it to 16 bytes after it.
+ *
+ * @param state  The state
+ * @param output Word aligned output row, not `input`
+ * @param input  Word aligned raw row, int8 pixels
+ * @param width  Row width in pixels, a multiple of 16
+ * @param y      Row index in the frame
+ */
+void isp_dpc_row(
+    dpc_state_t* state,
+    int8_t output[],
+    const int8_t input[],
+    const unsigned width,
+    const unsigned y);
+
+#if defined(__XC__) || defined(__cplusplus)
+}
+#endif
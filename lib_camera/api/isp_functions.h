@@ -5,12 +5,252 @@
 
 #include <stdint.h>
 
+// Resize plan limits
+#define ISP_RESIZE_MAX_DIM        320   // max width or height (input and output)
+#define ISP_RESIZE_MAX_CHANNELS   3
+#define ISP_RESIZE_ROW_MAX_BYTES  (ISP_RESIZE_MAX_DIM * ISP_RESIZE_MAX_CHANNELS)
+#define ISP_RESIZE_WEIGHT_BITS    7     // interpolation weights in Q7
+
+// Channel layout of an image
+typedef enum {
+	ISP_LAYOUT_HWC = 0,	// interleaved (RGBRGB...)
+	ISP_LAYOUT_CHW,		// planar (RR..GG..BB..)
+} isp_layout_t;
+
+// Pixel type of an image
+typedef enum {
+	ISP_TYPE_UINT8 = 0,
+	ISP_TYPE_INT8,
+} isp_type_t;
+
+/**
+ * Image descriptor, a view over pixels it doesn't own.
+ * Channel c of pixel (x, y) is at byte offset
+ *   y * row_stride + x * col_stride + c * chan_stride
+ * from `data`, so crops are views with the same strides.
+ */
+typedef struct {
+	void* data;
+	unsigned width;
+	unsigned height;
+	unsigned channels;
+	unsigned row_stride;	// bytes between rows
+	unsigned col_stride;	// bytes between pixels of a row
+	unsigned chan_stride;	// bytes between channels of a pixel
+	isp_layout_t layout;
+	isp_type_t type;
+} isp_image_t;
+
+// Region of interest of an image, in pixels
+typedef struct {
+	unsigned x;
+	unsigned y;
+	unsigned width;
+	unsigned height;
+} isp_roi_t;
+
+// Max ROIs of a single isp_crop_and_resize() call
+#define ISP_CROP_RESIZE_MAX_ROIS  16
+
+// Max channels of a model input tensor
+#define ISP_TENSOR_MAX_CHANNELS   3
+// Fractional bits of isp_tensor_quant_t
+#define ISP_TENSOR_QUANT_BITS     16
+
+/**
+ * Fixed-point normalisation and quantisation of a model input, per channel:
+ *   q = clamp((pixel * mul + add) >> ISP_TENSOR_QUANT_BITS, -128, 127)
+ * where pixel is the uint8 value (int8 camera pixels are pixel - 128).
+ * Built once by isp_tensor_quant_init().
+ */
+typedef struct {
+	unsigned channels;
+	int32_t mul[ISP_TENSOR_MAX_CHANNELS];
+	int32_t add[ISP_TENSOR_MAX_CHANNELS];
+	int8_t pad[ISP_TENSOR_MAX_CHANNELS];	// quantised letterbox value
+} isp_tensor_quant_t;
+
+// Interpolation used by isp_resize_mode_*()
+typedef enum {
+	ISP_RESIZE_BILINEAR = 0,	// isp_resize_*()
+	ISP_RESIZE_NEAREST,			// nearest pixel centre
+	ISP_RESIZE_AREA,			// mean of the covered source pixels (downscale)
+} isp_resize_mode_t;
+
 // -------------------------- C --------------------------
 #if defined(__XC__) || defined(__cplusplus)
 extern "C" {
 #endif
 
-// Crop
+// Image views
+
+/**
+ * Describe a compact image (no padding between rows or planes).
+ *
+ * @param img      Image descriptor to initialise
+ * @param data     Pixels
+ * @param width    Width in pixels
+ * @param height   Height in pixels
+ * @param channels Channels per pixel
+ * @param layout   Channel layout
+ * @param type     Pixel type
+ */
+void isp_image_init(
+	isp_image_t* img,
+	void* data,
+	const unsigned width,
+	const unsigned height,
+	const unsigned channels,
+	const isp_layout_t layout,
+	const isp_type_t type);
+
+/**
+ * Make a view of a rectangle of an image. No pixels are copied, the view
+ * shares the strides of the image.
+ *
+ * @param img    Image (or view) to crop
+ * @param view   Resulting view
+ * @param x      Left column of the rectangle
+ * @param y      Top row of the rectangle
+ * @param width  Width of the rectangle, x + width <= img->width
+ * @param height Height of the rectangle, y + height <= img->height
+ */
+void isp_image_crop(
+	const isp_image_t* img,
+	isp_image_t* view,
+	const unsigned x,
+	const unsigned y,
+	const unsigned width,
+	const unsigned height);
+
+/**
+ * Copy pixels between images of the same size, channels and type. Layouts
+ * and strides may differ, so this also compacts views and converts between
+ * HWC and CHW. Overlap is only supported when both have the same layout
+ * and `dst` starts at or before `src` (in place compaction of a crop).
+ *
+ * @param src Source image
+ * @param dst Destination image
+ */
+void isp_image_copy(
+	const isp_image_t* src,
+	const isp_image_t* dst);
+
+/**
+ * Resize between images (or views) of the same channels and type, read and
+ * written in place through their strides. Bilinear uses Q7 weights, as
+ * isp_crop_and_resize(), for every image. Nearest and area use the
+ * isp_resize_mode_*() fast paths for compact HWC 3 channel images, which give
+ * the same pixels. A view and a compacted copy of it therefore always resize
+ * to identical images.
+ *
+ * @param src  Source image
+ * @param dst  Destination image, must not overlap the source
+ * @param mode Interpolation
+ */
+void isp_resize_image(
+	const isp_image_t* src,
+	const isp_image_t* dst,
+	const isp_resize_mode_t mode);
+
+/**
+ * Crop N regions of one image and resize each one to its own output, with
+ * bilinear interpolation (corner aligned, as isp_resize_image()).
+ *
+ * Regions with the same columns (x, width and output width) are resized
+ * together in one pass from top to bottom: each source row they need is
+ * interpolated horizontally once and shared by all of them, and by the
+ * consecutive output rows that read it. Other regions get a pass of their
+ * own: overlapping boxes with different columns interpolate their common
+ * source rows once each, so they only save the work of the per-view
+ * isp_resize_image(), which blends four source pixels for every output
+ * value. Sharing across different columns would need two interpolated rows
+ * per region, 61 KB for ISP_CROP_RESIZE_MAX_ROIS regions at
+ * ISP_RESIZE_ROW_MAX_BYTES. Outputs can be any layout and stride, e.g. views
+ * into a batch of tensors.
+ *
+ * @param src  Source image
+ * @param rois Regions of the source, each at least 2x2
+ * @param dsts Outputs, one per region, at least 2x2, same channels and type
+ *             as the source, at most ISP_RESIZE_ROW_MAX_BYTES values per row
+ * @param n    Number of regions, at most ISP_CROP_RESIZE_MAX_ROIS
+ */
+void isp_crop_and_resize(
+	const isp_image_t* src,
+	const isp_roi_t rois[],
+	const isp_image_t dsts[],
+	const unsigned n);
+
+/**
+ * Build the fixed-point quantisation of a model input. Per channel c:
+ *   real = (pixel / 255 - mean[c]) / std[c]
+ *   q    = round(real / scale[c]) + zero_point[c]
+ * with pixel the uint8 value.
+ *
+ * @param quant      Quantisation to initialise
+ * @param channels   Channels, at most ISP_TENSOR_MAX_CHANNELS
+ * @param mean       Per channel mean, on [0, 1] pixels
+ * @param std        Per channel standard deviation, on [0, 1] pixels
+ * @param scale      Per channel scale of the int8 tensor
+ * @param zero_point Per channel zero point of the int8 tensor
+ * @param pad_value  uint8 pixel value of the letterbox borders
+ */
+void isp_tensor_quant_init(
+	isp_tensor_quant_t* quant,
+	const unsigned channels,
+	const float mean[],
+	const float std[],
+	const float scale[],
+	const int32_t zero_point[],
+	const uint8_t pad_value);
+
+/**
+ * Compose an optional gamma table with a quantisation, into one lookup table
+ * per channel indexed by the int8 pixel + 128. Entries round as
+ * isp_resize_to_tensor() does.
+ *
+ * @param quant Quantisation from isp_tensor_quant_init()
+ * @param gamma Gamma table indexed by the int8 pixel + 127 (as gamma_int8),
+ *              NULL for none
+ * @param lut   Tables to fill, one per channel of `quant`
+ */
+void isp_tensor_quant_lut(
+	const isp_tensor_quant_t* quant,
+	const int8_t gamma[256],
+	int8_t lut[][256]);
+
+/**
+ * Write a model input tensor from an image (e.g. the decimated frame from
+ * camera_capture_image(), as ISP_TYPE_INT8) in a single pass: crop, bilinear
+ * resize, optional letterbox, normalisation/quantisation and layout (given
+ * by the strides of `tensor`, HWC or CHW).
+ *
+ * With letterbox the aspect ratio of the region is kept: the image is
+ * centred and the borders are filled with the quantised pad value.
+ *
+ * @param src       Source image
+ * @param roi       Region of the source, NULL for all of it
+ * @param tensor    Output, ISP_TYPE_INT8 with the channels of the source
+ * @param quant     Quantisation from isp_tensor_quant_init()
+ * @param letterbox 1 to keep the aspect ratio, 0 to stretch
+ */
+void isp_resize_to_tensor(
+	const isp_image_t* src,
+	const isp_roi_t* roi,
+	const isp_image_t* tensor,
+	const isp_tensor_quant_t* quant,
+	const unsigned letterbox);
+
+// Pointer based kernels
+//
+// The functions below keep their pointer and size arguments and work on
+// compact HWC images only. isp_resize_image() uses isp_resize_mode_*() for
+// such images in nearest and area modes. Views (crops, strided or CHW images)
+// go through the isp_image_* functions above instead. isp_resize_*() and
+// ISP_RESIZE_BILINEAR of isp_resize_mode_*() keep their float interpolation,
+// which can differ by one from isp_resize_image().
+
+// Crop, in place compaction of 3 channel HWC images
 void isp_crop_int8(
 	int8_t* img,
 	const unsigned in_width,
@@ -29,7 +269,7 @@ void isp_crop_uint8(
 	unsigned xu2,
 	unsigned yu2);
 
-// Resize
+// Resize, 3 channel HWC images
 void isp_resize_int8(
 	const int8_t* img,
 	const unsigned in_width,
@@ -46,6 +286,118 @@ void isp_resize_uint8(
 	const unsigned out_width,
 	const unsigned out_height);
 
+/**
+ * Resize with a selectable interpolation. Images are HWC with 3 channels.
+ *
+ * ISP_RESIZE_BILINEAR is isp_resize_*(). ISP_RESIZE_NEAREST and
+ * ISP_RESIZE_AREA have fast paths when both dimensions shrink by the same
+ * integer factor. For ISP_RESIZE_AREA with a power of two factor the rows are
+ * summed on the VPU, which needs a word aligned input and in_width * 3 to be
+ * a multiple of 16. Both paths round the sum of each area once, so they give
+ * identical pixels.
+ *
+ * @param img        Input image
+ * @param in_width   Input width
+ * @param in_height  Input height
+ * @param out_img    Output image, must not overlap the input
+ * @param out_width  Output width
+ * @param out_height Output height
+ * @param mode       Interpolation
+ */
+void isp_resize_mode_int8(
+	const int8_t* img,
+	const unsigned in_width,
+	const unsigned in_height,
+	int8_t* out_img,
+	const unsigned out_width,
+	const unsigned out_height,
+	const isp_resize_mode_t mode);
+
+void isp_resize_mode_uint8(
+	const uint8_t* img,
+	const unsigned in_width,
+	const unsigned in_height,
+	uint8_t* out_img,
+	const unsigned out_width,
+	const unsigned out_height,
+	const isp_resize_mode_t mode);
+
+/**
+ * Precomputed bilinear resize.
+ *
+ * Source indices and Q7 weights are computed once per column and per row by
+ * isp_resize_plan_init(), so resizing a frame is only integer multiply-adds.
+ * The resize is separable: source rows are interpolated horizontally into
+ * rows[] (each source row at most once), then pairs of rows are blended
+ * vertically on the VPU. The plan also holds these work buffers, so it must
+ * not be shared between threads.
+ *
+ * The horizontal pass gathers two source pixels per output value through the
+ * x_lo/x_hi tables, which the VPU can't do, so it stays scalar: one
+ * multiply-add pair per output value of each source row used, at most
+ * min(in_height, out_height) rows. After the VPU pass, the bias of uint8
+ * images is removed a word (4 pixels) at a time, and only pixels saturated to
+ * -127 are recomputed.
+ */
+typedef struct {
+	unsigned in_width;
+	unsigned in_height;
+	unsigned out_width;
+	unsigned out_height;
+	unsigned channels;
+	// per output column: byte offsets of the left and right source pixels
+	uint16_t x_lo[ISP_RESIZE_MAX_DIM];
+	uint16_t x_hi[ISP_RESIZE_MAX_DIM];
+	uint8_t x_w[ISP_RESIZE_MAX_DIM];	// weight of the right pixel
+	// per output row: top and bottom source rows
+	uint16_t y_lo[ISP_RESIZE_MAX_DIM];
+	uint16_t y_hi[ISP_RESIZE_MAX_DIM];
+	uint8_t y_w[ISP_RESIZE_MAX_DIM];	// weight of the bottom row
+	// work buffers
+	int row_tag[2];
+	int8_t rows[2][ISP_RESIZE_ROW_MAX_BYTES] __attribute__((aligned(4)));
+	int16_t accs[2 * ISP_RESIZE_ROW_MAX_BYTES] __attribute__((aligned(4)));
+} isp_resize_plan_t;
+
+/**
+ * Compute the tables of a resize plan. Uses the same corner-aligned mapping as
+ * isp_resize_uint8() and isp_resize_int8(). Images are HWC.
+ *
+ * @param plan       Plan to initialise
+ * @param in_width   Input width, 2 to ISP_RESIZE_MAX_DIM
+ * @param in_height  Input height, 2 to ISP_RESIZE_MAX_DIM
+ * @param out_width  Output width, 2 to ISP_RESIZE_MAX_DIM
+ * @param out_height Output height, 2 to ISP_RESIZE_MAX_DIM
+ * @param channels   Channels per pixel, 1 to ISP_RESIZE_MAX_CHANNELS
+ */
+void isp_resize_plan_init(
+	isp_resize_plan_t* plan,
+	const unsigned in_width,
+	const unsigned in_height,
+	const unsigned out_width,
+	const unsigned out_height,
+	const unsigned channels);
+
+/**
+ * Resize an image with a precomputed plan.
+ * The VPU is used for the vertical pass when `out_img` is word aligned and
+ * out_width * channels is a multiple of 16, otherwise a scalar pass is used.
+ * Weights are Q7, results are within a couple of LSBs of isp_resize_*().
+ *
+ * @param plan    Plan from isp_resize_plan_init()
+ * @param img     Input image
+ * @param out_img Output image, must not overlap the input
+ */
+void isp_resize_plan_int8(
+	isp_resize_plan_t* plan,
+	const int8_t* img,
+	int8_t* out_img);
+
+void isp_resize_plan_uint8(
+	isp_resize_plan_t* plan,
+	const uint8_t* img,
+	uint8_t* out_img);
+
 #if defined(__XC__) || defined(__cplusplus)
 } // extern "C"
 #endif
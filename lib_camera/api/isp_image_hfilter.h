@@ -13,6 +13,13 @@
 #define COEF_B0   (0.58254019f)
 #define COEF_B1   (0.20872991f)
 
+// Each decimation factor has its own filter (see python/_filters.txt):
+//  2: (0.04622150, 0.90755700, 0.04622150)
+//  4: the filter above
+//  8: (0.00539473, 0.18786418, 0.61348217, 0.18786418, 0.00539473)
+// Taps apply to same-colour pixels, 2 bytes apart in the Bayer row.
+#define HFILTER_TAP_COUNT_MAX   (5)
+
 /**
  * This structure holds the state for the horizontal filter.
  */
@@ -69,3 +76,57 @@ void pixel_hfilter_update_scale(
     hfilter_state_t* state,
     const float gain,
     const unsigned offset);
+
+/**
+ * Same as pixel_hfilter_update_scale(), with the filter of the given
+ * decimation factor. pixel_hfilter_update_scale() uses the factor 4 filter.
+ * 
+ * SENSOR_BLACK_LEVEL is subtracted from the raw pixels before the gain, as
+ * pixel_hfilter_update_black_level() does with a measured level.
+ * 
+ * @param state       The filter state to update
+ * @param gain        The gain to apply to the filter coefficients
+ * @param offset      The offset into the filter coefficient array to start at.
+ * @param dec_factor  Decimation factor, 2, 4 or 8
+ */
+void pixel_hfilter_update_scale_dec(
+    hfilter_state_t* state,
+    const float gain,
+    const unsigned offset,
+    const unsigned dec_factor);
+
+/**
+ * Replace the fixed SENSOR_BLACK_LEVEL of the last scale update with a
+ * measured black level. It is subtracted from the raw pixels, before the
+ * gain, by changing `acc_init` only.
+ * 
+ * @param state       The filter state, after pixel_hfilter_update_scale_dec()
+ * @param black_level The black level in raw uint8 units
+ */
+void pixel_hfilter_update_black_level(
+    hfilter_state_t* state,
+    const float black_level);
+
+/**
+ * Set up the filter to sum both colours of a Bayer row into one output, for
+ * the luma-only mode. The colour at even columns is scaled by `gain[0]`, the
+ * one at odd columns by `gain[1]`, after taking off their black level, and
+ * `out_offset` is taken off the sum:
+ * 
+ *    out = gain[0] * (c0 - black_level[0]) + gain[1] * (c1 - black_level[1])
+ *          - out_offset
+ * 
+ * in raw uint8 units, saturated to int8.
+ * 
+ * @param state       The filter state to update
+ * @param gain        Gains of the even and odd column colours
+ * @param black_level Black levels of the even and odd column colours
+ * @param out_offset  Offset taken off the output
+ * @param dec_factor  Decimation factor, 2, 4 or 8
+ */
+void pixel_hfilter_update_luma(
+    hfilter_state_t* state,
+    const float gain[2],
+    const float black_level[2],
+    const float out_offset,
+    const unsigned dec_factor);
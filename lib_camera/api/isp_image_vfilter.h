@@ -6,8 +6,10 @@
 #include <stdint.h>
 
 #include "sensor.h"
+#include "isp_image_hfilter.h"
 
-// The number of non-zero taps in the vertical filter.
+// The number of non-zero taps in the default vertical filter, and the most
+// taps of any filter bank.
 #define VFILTER_TAP_COUNT   (5)
 
 // The effective decimation factor of the vertical filter.
@@ -21,14 +23,22 @@
 
 // The number of accumulators required for vertical filtering.
 // ceil(tap_count / dec_factor)
-#define VFILTER_ACC_COUNT  ((VFILTER_TAP_COUNT + VFILTER_DEC_FACTOR - 1)\
-                              / (VFILTER_DEC_FACTOR))
+#define VFILTER_ACC_COUNT_DEC(DEC)  ((VFILTER_TAP_COUNT + (DEC) - 1) / (DEC))
+#define VFILTER_ACC_COUNT  VFILTER_ACC_COUNT_DEC(VFILTER_DEC_FACTOR)
 
-// The value that the next_tap gets reset to after outputting a row.
-#define VFILTER_RESET_INDEX   ((VFILTER_TAP_COUNT) - \
-                  ( (VFILTER_DEC_FACTOR) * (VFILTER_ACC_COUNT) ))
+// Accumulators to allocate so that any filter bank fits (3 taps for factor 2,
+// 5 taps for factors 4 and 8)
+#define VFILTER_ACC_COUNT_MAX  (3)
 
-#define VFILTER_ACC_WIDTH_SHORTS  (2 * APP_IMAGE_WIDTH_PIXELS)
+// Accumulators are sized for the widest runtime output
+#define VFILTER_ACC_WIDTH_SHORTS  (2 * APP_MAX_IMAGE_WIDTH_PIXELS)
+
+// 1 to decimate with the fused horizontal and vertical filter
+// (pixel_hfilter_vfilter_macc()) in image_vfilter_row_columns(), 0 for
+// pixel_hfilter() into a row then pixel_vfilter_macc() per tap
+#ifndef ISP_FUSED_FILTER
+#define ISP_FUSED_FILTER  0
+#endif
 
 #if defined(__XC__) || defined(__cplusplus)
 extern "C" {
@@ -39,6 +49,46 @@ typedef struct {
   int16_t buff[VFILTER_ACC_WIDTH_SHORTS];
 } vfilter_acc_t;
 
+/**
+ * Vertical filter taps for one decimation factor, see image_vfilter_bank().
+ */
+typedef struct {
+  /// @brief Vertical decimation factor, half the Bayer decimation factor
+  unsigned dec_factor;
+  /// @brief Number of taps, at most VFILTER_TAP_COUNT
+  unsigned tap_count;
+  /// @brief Accumulators in use, ceil(tap_count / dec_factor)
+  unsigned acc_count;
+  /// @brief Tap coefficients, each repeated for the 16 VPU lanes
+  int8_t coef[VFILTER_TAP_COUNT][16];
+  /// @brief Output shift, the taps sum to 1 << shift
+  int16_t shift[16];
+} vfilter_bank_t;
+
+/**
+ * A live vertical filter tap, for pixel_hfilter_vfilter_macc().
+ */
+typedef struct {
+  /// @brief Accumulators of the tap (vfilter_acc_t.buff)
+  int16_t* accs;
+  /// @brief Coefficients of the tap, 16 lanes
+  const int8_t* coef;
+} vfilter_tap_t;
+
+/**
+ * Vertical filter work of one row, split from the accumulator bookkeeping so
+ * that column ranges can run on different threads, see
+ * image_vfilter_row_begin().
+ */
+typedef struct {
+  /// @brief Live taps of the row
+  vfilter_tap_t taps[VFILTER_ACC_COUNT_MAX];
+  /// @brief Number of live taps
+  unsigned tap_count;
+  /// @brief Accumulators that get their last tap in this row, or NULL
+  int16_t* complete;
+} vfilter_row_t;
+
 /**
  * Initialize a vector of 32-bit split accumulators to a given value.
  *
@@ -133,6 +183,49 @@ void pixel_vfilter_macc(
     const int8_t filter[16],
     const unsigned pix_count);
 
+/**
+ * Horizontal filter fused with the vertical filter taps.
+ * 
+ * Equivalent to pixel_hfilter() into a temporary row followed by
+ * pixel_vfilter_macc() of that row for each of the `tap_count` taps, but
+ * each block of 16 outputs is maccumulated into every tap as soon as it is
+ * computed, so the intermediate row is never written.
+ * 
+ * `output_count` must be a multiple of 16 and the accumulators and
+ * coefficients of `taps` must be 4-byte aligned.
+ * 
+ * @param taps          The live taps
+ * @param tap_count     The number of taps, may be 0
+ * @param input         The input array of pixels
+ * @param coef          The horizontal filter coefficients
+ * @param acc_init      The initial value for the horizontal accumulator
+ * @param shift         The shift applied to the horizontal accumulator
+ * @param input_stride  The number of input pixels to skip between outputs
+ * @param output_count  The number of horizontal filter outputs
+ */
+void pixel_hfilter_vfilter_macc(
+    const vfilter_tap_t taps[],
+    const unsigned tap_count,
+    const int8_t input[],
+    const int8_t coef[32],
+    const int32_t acc_init,
+    const unsigned shift,
+    const int32_t input_stride,
+    const unsigned output_count);
+
+/**
+ * @brief Get the precomputed vertical filter of a decimation factor.
+ * 
+ *  2: (6, 116, 6) / 128, no decimation across same-colour rows
+ *  4: (6, 65, 114, 65, 6) / 256
+ *  8: (22, 61, 90, 61, 22) / 256, wider for the lower cut-off
+ * 
+ * @param dec_factor Bayer decimation factor, 2, 4 or 8
+ * @return const vfilter_bank_t* The filter bank
+ */
+const vfilter_bank_t* image_vfilter_bank(
+    const unsigned dec_factor);
+
 /**
  * @brief Initialize a vector of vertical filter accumulators.
  * 
@@ -140,11 +233,11 @@ void pixel_vfilter_macc(
  * are set somewhat differently than image_vfilter_reset(), because the behavior
  * at the start of the image is a little different.
  * 
- * `acc_count` is the number of ROWS of accumulators, whereas
- * `image_width_lores` is the number of pixels per low-resolution image row 
+ * `bank->acc_count` is the number of ROWS of accumulators, whereas
+ * `width` is the number of pixels per low-resolution image row 
  * (which is the number of individual accumulators PER ROW).
  * 
- * `image_width_lores` must be a multiple of 16 (atm)
+ * `width` must be a multiple of 16 (atm)
  * 
  * @note vfilter functions are channel agnostic, so if the image is
  * separated into different color planes, this will need to be called once
@@ -152,10 +245,15 @@ void pixel_vfilter_macc(
  * but the image width must then be the width in _bytes_. And it must
  * still be a multiple of 16.
  * 
- * @param accs The vector of accumulators to initialize.
+ * @param accs  The vector of accumulators to initialize, at least
+ *              `bank->acc_count` elements.
+ * @param bank  Filter bank, from image_vfilter_bank()
+ * @param width Row width in pixels, at most APP_MAX_IMAGE_WIDTH_PIXELS
  */
 void image_vfilter_frame_init(
-    vfilter_acc_t accs[]);
+    vfilter_acc_t accs[],
+    const vfilter_bank_t* bank,
+    const unsigned width);
 
 /**
  * @brief Apply a filter tap to a vector of accumulators using the supplied input
@@ -163,12 +261,87 @@ void image_vfilter_frame_init(
  * @param output output vector after the filtering process
  * @param acc    vector of accumulators
  * @param pixel_data input data
+ * @param bank   filter bank, as given to image_vfilter_frame_init()
+ * @param width  row width, as given to image_vfilter_frame_init()
  * @return unsigned 1 if rows are finished
  */
 unsigned image_vfilter_process_row(
     int8_t output[],
     vfilter_acc_t acc[],
-    const int8_t pixel_data[]);
+    const int8_t pixel_data[],
+    const vfilter_bank_t* bank,
+    const unsigned width);
+
+/**
+ * @brief Horizontally filter a raw row and apply it to the vertical filter
+ * 
+ * Same result as pixel_hfilter() followed by image_vfilter_process_row(). The
+ * two filters run in a single pass with pixel_hfilter_vfilter_macc() only when
+ * ISP_FUSED_FILTER is 1.
+ *
+ * @param output output vector after the filtering process
+ * @param acc    vector of accumulators
+ * @param input  raw row
+ * @param hf     horizontal filter state of the channel
+ * @param input_stride horizontal decimation factor
+ * @param bank   filter bank, as given to image_vfilter_frame_init()
+ * @param width  row width, as given to image_vfilter_frame_init()
+ * @return unsigned 1 if rows are finished
+ */
+unsigned image_vfilter_process_row_hfilter(
+    int8_t output[],
+    vfilter_acc_t acc[],
+    const int8_t input[],
+    const hfilter_state_t* hf,
+    const unsigned input_stride,
+    const vfilter_bank_t* bank,
+    const unsigned width);
+
+/**
+ * @brief Advance the accumulators by one row, without filtering it
+ * 
+ * Picks the live taps of the row and the accumulators it completes into `row`.
+ * The filtering is then done by image_vfilter_row_columns() over column
+ * ranges covering the whole row, in any order and from any thread.
+ * 
+ * @param row    Work of the row
+ * @param acc    vector of accumulators
+ * @param bank   filter bank, as given to image_vfilter_frame_init()
+ * @return unsigned 1 if the row completes an output row
+ */
+unsigned image_vfilter_row_begin(
+    vfilter_row_t* row,
+    vfilter_acc_t acc[],
+    const vfilter_bank_t* bank);
+
+/**
+ * @brief Filter a column range of a row prepared by image_vfilter_row_begin()
+ * 
+ * Horizontally filters the raw row into the live taps for output columns
+ * `col_start` to `col_start + col_count - 1`, and if the row completes an
+ * output row, writes those columns of `output[]`. Column ranges of a row don't
+ * share any data. Both filters run in one pass when ISP_FUSED_FILTER is 1.
+ * 
+ * `col_start` and `col_count` must be multiples of 16.
+ * 
+ * @param output        output row, the full row width
+ * @param row           Work of the row
+ * @param input         raw row
+ * @param hf            horizontal filter state of the channel
+ * @param input_stride  horizontal decimation factor
+ * @param bank          filter bank, as given to image_vfilter_frame_init()
+ * @param col_start     first output column
+ * @param col_count     number of output columns, may be 0
+ */
+void image_vfilter_row_columns(
+    int8_t output[],
+    const vfilter_row_t* row,
+    const int8_t input[],
+    const hfilter_state_t* hf,
+    const unsigned input_stride,
+    const vfilter_bank_t* bank,
+    const unsigned col_start,
+    const unsigned col_count);
 
 /**
  * After the last line of the image, some of the accumulators will be midway
@@ -179,11 +352,15 @@ unsigned image_vfilter_process_row(
  *
  * @param output output vector after the filtering process
  * @param acc array of accumulators
+ * @param bank   filter bank, as given to image_vfilter_frame_init()
+ * @param width  row width, as given to image_vfilter_frame_init()
  * @return unsigned 0 when finished
  */
 unsigned image_vfilter_drain(
     int8_t output[],
-    vfilter_acc_t acc[]);
+    vfilter_acc_t acc[],
+    const vfilter_bank_t* bank,
+    const unsigned width);
 
 #if defined(__XC__) || defined(__cplusplus)
 }
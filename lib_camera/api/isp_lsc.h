@@ -0,0 +1,141 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#pragma once
+
+#include <stdint.h>
+
+#include "sensor.h"
+
+// Lens shading correction of the decimated rows (camera_set_lens_shading()).
+// 0 leaves it out, saving the grid and its row buffers.
+#ifndef APP_LSC_ENABLED
+# define APP_LSC_ENABLED        (0)
+#endif
+
+// Lens shading gain grid, nodes across and down the image. The first and last
+// nodes sit on the edge pixels.
+#ifndef LSC_GRID_W
+# define LSC_GRID_W     (16)
+#endif
+#ifndef LSC_GRID_H
+# define LSC_GRID_H     (12)
+#endif
+// Fractional bits of the grid gains. The grid is only interpolated at this
+// precision: the gain applied to a pixel is gain - 1 in int8 Q6 (LSC_SHIFT),
+// so the correction itself has a resolution of 1/64, about 1.6 %.
+#define LSC_GRID_SHIFT  (12)
+// Fractional bits of the per-pixel gains applied to the rows, gains of up to
+// 191 / 64 = 2.98 can be applied
+#define LSC_SHIFT       (6)
+#define LSC_GAIN_MAX    (2.98f)
+
+// Row buffer size in bytes of lsc_state_t, for rows of `width` pixels: the
+// two expanded grid rows around the current row, and its gains
+#define LSC_ROWS_BYTES(width)  (3 * APP_IMAGE_CHANNEL_COUNT * (width))
+
+#if defined(__XC__) || defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Per-channel lens shading gain grid, see isp_lsc_init().
+ */
+typedef struct {
+  /// @brief 0 leaves the rows unchanged
+  unsigned enabled;
+  /// @brief Gains in Q12 of each channel and node
+  uint16_t gain[APP_IMAGE_CHANNEL_COUNT][LSC_GRID_H][LSC_GRID_W];
+} isp_lsc_t;
+
+/**
+ * Lens shading correction of the rows of one frame, see isp_lsc_frame_init().
+ */
+typedef struct {
+  /// @brief The grid
+  const isp_lsc_t* lsc;
+  /// @brief Frame size in pixels
+  unsigned width;
+  unsigned height;
+  /// @brief Grid row expanded in `rows` slot `top`, -1 before the first row
+  int grid_row;
+  unsigned top;
+  /// @brief Row buffer, [2][CH][width] expanded grid rows then [CH][width] gains
+  int8_t* rows;
+  /// @brief Shifts of the vertical interpolation
+  int16_t shifts[16] __attribute__((aligned(4)));
+} lsc_state_t;
+
+/**
+ * Apply per-pixel gains to a row, with the VPU in 8-bit mode.
+ *
+ * For each pixel k, on uint8 values:
+ *
+ *    pix_out[k] = pix_in[k] * (1 + gain_delta[k] / 2^LSC_SHIFT)
+ *
+ * rounded and saturated to [-127, 127] as int8. `pix_out` can be `pix_in`.
+ *
+ * `pix_count` must be a multiple of 16 and the rows must be 4-byte aligned.
+ *
+ * @param pix_out    The output pixels
+ * @param pix_in     The input pixels
+ * @param gain_delta The gains minus 1, in Q6
+ * @param pix_count  The number of pixels
+ */
+void pixel_lsc_gain(
+    int8_t pix_out[],
+    const int8_t pix_in[],
+    const int8_t gain_delta[],
+    const unsigned pix_count);
+
+/**
+ * @brief Quantise a lens shading gain grid.
+ *
+ * The gains multiply uint8 pixel values. A grid is usually made from flat-field
+ * captures with python/lens_shading_calibration.py.
+ *
+ * @param lsc   The grid to fill
+ * @param gains [channel][node row][node column] gains in [0, LSC_GAIN_MAX], or
+ *              NULL to disable the correction
+ * @return int 0 on success, -1 if a gain is out of range
+ */
+int isp_lsc_init(
+    isp_lsc_t* lsc,
+    const float gains[APP_IMAGE_CHANNEL_COUNT][LSC_GRID_H][LSC_GRID_W]);
+
+/**
+ * @brief Prepare the correction of a frame, call at the start of each frame.
+ *
+ * @param state  The state to initialise
+ * @param lsc    The grid, enabled, used until the next frame start
+ * @param width  Frame width in pixels, a multiple of 16
+ * @param height Frame height in pixels, at least 2
+ * @param rows   Word aligned row buffer of LSC_ROWS_BYTES(width) bytes
+ */
+void isp_lsc_frame_init(
+    lsc_state_t* state,
+    const isp_lsc_t* lsc,
+    const unsigned width,
+    const unsigned height,
+    int8_t* rows);
+
+/**
+ * @brief Correct a planar row in place.
+ *
+ * The grid is bilinearly interpolated at each pixel. The two grid rows around
+ * the row are expanded to the frame width once per grid row, each row then
+ * only costs a vertical interpolation and the gains, on the VPU. Rows are
+ * expected in order, any other row expands both grid rows again.
+ *
+ * @param state The frame state
+ * @param row   Word aligned [CH][width] row
+ * @param y     Row index in the frame
+ */
+void isp_lsc_apply(
+    lsc_state_t* state,
+    int8_t row[],
+    const unsigned y);
+
+#if defined(__XC__) || defined(__cplusplus)
+}
+#endif
@@ -30,6 +30,16 @@
 #define AWB_MIN         0.8
 #define APPLY_GAMMA     1
 
+// Threads sharing the decimation of each row by column range, the ISP thread
+// included. Each thread past the first needs a free hardware thread on the tile.
+#ifndef ISP_THREAD_COUNT
+#define ISP_THREAD_COUNT  1
+#endif
+
+#if (ISP_THREAD_COUNT < 1) || (ISP_THREAD_COUNT > 4)
+#error ISP_THREAD_COUNT must be 1 to 4
+#endif
+
 #if defined(__XC__)
 extern "C" {
 #endif
@@ -44,6 +54,7 @@ typedef enum{
     PROCESS_ROW,
     FILTER_DRAIN,
     PROCESS_EOF,
+    SENSOR_UPDATE,
     ISP_STOP,
 } isp_cmd_t;
 
@@ -100,6 +111,21 @@ void isp_send_row_info(chanend_t ch, row_info_t* info);
  */
 row_info_t isp_recieve_row_info(chanend_t ch);
 
+/**
+ * @brief             Forward an encoded sensor command from the PH to the ISP,
+ *                    to be sent after a SENSOR_UPDATE command
+ * @param ch          Channel to send the sensor command
+ * @param encoded_cmd Sensor command encoded with ENCODE(cmd, arg)
+ */
+void isp_send_sensor_cmd(chanend_t ch, uint32_t encoded_cmd);
+
+/**
+ * @brief     Recieve an encoded sensor command from the PH.
+ * @param ch  Channel to recieve the sensor command
+ * @return    Sensor command encoded with ENCODE(cmd, arg)
+ */
+uint32_t isp_recieve_sensor_cmd(chanend_t ch);
+
 /**
  * @brief     Wait to revieve a command from the ISP
  * @param ch  channel to wait for the command
@@ -116,11 +142,33 @@ void isp_signal(chanend_t ch);
 /**
  * @brief ISP thread it recieves raw data and process it
  * 
+ * With ISP_THREAD_COUNT > 1 it starts ISP_THREAD_COUNT - 1 worker threads,
+ * that filter their own column range of each row. Rows are still output in
+ * order by the ISP thread.
+ * 
  * @param c_isp 
  * @param c_control 
  */
 void isp_thread(chanend_t c_isp, chanend_t c_control);
 
+/**
+ * Command loop of the ISP thread, started by isp_thread() alongside the
+ * workers. Returns on ISP_STOP, after stopping the workers.
+ * 
+ * @param c_isp 
+ * @param c_control 
+ */
+void isp_main(chanend_t c_isp, chanend_t c_control);
+
+/**
+ * Worker thread of isp_thread(), filters column range `shard` (1 to
+ * ISP_THREAD_COUNT - 1) of each row the ISP thread hands out, until ISP_STOP.
+ * 
+ * @param c_worker Channel end to the ISP thread
+ * @param shard    Column range of the worker
+ */
+void isp_worker(chanend_t c_worker, unsigned shard);
+
 // Gamma
 extern const int8_t  gamma_int8[256];
 
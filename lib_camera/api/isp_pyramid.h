@@ -0,0 +1,39 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#pragma once
+
+#include <stdint.h>
+
+#if defined(__XC__) || defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * @brief One row of a 2:1 pyramid level from two rows of the level below.
+ *
+ * Each output pixel is the mean of a 2x2 block, the sum of the four pixels
+ * rounded once, halves away from zero:
+ *
+ *    out[x] = round((top[2x] + top[2x+1] + bot[2x] + bot[2x+1]) / 4)
+ *
+ * When `w_in` is a multiple of 16 and the rows are word aligned the column
+ * sums come from the VPU accumulators, which hold them exactly, so both paths
+ * give the same pixels.
+ *
+ * @param out   Output row of w_in / 2 pixels
+ * @param top   First input row of w_in pixels
+ * @param bot   Second input row of w_in pixels
+ * @param w_in  Input row width in pixels, even
+ * @param accs  Word aligned scratch of 2 * w_in int16
+ */
+void isp_pyramid_downscale_row(
+    int8_t* out,
+    const int8_t* top,
+    const int8_t* bot,
+    const unsigned w_in,
+    int16_t* accs);
+
+#if defined(__XC__) || defined(__cplusplus)
+}
+#endif
@@ -0,0 +1,115 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#pragma once
+
+#include <stdint.h>
+
+#include "sensor.h"
+#include "isp_demosaic.h"
+
+// Sharpening of the decimated output (camera_set_sharpen()). 0 leaves it out,
+// saving the row ring.
+#ifndef APP_SHARPEN_ENABLED
+# define APP_SHARPEN_ENABLED    (0)
+#endif
+// Strength when built in, in 1/16
+#ifndef APP_SHARPEN_STRENGTH
+# define APP_SHARPEN_STRENGTH   (16)
+#endif
+
+// Largest strength in 1/16, 3.0
+#define SHARPEN_STRENGTH_MAX    (48)
+// Fractional bits of the kernel
+#define SHARPEN_SHIFT           (6)
+// Taps of the vertical pass: the centre row, split so each coefficient fits
+// int8, and the three blurred rows
+#define SHARPEN_TAP_MAX         (6)
+
+// Ring size in bytes for rows of `width` pixels: two input rows, three
+// horizontally blurred rows and the two shifted copies of a channel row
+#define SHARPEN_RING_BYTES(width)  ((5 * APP_IMAGE_CHANNEL_COUNT + 2) * (width))
+
+#if defined(__XC__) || defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Streaming 3x3 unsharp mask of planar rows, see isp_sharpen_frame_init().
+ */
+typedef struct {
+  /// @brief Strength in 1/16
+  unsigned strength;
+  /// @brief Row width in pixels
+  unsigned width;
+  /// @brief Rows pushed and output in the current frame
+  unsigned rows_in;
+  unsigned rows_out;
+  /// @brief Row ring, SHARPEN_RING_BYTES(width) bytes
+  int8_t* ring;
+  /// @brief Taps of the centre row in the vertical pass
+  unsigned centre_taps;
+  /// @brief Coefficients on all 16 lanes: horizontal blur 1 2 1, then the
+  /// vertical pass, centre taps first
+  int8_t coef_h[3][16] __attribute__((aligned(4)));
+  int8_t coef_v[SHARPEN_TAP_MAX][16] __attribute__((aligned(4)));
+  int16_t shifts_h[16] __attribute__((aligned(4)));
+  int16_t shifts_v[16] __attribute__((aligned(4)));
+} sharpen_state_t;
+
+/**
+ * @brief Prepare the sharpening of a frame, call at the start of each frame.
+ *
+ * With B the 3x3 binomial blur [1 2 1]^T [1 2 1] / 16, each output pixel is
+ *
+ *    out = in + s * (in - B(in)),  s = strength / 16
+ *
+ * mirrored at the frame edges. Flat areas come out unchanged.
+ *
+ * @param state    The state to initialise
+ * @param strength Strength in 1/16, 1 to SHARPEN_STRENGTH_MAX
+ * @param width    Row width in pixels, a multiple of 16
+ * @param ring     Word aligned ring of SHARPEN_RING_BYTES(width) bytes
+ */
+void isp_sharpen_frame_init(
+    sharpen_state_t* state,
+    const unsigned strength,
+    const unsigned width,
+    int8_t* ring);
+
+/**
+ * @brief Push the next [CH][width] row of the frame.
+ *
+ * The blur is separable: the row is blurred horizontally once when it comes
+ * in, then each output row sums its centre row and three blurred rows, on
+ * the VPU. An output row needs the row below it, so rows come out one row
+ * late, the last one from isp_sharpen_drain().
+ *
+ * @param state     The state
+ * @param output    Word aligned [CH][width] output row, not `input`
+ * @param input     Word aligned [CH][width] input row
+ * @param row_index Filled with the index of the output row
+ * @return unsigned 1 if `output` holds a row, 0 for the first row
+ */
+unsigned isp_sharpen_push_row(
+    sharpen_state_t* state,
+    int8_t output[],
+    const int8_t input[],
+    unsigned* row_index);
+
+/**
+ * @brief Output the last row of the frame, after the last push.
+ *
+ * @param state     The state
+ * @param output    Word aligned [CH][width] output row
+ * @param row_index Filled with the index of the output row
+ * @return unsigned 1 if `output` holds a row, 0 if there is none left
+ */
+unsigned isp_sharpen_drain(
+    sharpen_state_t* state,
+    int8_t output[],
+    unsigned* row_index);
+
+#if defined(__XC__) || defined(__cplusplus)
+}
+#endif
@@ -15,6 +15,22 @@
 #define HISTOGRAM_BIN_COUNT (64)
 #define HIST_QUANT_BITS     (2)
 
+// Auto black level: the first APP_BLACK_LEVEL_ROWS image rows of each frame
+// are taken to see no light. The IMX219 modes don't send the sensor's optical
+// black rows, so these are ordinary image rows, masked on the module.
+// 0 keeps the fixed SENSOR_BLACK_LEVEL.
+#ifndef APP_BLACK_LEVEL_ROWS
+# define APP_BLACK_LEVEL_ROWS    (0)
+#endif
+#if APP_BLACK_LEVEL_ROWS == 1
+# error "APP_BLACK_LEVEL_ROWS needs an RG and a GB row"
+#endif
+// Bytes between the pixel pairs sampled in a black row
+#define BLACK_LEVEL_STEP        (16)
+// Each frame moves the running average by 1 / 2^BLACK_LEVEL_AVG_SHIFT of the
+// difference
+#define BLACK_LEVEL_AVG_SHIFT   (3)
+
 typedef struct {
   uint32_t bins[HISTOGRAM_BIN_COUNT];
 } channel_histogram_t;
@@ -37,6 +53,14 @@ typedef struct{
   channel_histogram_t histogram_blue;
 } histograms_t;
 
+// Black level of each channel, in raw uint8 units
+typedef struct{
+  int32_t sum[APP_IMAGE_CHANNEL_COUNT];
+  uint32_t count[APP_IMAGE_CHANNEL_COUNT];
+  int32_t level_q8[APP_IMAGE_CHANNEL_COUNT]; // running average, Q8
+  unsigned valid;                            // a frame has been measured
+} black_level_t;
+
 typedef struct{
   channel_stats_t stats_red;
   channel_stats_t stats_green;
@@ -55,6 +79,26 @@ void stats_compute_histograms(
   const uint32_t width, 
   const int8_t pix_out[3][width]);
 
+/**
+ * @brief Compute the histogram of a luma row, into the green histogram
+ * 
+ * @param histograms histogram struct pointer
+ * @param width      width of the image
+ * @param luma       pointer to the luma row
+ */
+void stats_compute_histograms_luma(
+  histograms_t* histograms, 
+  const uint32_t width, 
+  const int8_t luma[width]);
+
+/**
+ * @brief Copy the luma histogram to the red and blue ones at the end of a
+ *        luma frame, so the exposure control sees it in every channel
+ * 
+ * @param histograms histogram struct pointer
+ */
+void stats_histograms_from_luma(histograms_t* histograms);
+
 /**
  * @brief Reset to zero the histograms and stats
  */
@@ -79,3 +123,40 @@ void stats_print(statistics_t* stats);
  * @return float  mean skewness
  */
 float stats_compute_mean_skewness(statistics_t* stats);
+
+/**
+ * @brief Add a black raw row of the frame to the black level measurement
+ *
+ * The ISP passes the first APP_BLACK_LEVEL_ROWS rows of the image, which are
+ * only black if they are masked, not optical black rows of the sensor.
+ * Samples the red and green pixels of even rows and the blue pixels of odd
+ * rows, the same pixels as the decimation filters, every BLACK_LEVEL_STEP
+ * bytes.
+ *
+ * @param black_level black level struct pointer
+ * @param row         the raw RGGB row, int8 pixels
+ * @param width       row width in pixels
+ * @param row_index   row index in the frame
+ */
+void stats_black_level_row(
+  black_level_t* black_level,
+  const int8_t row[],
+  const unsigned width,
+  const unsigned row_index);
+
+/**
+ * @brief Fold the measurement of a frame into the running average, and start
+ *        a new one
+ * @param black_level black level struct pointer
+ */
+void stats_black_level_frame_end(black_level_t* black_level);
+
+/**
+ * @brief         Black level of a channel
+ * @param black_level black level struct pointer, valid
+ * @param channel     CHAN_RED, CHAN_GREEN or CHAN_BLUE
+ * @return float  running average in raw uint8 units
+ */
+float stats_black_level(
+  const black_level_t* black_level,
+  const unsigned channel);
@@ -0,0 +1,166 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "sensor.h"
+
+// Temporal denoise of the decimated output (camera_set_temporal_denoise()).
+// 0 leaves it out, saving the previous frame buffer.
+#ifndef APP_TNR_ENABLED
+# define APP_TNR_ENABLED        (0)
+#endif
+// Blend strength and motion threshold when built in, see isp_tnr_set()
+#ifndef APP_TNR_STRENGTH
+# define APP_TNR_STRENGTH       (96)
+#endif
+#ifndef APP_TNR_THRESHOLD
+# define APP_TNR_THRESHOLD      (16)
+#endif
+
+// Previous frame buffer size in bytes for the default [CH][H][W] output, larger
+// outputs (camera_set_decimation()) aren't filtered
+#define TNR_PREV_BYTES    (APP_IMAGE_CHANNEL_COUNT * APP_IMAGE_HEIGHT_PIXELS * APP_IMAGE_WIDTH_PIXELS)
+// Fractional bits of the blend
+#define TNR_SHIFT         (6)
+// Largest motion threshold, clip(hd, 2T) + 2T mustn't saturate in the kernel
+#define TNR_THRESHOLD_MAX (63)
+
+// Constant vectors of pixel_tnr_blend(), the coefficient must follow the 64s
+enum {
+  TNR_VEC_T = 0,
+  TNR_VEC_NEG_T,
+  TNR_VEC_T2,
+  TNR_VEC_NEG_T2,
+  TNR_VEC_64,
+  TNR_VEC_COEF,
+  TNR_VEC_COUNT
+};
+
+#if defined(__XC__) || defined(__cplusplus)
+extern "C" {
+#endif
+
+/**
+ * Temporal denoise state, with the previous output frame, see isp_tnr_init().
+ */
+typedef struct {
+  /// @brief Blend strength, 0 when off
+  unsigned strength;
+  /// @brief Motion threshold, in uint8 units
+  unsigned threshold;
+  /// @brief Constant vectors on all 32 lanes, for pixel_tnr_blend()
+  int8_t vec[TNR_VEC_COUNT][32] __attribute__((aligned(4)));
+  int16_t shifts[16] __attribute__((aligned(4)));
+  /// @brief Previous output frame, [CH][height][width]
+  int8_t* prev;
+  size_t prev_bytes;
+  /// @brief Frame size in pixels
+  unsigned width;
+  unsigned height;
+  /// @brief 1 if `prev` holds a whole frame of this size
+  unsigned primed;
+  /// @brief 1 while the current frame only fills `prev`
+  unsigned seed;
+} tnr_state_t;
+
+/**
+ * Blend a row with the same row of the previous output frame, with the VPU in
+ * 8-bit mode.
+ *
+ * With d the difference to the previous frame, on halved pixels (h) so that it
+ * can't saturate:
+ *
+ *    hd = (pix_in >> 1) - (pix_prev >> 1)
+ *    g  = 2 * clip(hd, T) - clip(hd, 2T)
+ *    pix_out = pix_in + coef * g / 2^TNR_SHIFT
+ *
+ * g follows hd up to T, then fades out to 0 at 2T: still pixels are pulled
+ * towards the previous frame, moving ones are left alone. The output is
+ * rounded and saturated to [-127, 127], and also written to `pix_prev`.
+ * `pix_out` can be `pix_in`.
+ *
+ * The element-wise VPU ops work on 32 lanes, so the inputs are read 16 bytes
+ * past their ends. `pix_count` must be a multiple of 16 and the rows must be
+ * 4-byte aligned.
+ *
+ * @param pix_out   The output pixels
+ * @param pix_prev  The previous frame pixels, updated
+ * @param pix_in    The input pixels
+ * @param vec       The constant vectors, indexed by TNR_VEC_*
+ * @param shifts    TNR_SHIFT on 16 lanes
+ * @param pix_count The number of pixels
+ */
+void pixel_tnr_blend(
+    int8_t pix_out[],
+    int8_t pix_prev[],
+    const int8_t pix_in[],
+    const int8_t vec[TNR_VEC_COUNT][32],
+    const int16_t shifts[16],
+    const unsigned pix_count);
+
+/**
+ * @brief Prepare the temporal denoise, turned off.
+ *
+ * @param state      The state to initialise
+ * @param prev       Word aligned previous frame buffer
+ * @param prev_bytes Size of `prev`, usually TNR_PREV_BYTES
+ */
+void isp_tnr_init(
+    tnr_state_t* state,
+    int8_t* prev,
+    const size_t prev_bytes);
+
+/**
+ * @brief Set the blend, between frames.
+ *
+ * Differences to the previous frame up to `threshold` are blended, taking
+ * `strength / 128` of the previous frame: the noise of a still scene drops to
+ * about sqrt((128 - strength) / (128 + strength)). Differences past
+ * 2 * `threshold` are taken as motion and kept whole.
+ *
+ * @param state     The state
+ * @param strength  0 (off) to 127
+ * @param threshold Motion threshold in uint8 units, 2 to TNR_THRESHOLD_MAX
+ * @return int 0 on success, -1 if a setting is out of range
+ */
+int isp_tnr_set(
+    tnr_state_t* state,
+    const unsigned strength,
+    const unsigned threshold);
+
+/**
+ * @brief Prepare a frame, call at the start of each frame.
+ *
+ * The first frame after the denoise is turned on or the size changes only
+ * fills the previous frame buffer.
+ *
+ * @param state  The state
+ * @param width  Frame width in pixels, a multiple of 16
+ * @param height Frame height in pixels
+ * @return unsigned 1 if the frame is to be filtered, 0 if the denoise is off
+ *         or the frame doesn't fit the buffer
+ */
+unsigned isp_tnr_frame_init(
+    tnr_state_t* state,
+    const unsigned width,
+    const unsigned height);
+
+/**
+ * @brief Denoise a planar row in place, after isp_tnr_frame_init() returned 1.
+ *
+ * @param state The state
+ * @param row   Word aligned [CH][width] row
+ * @param y     Row index in the frame
+ */
+void isp_tnr_apply(
+    tnr_state_t* state,
+    int8_t row[],
+    const unsigned y);
+
+#if defined(__XC__) || defined(__cplusplus)
+}
+#endif
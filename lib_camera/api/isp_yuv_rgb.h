@@ -3,6 +3,33 @@
 
 #pragma once
 
+#include <stdint.h>
+
+#include "sensor.h"
+
+// Taps of an output channel of a row conversion, coefficients above 127 take
+// several taps
+#define YUV_RGB_TAP_MAX   (6)
+// Block of pixels deinterleaved at a time by isp_color_convert_interleaved()
+#define YUV_RGB_BLOCK     (64)
+
+// YUV images converted by the ISP (camera_capture_image_yuv()). 0 leaves
+// them out, saving the conversion row buffers.
+#ifndef APP_YUV_ENABLED
+# define APP_YUV_ENABLED        (0)
+#endif
+
+// Semi-planar YUV image size in bytes: a [height][width] Y plane, then the
+// U V pairs of each 2x1 (4:2:2) or 2x2 (4:2:0) block of pixels
+#define YUV_CHROMA_BYTES(format, width, height) \
+  (((format) == YUV_FORMAT_NV12) ? (width) * ((height) / 2) : (width) * (height))
+#define YUV_IMAGE_BYTES(format, width, height) \
+  ((width) * (height) + YUV_CHROMA_BYTES(format, width, height))
+
+#if defined(__XC__) || defined(__cplusplus)
+extern "C" {
+#endif
+
 // -------------------------- COLOR CONVERSION -------------------------------------
 // Macro arguments to get color components from packed result in the assembly program
 #define GET_R(rgb) (rgb & 0xFF)
@@ -38,3 +65,111 @@ int rgb_to_yuv(
     int r, 
     int g, 
     int b);
+
+/**
+ * Layout of the YUV images written by isp_yuv_pack_row().
+ */
+typedef enum {
+  YUV_FORMAT_422 = 0,   // NV16: Y plane, U V plane at full height
+  YUV_FORMAT_NV12       // NV12: Y plane, U V plane at half height
+} yuv_format_t;
+
+/**
+ * A colour conversion matrix quantised for the row conversions, see
+ * isp_rgb_to_yuv_init() and isp_yuv_to_rgb_init().
+ */
+typedef struct {
+  /// @brief Taps of each output channel
+  unsigned tap_count[APP_IMAGE_CHANNEL_COUNT];
+  /// @brief Input channel of each tap
+  uint8_t tap_in[APP_IMAGE_CHANNEL_COUNT][YUV_RGB_TAP_MAX];
+  /// @brief Coefficients of each tap, on all 16 lanes
+  int8_t coef[APP_IMAGE_CHANNEL_COUNT][YUV_RGB_TAP_MAX][16] __attribute__((aligned(4)));
+  int16_t shifts[16] __attribute__((aligned(4)));
+} color_conv_t;
+
+/**
+ * @brief Prepare the RGB to YUV conversion of rgb_to_yuv(), for rows.
+ *
+ * @param conv The conversion to fill
+ */
+void isp_rgb_to_yuv_init(
+    color_conv_t* conv);
+
+/**
+ * @brief Prepare the YUV to RGB conversion of yuv_to_rgb(), for rows.
+ *
+ * @param conv The conversion to fill
+ */
+void isp_yuv_to_rgb_init(
+    color_conv_t* conv);
+
+/**
+ * @brief Convert planar pixels, on the VPU.
+ *
+ * Converts `pix_count` pixels whose channels are `plane_stride` bytes apart,
+ * [CH][width] rows with `plane_stride = pix_count = width`, or whole
+ * [CH][H][W] images with `plane_stride = pix_count = H * W`. The matrix is
+ * quantised once by the init function, each block of 16 pixels of an output
+ * channel is summed in the VPU accumulators (pixel_demosaic_macc()). Outputs
+ * are within 2 of the per-pixel functions.
+ *
+ * @param conv         The conversion
+ * @param output       Word aligned output planes, not `input`
+ * @param input        Word aligned input planes
+ * @param pix_count    The number of pixels of each plane, a multiple of 16
+ * @param plane_stride Bytes from a channel to the next, a multiple of 4
+ */
+void isp_color_convert_planar(
+    const color_conv_t* conv,
+    int8_t output[],
+    const int8_t input[],
+    const unsigned pix_count,
+    const unsigned plane_stride);
+
+/**
+ * @brief Convert interleaved pixels, on the VPU.
+ *
+ * Converts [pix_count][CH] pixels, rows or whole images, YUV_RGB_BLOCK pixels
+ * at a time through planar buffers on the stack. `output` can be `input`.
+ *
+ * @param conv      The conversion
+ * @param output    The output pixels
+ * @param input     The input pixels
+ * @param pix_count The number of pixels, a multiple of 16
+ */
+void isp_color_convert_interleaved(
+    const color_conv_t* conv,
+    int8_t output[],
+    const int8_t input[],
+    const unsigned pix_count);
+
+/**
+ * @brief Write a row into a semi-planar YUV image.
+ *
+ * Pixels are written as uint8, U and V centred on 128. The chroma of each
+ * pair of pixels is their mean. In YUV_FORMAT_NV12 the means of an even row
+ * are kept in `chroma` until the odd row below completes them, rows must come
+ * in order and the last row of an odd height has no chroma.
+ *
+ * @param image   Word aligned image of YUV_IMAGE_BYTES(format, width, height)
+ *                bytes
+ * @param format  The layout
+ * @param width   Image width in pixels, a multiple of 4
+ * @param height  Image height in pixels
+ * @param yuv_row [CH][width] Y U V row, from isp_color_convert_planar()
+ * @param chroma  Buffer of `width` bytes, kept between the rows of a frame
+ * @param row     Row index in the image
+ */
+void isp_yuv_pack_row(
+    uint8_t image[],
+    const yuv_format_t format,
+    const unsigned width,
+    const unsigned height,
+    const int8_t yuv_row[],
+    int8_t chroma[],
+    const unsigned row);
+
+#if defined(__XC__) || defined(__cplusplus)
+}
+#endif
@@ -27,6 +27,24 @@ typedef enum {
   FMT_RAW10 = _MIPI_DT_RAW10
 } pixel_format_t;
 
+// Sensor test patterns, values match the IMX219 TEST_PATTERN_MODE register
+typedef enum {
+  TEST_PATTERN_NONE = 0,
+  TEST_PATTERN_SOLID = 1,        // every pixel at TEST_PATTERN_SOLID_VALUE
+  TEST_PATTERN_COLOUR_BARS = 2,  // 8 vertical bars
+  TEST_PATTERN_GREY_BARS = 3,    // colour bars fading to grey
+  TEST_PATTERN_PN9 = 4           // pseudo-random noise
+} sensor_test_pattern_t;
+
+#define TEST_PATTERN_SOLID_VALUE 0x200 // 10-bit
+
+// Sensor mode, can be changed at runtime (see camera_set_mode())
+typedef struct {
+  resolution_t resolution;
+  pixel_format_t pixel_format;
+  unsigned binning;
+} camera_mode_t;
+
 // -------------- Sensor abstraction layer --------------
 // Camera support
 #define CONFIG_IMX219_SUPPORT   ENABLED
@@ -36,6 +54,9 @@ typedef enum {
 #define CROP_ENABLED            DISABLED
 #define CONFIG_MODE             MODE_VGA_640x480
 
+// Binning selection
+#define CONFIG_BINNING          ENABLED
+
 // Mipi format and mode
 #ifndef CONFIG_MIPI_FORMAT
 #define CONFIG_MIPI_FORMAT      _MIPI_DT_RAW8
@@ -93,8 +114,42 @@ typedef enum {
 
 // ----------------------- Settings dependant of each sensor library
 
+// Runtime modes (do not edit)
+// Packet buffers are sized for the largest mode, so the sensor mode can be
+// switched at runtime without rebuilding.
+#define MIPI_MAX_IMAGE_WIDTH_PIXELS     1280
+#define MIPI_MAX_IMAGE_HEIGHT_PIXELS    960
+#define MIPI_MAX_IMAGE_WIDTH_BYTES      (((MIPI_MAX_IMAGE_WIDTH_PIXELS) >> 2) * 5) // RAW10
+
+#define MODE_WIDTH_PIXELS(RES)          (((RES) == MODE_1280x960) ? 1280 : 640)
+#define MODE_HEIGHT_PIXELS(RES)         (((RES) == MODE_1280x960) ? 960 : 480)
+#define MODE_WIDTH_BYTES(RES, FMT)      (((FMT) == _MIPI_DT_RAW10) \
+                                          ? ((MODE_WIDTH_PIXELS(RES) >> 2) * 5) \
+                                          : MODE_WIDTH_PIXELS(RES))
+// Every mode decimates down to the same APP_IMAGE_*_PIXELS output, unless a
+// decimation factor is requested with camera_set_decimation()
+#define MODE_DECIMATION_FACTOR(RES)     (((RES) == MODE_1280x960) ? 8 : 4)
+
+// Smallest runtime decimation factor (2 or 4), sizes the ISP row buffers.
+// Applications that request factor 2 define it as 2, at the cost of twice
+// the buffers.
+#ifndef APP_DECIMATION_FACTOR_MIN
+#define APP_DECIMATION_FACTOR_MIN       (4)
+#endif
+#define APP_MAX_IMAGE_WIDTH_PIXELS      (MIPI_MAX_IMAGE_WIDTH_PIXELS / APP_DECIMATION_FACTOR_MIN)
+#define APP_MAX_IMAGE_HEIGHT_PIXELS     (MIPI_MAX_IMAGE_HEIGHT_PIXELS / APP_DECIMATION_FACTOR_MIN)
+
+#if (APP_DECIMATION_FACTOR_MIN != 2) && (APP_DECIMATION_FACTOR_MIN != 4)
+# error APP_DECIMATION_FACTOR_MIN must be 2 or 4
+#endif
+
+#define CAMERA_MODE_DEFAULT { \
+  (resolution_t)CONFIG_MODE, \
+  (pixel_format_t)CONFIG_MIPI_FORMAT, \
+  CONFIG_BINNING }
+
 // Camera dependant (do not edit)
-#define MIPI_MAX_PKT_SIZE_BYTES ((MIPI_IMAGE_WIDTH_BYTES) + 4)
+#define MIPI_MAX_PKT_SIZE_BYTES ((MIPI_MAX_IMAGE_WIDTH_BYTES) + 4)
 #define MIPI_TILE 1
 #define EXPECTED_FORMAT CONFIG_MIPI_FORMAT //backward compatibility
 #define MIPI_EXPECTED_FORMAT CONFIG_MIPI_FORMAT //backward compatibility
@@ -143,5 +198,23 @@ typedef enum {
 #define H   (APP_IMAGE_HEIGHT_PIXELS)
 #define W   (APP_IMAGE_WIDTH_PIXELS)
 
+// Image pyramid (camera_capture_pyramid()), level k is [CH][H >> k][W >> k]
+#ifndef APP_PYRAMID_LEVELS
+# define APP_PYRAMID_LEVELS   (3)
+#endif
+#define APP_PYRAMID_WIDTH(k)  (W >> (k))
+#define APP_PYRAMID_HEIGHT(k) (H >> (k))
+
+#if ((H % (1 << (APP_PYRAMID_LEVELS - 1))) || (W % (1 << (APP_PYRAMID_LEVELS - 1))))
+# error "Image size must be divisible by 2^(APP_PYRAMID_LEVELS - 1)"
+#endif
+
+// Full resolution RGB output (camera_set_demosaic()), for sensor modes up to
+// this width. The ISP line buffer takes 25 bytes per pixel of width, 0 leaves
+// the demosaic out.
+#ifndef APP_DEMOSAIC_MAX_WIDTH_PIXELS
+# define APP_DEMOSAIC_MAX_WIDTH_PIXELS  (0)
+#endif
+
 #define H_RAW   (MIPI_IMAGE_HEIGHT_PIXELS)
 #define W_RAW   (MIPI_IMAGE_WIDTH_BYTES)
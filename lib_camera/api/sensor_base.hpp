@@ -5,9 +5,14 @@
 
 #include <stdint.h>
 
+#include <stdio.h>
+
 #include <xcore/assert.h>
 #include <xcore/channel.h>
 
+#include "sensor.h"
+#include "sensor_control.h"
+
 #ifdef __cplusplus
 
 extern "C" {
@@ -24,7 +29,7 @@ typedef struct
 
 typedef struct
 {
-  i2c_line_t * table;
+  const i2c_line_t * table;
   size_t num_lines;
 } i2c_table_t;
 
@@ -41,7 +46,7 @@ typedef struct
 #define GET_TABLE(regs_arr) (i2c_table_t){regs_arr, GET_NUM_LINES(regs_arr)}
 
 /**
- *  @brief Base class for implementing Sensor control from
+ *  @brief Base class providing the I2C access used by every sensor driver
  */
 class SensorBase {
 
@@ -92,6 +97,15 @@ class SensorBase {
      */
     int i2c_write_table(i2c_table_t table);
 
+    /**
+     * @brief Write a 16-bit value to two consecutive 8-bit registers, MSB first
+     *
+     * @param reg         First register to write to
+     * @param val         Value to write
+     * @returns           0 if succeeded, -1 if failed
+     */
+    int i2c_write_reg16(uint16_t reg, uint16_t val);
+
   public:
 
     /**
@@ -102,57 +116,151 @@ class SensorBase {
      */
     SensorBase(i2c_config_t _conf);
 
-    /**
-     * @brief Initialize sensor
-     *
-     * @note This is a virtual function, and will have to be implemented in the derived class
-     * @note Can't make it a pure virtual method as it adds 18 kB of memory in the current (15.2.1) XTC version
-     */
-    virtual int initialize();
+}; // SensorBase
 
-    /**
-     * @brief Start data stream
-     *
-     * @note This is a virtual function, and will have to be implemented in the derived class
-     * @note Can't make it a pure virtual method as it adds 18 kB of memory in the current (15.2.1) XTC version
-     */
-    virtual int stream_start();
+/**
+ * @brief Compile-time sensor driver interface (CRTP).
+ *
+ * A driver derives as `class NEW_SENSOR : public SensorDriver<NEW_SENSOR>` and
+ * implements `initialize()`, `stream_start()`, `stream_stop()`,
+ * `set_exposure()` and `configure()`. Optional commands fall back to the
+ * defaults below when the driver doesn't provide them. Calls are resolved at
+ * compile time, so there is no vtable or dispatch code.
+ */
+template <typename Derived>
+class SensorDriver : public SensorBase {
 
-    /**
-     * @brief Stop data stream
-     *
-     * @note This is a virtual function, and will have to be implemented in the derived class
-     * @note Can't make it a pure virtual method as it adds 18 kB of memory in the current (15.2.1) XTC version
-     */
-    virtual int stream_stop();
+  private:
+
+    Derived& derived() {
+      return *static_cast<Derived*>(this);
+    }
+
+  public:
 
     /**
-     * @brief Set sensor exposure
+     * @brief Construct new `SensorDriver`
      *
-     * @param dBGain      Exposure gain in dB, can enable different types of camera gain
-     * @note This is a virtual function, and will have to be implemented in the derived class
-     * @note Can't make it a pure virtual method as it adds 18 kB of memory in the current (15.2.1) XTC version
+     * @param _conf       I2C master config to use for the sensor control
+     * @note This will initialize I2C interface
      */
-    virtual int set_exposure(uint32_t dBGain);
+    SensorDriver(i2c_config_t _conf) : SensorBase(_conf) {}
 
     /**
-     * @brief Set sensor resolution, binning mode, and RAW format
-     *
-     * @note This is a virtual function, and will have to be implemented in the derived class
-     * @note Can't make it a pure virtual method as it adds 18 kB of memory in the current (15.2.1) XTC version
+     * @brief Default optional commands, ignored with a warning
      */
-    virtual int configure();
+    int set_mode(resolution_t _res, pixel_format_t _pix_fmt, bool _binning) {
+      (void)_res; (void)_pix_fmt; (void)_binning;
+      puts("Warning: sensor mode change not supported");
+      return 0;
+    }
+
+    int set_fps(uint16_t fps) {
+      (void)fps;
+      puts("Warning: frame rate control not supported");
+      return 0;
+    }
+
+    int set_line_length(uint16_t _line_length) {
+      (void)_line_length;
+      puts("Warning: line length control not supported");
+      return 0;
+    }
+
+    void set_isp_row_time(uint16_t ticks) {
+      (void)ticks;
+    }
+
+    int set_test_pattern(sensor_test_pattern_t pattern) {
+      (void)pattern;
+      puts("Warning: test patterns not supported");
+      return 0;
+    }
 
     /**
      * @brief Control thread intry, will initialise and configure sensor inside
      *
      * @param c_control   Control channel
-     * @note This is a virtual function, and will have to be implemented in the derived class
-     * @note Can't make it a pure virtual method as it adds 18 kB of memory in the current (15.2.1) XTC version
      */
-    virtual void control(chanend_t c_control);
+    void control(chanend_t c_control) {
+      // Init the I2C sensor first configuration
+      int ret = 0;
+      ret |= derived().initialize();
+      delay_milliseconds(100);
+      ret |= derived().configure();
+      delay_milliseconds(600);
+      ret |= derived().stream_start();
+      delay_milliseconds(600);
+      xassert((ret == 0) && "Could not initialise camera");
+      puts("\nCamera_started and configured...");
 
-}; // SensorBase
+      // store the response
+      uint32_t encoded_response;
+      sensor_control_t cmd;
+      uint16_t arg;
+
+      // sensor control logic
+      while(1) {
+        encoded_response = chan_in_word(c_control);
+        cmd = (sensor_control_t) DECODE_CMD(encoded_response);
+        arg = DECODE_ARG(encoded_response);
+
+        // A mode change is acknowledged once the sensor streams in the new
+        // mode, so the packet handler can't see a frame of the old mode
+        // with the new geometry. Other commands don't hold the caller.
+        if (cmd != SENSOR_SET_MODE) {
+          chan_out_word(c_control, 0);
+        }
+
+        #if ENABLE_PRINT_SENSOR_CONTROL
+          printf("--------------- Received command %d\n", cmd);
+        #endif
+
+        switch (cmd)
+        {
+        case SENSOR_INIT:
+          ret = derived().initialize();
+          break;
+        case SENSOR_CONFIG:
+          ret = derived().configure();
+          break;
+        case SENSOR_STREAM_START:
+          ret = derived().stream_start();
+          break;
+        case SENSOR_STREAM_STOP:
+          ret = derived().stream_stop();
+          break;
+        case SENSOR_SET_EXPOSURE:
+          ret = derived().set_exposure((uint8_t)arg);
+          break;
+        case SENSOR_SET_MODE:
+          ret = derived().set_mode(
+            (resolution_t)MODE_DECODE_RES(arg),
+            (pixel_format_t)MODE_DECODE_FMT(arg),
+            MODE_DECODE_BINNING(arg));
+          chan_out_word(c_control, 0);
+          break;
+        case SENSOR_SET_FPS:
+          ret = derived().set_fps(arg);
+          break;
+        case SENSOR_SET_LINE_LENGTH:
+          ret = derived().set_line_length(arg);
+          break;
+        case SENSOR_SET_ROW_TIME:
+          derived().set_isp_row_time(arg);
+          ret = 0;
+          break;
+        case SENSOR_SET_TEST_PATTERN:
+          ret = derived().set_test_pattern((sensor_test_pattern_t)arg);
+          break;
+        default:
+          break;
+        }
+        xassert((ret == 0) && "Could not perform I2C write");
+      }
+    }
+
+}; // SensorDriver
 
 } // sensor
 
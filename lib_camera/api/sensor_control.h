@@ -16,7 +16,18 @@ typedef enum {
   SENSOR_CONFIG,
   SENSOR_STREAM_START,
   SENSOR_STREAM_STOP,
-  SENSOR_SET_EXPOSURE
+  SENSOR_SET_EXPOSURE,
+  SENSOR_SET_MODE,
+  SENSOR_SET_FPS,
+  SENSOR_SET_LINE_LENGTH,
+  SENSOR_SET_ROW_TIME,
+  SENSOR_SET_TEST_PATTERN,
+  SENSOR_SET_DECIMATION,  // handled by the ISP, not sent to the sensor
+  SENSOR_SET_DEMOSAIC,    // handled by the ISP, not sent to the sensor
+  SENSOR_SET_DPC,         // handled by the ISP, not sent to the sensor
+  SENSOR_SET_TNR,         // handled by the ISP, not sent to the sensor
+  SENSOR_SET_SHARPEN,     // handled by the ISP, not sent to the sensor
+  SENSOR_SET_LUMA         // handled by the ISP, not sent to the sensor
 } sensor_control_t;
 
 #define I2C_DEV_ADDR 0x10
@@ -27,6 +38,19 @@ typedef enum {
 #define DECODE_CMD(value) ((uint16_t)((value) >> 16))
 #define DECODE_ARG(value) ((uint16_t)(value))
 
+// SENSOR_SET_MODE argument: [15:8] pixel format, [4] binning, [3:0] resolution
+#define MODE_ENCODE(res, fmt, binning) \
+  ((((uint32_t)(fmt) & 0xFF) << 8) | (((binning) ? 1 : 0) << 4) | ((uint32_t)(res) & 0xF))
+#define MODE_DECODE_RES(arg) ((arg) & 0xF)
+#define MODE_DECODE_FMT(arg) (((arg) >> 8) & 0xFF)
+#define MODE_DECODE_BINNING(arg) (((arg) >> 4) & 0x1)
+
+// SENSOR_SET_TNR argument: [15:8] threshold, [7:0] strength
+#define TNR_ENCODE(strength, threshold) \
+  ((((uint32_t)(threshold) & 0xFF) << 8) | ((uint32_t)(strength) & 0xFF))
+#define TNR_DECODE_STRENGTH(arg) ((arg) & 0xFF)
+#define TNR_DECODE_THRESHOLD(arg) (((arg) >> 8) & 0xFF)
+
 #if defined(__XC__) || defined(__cplusplus)
 extern "C" {
 #endif
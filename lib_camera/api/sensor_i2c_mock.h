@@ -0,0 +1,126 @@
+// Copyright 2023-2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+// Mock I2C backend for sensor control tests.
+// Build with SENSOR_I2C_MOCK=1 and SensorBase will talk to this mock instead
+// of the I2C bus. Every transaction is recorded with a simulated bus time and
+// an IMX219 register map is emulated, so register sequences and bus timing of
+// the sensor driver can be checked without a sensor.
+
+#pragma once
+
+#include <stdint.h>
+
+#ifndef SENSOR_I2C_MOCK
+#define SENSOR_I2C_MOCK 0
+#endif
+
+// Transactions kept in the log, later ones are only counted
+#define I2C_MOCK_LOG_SIZE     256
+// Distinct registers the emulated register map can hold
+#define I2C_MOCK_MAX_REGS     128
+
+// Bits on the bus (start, 9 bits per byte, stop)
+// write: [dev addr][reg hi][reg lo][value]
+// read:  [dev addr][reg hi][reg lo] restart [dev addr][value]
+#define I2C_MOCK_WRITE_BITS   (1 + 4 * 9 + 1)
+#define I2C_MOCK_READ_BITS    (1 + 3 * 9 + 1 + 2 * 9 + 1)
+
+// Bus time in reference clock ticks (100 MHz) for a given speed in kHz
+#define I2C_MOCK_TICKS(bits, speed_khz) (((bits) * 100000u) / (speed_khz))
+
+#if defined(__XC__) || defined(__cplusplus)
+extern "C" {
+#endif
+
+typedef struct {
+  uint16_t reg;     // register address
+  uint8_t val;      // value written or read
+  uint8_t is_read;  // 1 for reads, 0 for writes
+  uint32_t time;    // simulated bus time when the transaction ended (ticks)
+} i2c_mock_transaction_t;
+
+/**
+ * Reset the mock: clear the transaction log and the simulated time, and
+ * restore the IMX219 power-up register values.
+ *
+ * @param speed_khz I2C bus speed used to simulate the bus time
+ */
+void i2c_mock_reset(
+    const unsigned speed_khz);
+
+/**
+ * Write an 8-bit register with a 16-bit address.
+ * A write of 1 to the software reset register (0x0103) restores the power-up
+ * register values.
+ *
+ * @param reg Register address
+ * @param val Value to write
+ * @return 0 on success
+ */
+int i2c_mock_write_reg8_addr16(
+    const uint16_t reg,
+    const uint8_t val);
+
+/**
+ * Read an 8-bit register with a 16-bit address.
+ * Registers that have not been written read as their power-up value, or 0.
+ *
+ * @param reg Register address
+ * @return Register value
+ */
+uint8_t i2c_mock_read_reg8_addr16(
+    const uint16_t reg);
+
+/**
+ * Advance the simulated time without a bus transaction (sensor sleeps).
+ *
+ * @param ticks Reference clock ticks
+ */
+void i2c_mock_delay(
+    const unsigned ticks);
+
+/**
+ * @return Number of transactions since the last reset, including the ones
+ *         that didn't fit in the log
+ */
+unsigned i2c_mock_get_transaction_count();
+
+/**
+ * @param index Transaction index, must be lower than I2C_MOCK_LOG_SIZE
+ * @return Pointer to the logged transaction
+ */
+const i2c_mock_transaction_t* i2c_mock_get_transaction(
+    const unsigned index);
+
+/**
+ * @return Simulated time since the last reset (ticks), bus time plus delays
+ */
+uint32_t i2c_mock_get_time();
+
+/**
+ * @return Bus time since the last reset (ticks), excluding delays
+ */
+uint32_t i2c_mock_get_bus_time();
+
+/**
+ * Get the current value of an emulated register without a bus transaction.
+ *
+ * @param reg Register address
+ * @return Register value
+ */
+uint8_t i2c_mock_get_reg(
+    const uint16_t reg);
+
+/**
+ * Get the current value of two consecutive emulated registers, MSB first.
+ *
+ * @param reg First register address
+ * @return Register value
+ */
+uint16_t i2c_mock_get_reg16(
+    const uint16_t reg);
+
+#if defined(__XC__) || defined(__cplusplus)
+}
+#endif
@@ -14,12 +14,35 @@
 #include "camera_utils.h"
 #include "camera_api.h"
 #include "isp_pipeline.h"
-
-#define CHAN_RAW  0
-#define CHAN_DEC  1
-#define CHAN_STOP 2
-
-channel_t c_user_api[3];
+#include "isp_functions.h"
+#include "sensor_control.h"
+
+#define CHAN_RAW    0
+#define CHAN_DEC    1
+#define CHAN_STOP   2
+#define CHAN_SENSOR 3
+#define CHAN_PYR    4
+#define CHAN_RGB    5
+#define CHAN_CCM    6
+#define CHAN_LSC    7
+#define CHAN_DPC    8
+#define CHAN_YUV    9
+#define CHAN_GRAY   10
+
+channel_t c_user_api[11];
+
+// Output quantisation, indexed by pixel + 128. Composed with gamma for
+// camera_capture_image(), alone for the captures that copy rows without it,
+// and mixed from the channels for the gray capture. Applied on the client
+// as rows are copied into the capture buffers.
+static int8_t output_lut[CH][256];
+static int8_t output_lut_linear[CH][256];
+static int8_t output_lut_gray[1][256];
+static unsigned output_quant = 0;
+
+// Decimated output size, set by the ISP at each frame start
+static volatile unsigned frame_width = W;
+static volatile unsigned frame_height = H;
 
 // -------------- INIT /STOP --------------
 
@@ -28,6 +51,14 @@ void camera_init()
   c_user_api[CHAN_RAW]   = chan_alloc();
   c_user_api[CHAN_DEC]   = chan_alloc();
   c_user_api[CHAN_STOP]  = chan_alloc();
+  c_user_api[CHAN_SENSOR] = chan_alloc();
+  c_user_api[CHAN_PYR]    = chan_alloc();
+  c_user_api[CHAN_RGB]    = chan_alloc();
+  c_user_api[CHAN_CCM]    = chan_alloc();
+  c_user_api[CHAN_LSC]    = chan_alloc();
+  c_user_api[CHAN_DPC]    = chan_alloc();
+  c_user_api[CHAN_YUV]    = chan_alloc();
+  c_user_api[CHAN_GRAY]   = chan_alloc();
 }
 
 void camera_stop(){
@@ -49,6 +80,246 @@ unsigned camera_check_stop(){
     }
 }
 
+// -------------- SENSOR --------------
+
+int camera_set_mode(
+    const camera_mode_t mode)
+{
+  if (mode.resolution != RES_640_480 && mode.resolution != RES_1280_960) {
+    return -1;
+  }
+  if (mode.pixel_format != FMT_RAW8 && mode.pixel_format != FMT_RAW10) {
+    return -1;
+  }
+  if (mode.binning > 1) {
+    return -1;
+  }
+  const uint32_t arg = MODE_ENCODE(mode.resolution, mode.pixel_format, mode.binning);
+  chan_out_word(c_user_api[CHAN_SENSOR].end_a, ENCODE(SENSOR_SET_MODE, arg));
+  return 0;
+}
+
+int camera_set_fps(
+    const unsigned fps)
+{
+  // The argument is a 16-bit field of the command
+  if (fps == 0 || fps > UINT16_MAX) {
+    return -1;
+  }
+  chan_out_word(c_user_api[CHAN_SENSOR].end_a, ENCODE(SENSOR_SET_FPS, fps));
+  return 0;
+}
+
+int camera_set_line_length(
+    const unsigned line_length)
+{
+  if (line_length == 0 || line_length > UINT16_MAX) {
+    return -1;
+  }
+  chan_out_word(c_user_api[CHAN_SENSOR].end_a, ENCODE(SENSOR_SET_LINE_LENGTH, line_length));
+  return 0;
+}
+
+int camera_set_test_pattern(
+    const sensor_test_pattern_t pattern)
+{
+  if ((unsigned)pattern > TEST_PATTERN_PN9) {
+    return -1;
+  }
+  chan_out_word(c_user_api[CHAN_SENSOR].end_a, ENCODE(SENSOR_SET_TEST_PATTERN, pattern));
+  return 0;
+}
+
+int camera_set_decimation(
+    const unsigned dec_factor)
+{
+  if (dec_factor != 0 && dec_factor != 2 && dec_factor != 4 && dec_factor != 8) {
+    return -1;
+  }
+  if (dec_factor != 0 && dec_factor < APP_DECIMATION_FACTOR_MIN) {
+    return -1;
+  }
+  chan_out_word(c_user_api[CHAN_SENSOR].end_a, ENCODE(SENSOR_SET_DECIMATION, dec_factor));
+  return 0;
+}
+
+int camera_set_demosaic(
+    const demosaic_mode_t mode)
+{
+  if (mode != DEMOSAIC_NONE && mode != DEMOSAIC_BILINEAR && mode != DEMOSAIC_GRADIENT) {
+    return -1;
+  }
+  if (mode != DEMOSAIC_NONE && APP_DEMOSAIC_MAX_WIDTH_PIXELS == 0) {
+    return -1;
+  }
+  chan_out_word(c_user_api[CHAN_SENSOR].end_a, ENCODE(SENSOR_SET_DEMOSAIC, mode));
+  return 0;
+}
+
+int camera_set_dpc(
+    const unsigned threshold)
+{
+  if (threshold > INT8_MAX || APP_DPC_ENABLED == 0) {
+    return -1;
+  }
+  chan_out_word(c_user_api[CHAN_SENSOR].end_a, ENCODE(SENSOR_SET_DPC, threshold));
+  return 0;
+}
+
+int camera_set_temporal_denoise(
+    const unsigned strength,
+    const unsigned threshold)
+{
+  if (APP_TNR_ENABLED == 0 || strength > INT8_MAX) {
+    return -1;
+  }
+  if (threshold < 2 || threshold > TNR_THRESHOLD_MAX) {
+    return -1;
+  }
+  chan_out_word(c_user_api[CHAN_SENSOR].end_a,
+                ENCODE(SENSOR_SET_TNR, TNR_ENCODE(strength, threshold)));
+  return 0;
+}
+
+int camera_set_sharpen(
+    const unsigned strength)
+{
+  if (strength > SHARPEN_STRENGTH_MAX || APP_SHARPEN_ENABLED == 0) {
+    return -1;
+  }
+  chan_out_word(c_user_api[CHAN_SENSOR].end_a, ENCODE(SENSOR_SET_SHARPEN, strength));
+  return 0;
+}
+
+int camera_set_luma(
+    const unsigned enable)
+{
+  if (enable > 1) {
+    return -1;
+  }
+  chan_out_word(c_user_api[CHAN_SENSOR].end_a, ENCODE(SENSOR_SET_LUMA, enable));
+  return 0;
+}
+
+// ISP tables (colour correction, lens shading, defect list) are built by the client and
+// copied by the ISP at the next frame start, the client waits for the copy
+static
+void send_isp_table(
+    const unsigned chan,
+    const void* table)
+{
+  chan_out_word(c_user_api[chan].end_b, (unsigned)table);
+  chan_in_word(c_user_api[chan].end_b);
+}
+
+static
+unsigned check_isp_table(
+    const unsigned chan,
+    void* table,
+    const size_t size)
+{
+  SELECT_RES(
+      CASE_THEN(c_user_api[chan].end_a, user_handler),
+      DEFAULT_THEN(default_handler))
+    {
+      user_handler:
+        memcpy(table, (const void*)chan_in_word(c_user_api[chan].end_a), size);
+        chan_out_word(c_user_api[chan].end_a, 0);
+        return 1;
+      default_handler:
+        return 0;
+    }
+}
+
+int camera_set_ccm(
+    const float matrix[CH][CH])
+{
+  isp_ccm_t ccm;
+  if (APP_CCM_ENABLED == 0 || isp_ccm_init(&ccm, matrix)) {
+    return -1;
+  }
+  send_isp_table(CHAN_CCM, &ccm);
+  return 0;
+}
+
+unsigned camera_check_ccm(
+    isp_ccm_t* ccm)
+{
+  return check_isp_table(CHAN_CCM, ccm, sizeof(isp_ccm_t));
+}
+
+int camera_set_lens_shading(
+    const float gains[CH][LSC_GRID_H][LSC_GRID_W])
+{
+  isp_lsc_t lsc;
+  if (APP_LSC_ENABLED == 0 || isp_lsc_init(&lsc, gains)) {
+    return -1;
+  }
+  send_isp_table(CHAN_LSC, &lsc);
+  return 0;
+}
+
+unsigned camera_check_lens_shading(
+    isp_lsc_t* lsc)
+{
+  return check_isp_table(CHAN_LSC, lsc, sizeof(isp_lsc_t));
+}
+
+int camera_set_defect_list(
+    const dpc_defect_t defects[],
+    const unsigned defect_count)
+{
+  dpc_defect_list_t list;
+  if (APP_DPC_ENABLED == 0 || isp_dpc_defect_list_init(&list, defects, defect_count)) {
+    return -1;
+  }
+  send_isp_table(CHAN_DPC, &list);
+  return 0;
+}
+
+unsigned camera_check_defect_list(
+    dpc_defect_list_t* list)
+{
+  return check_isp_table(CHAN_DPC, list, sizeof(dpc_defect_list_t));
+}
+
+void camera_get_image_size(
+    unsigned* width,
+    unsigned* height)
+{
+  *width = frame_width;
+  *height = frame_height;
+}
+
+void camera_new_frame_size(
+    const unsigned width,
+    const unsigned height)
+{
+  frame_width = width;
+  frame_height = height;
+}
+
+static
+unsigned image_size_is_default()
+{
+  return (frame_width == W) && (frame_height == H);
+}
+
+unsigned camera_check_sensor_cmd(
+    uint32_t* encoded_cmd)
+{
+  SELECT_RES(
+      CASE_THEN(c_user_api[CHAN_SENSOR].end_b, user_handler),
+      DEFAULT_THEN(default_handler))
+    {
+      user_handler:
+        *encoded_cmd = chan_in_word(c_user_api[CHAN_SENSOR].end_b);
+        return 1;
+      default_handler:
+        return 0;
+    }
+}
+
 // -------------- RAW --------------
 void camera_new_row(
     const int8_t pixel_data[W_RAW],
@@ -100,20 +371,35 @@ unsigned camera_capture_image_raw(
 
 // -------------- RGB --------------
 
-void camera_new_row_decimated(
-    const int8_t pixel_data[CH][W],
-    const unsigned row_index)
+// Give a [chans][width] row to a client waiting on `c`, if there is one
+static
+void new_row_planar(
+    chanend_t c,
+    const int8_t* pixel_data,
+    const unsigned row_index,
+    const unsigned width,
+    const unsigned chans)
 {
     int8_t *user_pixel_data;
+    unsigned user_width;
 
     SELECT_RES(
-        CASE_THEN(c_user_api[CHAN_DEC].end_a, user_handler),
+        CASE_THEN(c, user_handler),
         DEFAULT_THEN(default_handler))
     {
     user_handler:
-        user_pixel_data = (int8_t *)chan_in_word(c_user_api[CHAN_DEC].end_a);
-        memcpy(user_pixel_data, (void *)pixel_data, CH * W);
-        chan_out_word(c_user_api[CHAN_DEC].end_a, row_index);
+        user_pixel_data = (int8_t *)chan_in_word(c);
+        user_width = chan_in_word(c);
+        if (user_width == width) {
+          memcpy(user_pixel_data, (void *)pixel_data, chans * width);
+        }
+        else {
+          const unsigned len = (width < user_width) ? width : user_width;
+          for (unsigned k = 0; k < chans; k++) {
+            memcpy(&user_pixel_data[k * user_width], &pixel_data[k * width], len);
+          }
+        }
+        chan_out_word(c, row_index);
         break;
     default_handler:
         break;
@@ -121,18 +407,56 @@ void camera_new_row_decimated(
     
 }
 
+void camera_new_row_decimated(
+    const int8_t* pixel_data,
+    const unsigned row_index,
+    const unsigned width)
+{
+  new_row_planar(c_user_api[CHAN_DEC].end_a, pixel_data, row_index, width, CH);
+}
+
+void camera_new_row_rgb(
+    const int8_t* pixel_data,
+    const unsigned row_index,
+    const unsigned width)
+{
+  new_row_planar(c_user_api[CHAN_RGB].end_a, pixel_data, row_index, width, CH);
+}
+
+unsigned camera_capture_row_rgb(
+    int8_t* pixel_data,
+    const unsigned max_width)
+{
+  chan_out_word(c_user_api[CHAN_RGB].end_b, (unsigned) pixel_data);
+  chan_out_word(c_user_api[CHAN_RGB].end_b, max_width);
+  return chan_in_word(c_user_api[CHAN_RGB].end_b); // returns row_index
+}
+
 unsigned camera_capture_row_decimated(
     int8_t pixel_data[CH][W])
 {
-  chan_out_word(c_user_api[CHAN_DEC].end_b, (unsigned) &pixel_data[0][0]);
+  return camera_capture_row_scaled(&pixel_data[0][0], W);
+}
+
+unsigned camera_capture_row_scaled(
+    int8_t* pixel_data,
+    const unsigned max_width)
+{
+  chan_out_word(c_user_api[CHAN_DEC].end_b, (unsigned) pixel_data);
+  chan_out_word(c_user_api[CHAN_DEC].end_b, max_width);
   return chan_in_word(c_user_api[CHAN_DEC].end_b); // returns row_index
 }
 
 static
 void pixelcpy(
   int8_t *image_buff, 
-  int8_t pixel_out)
+  int8_t pixel_out,
+  unsigned chan)
 {
+  if (output_quant) {
+    *image_buff = output_lut[chan][(uint8_t)(pixel_out + 128)];
+    return;
+  }
   #if (APPLY_GAMMA == 1)
     *image_buff = gamma_int8[pixel_out + 127];
   #else
@@ -140,6 +464,59 @@ void pixelcpy(
   #endif
 }
 
+static
+void rowcpy(
+  int8_t *image_buff,
+  const int8_t *pixel_data,
+  const int8_t lut[256],
+  unsigned len)
+{
+  if (!output_quant) {
+    memcpy(image_buff, pixel_data, len);
+    return;
+  }
+  for (unsigned k = 0; k < len; k++) {
+    image_buff[k] = lut[(uint8_t)(pixel_data[k] + 128)];
+  }
+}
+
+void camera_set_output_quant(
+    const float mean[CH],
+    const float std[CH],
+    const float scale[CH],
+    const int32_t zero_point[CH])
+{
+  isp_tensor_quant_t quant;
+  isp_tensor_quant_init(&quant, CH, mean, std, scale, zero_point, 0);
+
+  #if (APPLY_GAMMA == 1)
+    isp_tensor_quant_lut(&quant, gamma_int8, output_lut);
+  #else
+    isp_tensor_quant_lut(&quant, NULL, output_lut);
+  #endif
+  isp_tensor_quant_lut(&quant, NULL, output_lut_linear);
+
+  // Luma is the BT.601 mix of the channels, so it takes the same mix of
+  // their quantisations: a gray pixel quantises to the luma of its colour
+  // quantisations, and equal settings on all channels apply unchanged.
+  static const float weight[CH] = {0.299f, 0.587f, 0.114f};
+  float mul = 0, add = 0;
+  for (unsigned c = 0; c < CH; c++) {
+    mul += weight[c] * quant.mul[c];
+    add += weight[c] * quant.add[c];
+  }
+  quant.channels = 1;
+  quant.mul[0] = (int32_t)(mul + 0.5f);
+  quant.add[0] = (int32_t)((add >= 0) ? add + 0.5f : add - 0.5f);
+  isp_tensor_quant_lut(&quant, NULL, output_lut_gray);
+  output_quant = 1;
+}
+
+void camera_clear_output_quant()
+{
+  output_quant = 0;
+}
+
 unsigned camera_capture_image(
     int8_t image_buff[H][W][CH])
 {
@@ -151,6 +528,10 @@ unsigned camera_capture_image(
     row_index = camera_capture_row_decimated(pixel_data);
     } while (row_index != 0);
 
+    if (!image_size_is_default()) {
+      return 1;
+    }
+
     // Now capture the rest of the rows
     for (unsigned row = 0; row < H; row++) {
       // Ensure captured line is correct
@@ -161,7 +542,7 @@ unsigned camera_capture_image(
       // Loop over all pixels in the row
       for (int col = 0; col < W; col++) {
         for (int chan = 0; chan < CH; chan++) {
-            pixelcpy(&image_buff[row][col][chan], pixel_data[chan][col]);
+            pixelcpy(&image_buff[row][col][chan], pixel_data[chan][col], chan);
         }
       }
 
@@ -185,8 +566,12 @@ unsigned camera_capture_image_transpose(
     row_index = camera_capture_row_decimated(pixel_data);
   } while (row_index != 0);
 
+  if (!image_size_is_default()) {
+    return 1;
+  }
+
   for(int c = 0; c < CH; c++) 
-    memcpy(&image_buff[c][0][0], &pixel_data[c][0], W);
+    rowcpy(&image_buff[c][0][0], &pixel_data[c][0], output_lut_linear[c], W);
 
   // Now capture the rest of the rows
   for (unsigned row = 1; row < H; row++) {
@@ -195,7 +580,7 @@ unsigned camera_capture_image_transpose(
     if (row_index != row){return 1;}
 
     for(int c = 0; c < CH; c++)
-      memcpy(&image_buff[c][row][0], &pixel_data[c][0], W);
+      rowcpy(&image_buff[c][row][0], &pixel_data[c][0], output_lut_linear[c], W);
       
   }
 
@@ -224,8 +609,12 @@ unsigned camera_capture_image_cropped(
     row_index = camera_capture_row_decimated(pixel_data);
   } while (row_index != CROP_ROW);
 
+  if (!image_size_is_default()) {
+    return 1;
+  }
+
   for(int c = 0; c < CH; c++) 
-    memcpy(&image[c][0][0], &pixel_data[c][CROP_COL], CROP_W);
+    rowcpy(&image[c][0][0], &pixel_data[c][CROP_COL], output_lut_linear[c], CROP_W);
 
   // Now capture the rest of the rows
   for (unsigned row = 1; row < CROP_H; row++) {
@@ -235,9 +624,180 @@ unsigned camera_capture_image_cropped(
     if (row_index != row + crop_params.origin.row)  return 1; 
 
     for(int c = 0; c < CH; c++)
-      memcpy(&image[c][row][0], &pixel_data[c][CROP_COL], CROP_W);
+      rowcpy(&image[c][row][0], &pixel_data[c][CROP_COL], output_lut_linear[c], CROP_W);
       
   }
 
   return 0;
 }
+
+
+unsigned camera_capture_image_scaled(
+    int8_t* image_buff,
+    const size_t buff_size,
+    unsigned* width,
+    unsigned* height)
+{
+  unsigned row_index;
+
+  __attribute__((aligned(4)))
+  int8_t pixel_data[CH][APP_MAX_IMAGE_WIDTH_PIXELS];
+
+  // Loop, capturing rows until we get one with row_index==0
+  do {
+    row_index = camera_capture_row_scaled(&pixel_data[0][0], APP_MAX_IMAGE_WIDTH_PIXELS);
+  } while (row_index != 0);
+
+  // The size of this frame was set before its first row
+  const unsigned img_w = frame_width;
+  const unsigned img_h = frame_height;
+  *width = img_w;
+  *height = img_h;
+  if ((size_t)CH * img_w * img_h > buff_size) {
+    return 1;
+  }
+
+  int8_t (*image)[img_h][img_w] = (int8_t (*)[img_h][img_w]) image_buff;
+
+  for(int c = 0; c < CH; c++)
+    rowcpy(&image[c][0][0], &pixel_data[c][0], output_lut_linear[c], img_w);
+
+  // Now capture the rest of the rows
+  for (unsigned row = 1; row < img_h; row++) {
+    row_index = camera_capture_row_scaled(&pixel_data[0][0], APP_MAX_IMAGE_WIDTH_PIXELS);
+
+    if (row_index != row){return 1;}
+
+    for(int c = 0; c < CH; c++)
+      rowcpy(&image[c][row][0], &pixel_data[c][0], output_lut_linear[c], img_w);
+  }
+
+  return 0;
+}
+
+
+// -------------- Pyramid --------------
+
+unsigned camera_capture_pyramid(
+    int8_t* levels[APP_PYRAMID_LEVELS])
+{
+  for (unsigned k = 0; k < APP_PYRAMID_LEVELS; k++) {
+    xassert(((uintptr_t)levels[k] & 0x3) == 0);
+    chan_out_word(c_user_api[CHAN_PYR].end_b, (unsigned)levels[k]);
+  }
+  return chan_in_word(c_user_api[CHAN_PYR].end_b);
+}
+
+unsigned camera_check_pyramid(
+    int8_t* levels[APP_PYRAMID_LEVELS])
+{
+  SELECT_RES(
+      CASE_THEN(c_user_api[CHAN_PYR].end_a, user_handler),
+      DEFAULT_THEN(default_handler))
+    {
+      user_handler:
+        for (unsigned k = 0; k < APP_PYRAMID_LEVELS; k++) {
+          levels[k] = (int8_t*)chan_in_word(c_user_api[CHAN_PYR].end_a);
+        }
+        return 1;
+      default_handler:
+        return 0;
+    }
+}
+
+void camera_pyramid_done(
+    const unsigned status)
+{
+  chan_out_word(c_user_api[CHAN_PYR].end_a, status);
+}
+
+
+// -------------- YUV --------------
+
+unsigned camera_capture_image_yuv(
+    uint8_t* image,
+    const unsigned image_bytes,
+    const yuv_format_t format)
+{
+  xassert(((uintptr_t)image & 0x3) == 0);
+  if (APP_YUV_ENABLED == 0 || (format != YUV_FORMAT_422 && format != YUV_FORMAT_NV12)) {
+    return 1;
+  }
+  chan_out_word(c_user_api[CHAN_YUV].end_b, (unsigned)image);
+  chan_out_word(c_user_api[CHAN_YUV].end_b, image_bytes);
+  chan_out_word(c_user_api[CHAN_YUV].end_b, (unsigned)format);
+  return chan_in_word(c_user_api[CHAN_YUV].end_b);
+}
+
+unsigned camera_check_yuv(
+    uint8_t** image,
+    unsigned* image_bytes,
+    yuv_format_t* format)
+{
+  SELECT_RES(
+      CASE_THEN(c_user_api[CHAN_YUV].end_a, user_handler),
+      DEFAULT_THEN(default_handler))
+    {
+      user_handler:
+        *image = (uint8_t*)chan_in_word(c_user_api[CHAN_YUV].end_a);
+        *image_bytes = chan_in_word(c_user_api[CHAN_YUV].end_a);
+        *format = (yuv_format_t)chan_in_word(c_user_api[CHAN_YUV].end_a);
+        return 1;
+      default_handler:
+        return 0;
+    }
+}
+
+void camera_yuv_done(
+    const unsigned status)
+{
+  chan_out_word(c_user_api[CHAN_YUV].end_a, status);
+}
+
+
+// -------------- Gray --------------
+
+void camera_new_row_gray(
+    const int8_t* pixel_data,
+    const unsigned row_index,
+    const unsigned width)
+{
+  new_row_planar(c_user_api[CHAN_GRAY].end_a, pixel_data, row_index, width, 1);
+}
+
+unsigned camera_capture_row_gray(
+    int8_t* pixel_data,
+    const unsigned max_width)
+{
+  chan_out_word(c_user_api[CHAN_GRAY].end_b, (unsigned) pixel_data);
+  chan_out_word(c_user_api[CHAN_GRAY].end_b, max_width);
+  return chan_in_word(c_user_api[CHAN_GRAY].end_b); // returns row_index
+}
+
+unsigned camera_capture_image_gray(
+    int8_t image[H][W])
+{
+  unsigned row_index;
+  int8_t pixel_data[W];
+
+  // Loop, capturing rows until we get one with row_index==0
+  do {
+    row_index = camera_capture_row_gray(pixel_data, W);
+  } while (row_index != 0);
+
+  if (!image_size_is_default()) {
+    return 1;
+  }
+
+  rowcpy(&image[0][0], pixel_data, output_lut_gray[0], W);
+
+  // Now capture the rest of the rows
+  for (unsigned row = 1; row < H; row++) {
+    row_index = camera_capture_row_gray(pixel_data, W);
+    if (row_index != row) {
+      return 1;
+    }
+    rowcpy(&image[row][0], pixel_data, output_lut_gray[0], W);
+  }
+  return 0;
+}
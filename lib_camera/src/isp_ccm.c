@@ -0,0 +1,93 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <xcore/assert.h>
+
+#include "isp_ccm.h"
+#include "isp_demosaic.h" // pixel_demosaic_macc()
+
+// Constant row of the bias tap
+__attribute__((aligned(4)))
+static const int8_t ccm_bias_row[APP_MAX_IMAGE_WIDTH_PIXELS] = {
+  [0 ... APP_MAX_IMAGE_WIDTH_PIXELS - 1] = CCM_BIAS
+};
+
+// Round to nearest, -1 if it doesn't fit an int8
+static
+int ccm_quantise(
+    const float value,
+    int8_t* q)
+{
+  const float scaled = value * (1 << CCM_SHIFT);
+  if (scaled >= 127.5f || scaled < -128.5f) {
+    return -1;
+  }
+  *q = (int8_t)((scaled >= 0) ? (scaled + 0.5f) : (scaled - 0.5f));
+  return 0;
+}
+
+
+int isp_ccm_init(
+    isp_ccm_t* ccm,
+    const float matrix[APP_IMAGE_CHANNEL_COUNT][APP_IMAGE_CHANNEL_COUNT])
+{
+  memset(ccm, 0, sizeof(isp_ccm_t));
+  if (matrix == NULL) {
+    return 0;
+  }
+
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    int32_t row_sum = 0;
+    for (unsigned j = 0; j < APP_IMAGE_CHANNEL_COUNT; j++) {
+      int8_t q;
+      if (ccm_quantise(matrix[c][j], &q)) {
+        return -1;
+      }
+      memset(ccm->coef[c][j], q, 16);
+      row_sum += q;
+    }
+    // With int8 pixels p = u - 128, out = M * (p + 128) - 128 adds
+    // 128 * (row_sum - 1) to every output, which the bias row carries
+    const int32_t bias = 128 * (row_sum - (1 << CCM_SHIFT)) / CCM_BIAS;
+    if (bias > INT8_MAX || bias < INT8_MIN) {
+      return -1;
+    }
+    memset(ccm->coef[c][APP_IMAGE_CHANNEL_COUNT], (int8_t)bias, 16);
+  }
+
+  for (unsigned k = 0; k < 16; k++) {
+    ccm->shifts[k] = CCM_SHIFT;
+  }
+  ccm->enabled = 1;
+  return 0;
+}
+
+
+void isp_ccm_apply(
+    int8_t output[],
+    const int8_t input[],
+    const isp_ccm_t* ccm,
+    const unsigned width)
+{
+  xassert(ccm->enabled);
+  xassert((width % 16) == 0 && width <= APP_MAX_IMAGE_WIDTH_PIXELS);
+  xassert(output != input);
+  xassert((((uintptr_t)output | (uintptr_t)input) & 0x3) == 0);
+
+  demosaic_tap_t taps[CCM_TAPS];
+  taps[APP_IMAGE_CHANNEL_COUNT].pix = ccm_bias_row;
+
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    for (unsigned t = 0; t < CCM_TAPS; t++) {
+      if (t < APP_IMAGE_CHANNEL_COUNT) {
+        taps[t].pix = &input[t * width];
+      }
+      taps[t].coef = &ccm->coef[c][t][0];
+    }
+    pixel_demosaic_macc(&output[c * width], taps, CCM_TAPS, ccm->shifts, width);
+  }
+}
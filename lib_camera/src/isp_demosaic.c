@@ -0,0 +1,252 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <xcore/assert.h>
+
+#include "isp_demosaic.h"
+
+// Kernels, [dy + 2][dx + 2], each sums to 1 << DEMOSAIC_SHIFT
+enum {
+  K_IDENTITY = 0,
+  K_HORIZONTAL,   // colour of the left and right neighbours, at a green pixel
+  K_VERTICAL,     // colour of the top and bottom neighbours, at a green pixel
+  K_CROSS,        // green at a red or blue pixel
+  K_DIAGONAL,     // red at a blue pixel, blue at a red pixel
+  K_COUNT
+};
+
+static
+const int8_t demosaic_kernels[2][K_COUNT][5][5] = {
+  { // DEMOSAIC_BILINEAR
+    {{0, 0,  0, 0, 0}, {0, 0,  0, 0, 0}, {0, 0, 16, 0, 0}, {0, 0,  0, 0, 0}, {0, 0,  0, 0, 0}},
+    {{0, 0,  0, 0, 0}, {0, 0,  0, 0, 0}, {0, 8,  0, 8, 0}, {0, 0,  0, 0, 0}, {0, 0,  0, 0, 0}},
+    {{0, 0,  0, 0, 0}, {0, 0,  8, 0, 0}, {0, 0,  0, 0, 0}, {0, 0,  8, 0, 0}, {0, 0,  0, 0, 0}},
+    {{0, 0,  0, 0, 0}, {0, 0,  4, 0, 0}, {0, 4,  0, 4, 0}, {0, 0,  4, 0, 0}, {0, 0,  0, 0, 0}},
+    {{0, 0,  0, 0, 0}, {0, 4,  0, 4, 0}, {0, 0,  0, 0, 0}, {0, 4,  0, 4, 0}, {0, 0,  0, 0, 0}},
+  },
+  { // DEMOSAIC_GRADIENT, the bilinear estimate corrected by the laplacian of
+    // the pixel's own colour
+    {{ 0,  0,  0,  0,  0}, { 0,  0,  0,  0,  0}, { 0,  0, 16,  0,  0}, { 0,  0,  0,  0,  0}, { 0,  0,  0,  0,  0}},
+    {{ 0,  0,  1,  0,  0}, { 0, -2,  0, -2,  0}, {-2,  8, 10,  8, -2}, { 0, -2,  0, -2,  0}, { 0,  0,  1,  0,  0}},
+    {{ 0,  0, -2,  0,  0}, { 0, -2,  8, -2,  0}, { 1,  0, 10,  0,  1}, { 0, -2,  8, -2,  0}, { 0,  0, -2,  0,  0}},
+    {{ 0,  0, -2,  0,  0}, { 0,  0,  4,  0,  0}, {-2,  4,  8,  4, -2}, { 0,  0,  4,  0,  0}, { 0,  0, -2,  0,  0}},
+    {{ 0,  0, -3,  0,  0}, { 0,  4,  0,  4,  0}, {-3,  0, 12,  0, -3}, { 0,  4,  0,  4,  0}, { 0,  0, -3,  0,  0}},
+  },
+};
+
+// Kernel of each [row parity][channel][column parity], RGGB
+static
+const uint8_t demosaic_kernel_map[2][APP_IMAGE_CHANNEL_COUNT][2] = {
+  { // R G
+    {K_IDENTITY, K_HORIZONTAL},
+    {K_CROSS,    K_IDENTITY},
+    {K_DIAGONAL, K_VERTICAL},
+  },
+  { // G B
+    {K_VERTICAL, K_DIAGONAL},
+    {K_IDENTITY, K_CROSS},
+    {K_HORIZONTAL, K_IDENTITY},
+  },
+};
+
+// Raw row `row` of the frame, mirrored at the top and bottom edges
+static inline
+unsigned demosaic_mirror_row(
+    const demosaic_state_t* state,
+    const int row)
+{
+  if (row < 0) {
+    return -row;
+  }
+  if (row >= (int)state->rows_in) {
+    return 2 * (state->rows_in - 1) - row;
+  }
+  return row;
+}
+
+static inline
+int8_t* demosaic_line(
+    const demosaic_state_t* state,
+    const unsigned row)
+{
+  return &state->lines[(row % DEMOSAIC_ROWS) * state->width];
+}
+
+// dst[i] = src[x0 + i + dx] for `len` pixels, mirrored at the left and right
+// edges
+static
+void demosaic_shift_copy(
+    int8_t* dst,
+    const int8_t* src,
+    const unsigned x0,
+    const unsigned len,
+    const int dx,
+    const unsigned width)
+{
+  const int w = (int)width;
+  int x = (int)x0 + dx;
+  unsigned i = 0;
+  for (; i < len && x < 0; i++, x++) {
+    dst[i] = src[-x];
+  }
+  const unsigned inside = (len - i < (unsigned)(w - x)) ? len - i : (unsigned)(w - x);
+  memcpy(&dst[i], &src[x], inside);
+  i += inside;
+  x += inside;
+  for (; i < len; i++, x++) {
+    dst[i] = src[2 * (w - 1) - x];
+  }
+}
+
+// Output row `row`, all of its input rows are in the line buffer
+static
+void demosaic_row(
+    demosaic_state_t* state,
+    int8_t output[],
+    const unsigned row)
+{
+  const unsigned p = row & 1;
+  const unsigned width = state->width;
+  int8_t* shifted = &state->lines[DEMOSAIC_ROWS * width];
+  const int8_t* src[5];
+  demosaic_tap_t taps[DEMOSAIC_TAP_MAX];
+
+  for (int dy = -2; dy <= 2; dy++) {
+    src[dy + 2] = demosaic_line(state, demosaic_mirror_row(state, (int)row + dy));
+  }
+
+  for (unsigned x0 = 0; x0 < width; x0 += DEMOSAIC_CHUNK) {
+    const unsigned len = (width - x0 < DEMOSAIC_CHUNK) ? width - x0 : DEMOSAIC_CHUNK;
+
+    for (unsigned s = 0; s < state->shifted_count[p]; s++) {
+      demosaic_shift_copy(&shifted[s * DEMOSAIC_CHUNK], src[state->shifted_dy[p][s] + 2],
+                          x0, len, state->shifted_dx[p][s], width);
+    }
+
+    for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+      const unsigned tap_count = state->tap_count[p][c];
+      for (unsigned t = 0; t < tap_count; t++) {
+        const int s = state->tap_shifted[p][c][t];
+        taps[t].pix = (s < 0) ? &src[state->tap_dy[p][c][t] + 2][x0]
+                              : &shifted[s * DEMOSAIC_CHUNK];
+        taps[t].coef = &state->tap_coef[p][c][t][0];
+      }
+      pixel_demosaic_macc(&output[c * width + x0], taps, tap_count,
+                          state->shifts, len);
+    }
+  }
+}
+
+
+// The shifted copy of (dy, dx) for row parity p, added if it's new
+static
+int demosaic_shifted_slot(
+    demosaic_state_t* state,
+    const unsigned p,
+    const int dy,
+    const int dx)
+{
+  unsigned s = 0;
+  for (; s < state->shifted_count[p]; s++) {
+    if (state->shifted_dy[p][s] == dy && state->shifted_dx[p][s] == dx) {
+      return s;
+    }
+  }
+  xassert(s < DEMOSAIC_SHIFTED);
+  state->shifted_dy[p][s] = dy;
+  state->shifted_dx[p][s] = dx;
+  state->shifted_count[p]++;
+  return s;
+}
+
+
+void isp_demosaic_init(
+    demosaic_state_t* state,
+    const demosaic_mode_t mode,
+    const unsigned width,
+    int8_t* lines)
+{
+  xassert((mode == DEMOSAIC_BILINEAR || mode == DEMOSAIC_GRADIENT) && "Unknown demosaic mode");
+  xassert((width % 16) == 0 && width >= 16);
+  xassert(((uintptr_t)lines & 0x3) == 0);
+
+  state->mode = mode;
+  state->width = width;
+  state->rows_in = 0;
+  state->rows_out = 0;
+  state->radius = (mode == DEMOSAIC_GRADIENT) ? 2 : 1;
+  state->lines = lines;
+
+  const int8_t (*kernels)[5][5] = demosaic_kernels[mode - DEMOSAIC_BILINEAR];
+
+  // A tap for every position where the kernel of either column parity is used,
+  // and a shifted copy for every (dy, dx) off the pixel column
+  for (unsigned p = 0; p < 2; p++) {
+    state->shifted_count[p] = 0;
+    for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+      const int8_t (*k_even)[5] = kernels[demosaic_kernel_map[p][c][0]];
+      const int8_t (*k_odd)[5] = kernels[demosaic_kernel_map[p][c][1]];
+      unsigned n = 0;
+      for (int dy = -2; dy <= 2; dy++) {
+        for (int dx = -2; dx <= 2; dx++) {
+          const int8_t even = k_even[dy + 2][dx + 2];
+          const int8_t odd = k_odd[dy + 2][dx + 2];
+          if (even == 0 && odd == 0) continue;
+          xassert(n < DEMOSAIC_TAP_MAX);
+          state->tap_dy[p][c][n] = dy;
+          state->tap_shifted[p][c][n] = (dx == 0) ? -1 : demosaic_shifted_slot(state, p, dy, dx);
+          for (unsigned k = 0; k < 16; k += 2) {
+            state->tap_coef[p][c][n][k] = even;
+            state->tap_coef[p][c][n][k + 1] = odd;
+          }
+          n++;
+        }
+      }
+      state->tap_count[p][c] = n;
+    }
+  }
+
+  for (unsigned k = 0; k < 16; k++) {
+    state->shifts[k] = DEMOSAIC_SHIFT;
+  }
+}
+
+
+unsigned isp_demosaic_push_row(
+    demosaic_state_t* state,
+    int8_t output[],
+    const int8_t raw[],
+    unsigned* row_index)
+{
+  const unsigned row = state->rows_in;
+  memcpy(demosaic_line(state, row), raw, state->width);
+  state->rows_in++;
+
+  // The row `radius` rows up has all of its input rows now
+  if (row < state->radius) {
+    return 0;
+  }
+  *row_index = state->rows_out;
+  demosaic_row(state, output, state->rows_out);
+  state->rows_out++;
+  return 1;
+}
+
+
+unsigned isp_demosaic_drain(
+    demosaic_state_t* state,
+    int8_t output[],
+    unsigned* row_index)
+{
+  // The rows below the last one are mirrored from the line buffer
+  if (state->rows_out >= state->rows_in || state->rows_in <= state->radius) {
+    return 0;
+  }
+  *row_index = state->rows_out;
+  demosaic_row(state, output, state->rows_out);
+  state->rows_out++;
+  return 1;
+}
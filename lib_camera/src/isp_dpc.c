@@ -0,0 +1,135 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <xcore/assert.h>
+
+#include "isp_dpc.h"
+
+// left[k] = input[k - 2] for k in [0, width + 4), from aligned words. Reads
+// the words before and after the row.
+static
+void dpc_shift_left(
+    int8_t* left,
+    const int8_t* input,
+    const unsigned width)
+{
+  const uint32_t* in = (const uint32_t*)input;
+  uint32_t* out = (uint32_t*)left;
+  uint32_t prev = in[-1];
+  for (unsigned i = 0; i <= width / 4; i++) {
+    const uint32_t word = in[i];
+    out[i] = (prev >> 16) | (word << 16);
+    prev = word;
+  }
+}
+
+static inline
+int8_t dpc_mean(
+    const int8_t* input,
+    const unsigned width,
+    const unsigned x)
+{
+  if (x < 2) {
+    return input[x + 2];
+  }
+  if (x + 2 >= width) {
+    return input[x - 2];
+  }
+  return (input[x - 2] + input[x + 2] + 1) >> 1;
+}
+
+
+int isp_dpc_defect_list_init(
+    dpc_defect_list_t* list,
+    const dpc_defect_t defects[],
+    const unsigned defect_count)
+{
+  if (defects == NULL && defect_count != 0) {
+    return -1;
+  }
+  for (unsigned k = 1; k < defect_count; k++) {
+    const unsigned ordered = (defects[k].y > defects[k - 1].y)
+        || (defects[k].y == defects[k - 1].y && defects[k].x > defects[k - 1].x);
+    if (!ordered) {
+      return -1;
+    }
+  }
+  list->defects = defects;
+  list->count = defect_count;
+  return 0;
+}
+
+
+void isp_dpc_init(
+    dpc_state_t* state,
+    const unsigned threshold,
+    int8_t* left)
+{
+  xassert(((uintptr_t)left & 0x3) == 0);
+
+  state->list.defects = NULL;
+  state->list.count = 0;
+  state->next = 0;
+  state->left = left;
+  isp_dpc_set_threshold(state, threshold);
+}
+
+
+void isp_dpc_set_threshold(
+    dpc_state_t* state,
+    const unsigned threshold)
+{
+  xassert(threshold <= INT8_MAX);
+  state->threshold = threshold;
+  memset(state->threshold_half, threshold >> 1, sizeof(state->threshold_half));
+}
+
+
+void isp_dpc_frame_start(
+    dpc_state_t* state)
+{
+  state->next = 0;
+}
+
+
+void isp_dpc_row(
+    dpc_state_t* state,
+    int8_t output[],
+    const int8_t input[],
+    const unsigned width,
+    const unsigned y)
+{
+  xassert((width % 16) == 0 && width >= 16);
+  xassert((((uintptr_t)output | (uintptr_t)input) & 0x3) == 0);
+
+  if (state->threshold != 0) {
+    dpc_shift_left(state->left, input, width);
+    pixel_dpc(output, input, state->left, state->threshold_half, width);
+    // Single neighbour at the ends
+    output[0] = input[0];
+    output[1] = input[1];
+    output[width - 2] = input[width - 2];
+    output[width - 1] = input[width - 1];
+  }
+  else {
+    memcpy(output, input, width);
+  }
+
+  // Skip the defects of rows that didn't come, then correct this row's
+  const dpc_defect_t* defects = state->list.defects;
+  const unsigned count = state->list.count;
+  while (state->next < count && defects[state->next].y < y) {
+    state->next++;
+  }
+  while (state->next < count && defects[state->next].y == y) {
+    const unsigned x = defects[state->next].x;
+    if (x < width) {
+      output[x] = dpc_mean(input, width, x);
+    }
+    state->next++;
+  }
+}
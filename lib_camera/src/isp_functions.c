@@ -22,19 +22,16 @@ void isp_crop(
   xu2 = (xu2 >= in_width) ? in_width - 1 : xu2;
 
   unsigned out_width = xu2 - xu1;
+  unsigned out_height = yu2 - yu1;
   xassert(out_width <= in_width);
-  xassert((yu2 - yu1) <= in_height);
-  unsigned in_row_len = in_width * 3;
-
-  unsigned out_index = 0;
-  unsigned in_index = yu1 * in_row_len + xu1 * 3;
-  unsigned out_row_len = out_width * 3;
-
-  for (unsigned i = yu1; i < yu2; i++) {
-    memmove(&img[out_index], &img[in_index], out_row_len);
-    in_index += in_row_len;
-    out_index += out_row_len;
-  }
+  xassert(out_height <= in_height);
+
+  // compact the cropped view to the start of the buffer
+  isp_image_t src, view, dst;
+  isp_image_init(&src, img, in_width, in_height, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+  isp_image_crop(&src, &view, xu1, yu1, out_width, out_height);
+  isp_image_init(&dst, img, out_width, out_height, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+  isp_image_copy(&view, &dst);
 }
 
 void isp_crop_int8(
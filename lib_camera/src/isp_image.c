@@ -0,0 +1,629 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <xcore/assert.h>
+
+#include "isp_functions.h"
+
+#define WEIGHT_BITS   ISP_RESIZE_WEIGHT_BITS
+#define WEIGHT_ONE    (1 << WEIGHT_BITS)
+
+// Bias that maps uint8 pixels to int8 (v ^ 0x80 == v - 128) and back
+#define UINT8_BIAS    0x80
+
+static inline
+unsigned pix_offset(
+  const isp_image_t* img,
+  const unsigned x,
+  const unsigned y,
+  const unsigned c)
+{
+  return y * img->row_stride + x * img->col_stride + c * img->chan_stride;
+}
+
+static inline
+int32_t pix_get(
+  const isp_image_t* img,
+  const unsigned x,
+  const unsigned y,
+  const unsigned c,
+  const uint8_t bias)
+{
+  return (int8_t)(((const int8_t*)img->data)[pix_offset(img, x, y, c)] ^ bias);
+}
+
+static inline
+void pix_set(
+  const isp_image_t* img,
+  const unsigned x,
+  const unsigned y,
+  const unsigned c,
+  const int32_t val,
+  const uint8_t bias)
+{
+  ((int8_t*)img->data)[pix_offset(img, x, y, c)] = (int8_t)val ^ bias;
+}
+
+// Rows of pixels are contiguous bytes
+static inline
+unsigned rows_contiguous(
+  const isp_image_t* img)
+{
+  return img->layout == ISP_LAYOUT_HWC
+      && img->chan_stride == 1
+      && img->col_stride == img->channels;
+}
+
+// No padding at all, the layout isp_resize_mode_*() expects
+static inline
+unsigned is_compact_hwc(
+  const isp_image_t* img)
+{
+  return rows_contiguous(img) && img->row_stride == img->width * img->channels;
+}
+
+void isp_image_init(
+  isp_image_t* img,
+  void* data,
+  const unsigned width,
+  const unsigned height,
+  const unsigned channels,
+  const isp_layout_t layout,
+  const isp_type_t type)
+{
+  xassert(channels > 0);
+  img->data = data;
+  img->width = width;
+  img->height = height;
+  img->channels = channels;
+  img->layout = layout;
+  img->type = type;
+  if (layout == ISP_LAYOUT_HWC) {
+    img->row_stride = width * channels;
+    img->col_stride = channels;
+    img->chan_stride = 1;
+  }
+  else {
+    img->row_stride = width;
+    img->col_stride = 1;
+    img->chan_stride = width * height;
+  }
+}
+
+void isp_image_crop(
+  const isp_image_t* img,
+  isp_image_t* view,
+  const unsigned x,
+  const unsigned y,
+  const unsigned width,
+  const unsigned height)
+{
+  xassert(x + width <= img->width);
+  xassert(y + height <= img->height);
+  *view = *img;
+  view->data = (int8_t*)img->data + pix_offset(img, x, y, 0);
+  view->width = width;
+  view->height = height;
+}
+
+void isp_image_copy(
+  const isp_image_t* src,
+  const isp_image_t* dst)
+{
+  xassert(src->width == dst->width && src->height == dst->height);
+  xassert(src->channels == dst->channels && src->type == dst->type);
+
+  if (rows_contiguous(src) && rows_contiguous(dst)) {
+    const unsigned row_len = src->width * src->channels;
+    for (unsigned y = 0; y < src->height; y++) {
+      memmove((int8_t*)dst->data + y * dst->row_stride,
+              (const int8_t*)src->data + y * src->row_stride, row_len);
+    }
+    return;
+  }
+
+  // planar rows are contiguous per channel
+  if (src->layout == ISP_LAYOUT_CHW && dst->layout == ISP_LAYOUT_CHW
+      && src->col_stride == 1 && dst->col_stride == 1) {
+    for (unsigned c = 0; c < src->channels; c++) {
+      for (unsigned y = 0; y < src->height; y++) {
+        memmove((int8_t*)dst->data + pix_offset(dst, 0, y, c),
+                (const int8_t*)src->data + pix_offset(src, 0, y, c), src->width);
+      }
+    }
+    return;
+  }
+
+  for (unsigned y = 0; y < src->height; y++) {
+    for (unsigned x = 0; x < src->width; x++) {
+      for (unsigned c = 0; c < src->channels; c++) {
+        pix_set(dst, x, y, c, pix_get(src, x, y, c, 0), 0);
+      }
+    }
+  }
+}
+
+// ----------------------------- Strided resize -----------------------------
+
+static
+void resize_strided_nearest(
+  const isp_image_t* src,
+  const isp_image_t* dst)
+{
+  for (unsigned i = 0; i < dst->height; i++) {
+    const unsigned y = ((2 * i + 1) * src->height) / (2 * dst->height);
+    for (unsigned j = 0; j < dst->width; j++) {
+      const unsigned x = ((2 * j + 1) * src->width) / (2 * dst->width);
+      for (unsigned c = 0; c < dst->channels; c++) {
+        pix_set(dst, j, i, c, pix_get(src, x, y, c, 0), 0);
+      }
+    }
+  }
+}
+
+static
+void resize_strided_area(
+  const isp_image_t* src,
+  const isp_image_t* dst,
+  const uint8_t bias)
+{
+  for (unsigned i = 0; i < dst->height; i++) {
+    const unsigned y0 = (i * src->height) / dst->height;
+    unsigned y1 = ((i + 1) * src->height) / dst->height;
+    y1 = (y1 > y0) ? y1 : y0 + 1;
+
+    for (unsigned j = 0; j < dst->width; j++) {
+      const unsigned x0 = (j * src->width) / dst->width;
+      unsigned x1 = ((j + 1) * src->width) / dst->width;
+      x1 = (x1 > x0) ? x1 : x0 + 1;
+      const int32_t n = (y1 - y0) * (x1 - x0);
+
+      for (unsigned c = 0; c < dst->channels; c++) {
+        int32_t sum = 0;
+        for (unsigned y = y0; y < y1; y++) {
+          for (unsigned x = x0; x < x1; x++) {
+            sum += pix_get(src, x, y, c, bias);
+          }
+        }
+        sum = (sum >= 0) ? (sum + n / 2) / n : -((-sum + n / 2) / n);
+        pix_set(dst, j, i, c, sum, bias);
+      }
+    }
+  }
+}
+
+// Corner aligned, Q7 weights as isp_resize_plan_*()
+static
+void resize_strided_bilinear(
+  const isp_image_t* src,
+  const isp_image_t* dst,
+  const uint8_t bias)
+{
+  xassert(src->width >= 2 && src->height >= 2);
+  xassert(dst->width >= 2 && dst->height >= 2);
+
+  for (unsigned i = 0; i < dst->height; i++) {
+    const unsigned py = ((i * (src->height - 1)) << WEIGHT_BITS) / (dst->height - 1);
+    const unsigned y_lo = py >> WEIGHT_BITS;
+    const int32_t wy = py & (WEIGHT_ONE - 1);
+    const unsigned y_hi = wy ? y_lo + 1 : y_lo;
+
+    for (unsigned j = 0; j < dst->width; j++) {
+      const unsigned px = ((j * (src->width - 1)) << WEIGHT_BITS) / (dst->width - 1);
+      const unsigned x_lo = px >> WEIGHT_BITS;
+      const int32_t wx = px & (WEIGHT_ONE - 1);
+      const unsigned x_hi = wx ? x_lo + 1 : x_lo;
+
+      for (unsigned c = 0; c < dst->channels; c++) {
+        const int32_t top = pix_get(src, x_lo, y_lo, c, bias) * (WEIGHT_ONE - wx)
+                          + pix_get(src, x_hi, y_lo, c, bias) * wx;
+        const int32_t bot = pix_get(src, x_lo, y_hi, c, bias) * (WEIGHT_ONE - wx)
+                          + pix_get(src, x_hi, y_hi, c, bias) * wx;
+        const int32_t val = (top * (WEIGHT_ONE - wy) + bot * wy
+                          + (1 << (2 * WEIGHT_BITS - 1))) >> (2 * WEIGHT_BITS);
+        pix_set(dst, j, i, c, val, bias);
+      }
+    }
+  }
+}
+
+void isp_resize_image(
+  const isp_image_t* src,
+  const isp_image_t* dst,
+  const isp_resize_mode_t mode)
+{
+  xassert(src->channels == dst->channels && src->type == dst->type);
+  const unsigned is_uint8 = (src->type == ISP_TYPE_UINT8);
+
+  // Bilinear always takes the Q7 strided path, so a view and its compacted
+  // copy give the same pixels. The compact nearest and area paths already
+  // match the strided ones.
+  if (mode != ISP_RESIZE_BILINEAR
+      && src->channels == 3 && is_compact_hwc(src) && is_compact_hwc(dst)) {
+    if (is_uint8) {
+      isp_resize_mode_uint8(src->data, src->width, src->height,
+                            dst->data, dst->width, dst->height, mode);
+    }
+    else {
+      isp_resize_mode_int8(src->data, src->width, src->height,
+                           dst->data, dst->width, dst->height, mode);
+    }
+    return;
+  }
+
+  const uint8_t bias = is_uint8 ? UINT8_BIAS : 0;
+  switch (mode) {
+    case ISP_RESIZE_BILINEAR:
+      resize_strided_bilinear(src, dst, bias);
+      break;
+    case ISP_RESIZE_NEAREST:
+      resize_strided_nearest(src, dst);
+      break;
+    case ISP_RESIZE_AREA:
+      resize_strided_area(src, dst, bias);
+      break;
+    default:
+      xassert(0 && "Unknown resize mode");
+      break;
+  }
+}
+
+// ----------------------------- Crop and resize -----------------------------
+
+// Source rows and weight of output row i of a region, as in
+// resize_strided_bilinear()
+static inline
+void roi_rows(
+  const isp_roi_t* roi,
+  const isp_image_t* dst,
+  const unsigned i,
+  unsigned* y_lo,
+  unsigned* y_hi,
+  int32_t* wy)
+{
+  const unsigned py = ((i * (roi->height - 1)) << WEIGHT_BITS) / (dst->height - 1);
+  *y_lo = roi->y + (py >> WEIGHT_BITS);
+  *wy = py & (WEIGHT_ONE - 1);
+  *y_hi = *wy ? *y_lo + 1 : *y_lo;
+}
+
+// Source row y of a region interpolated to the output columns, in Q7.
+// Pixels are pixel - 128 for uint8 sources.
+static
+void crop_resize_hrow(
+  const isp_image_t* src,
+  const isp_roi_t* roi,
+  const isp_image_t* dst,
+  const unsigned y,
+  const uint8_t bias,
+  int16_t hrow[])
+{
+  const int8_t* row = (const int8_t*)src->data + y * src->row_stride;
+
+  // exact steps of (j * (width - 1) << WEIGHT_BITS) / (out_width - 1)
+  const unsigned den = dst->width - 1;
+  const unsigned num = (roi->width - 1) << WEIGHT_BITS;
+  const unsigned q_step = num / den;
+  const unsigned r_step = num % den;
+  unsigned px = 0, rem = 0;
+
+  for (unsigned j = 0; j < dst->width; j++) {
+    const unsigned x_lo = roi->x + (px >> WEIGHT_BITS);
+    const int32_t wx = px & (WEIGHT_ONE - 1);
+    const unsigned x_hi = wx ? x_lo + 1 : x_lo;
+    const unsigned off_lo = x_lo * src->col_stride;
+    const unsigned off_hi = x_hi * src->col_stride;
+
+    for (unsigned c = 0; c < dst->channels; c++) {
+      const unsigned off_c = c * src->chan_stride;
+      const int32_t a = (int8_t)(row[off_lo + off_c] ^ bias);
+      const int32_t b = (int8_t)(row[off_hi + off_c] ^ bias);
+      *hrow++ = a * (WEIGHT_ONE - wx) + b * wx;
+    }
+
+    px += q_step;
+    rem += r_step;
+    if (rem >= den) {
+      rem -= den;
+      px++;
+    }
+  }
+}
+
+// Output row i of a region from its two interpolated source rows. Without
+// `quant` pixels are written in the source type, with it they are quantised
+// (`add` offset for int8 pixels).
+static
+void crop_resize_vrow(
+  const isp_image_t* dst,
+  const unsigned i,
+  const int16_t top[],
+  const int16_t bot[],
+  const int32_t wy,
+  const uint8_t bias,
+  const isp_tensor_quant_t* quant)
+{
+  int8_t* out = (int8_t*)dst->data + i * dst->row_stride;
+
+  for (unsigned j = 0; j < dst->width; j++) {
+    for (unsigned c = 0; c < dst->channels; c++) {
+      const int32_t val = (top[c] * (WEIGHT_ONE - wy) + bot[c] * wy
+                        + (1 << (2 * WEIGHT_BITS - 1))) >> (2 * WEIGHT_BITS);
+      int8_t* pix = &out[j * dst->col_stride + c * dst->chan_stride];
+      if (quant == NULL) {
+        *pix = (int8_t)val ^ bias;
+      }
+      else {
+        int32_t q = (val * quant->mul[c] + quant->add[c]) >> ISP_TENSOR_QUANT_BITS;
+        q = (q > INT8_MAX) ? INT8_MAX : q;
+        q = (q < INT8_MIN) ? INT8_MIN : q;
+        *pix = (int8_t)q;
+      }
+    }
+    top += dst->channels;
+    bot += dst->channels;
+  }
+}
+
+// Output row i of a region
+static
+void crop_resize_row(
+  const isp_image_t* src,
+  const isp_roi_t* roi,
+  const isp_image_t* dst,
+  const unsigned i,
+  const uint8_t bias,
+  const isp_tensor_quant_t* quant)
+{
+  xassert(dst->width * dst->channels <= ISP_RESIZE_ROW_MAX_BYTES);
+  int16_t hrows[2][ISP_RESIZE_ROW_MAX_BYTES];
+
+  unsigned y_lo, y_hi;
+  int32_t wy;
+  roi_rows(roi, dst, i, &y_lo, &y_hi, &wy);
+
+  crop_resize_hrow(src, roi, dst, y_lo, bias, hrows[0]);
+  if (y_hi != y_lo) {
+    crop_resize_hrow(src, roi, dst, y_hi, bias, hrows[1]);
+  }
+  crop_resize_vrow(dst, i, hrows[0], hrows[(y_hi != y_lo) ? 1 : 0], wy, bias, quant);
+}
+
+// Regions with the same columns and output width interpolate their source
+// rows identically
+static inline
+unsigned same_columns(
+  const isp_roi_t* a,
+  const isp_image_t* a_dst,
+  const isp_roi_t* b,
+  const isp_image_t* b_dst)
+{
+  return a->x == b->x && a->width == b->width && a_dst->width == b_dst->width;
+}
+
+// Interpolated source row y, for pass row y_pass (y is y_pass or
+// y_pass - 1). Made once, in the slot that holds neither of those rows.
+static
+const int16_t* crop_resize_cached_hrow(
+  const isp_image_t* src,
+  const isp_roi_t* roi,
+  const isp_image_t* dst,
+  const unsigned y,
+  const unsigned y_pass,
+  const uint8_t bias,
+  int16_t hrows[2][ISP_RESIZE_ROW_MAX_BYTES],
+  int slot_y[2])
+{
+  for (unsigned s = 0; s < 2; s++) {
+    if (slot_y[s] == (int)y) {
+      return hrows[s];
+    }
+  }
+  const unsigned s = (slot_y[0] == (int)y_pass || slot_y[0] == (int)y_pass - 1) ? 1 : 0;
+  crop_resize_hrow(src, roi, dst, y, bias, hrows[s]);
+  slot_y[s] = y;
+  return hrows[s];
+}
+
+void isp_crop_and_resize(
+  const isp_image_t* src,
+  const isp_roi_t rois[],
+  const isp_image_t dsts[],
+  const unsigned n)
+{
+  xassert(n <= ISP_CROP_RESIZE_MAX_ROIS);
+  const uint8_t bias = (src->type == ISP_TYPE_UINT8) ? UINT8_BIAS : 0;
+
+  unsigned next_row[ISP_CROP_RESIZE_MAX_ROIS];
+  unsigned done[ISP_CROP_RESIZE_MAX_ROIS];
+  for (unsigned b = 0; b < n; b++) {
+    const isp_roi_t* roi = &rois[b];
+    xassert(roi->width >= 2 && roi->height >= 2);
+    xassert(roi->x + roi->width <= src->width);
+    xassert(roi->y + roi->height <= src->height);
+    xassert(dsts[b].width >= 2 && dsts[b].height >= 2);
+    xassert(dsts[b].width * dsts[b].channels <= ISP_RESIZE_ROW_MAX_BYTES);
+    xassert(dsts[b].channels == src->channels && dsts[b].type == src->type);
+    next_row[b] = 0;
+    done[b] = 0;
+  }
+
+  int16_t hrows[2][ISP_RESIZE_ROW_MAX_BYTES];
+
+  // One pass per group of regions with the same columns. An output row is
+  // produced once its bottom source row is reached, while the rows it reads
+  // are the last two interpolated ones, shared by the whole group.
+  for (unsigned g = 0; g < n; g++) {
+    if (done[g]) {
+      continue;
+    }
+    unsigned y_first = src->height, y_last = 0;
+    for (unsigned b = g; b < n; b++) {
+      if (done[b] || !same_columns(&rois[g], &dsts[g], &rois[b], &dsts[b])) {
+        continue;
+      }
+      y_first = (rois[b].y < y_first) ? rois[b].y : y_first;
+      y_last = (rois[b].y + rois[b].height > y_last) ? rois[b].y + rois[b].height : y_last;
+    }
+
+    int slot_y[2] = {-1, -1};
+    for (unsigned y = y_first; y < y_last; y++) {
+      for (unsigned b = g; b < n; b++) {
+        if (done[b] || !same_columns(&rois[g], &dsts[g], &rois[b], &dsts[b])) {
+          continue;
+        }
+        while (next_row[b] < dsts[b].height) {
+          unsigned y_lo, y_hi;
+          int32_t wy;
+          roi_rows(&rois[b], &dsts[b], next_row[b], &y_lo, &y_hi, &wy);
+          if (y_hi != y) {
+            break;
+          }
+          const int16_t* top = crop_resize_cached_hrow(
+            src, &rois[g], &dsts[g], y_lo, y, bias, hrows, slot_y);
+          const int16_t* bot = crop_resize_cached_hrow(
+            src, &rois[g], &dsts[g], y_hi, y, bias, hrows, slot_y);
+          crop_resize_vrow(&dsts[b], next_row[b], top, bot, wy, bias, NULL);
+          next_row[b]++;
+        }
+      }
+    }
+
+    for (unsigned b = g; b < n; b++) {
+      if (same_columns(&rois[g], &dsts[g], &rois[b], &dsts[b])) {
+        done[b] = 1;
+      }
+    }
+  }
+}
+
+// ----------------------------- Model input tensor -----------------------------
+
+static inline
+int32_t round_to_int(
+  const float val)
+{
+  return (int32_t)((val >= 0) ? val + 0.5f : val - 0.5f);
+}
+
+void isp_tensor_quant_init(
+  isp_tensor_quant_t* quant,
+  const unsigned channels,
+  const float mean[],
+  const float std[],
+  const float scale[],
+  const int32_t zero_point[],
+  const uint8_t pad_value)
+{
+  xassert(channels > 0 && channels <= ISP_TENSOR_MAX_CHANNELS);
+  quant->channels = channels;
+
+  for (unsigned c = 0; c < channels; c++) {
+    xassert(std[c] > 0 && scale[c] > 0);
+    // q = pixel * gain + offset
+    const float gain = 1.0f / (255.0f * std[c] * scale[c]);
+    const float offset = (float)zero_point[c] - mean[c] / (std[c] * scale[c]);
+    // keep pixel * mul + add within 32 bits for every pixel, one unit of
+    // margin for the rounding of mul, add and the result
+    const float mag = gain * 255.0f + ((offset < 0) ? -offset : offset);
+    xassert(mag < (float)((1 << 15) - 1));
+    quant->mul[c] = round_to_int(gain * (1 << ISP_TENSOR_QUANT_BITS));
+    quant->add[c] = round_to_int(offset * (1 << ISP_TENSOR_QUANT_BITS));
+
+    int32_t pad = round_to_int(pad_value * gain + offset);
+    pad = (pad > INT8_MAX) ? INT8_MAX : pad;
+    pad = (pad < INT8_MIN) ? INT8_MIN : pad;
+    quant->pad[c] = (int8_t)pad;
+  }
+}
+
+void isp_tensor_quant_lut(
+  const isp_tensor_quant_t* quant,
+  const int8_t gamma[256],
+  int8_t lut[][256])
+{
+  for (unsigned k = 0; k < 256; k++) {
+    int32_t pixel = (int32_t)k - 128;
+    if (gamma != NULL) {
+      pixel = gamma[(pixel < -127) ? 0 : pixel + 127];
+    }
+    const int32_t pixel_u8 = pixel + 128;
+    for (unsigned c = 0; c < quant->channels; c++) {
+      int32_t q = (pixel_u8 * quant->mul[c] + quant->add[c]
+                  + (1 << (ISP_TENSOR_QUANT_BITS - 1))) >> ISP_TENSOR_QUANT_BITS;
+      q = (q > INT8_MAX) ? INT8_MAX : q;
+      q = (q < INT8_MIN) ? INT8_MIN : q;
+      lut[c][k] = (int8_t)q;
+    }
+  }
+}
+
+static inline
+void tensor_pad(
+  const isp_image_t* tensor,
+  const isp_tensor_quant_t* quant,
+  const unsigned y,
+  const unsigned x0,
+  const unsigned x1)
+{
+  for (unsigned x = x0; x < x1; x++) {
+    for (unsigned c = 0; c < tensor->channels; c++) {
+      pix_set(tensor, x, y, c, quant->pad[c], 0);
+    }
+  }
+}
+
+void isp_resize_to_tensor(
+  const isp_image_t* src,
+  const isp_roi_t* roi,
+  const isp_image_t* tensor,
+  const isp_tensor_quant_t* quant,
+  const unsigned letterbox)
+{
+  xassert(tensor->type == ISP_TYPE_INT8);
+  xassert(tensor->channels == src->channels && quant->channels == src->channels);
+
+  isp_roi_t full = {0, 0, src->width, src->height};
+  roi = (roi == NULL) ? &full : roi;
+  xassert(roi->x + roi->width <= src->width);
+  xassert(roi->y + roi->height <= src->height);
+  xassert(roi->width >= 2 && roi->height >= 2);
+
+  // area of the tensor holding the image
+  unsigned cw = tensor->width, ch = tensor->height;
+  if (letterbox) {
+    if (roi->width * tensor->height > roi->height * tensor->width) {
+      ch = (2 * roi->height * tensor->width + roi->width) / (2 * roi->width);
+    }
+    else {
+      cw = (2 * roi->width * tensor->height + roi->height) / (2 * roi->height);
+    }
+  }
+  const unsigned ox = (tensor->width - cw) / 2;
+  const unsigned oy = (tensor->height - ch) / 2;
+  xassert(cw >= 2 && ch >= 2);
+
+  isp_image_t content;
+  isp_image_crop(tensor, &content, ox, oy, cw, ch);
+
+  // Interpolated pixels are pixel - 128 for both source types, fold the
+  // 128 and the rounding into the offset
+  isp_tensor_quant_t q = *quant;
+  for (unsigned c = 0; c < q.channels; c++) {
+    q.add[c] += 128 * q.mul[c] + (1 << (ISP_TENSOR_QUANT_BITS - 1));
+  }
+  const uint8_t bias = (src->type == ISP_TYPE_UINT8) ? UINT8_BIAS : 0;
+
+  for (unsigned y = 0; y < tensor->height; y++) {
+    if (y < oy || y >= oy + ch) {
+      tensor_pad(tensor, quant, y, 0, tensor->width);
+      continue;
+    }
+    tensor_pad(tensor, quant, y, 0, ox);
+    crop_resize_row(src, roi, &content, y - oy, bias, &q);
+    tensor_pad(tensor, quant, y, ox + cw, tensor->width);
+  }
+}
@@ -3,41 +3,145 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <xcore/assert.h>
 
 #include "isp_image_hfilter.h"
 #include "sensor.h" // black level
 
 //Note: for filter coefficients reference : python/filters.txt
 
-void pixel_hfilter_update_scale(
+// Symmetric filters, centre tap first then one side
+typedef struct {
+  unsigned side_count;
+  float taps[HFILTER_TAP_COUNT_MAX / 2 + 1];
+} hfilter_taps_t;
+
+static
+const hfilter_taps_t hfilter_taps_dec2 = {1, {0.90755700f, 0.04622150f}};
+static
+const hfilter_taps_t hfilter_taps_dec4 = {1, {COEF_B0, COEF_B1}};
+static
+const hfilter_taps_t hfilter_taps_dec8 = {2, {0.61348217f, 0.18786418f, 0.00539473f}};
+
+static
+const hfilter_taps_t* hfilter_taps_dec(
+    const unsigned dec_factor)
+{
+  switch (dec_factor) {
+    case 2:  return &hfilter_taps_dec2;
+    case 4:  return &hfilter_taps_dec4;
+    case 8:  return &hfilter_taps_dec8;
+    default: xassert(0 && "Unsupported decimation factor"); return NULL;
+  }
+}
+
+// Largest shift with the centre tap `sc_b0` still in int8
+static
+unsigned hfilter_shift(
+    const float sc_b0)
+{
+  // Faster than computing ceil(log2(__))
+  if(sc_b0 <= 0.25f)      return 9;
+  else if(sc_b0 <= 0.5f)  return 8;
+  else if(sc_b0 <= 1.0f)  return 7;
+  else if(sc_b0 <= 2.0f)  return 6;
+  else                    return 5;
+}
+
+static inline
+int8_t hfilter_coef_s8(
+    const float b)
+{
+  return (b >= INT8_MAX) ? INT8_MAX : (b + 0.5f);
+}
+
+void pixel_hfilter_update_scale_dec(
     hfilter_state_t* state,
     const float gain,
-    const unsigned offset)
+    const unsigned offset,
+    const unsigned dec_factor)
 {
-  float sc_b0 = COEF_B0 * gain;
-  float sc_b1 = COEF_B1 * gain;
+  const hfilter_taps_t* taps = hfilter_taps_dec(dec_factor);
 
-  // Faster than computing ceil(log2(__))
-  if(sc_b0 <= 0.25f)      state->shift = 9;
-  else if(sc_b0 <= 0.5f)  state->shift = 8;
-  else if(sc_b0 <= 1.0f)  state->shift = 7;
-  else if(sc_b0 <= 2.0f)  state->shift = 6;
-  else                    state->shift = 5;
+  float sc_b0 = taps->taps[0] * gain;
+  state->shift = hfilter_shift(sc_b0);
 
   const int shift_scale = 1 << state->shift;
 
+  // taps of a previous factor may be further out
+  memset(state->coef, 0, sizeof(state->coef));
+
+  const unsigned s = offset;
+  const unsigned centre = 2 * taps->side_count + s;
+
   const float b0 = (sc_b0 * shift_scale);
-  const float b1 = (sc_b1 * shift_scale);
+  state->coef[centre] = hfilter_coef_s8(b0);
 
-  const int8_t b0_s8 = (b0 >= INT8_MAX) ? INT8_MAX : (b0 + 0.5f);
-  const int8_t b1_s8 = (b1 >= INT8_MAX) ? INT8_MAX : (b1 + 0.5f);
+  for (unsigned k = 1; k <= taps->side_count; k++) {
+    const float bk = (taps->taps[k] * gain * shift_scale);
+    state->coef[centre - 2 * k] = state->coef[centre + 2 * k] = hfilter_coef_s8(bk);
+  }
 
-  const unsigned s = offset;
+  // black level off the raw pixels before the gain, as a measured one is
+  pixel_hfilter_update_black_level(state, SENSOR_BLACK_LEVEL);
+}
+
+void pixel_hfilter_update_black_level(
+    hfilter_state_t* state,
+    const float black_level)
+{
+  const int32_t shift_scale = 1 << state->shift;
 
-  state->coef[0+s] = state->coef[4+s] = b1_s8;
-  state->coef[2+s] = b0_s8;
+  // DC gain of the quantised filter
+  int32_t sum_q = 0;
+  for (unsigned k = 0; k < sizeof(state->coef); k++) {
+    sum_q += state->coef[k];
+  }
+
+  const float black = black_level * sum_q;
+  state->acc_init = 128 * (sum_q - shift_scale) - (int32_t)(black + 0.5f);
+}
+
+void pixel_hfilter_update_luma(
+    hfilter_state_t* state,
+    const float gain[2],
+    const float black_level[2],
+    const float out_offset,
+    const unsigned dec_factor)
+{
+  const hfilter_taps_t* taps = hfilter_taps_dec(dec_factor);
 
-  const float sum_b = b0 + 2*b1;
+  const float gain_max = (gain[0] > gain[1]) ? gain[0] : gain[1];
+  state->shift = hfilter_shift(taps->taps[0] * gain_max);
+  const int32_t shift_scale = 1 << state->shift;
 
-  state->acc_init = 128 * (sum_b - shift_scale) - SENSOR_BLACK_LEVEL * shift_scale;
+  memset(state->coef, 0, sizeof(state->coef));
+
+  // Both colours of the row, interleaved as in the row
+  int32_t sum_q = 0;
+  float black = 0;
+  for (unsigned s = 0; s < 2; s++) {
+    const unsigned centre = 2 * taps->side_count + s;
+    int32_t sum_s = 0;
+    for (int k = -(int)taps->side_count; k <= (int)taps->side_count; k++) {
+      const int8_t q = hfilter_coef_s8(taps->taps[(k < 0) ? -k : k] * gain[s] * shift_scale);
+      state->coef[centre + 2 * k] = q;
+      sum_s += q;
+    }
+    sum_q += sum_s;
+    black += black_level[s] * sum_s;
+  }
+
+  state->acc_init = 128 * sum_q - (int32_t)(black + 0.5f)
+                  - (int32_t)(out_offset * shift_scale + 0.5f);
+}
+
+void pixel_hfilter_update_scale(
+    hfilter_state_t* state,
+    const float gain,
+    const unsigned offset)
+{
+  pixel_hfilter_update_scale_dec(state, gain, offset, 4);
 }
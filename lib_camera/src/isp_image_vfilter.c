@@ -6,85 +6,265 @@
 #include <stdint.h>
 #include <stdio.h>
 
+#include <xcore/assert.h>
+
 #include "isp_image_vfilter.h"
 
 static
 const int32_t vfilter_acc_offset = 0;
 
+#define VFILTER_LANES(X) { X, X, X, X, X, X, X, X, X, X, X, X, X, X, X, X }
+
+__attribute__((aligned(4)))
 static
-const int8_t vfilter_coef[5][16] = {
-  {  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,},
-  { 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65,},
-  {114,114,114,114,114,114,114,114,114,114,114,114,114,114,114,114,},
-  { 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65, 65,},
-  {  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,  6,},
+const vfilter_bank_t vfilter_bank_dec2 = {
+  1, 3, 3,
+  {
+    VFILTER_LANES(6),
+    VFILTER_LANES(116),
+    VFILTER_LANES(6),
+  },
+  VFILTER_LANES(7),
 };
 
+__attribute__((aligned(4)))
 static
-const int16_t vfilter_shift[16] = {8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,8,};
+const vfilter_bank_t vfilter_bank_dec4 = {
+  2, 5, 3,
+  {
+    VFILTER_LANES(6),
+    VFILTER_LANES(65),
+    VFILTER_LANES(114),
+    VFILTER_LANES(65),
+    VFILTER_LANES(6),
+  },
+  VFILTER_LANES(8),
+};
+
+__attribute__((aligned(4)))
+static
+const vfilter_bank_t vfilter_bank_dec8 = {
+  4, 5, 2,
+  {
+    VFILTER_LANES(22),
+    VFILTER_LANES(61),
+    VFILTER_LANES(90),
+    VFILTER_LANES(61),
+    VFILTER_LANES(22),
+  },
+  VFILTER_LANES(8),
+};
 
 /**
  * Prepare the provided accumulator struct for accumulation.
  */
+static inline
+int image_vfilter_reset_tap(
+    const vfilter_bank_t* bank)
+{
+  return (int)bank->tap_count - (int)(bank->dec_factor * bank->acc_count);
+}
+
 static inline
 void image_vfilter_reset(
-    vfilter_acc_t* acc)
+    vfilter_acc_t* acc,
+    const vfilter_bank_t* bank,
+    const unsigned width)
 {
-  acc->next_tap = VFILTER_RESET_INDEX;
-  pixel_vfilter_acc_init(acc->buff, vfilter_acc_offset, 
-                         APP_IMAGE_WIDTH_PIXELS);
+  acc->next_tap = image_vfilter_reset_tap(bank);
+  pixel_vfilter_acc_init(acc->buff, vfilter_acc_offset, width);
+}
+
+
+const vfilter_bank_t* image_vfilter_bank(
+    const unsigned dec_factor)
+{
+  switch (dec_factor) {
+    case 2: return &vfilter_bank_dec2;
+    case 4: return &vfilter_bank_dec4;
+    case 8: return &vfilter_bank_dec8;
+    default:
+      xassert(0 && "Unsupported decimation factor");
+      return NULL;
+  }
 }
 
 
 void image_vfilter_frame_init(
-    vfilter_acc_t accs[])
+    vfilter_acc_t accs[],
+    const vfilter_bank_t* bank,
+    const unsigned width)
+{
+  xassert(bank->acc_count <= VFILTER_ACC_COUNT_MAX);
+  xassert(width <= APP_MAX_IMAGE_WIDTH_PIXELS && (width % 16) == 0);
+  for(unsigned k = 0; k < bank->acc_count; k++){
+    accs[k].next_tap = -((int)bank->dec_factor) * (int)k + (int)(bank->tap_count/2);
+    pixel_vfilter_acc_init(accs[k].buff, vfilter_acc_offset, width);
+  }
+}
+
+
+// Output the row of the accumulator that got its last tap, if any
+static
+unsigned image_vfilter_complete_row(
+    int8_t output[],
+    vfilter_acc_t acc[],
+    const vfilter_bank_t* bank,
+    const unsigned width)
 {
-  for(int k = 0; k < VFILTER_ACC_COUNT; k++){
-    accs[k].next_tap = -(VFILTER_DEC_FACTOR) * k + (VFILTER_TAP_COUNT/2);
-    pixel_vfilter_acc_init(accs[k].buff, vfilter_acc_offset, 
-                           APP_IMAGE_WIDTH_PIXELS);
+  for(unsigned k = 0; k < bank->acc_count; k++){
+    if(acc[k].next_tap != (int)bank->tap_count) continue;
+
+    // produce an output row from accumulator
+    pixel_vfilter_complete(output,
+                            acc[k].buff,
+                            bank->shift,
+                            width);
+
+    // reset the accumulator
+    image_vfilter_reset(&acc[k], bank, width);
+
+    return 1;
   }
+
+  return 0;
 }
 
 
 unsigned image_vfilter_process_row(
     int8_t output[],
     vfilter_acc_t acc[],
-    const int8_t pixel_data[])
+    const int8_t pixel_data[],
+    const vfilter_bank_t* bank,
+    const unsigned width)
 {
-  for(int k = 0; k < VFILTER_ACC_COUNT; k++){
+  for(unsigned k = 0; k < bank->acc_count; k++){
     if(acc[k].next_tap >= 0){
       pixel_vfilter_macc(acc[k].buff,
                          pixel_data,
-                         &vfilter_coef[acc[k].next_tap][0],
-                         APP_IMAGE_WIDTH_PIXELS);
+                         &bank->coef[acc[k].next_tap][0],
+                         width);
     }
     acc[k].next_tap++;
   }
 
-  for(int k = 0; k < VFILTER_ACC_COUNT; k++){
-    if(acc[k].next_tap != VFILTER_TAP_COUNT) continue;
+  return image_vfilter_complete_row(output, acc, bank, width);
+}
 
-    // produce an output row from accumulator
-    pixel_vfilter_complete(output,
-                            acc[k].buff,
-                            vfilter_shift,
-                            APP_IMAGE_WIDTH_PIXELS);
 
-    // reset the accumulator
-    image_vfilter_reset(&acc[k]);
+unsigned image_vfilter_row_begin(
+    vfilter_row_t* row,
+    vfilter_acc_t acc[],
+    const vfilter_bank_t* bank)
+{
+  row->tap_count = 0;
+  row->complete = NULL;
+
+  for(unsigned k = 0; k < bank->acc_count; k++){
+    if(acc[k].next_tap >= 0){
+      row->taps[row->tap_count].accs = acc[k].buff;
+      row->taps[row->tap_count].coef = &bank->coef[acc[k].next_tap][0];
+      row->tap_count++;
+    }
+    acc[k].next_tap++;
+  }
 
+  // The accumulators are reset by image_vfilter_row_columns()
+  for(unsigned k = 0; k < bank->acc_count; k++){
+    if(acc[k].next_tap != (int)bank->tap_count) continue;
+    row->complete = acc[k].buff;
+    acc[k].next_tap = image_vfilter_reset_tap(bank);
     return 1;
   }
 
   return 0;
 }
 
+
+// Column range of a row, with the fused kernel or in two stages
+static
+void image_vfilter_columns(
+    int8_t output[],
+    const vfilter_row_t* row,
+    const int8_t input[],
+    const hfilter_state_t* hf,
+    const unsigned input_stride,
+    const vfilter_bank_t* bank,
+    const unsigned col_start,
+    const unsigned col_count,
+    const unsigned fused)
+{
+  xassert((col_start % 16) == 0 && (col_count % 16) == 0);
+  if (col_count == 0) return;
+
+  // 2 shorts (hi and lo) per accumulator
+  vfilter_tap_t taps[VFILTER_ACC_COUNT_MAX];
+  for(unsigned t = 0; t < row->tap_count; t++){
+    taps[t].accs = row->taps[t].accs + 2 * col_start;
+    taps[t].coef = row->taps[t].coef;
+  }
+
+  if (fused) {
+    pixel_hfilter_vfilter_macc(taps, row->tap_count, &input[col_start * input_stride],
+                               hf->coef, hf->acc_init, hf->shift, input_stride, col_count);
+  }
+  else {
+    __attribute__((aligned(4)))
+    int8_t hf_row[APP_MAX_IMAGE_WIDTH_PIXELS];
+    pixel_hfilter(hf_row, &input[col_start * input_stride],
+                  hf->coef, hf->acc_init, hf->shift, input_stride, col_count);
+    for(unsigned t = 0; t < row->tap_count; t++){
+      pixel_vfilter_macc(taps[t].accs, hf_row, taps[t].coef, col_count);
+    }
+  }
+
+  if (row->complete != NULL) {
+    int16_t* accs = row->complete + 2 * col_start;
+    pixel_vfilter_complete(&output[col_start], accs, bank->shift, col_count);
+    pixel_vfilter_acc_init(accs, vfilter_acc_offset, col_count);
+  }
+}
+
+
+void image_vfilter_row_columns(
+    int8_t output[],
+    const vfilter_row_t* row,
+    const int8_t input[],
+    const hfilter_state_t* hf,
+    const unsigned input_stride,
+    const vfilter_bank_t* bank,
+    const unsigned col_start,
+    const unsigned col_count)
+{
+  image_vfilter_columns(output, row, input, hf, input_stride, bank,
+                        col_start, col_count, ISP_FUSED_FILTER);
+}
+
+
+unsigned image_vfilter_process_row_hfilter(
+    int8_t output[],
+    vfilter_acc_t acc[],
+    const int8_t input[],
+    const hfilter_state_t* hf,
+    const unsigned input_stride,
+    const vfilter_bank_t* bank,
+    const unsigned width)
+{
+  vfilter_row_t row;
+  unsigned new_row = image_vfilter_row_begin(&row, acc, bank);
+  image_vfilter_columns(output, &row, input, hf, input_stride, bank, 0, width,
+                        ISP_FUSED_FILTER);
+  return new_row;
+}
+
+
 unsigned image_vfilter_drain(
     int8_t output[],
-    vfilter_acc_t acc[])
+    vfilter_acc_t acc[],
+    const vfilter_bank_t* bank,
+    const unsigned width)
 {
-  for (int k = 0; k < VFILTER_ACC_COUNT; k++) {
+  for (unsigned k = 0; k < bank->acc_count; k++) {
     if (acc[k].next_tap <= 0){
       continue;
     }
@@ -92,8 +272,8 @@ unsigned image_vfilter_drain(
     pixel_vfilter_complete(
       output,
       acc[k].buff,
-      vfilter_shift,
-      APP_IMAGE_WIDTH_PIXELS);
+      bank->shift,
+      width);
     
     acc[k].next_tap = 0;
 
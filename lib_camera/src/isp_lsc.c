@@ -0,0 +1,142 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <xcore/assert.h>
+
+#include "isp_lsc.h"
+#include "isp_demosaic.h" // pixel_demosaic_macc()
+
+// Expanded grid row in slot 0 or 1 of the row buffer, [CH][width]
+static inline
+int8_t* lsc_slot(
+    const lsc_state_t* state,
+    const unsigned slot)
+{
+  return &state->rows[slot * APP_IMAGE_CHANNEL_COUNT * state->width];
+}
+
+// Interpolate grid row `grid_row` across the frame width, as gains minus 1 in
+// Q6. Once per grid row, so scalar.
+static
+void lsc_expand_row(
+    const lsc_state_t* state,
+    const unsigned slot,
+    const unsigned grid_row)
+{
+  const unsigned width = state->width;
+  // Node position of each pixel in Q16, the last node is on the last pixel
+  const uint32_t step = ((LSC_GRID_W - 1) << 16) / (width - 1);
+  int8_t* out = lsc_slot(state, slot);
+
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    const uint16_t* nodes = state->lsc->gain[c][grid_row];
+    uint32_t pos = 0;
+    for (unsigned x = 0; x < width; x++, pos += step) {
+      unsigned i = pos >> 16;
+      int32_t frac = pos & 0xFFFF;
+      if (i >= LSC_GRID_W - 1) {
+        i = LSC_GRID_W - 2;
+        frac = 0x10000;
+      }
+      const int32_t gain = nodes[i] + ((((int32_t)nodes[i + 1] - nodes[i]) * frac) >> 16);
+      int32_t delta = ((gain + (1 << (LSC_GRID_SHIFT - LSC_SHIFT - 1)))
+                       >> (LSC_GRID_SHIFT - LSC_SHIFT)) - (1 << LSC_SHIFT);
+      delta = (delta > INT8_MAX) ? INT8_MAX : delta;
+      out[c * width + x] = (int8_t)delta;
+    }
+  }
+}
+
+
+int isp_lsc_init(
+    isp_lsc_t* lsc,
+    const float gains[APP_IMAGE_CHANNEL_COUNT][LSC_GRID_H][LSC_GRID_W])
+{
+  memset(lsc, 0, sizeof(isp_lsc_t));
+  if (gains == NULL) {
+    return 0;
+  }
+
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    for (unsigned r = 0; r < LSC_GRID_H; r++) {
+      for (unsigned k = 0; k < LSC_GRID_W; k++) {
+        const float g = gains[c][r][k];
+        // also refuses NaN
+        if (!(g >= 0.0f && g <= LSC_GAIN_MAX)) {
+          return -1;
+        }
+        lsc->gain[c][r][k] = (uint16_t)(g * (1 << LSC_GRID_SHIFT) + 0.5f);
+      }
+    }
+  }
+  lsc->enabled = 1;
+  return 0;
+}
+
+
+void isp_lsc_frame_init(
+    lsc_state_t* state,
+    const isp_lsc_t* lsc,
+    const unsigned width,
+    const unsigned height,
+    int8_t* rows)
+{
+  xassert(lsc->enabled);
+  xassert((width % 16) == 0 && width >= 16);
+  xassert(height >= 2);
+  xassert(((uintptr_t)rows & 0x3) == 0);
+
+  state->lsc = lsc;
+  state->width = width;
+  state->height = height;
+  state->grid_row = -1;
+  state->top = 0;
+  state->rows = rows;
+  for (unsigned k = 0; k < 16; k++) {
+    state->shifts[k] = LSC_SHIFT;
+  }
+}
+
+
+void isp_lsc_apply(
+    lsc_state_t* state,
+    int8_t row[],
+    const unsigned y)
+{
+  const unsigned plane = APP_IMAGE_CHANNEL_COUNT * state->width;
+  __attribute__((aligned(4))) int8_t weight[2][16];
+
+  // Grid row above y and the weight of the one below, in Q6
+  const unsigned pos = ((y * (LSC_GRID_H - 1)) << LSC_SHIFT) / (state->height - 1);
+  int r = pos >> LSC_SHIFT;
+  int w = pos & ((1 << LSC_SHIFT) - 1);
+  if (r >= LSC_GRID_H - 1) {
+    r = LSC_GRID_H - 2;
+    w = 1 << LSC_SHIFT;
+  }
+
+  if (state->grid_row >= 0 && r == state->grid_row + 1) {
+    // The bottom grid row becomes the top one
+    state->top ^= 1;
+    lsc_expand_row(state, state->top ^ 1, r + 1);
+  }
+  else if (r != state->grid_row) {
+    lsc_expand_row(state, state->top, r);
+    lsc_expand_row(state, state->top ^ 1, r + 1);
+  }
+  state->grid_row = r;
+
+  memset(weight[0], (1 << LSC_SHIFT) - w, 16);
+  memset(weight[1], w, 16);
+  const demosaic_tap_t taps[2] = {
+    {lsc_slot(state, state->top), weight[0]},
+    {lsc_slot(state, state->top ^ 1), weight[1]},
+  };
+  int8_t* gain_delta = lsc_slot(state, 2);
+  pixel_demosaic_macc(gain_delta, taps, 2, state->shifts, plane);
+  pixel_lsc_gain(row, row, gain_delta, plane);
+}
@@ -1,13 +1,13 @@
 // Copyright 2023-2024 XMOS LIMITED.
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
-#include <stdio.h>
-
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <xcore/assert.h>
 #include <xcore/channel.h> // includes streaming channel and channend
+#include <xcore/parallel.h>
 
 #include "camera_api.h"
 #include "sensor_control.h"
@@ -15,6 +15,14 @@
 
 #include "isp_pipeline.h"
 #include "isp_stats.h"
+#include "isp_demosaic.h"
+#include "isp_ccm.h"
+#include "isp_lsc.h"
+#include "isp_dpc.h"
+#include "isp_tnr.h"
+#include "isp_sharpen.h"
+#include "isp_yuv_rgb.h"
+#include "isp_pyramid.h"
 
 // ISP global variables
 isp_params_t isp_params = {                                              
@@ -26,17 +34,138 @@ isp_params_t isp_params = {
 };
 
 static
-vfilter_acc_t vfilter_accs[APP_IMAGE_CHANNEL_COUNT][VFILTER_ACC_COUNT];
+vfilter_acc_t vfilter_accs[APP_IMAGE_CHANNEL_COUNT][VFILTER_ACC_COUNT_MAX];
 
 static
 hfilter_state_t hfilter_state[APP_IMAGE_CHANNEL_COUNT];
 
+// Channel rows are packed at the runtime output width, [CH][isp_out_width]
 __attribute__((aligned(8)))
-int8_t output_buff[2][APP_IMAGE_CHANNEL_COUNT][APP_IMAGE_WIDTH_PIXELS];
+int8_t output_buff[2][APP_IMAGE_CHANNEL_COUNT * APP_MAX_IMAGE_WIDTH_PIXELS];
 
 static 
 unsigned out_dex = 0;                                                       
 
+// Sensor mode, a requested mode is applied at the next frame start
+static camera_mode_t isp_mode = CAMERA_MODE_DEFAULT;
+static camera_mode_t isp_pending_mode;
+static unsigned isp_mode_pending = 0;
+static unsigned isp_dec_factor = APP_DECIMATION_FACTOR;
+
+// Requested decimation factor (0 follows the mode), applied at frame start
+static unsigned isp_dec_request = 0;
+static unsigned isp_out_width = APP_IMAGE_WIDTH_PIXELS;
+static unsigned isp_out_height = APP_IMAGE_HEIGHT_PIXELS;
+static const vfilter_bank_t* isp_vbank = NULL;
+
+// Image pyramid, written into the client buffers while a request is active
+static int8_t* pyr_levels[APP_PYRAMID_LEVELS];
+static unsigned pyr_active = 0;
+__attribute__((aligned(4)))
+static int16_t pyr_accs[2 * APP_IMAGE_WIDTH_PIXELS];
+
+// Full resolution RGB output, requested mode applied at frame start
+static demosaic_mode_t isp_demosaic_request = DEMOSAIC_NONE;
+#if APP_DEMOSAIC_MAX_WIDTH_PIXELS > 0
+static unsigned isp_demosaic_active = 0;
+static demosaic_state_t demosaic_state;
+__attribute__((aligned(4)))
+static int8_t demosaic_lines[DEMOSAIC_LINES_BYTES(APP_DEMOSAIC_MAX_WIDTH_PIXELS)];
+__attribute__((aligned(4)))
+static int8_t demosaic_out[APP_IMAGE_CHANNEL_COUNT * APP_DEMOSAIC_MAX_WIDTH_PIXELS];
+#endif
+
+// Defective pixel correction of the raw rows, requested threshold and client
+// defect list applied at frame start
+static unsigned isp_dpc_request = APP_DPC_THRESHOLD;
+#if APP_DPC_ENABLED
+static unsigned isp_dpc_active = 0;
+static dpc_state_t dpc_state;
+__attribute__((aligned(4)))
+static int8_t dpc_left[DPC_LEFT_BYTES(MIPI_MAX_IMAGE_WIDTH_PIXELS)];
+__attribute__((aligned(4)))
+static int8_t dpc_out[MIPI_MAX_IMAGE_WIDTH_PIXELS];
+#endif
+
+// Temporal denoise of the decimated rows, requested settings applied at frame
+// start
+static uint16_t isp_tnr_request = TNR_ENCODE(APP_TNR_STRENGTH, APP_TNR_THRESHOLD);
+#if APP_TNR_ENABLED
+static unsigned isp_tnr_active = 0;
+static tnr_state_t tnr_state;
+__attribute__((aligned(4)))
+static int8_t tnr_prev[TNR_PREV_BYTES];
+#endif
+
+// Sharpening of the client rows, the requested strength applied at frame start
+static unsigned isp_sharpen_request = APP_SHARPEN_STRENGTH;
+#if APP_SHARPEN_ENABLED
+static unsigned isp_sharpen_active = 0;
+static sharpen_state_t sharpen_state;
+__attribute__((aligned(4)))
+static int8_t sharpen_ring[SHARPEN_RING_BYTES(APP_MAX_IMAGE_WIDTH_PIXELS)];
+__attribute__((aligned(4)))
+static int8_t sharpen_out[APP_IMAGE_CHANNEL_COUNT * APP_MAX_IMAGE_WIDTH_PIXELS];
+#endif
+
+// YUV image requested by the client, written row by row
+#if APP_YUV_ENABLED
+static uint8_t* yuv_image = NULL;
+static unsigned yuv_image_bytes = 0;
+static yuv_format_t yuv_format = YUV_FORMAT_422;
+static unsigned yuv_active = 0;
+static color_conv_t yuv_conv;
+__attribute__((aligned(4)))
+static int8_t yuv_row[APP_IMAGE_CHANNEL_COUNT * APP_MAX_IMAGE_WIDTH_PIXELS];
+static int8_t yuv_chroma[APP_MAX_IMAGE_WIDTH_PIXELS];
+#endif
+
+// Lens shading correction of the decimated rows, the client grid is copied
+// here at frame start
+#if APP_LSC_ENABLED
+static isp_lsc_t isp_lsc;
+static lsc_state_t lsc_state;
+__attribute__((aligned(4)))
+static int8_t lsc_rows[LSC_ROWS_BYTES(APP_MAX_IMAGE_WIDTH_PIXELS)];
+#endif
+
+// Colour correction of the decimated rows. The client matrix is copied here
+// at frame start, so a frame is never corrected with two matrices.
+#if APP_CCM_ENABLED
+static isp_ccm_t isp_ccm;
+__attribute__((aligned(4)))
+static int8_t ccm_out[APP_IMAGE_CHANNEL_COUNT * APP_MAX_IMAGE_WIDTH_PIXELS];
+#endif
+
+// Luma-only mode (camera_set_luma()): both colours of each raw row go into
+// channel 0, through the hfilter of the row parity. Accumulators completed by
+// an RG row are written out by the GB row that follows it.
+static unsigned isp_luma_request = 0;
+static unsigned isp_luma_active = 0;
+static int16_t* luma_complete = NULL;
+
+// Decimation of the current row, shared by column range between the threads
+typedef struct {
+    const int8_t* input;
+    unsigned channel_count;
+    uint8_t channel[2];
+    const hfilter_state_t* hf[2];
+    vfilter_row_t vrow[2];
+} isp_row_job_t;
+
+static isp_row_job_t isp_job;
+
+// Output columns of each thread, multiples of 16
+static unsigned isp_shard_col[ISP_THREAD_COUNT + 1];
+
+#if ISP_THREAD_COUNT > 1
+static chanend_t isp_worker_chan[ISP_THREAD_COUNT - 1];
+#endif
+
+// Worst-case row processing time, reported to the sensor to validate line timing
+static unsigned isp_row_ticks_max = 0;
+static unsigned isp_row_ticks_reported = 0;
+
 
 // gamma 1.8, with substract 10 and 1.05 multiplier (int8 version)
 const int8_t gamma_int8[256] = {
@@ -61,6 +190,9 @@ const int8_t gamma_int8[256] = {
 // Stats functions
 static histograms_t histograms;
 static statistics_t statistics;
+#if APP_BLACK_LEVEL_ROWS > 0
+static black_level_t black_level;
+#endif
 
 
 // ------------- PH <> ISP communication -----------------------
@@ -87,6 +219,13 @@ row_info_t isp_recieve_row_info(chanend_t ch){
     return info;
 }
 
+void isp_send_sensor_cmd(chanend_t ch, uint32_t encoded_cmd){
+    chanend_out_word(ch, encoded_cmd);
+}
+uint32_t isp_recieve_sensor_cmd(chanend_t ch){
+    return chanend_in_word(ch);
+}
+
 isp_cmd_t isp_wait(chanend_t ch){
     return (isp_cmd_t)chanend_in_word(ch);
 }
@@ -222,51 +361,497 @@ void AWB_compute_gains_percentile(statistics_t* global_stats, isp_params_t *isp_
 
 // ------------- Core functions -----------------------
 
+// Black level of channel c for the hfilters
+static
+float channel_black_level(
+  const unsigned c)
+{
+#if APP_BLACK_LEVEL_ROWS > 0
+  if (black_level.valid) {
+    return stats_black_level(&black_level, c);
+  }
+#else
+  (void)c;
+#endif
+  return SENSOR_BLACK_LEVEL;
+}
+
+// BT.601 luma weights of the sensor colours, with the AWB gains folded in.
+// Green is in both rows and gets half its weight in each. Each row takes off
+// its share of the 128 offset, so the two rows sum to the int8 luma.
+static
+void luma_filter_update()
+{
+  static const float weight[APP_IMAGE_CHANNEL_COUNT] = {0.299f, 0.587f, 0.114f};
+  // Colours at the even and odd columns of the RG and GB rows
+  static const uint8_t colour[2][2] = {
+    {CHAN_RED, CHAN_GREEN},
+    {CHAN_GREEN, CHAN_BLUE}};
+
+  for (unsigned p = 0; p < 2; p++) {
+    float gain[2];
+    float black[2];
+    float share = 0;
+    for (unsigned s = 0; s < 2; s++) {
+      const uint8_t c = colour[p][s];
+      const float w = (c == CHAN_GREEN) ? 0.5f * weight[c] : weight[c];
+      gain[s] = w * isp_params.channel_gain[c];
+      black[s] = channel_black_level(c);
+      share += w;
+    }
+    pixel_hfilter_update_luma(&hfilter_state[p], gain, black, 128 * share, isp_dec_factor);
+  }
+
+  image_vfilter_frame_init(&vfilter_accs[0][0], isp_vbank, isp_out_width);
+}
+
 static
 void filter_update()
 {
+    if (isp_mode_pending) {
+        isp_mode = isp_pending_mode;
+        isp_mode_pending = 0;
+    }
+
+    isp_dec_factor = (isp_dec_request != 0)
+        ? isp_dec_request : MODE_DECIMATION_FACTOR(isp_mode.resolution);
+    isp_out_width = MODE_WIDTH_PIXELS(isp_mode.resolution) / isp_dec_factor;
+    isp_out_height = MODE_HEIGHT_PIXELS(isp_mode.resolution) / isp_dec_factor;
+    isp_vbank = image_vfilter_bank(isp_dec_factor);
+    camera_new_frame_size(isp_out_width, isp_out_height);
+#if APP_CCM_ENABLED
+    camera_check_ccm(&isp_ccm);
+#endif
+    isp_luma_active = isp_luma_request;
+#if APP_TNR_ENABLED
+    // Luma frames don't fill the previous frame, the next RGB frame reseeds it
+    isp_tnr_set(&tnr_state, isp_luma_active ? 0 : TNR_DECODE_STRENGTH(isp_tnr_request),
+                TNR_DECODE_THRESHOLD(isp_tnr_request));
+    isp_tnr_active = isp_tnr_frame_init(&tnr_state, isp_out_width, isp_out_height);
+#endif
+#if APP_LSC_ENABLED
+    camera_check_lens_shading(&isp_lsc);
+    if (isp_lsc.enabled) {
+        isp_lsc_frame_init(&lsc_state, &isp_lsc, isp_out_width, isp_out_height, lsc_rows);
+    }
+#endif
+#if APP_SHARPEN_ENABLED
+    isp_sharpen_active = (isp_sharpen_request != 0) && !isp_luma_active;
+    if (isp_sharpen_active) {
+        isp_sharpen_frame_init(&sharpen_state, isp_sharpen_request, isp_out_width, sharpen_ring);
+    }
+#endif
+
+#if APP_DPC_ENABLED
+    // Same-colour neighbours are 2 bytes apart in RAW8 rows only
+    camera_check_defect_list(&dpc_state.list);
+    isp_dpc_set_threshold(&dpc_state, isp_dpc_request);
+    isp_dpc_frame_start(&dpc_state);
+    isp_dpc_active = (isp_mode.pixel_format == FMT_RAW8)
+        && (dpc_state.threshold != 0 || dpc_state.list.count != 0);
+#endif
+
+#if APP_DEMOSAIC_MAX_WIDTH_PIXELS > 0
+    // The demosaic reads 8-bit pixels
+    const unsigned raw_width = MODE_WIDTH_PIXELS(isp_mode.resolution);
+    isp_demosaic_active = (isp_demosaic_request != DEMOSAIC_NONE)
+        && (isp_mode.pixel_format == FMT_RAW8)
+        && (raw_width <= APP_DEMOSAIC_MAX_WIDTH_PIXELS);
+    if (isp_demosaic_active) {
+        isp_demosaic_init(&demosaic_state, isp_demosaic_request, raw_width, demosaic_lines);
+    }
+#endif
+
+    const unsigned blocks = isp_out_width / VPU_SIZE_16B;
+    for (unsigned s = 0; s <= ISP_THREAD_COUNT; s++) {
+        isp_shard_col[s] = VPU_SIZE_16B * ((blocks * s) / ISP_THREAD_COUNT);
+    }
+
+    if (isp_luma_active) {
+        luma_filter_update();
+        return;
+    }
+
     for (int c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
-        pixel_hfilter_update_scale(
+        pixel_hfilter_update_scale_dec(
             &hfilter_state[c],
             isp_params.channel_gain[c],
-            (c == 0) ? 0 : 1);
+            (c == 0) ? 0 : 1,
+            isp_dec_factor);
+#if APP_BLACK_LEVEL_ROWS > 0
+        // Measured black level in acc_init, no cost per pixel
+        if (black_level.valid) {
+            pixel_hfilter_update_black_level(&hfilter_state[c], stats_black_level(&black_level, c));
+        }
+#endif
+
+        image_vfilter_frame_init(&vfilter_accs[c][0], isp_vbank, isp_out_width);
+    }
+}
 
-        image_vfilter_frame_init(&vfilter_accs[c][0]);
+static
+void sensor_update(chanend_t c_isp, chanend_t c_control)
+{
+    uint32_t encoded_cmd = isp_recieve_sensor_cmd(c_isp);
+
+    const uint16_t arg = DECODE_ARG(encoded_cmd);
+
+    // Decimation, demosaic, DPC, TNR, sharpening and the luma-only mode are
+    // ISP settings, the sensor doesn't see them
+    switch (DECODE_CMD(encoded_cmd)) {
+        case SENSOR_SET_DECIMATION:
+            isp_dec_request = arg;
+            return;
+        case SENSOR_SET_DEMOSAIC:
+            isp_demosaic_request = (demosaic_mode_t)arg;
+            return;
+        case SENSOR_SET_DPC:
+            isp_dpc_request = arg;
+            return;
+        case SENSOR_SET_TNR:
+            isp_tnr_request = arg;
+            return;
+        case SENSOR_SET_SHARPEN:
+            isp_sharpen_request = arg;
+            return;
+        case SENSOR_SET_LUMA:
+            isp_luma_request = arg;
+            return;
+        case SENSOR_SET_MODE:
+            isp_pending_mode.resolution = (resolution_t)MODE_DECODE_RES(arg);
+            isp_pending_mode.pixel_format = (pixel_format_t)MODE_DECODE_FMT(arg);
+            isp_pending_mode.binning = MODE_DECODE_BINNING(arg);
+            isp_mode_pending = 1;
+            break;
+        default:
+            break;
+    }
+
+    // Forward to the sensor control thread
+    chan_out_word(c_control, encoded_cmd);
+    chan_in_word(c_control);
+}
+
+// Row `row` of channel `c` of pyramid level k
+static inline
+int8_t* pyramid_row_ptr(
+    const unsigned k,
+    const unsigned c,
+    const unsigned row)
+{
+  return pyr_levels[k] + (c * APP_PYRAMID_HEIGHT(k) + row) * APP_PYRAMID_WIDTH(k);
+}
+
+// Row `row` of level k from rows 2 * row and 2 * row + 1 of level k - 1
+static
+void pyramid_downscale(
+    const unsigned k,
+    const unsigned row)
+{
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    isp_pyramid_downscale_row(pyramid_row_ptr(k, c, row),
+                              pyramid_row_ptr(k - 1, c, 2 * row),
+                              pyramid_row_ptr(k - 1, c, 2 * row + 1),
+                              APP_PYRAMID_WIDTH(k - 1), pyr_accs);
+  }
+}
+
+static
+void pyramid_new_row(
+    const int8_t pix_out[APP_IMAGE_CHANNEL_COUNT][APP_IMAGE_WIDTH_PIXELS],
+    const unsigned row)
+{
+  // A request is picked up at the start of a frame
+  if (row == 0 && !pyr_active) {
+    pyr_active = camera_check_pyramid(pyr_levels);
+  }
+  if (!pyr_active) {
+    return;
+  }
+  // Levels are sized for the default output
+  if (isp_out_width != APP_IMAGE_WIDTH_PIXELS || isp_out_height != APP_IMAGE_HEIGHT_PIXELS) {
+    camera_pyramid_done(1);
+    pyr_active = 0;
+    return;
+  }
+
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    memcpy(pyramid_row_ptr(0, c, row), &pix_out[c][0], APP_PYRAMID_WIDTH(0));
+  }
+
+  // Every second row of a level completes a row of the next one
+  unsigned r = row;
+  for (unsigned k = 1; k < APP_PYRAMID_LEVELS && (r & 1); k++) {
+    r >>= 1;
+    pyramid_downscale(k, r);
+  }
+
+  if (row == APP_IMAGE_HEIGHT_PIXELS - 1) {
+    camera_pyramid_done(0);
+    pyr_active = 0;
+  }
+}
+
+static
+void yuv_new_row(
+    const int8_t* pix,
+    const unsigned row)
+{
+#if APP_YUV_ENABLED
+  // A request is picked up at the start of a frame. One still active there
+  // lost the end of its frame and starts over, if the image still fits.
+  if (row == 0) {
+    if (!yuv_active) {
+      yuv_active = camera_check_yuv(&yuv_image, &yuv_image_bytes, &yuv_format);
+    }
+    if (yuv_active
+        && YUV_IMAGE_BYTES(yuv_format, isp_out_width, isp_out_height) > yuv_image_bytes) {
+      camera_yuv_done(1);
+      yuv_active = 0;
     }
+  }
+  if (!yuv_active) {
+    return;
+  }
+
+  isp_color_convert_planar(&yuv_conv, yuv_row, pix, isp_out_width, isp_out_width);
+  isp_yuv_pack_row(yuv_image, yuv_format, isp_out_width, isp_out_height,
+                   yuv_row, yuv_chroma, row);
+
+  if (row == isp_out_height - 1) {
+    camera_yuv_done(0);
+    yuv_active = 0;
+  }
+#endif
+}
+
+// A finished row for the client, the pyramid and the YUV image
+static
+void client_new_row(
+    const int8_t* pix,
+    const unsigned row)
+{
+  pyramid_new_row((const int8_t (*)[APP_IMAGE_WIDTH_PIXELS])pix, row);
+  yuv_new_row(pix, row);
+  camera_new_row_decimated(pix, row, isp_out_width);
+}
+
+// Sharpened rows come out a row late, the last one from sharpen_drain()
+static
+void sharpen_new_row(
+    const int8_t* pix,
+    const unsigned row)
+{
+#if APP_SHARPEN_ENABLED
+  unsigned out_row;
+  if (isp_sharpen_active) {
+    if (isp_sharpen_push_row(&sharpen_state, sharpen_out, pix, &out_row)) {
+      client_new_row(sharpen_out, out_row);
+    }
+    return;
+  }
+#endif
+  client_new_row(pix, row);
+}
+
+static
+void sharpen_drain()
+{
+#if APP_SHARPEN_ENABLED
+  unsigned row;
+  while (isp_sharpen_active
+         && isp_sharpen_drain(&sharpen_state, sharpen_out, &row)) {
+    client_new_row(sharpen_out, row);
+  }
+#endif
 }
 
 static 
 void send_row_camera(
-    const int8_t pix_out[APP_IMAGE_CHANNEL_COUNT][APP_IMAGE_WIDTH_PIXELS],
+    int8_t* pix_out,
     row_info_t* info)
 {
-  camera_new_row_decimated(pix_out, info->state_ptr->out_line_number);
+  const unsigned width = isp_out_width;
+
+#if APP_TNR_ENABLED
+  // Blended with the previous frame as it left the filters
+  if (isp_tnr_active) {
+    isp_tnr_apply(&tnr_state, pix_out, info->state_ptr->out_line_number);
+  }
+#endif
+
+#if APP_LSC_ENABLED
+  if (isp_lsc.enabled) {
+    isp_lsc_apply(&lsc_state, pix_out, info->state_ptr->out_line_number);
+  }
+#endif
+
+  // The stats keep the sensor colours, the AWB gains are computed from them
+  const int8_t* pix_client = pix_out;
+#if APP_CCM_ENABLED
+  if (isp_ccm.enabled) {
+    isp_ccm_apply(ccm_out, pix_out, &isp_ccm, width);
+    pix_client = ccm_out;
+  }
+#endif
+
+  sharpen_new_row(pix_client, info->state_ptr->out_line_number);
   info->state_ptr->out_line_number++;
-  stats_compute_histograms(&histograms, APP_IMAGE_WIDTH_PIXELS, pix_out);
+  stats_compute_histograms(&histograms, width, (const int8_t (*)[width])pix_out);
+}
+
+// Luma rows skip the colour stages
+static
+void send_row_luma(
+    const int8_t* pix_out,
+    row_info_t* info)
+{
+  camera_new_row_gray(pix_out, info->state_ptr->out_line_number, isp_out_width);
+  info->state_ptr->out_line_number++;
+  stats_compute_histograms_luma(&histograms, isp_out_width, pix_out);
+}
+
+// Row of channel c in the current output buffer
+static inline
+int8_t* output_row(
+    const unsigned c)
+{
+  return &output_buff[out_dex][c * isp_out_width];
+}
+
+// Raw row with its defective pixels corrected, or the row itself
+static
+const int8_t* dpc_new_row(
+  const int8_t* raw,
+  const unsigned ln)
+{
+#if APP_DPC_ENABLED
+  if (isp_dpc_active) {
+    isp_dpc_row(&dpc_state, dpc_out, raw, MODE_WIDTH_PIXELS(isp_mode.resolution), ln);
+    return dpc_out;
+  }
+#else
+  (void)ln;
+#endif
+  return raw;
+}
+
+// Full resolution RGB rows for the client, a few rows behind the raw rows
+static
+void demosaic_new_row(
+  const int8_t* raw)
+{
+#if APP_DEMOSAIC_MAX_WIDTH_PIXELS > 0
+  unsigned row;
+  if (isp_demosaic_active
+      && isp_demosaic_push_row(&demosaic_state, demosaic_out, raw, &row)) {
+    camera_new_row_rgb(demosaic_out, row, demosaic_state.width);
+  }
+#endif
+}
+
+static
+void demosaic_drain()
+{
+#if APP_DEMOSAIC_MAX_WIDTH_PIXELS > 0
+  unsigned row;
+  while (isp_demosaic_active
+         && isp_demosaic_drain(&demosaic_state, demosaic_out, &row)) {
+    camera_new_row_rgb(demosaic_out, row, demosaic_state.width);
+  }
+#endif
+}
+
+// Columns of thread `shard` of every channel of the current row
+static
+void decimate_shard(
+  const unsigned shard)
+{
+  const unsigned col = isp_shard_col[shard];
+  const unsigned count = isp_shard_col[shard + 1] - col;
+
+  for (unsigned i = 0; i < isp_job.channel_count; i++) {
+    image_vfilter_row_columns(
+      output_row(isp_job.channel[i]),
+      &isp_job.vrow[i],
+      isp_job.input,
+      isp_job.hf[i],
+      isp_dec_factor,
+      isp_vbank,
+      col,
+      count);
+  }
+}
+
+// Run the prepared job on all the threads
+static
+void decimate_job()
+{
+#if ISP_THREAD_COUNT > 1
+  for (unsigned w = 0; w < ISP_THREAD_COUNT - 1; w++) {
+    chan_out_word(isp_worker_chan[w], PROCESS_ROW);
+  }
+#endif
+  decimate_shard(0);
+#if ISP_THREAD_COUNT > 1
+  for (unsigned w = 0; w < ISP_THREAD_COUNT - 1; w++) {
+    chan_in_word(isp_worker_chan[w]);
+  }
+#endif
+}
+
+// Horizontal and vertical filter of the channels of a row (in a single pass
+// with ISP_FUSED_FILTER). Returns 1 if the last channel completes an output
+// row.
+static
+unsigned decimate_row(
+  const int8_t* input,
+  const unsigned channel_count,
+  const uint8_t channels[])
+{
+  unsigned new_row = 0;
+
+  isp_job.input = input;
+  isp_job.channel_count = channel_count;
+  for (unsigned i = 0; i < channel_count; i++) {
+    isp_job.channel[i] = channels[i];
+    isp_job.hf[i] = &hfilter_state[channels[i]];
+    new_row = image_vfilter_row_begin(
+      &isp_job.vrow[i], &vfilter_accs[channels[i]][0], isp_vbank);
+  }
+
+  decimate_job();
+  return new_row;
 }
 
+// Luma of a raw row, into channel 0. The RG row advances the accumulators and
+// adds to the live taps, the GB row adds to the same taps and completes the
+// output row. Returns 1 if the row completes an output row.
 static
-void hfilter(
-  const uint8_t channel,
-  int8_t hf_row[APP_IMAGE_WIDTH_PIXELS],
-  int8_t* input,
-  hfilter_state_t hf_state[APP_IMAGE_CHANNEL_COUNT])
+unsigned decimate_row_luma(
+  const int8_t* input,
+  const unsigned pattern)
 {
-  pixel_hfilter(
-    hf_row,
-    input,
-    &hf_state[channel].coef[0],
-    hf_state[channel].acc_init,
-    hf_state[channel].shift,
-    APP_DECIMATION_FACTOR,
-    APP_IMAGE_WIDTH_PIXELS);
+  isp_job.input = input;
+  isp_job.channel_count = 1;
+  isp_job.channel[0] = 0;
+  isp_job.hf[0] = &hfilter_state[pattern];
+  if (pattern == 0) {
+    image_vfilter_row_begin(&isp_job.vrow[0], &vfilter_accs[0][0], isp_vbank);
+    luma_complete = isp_job.vrow[0].complete;
+    isp_job.vrow[0].complete = NULL;
+  }
+  else {
+    isp_job.vrow[0].complete = luma_complete;
+  }
+
+  decimate_job();
+  return (pattern == 1) && (luma_complete != NULL);
 }
 
 static
 void process_row(chanend_t c_isp){
-    
-    // Tmp buffer for horizontal filter
-    int8_t hfilt_row[APP_IMAGE_WIDTH_PIXELS];
+    unsigned time_start = measure_time();
 
     // recieve the row pointers
     row_info_t info = isp_recieve_row_info(c_isp);
@@ -278,34 +863,37 @@ void process_row(chanend_t c_isp){
     // First, service any raw requests.
     camera_new_row((int8_t*) info.row_ptr, ln);
 
+    // Every other stage sees the corrected row
+    const int8_t* row = dpc_new_row(info.row_ptr, ln);
+    demosaic_new_row(row);
+
+#if APP_BLACK_LEVEL_ROWS > 0
+    if (ln < APP_BLACK_LEVEL_ROWS) {
+        stats_black_level_row(&black_level, row,
+                              MODE_WIDTH_PIXELS(isp_mode.resolution), ln);
+    }
+#endif
+
     // Print aux info
     //printf("rx_pix[0]=%d\n", (int8_t)info.row_ptr[0]);
     //printf("R=%d\n", info.state_ptr->in_line_number);
 
     // Apply downsample
-    if(pattern == 0){
-        // RED
-        hfilter(CHAN_RED, hfilt_row, info.row_ptr, hfilter_state);
-        image_vfilter_process_row(
-            &output_buff[out_dex][CHAN_RED][0],
-            &vfilter_accs[CHAN_RED][0],
-            &hfilt_row[0]);
-
-        // GREEN
-        hfilter(CHAN_GREEN, hfilt_row, info.row_ptr, hfilter_state);
-        image_vfilter_process_row(
-            &output_buff[out_dex][CHAN_GREEN][0],
-            &vfilter_accs[CHAN_GREEN][0],
-            &hfilt_row[0]);
+    if (isp_luma_active) {
+        if (decimate_row_luma(row, pattern)) {
+            send_row_luma(output_row(0), &info);
+            out_dex ^= 1;
+        }
+    } else if(pattern == 0){
+        // RED, GREEN
+        static const uint8_t rg[2] = {CHAN_RED, CHAN_GREEN};
+        decimate_row(row, 2, rg);
 
     } else{ // GB_PATTERN
 
         // BLUE
-        hfilter(CHAN_BLUE, hfilt_row, info.row_ptr, hfilter_state);
-        unsigned new_row = image_vfilter_process_row(
-            &output_buff[out_dex][CHAN_BLUE][0],
-            &vfilter_accs[CHAN_BLUE][0],
-            &hfilt_row[0]);
+        static const uint8_t b[1] = {CHAN_BLUE};
+        unsigned new_row = decimate_row(row, 1, b);
 
         if (new_row) {
             send_row_camera(output_buff[out_dex], &info);
@@ -313,6 +901,12 @@ void process_row(chanend_t c_isp){
         }
     }
 
+    // Track the time the PH has to wait for this row
+    unsigned time_row = measure_time() - time_start;
+    if (time_row > isp_row_ticks_max) {
+        isp_row_ticks_max = time_row;
+    }
+
     // Send response
     isp_signal(c_isp);
 
@@ -326,25 +920,57 @@ static
 void filter_drain(chanend_t c_isp)
 {
     row_info_t info = isp_recieve_row_info(c_isp);
-    image_vfilter_drain(&output_buff[out_dex][CHAN_RED][0], &vfilter_accs[CHAN_RED][0]);
-    image_vfilter_drain(&output_buff[out_dex][CHAN_GREEN][0], &vfilter_accs[CHAN_GREEN][0]);
-    image_vfilter_drain(&output_buff[out_dex][CHAN_BLUE][0], &vfilter_accs[CHAN_BLUE][0]);
-    send_row_camera(output_buff[out_dex], &info);
-    out_dex ^= 1;
+
+    demosaic_drain();
+
+    // The last row may already be out (factor 8 needs no drain)
+    if (info.state_ptr->out_line_number < isp_out_height && isp_luma_active) {
+        image_vfilter_drain(output_row(0), &vfilter_accs[0][0], isp_vbank, isp_out_width);
+        send_row_luma(output_row(0), &info);
+        out_dex ^= 1;
+    }
+    else if (info.state_ptr->out_line_number < isp_out_height) {
+        for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+            image_vfilter_drain(output_row(c), &vfilter_accs[c][0], isp_vbank, isp_out_width);
+        }
+        send_row_camera(output_buff[out_dex], &info);
+        out_dex ^= 1;
+    }
+
+    sharpen_drain();
+}
+
+static
+void report_row_time(chanend_t c_control)
+{
+    // Only report when the worst case grows
+    if (isp_row_ticks_max <= isp_row_ticks_reported) return;
+    isp_row_ticks_reported = isp_row_ticks_max;
+
+    uint32_t ticks = (isp_row_ticks_max > 0xFFFF) ? 0xFFFF : isp_row_ticks_max;
+    uint32_t encoded_cmd = ENCODE(SENSOR_SET_ROW_TIME, ticks);
+    chan_out_word(c_control, encoded_cmd);
+    chan_in_word(c_control);
 }
 
 static
 void process_end_of_frame(chanend_t c_isp, chanend_t c_control)
 {
     // Constants definitions
-    const size_t img_size = W*H;
+    const size_t img_size = isp_out_width * isp_out_height;
     const float inv_img_size = 1.0f / img_size;
 
     //const size_t row_size = W;
     //const float inv_row_size = 1.0f / row_size;
 
     // Compute stats
+    if (isp_luma_active) {
+        stats_histograms_from_luma(&histograms);
+    }
     stats_compute_stats(&statistics, &histograms, inv_img_size);
+#if APP_BLACK_LEVEL_ROWS > 0
+    stats_black_level_frame_end(&black_level);
+#endif
 
     // AE control exposure
     uint8_t ae_done = AE_control_exposure(&statistics, c_control);
@@ -357,10 +983,45 @@ void process_end_of_frame(chanend_t c_isp, chanend_t c_control)
     run_once = 1; // Set to 1 to run only once
     }
 
+    // Let the sensor validate its line period against the ISP
+    report_row_time(c_control);
+
 }
 
 // ------------- ISP thread -----------------------
-void isp_thread(chanend_t c_isp, chanend_t c_control){
+#if ISP_THREAD_COUNT > 1
+DECLARE_JOB(isp_worker, (chanend_t, unsigned));
+DECLARE_JOB(isp_main, (chanend_t, chanend_t));
+
+// Filters column range `shard` of each row the ISP thread hands out
+void isp_worker(chanend_t c_worker, unsigned shard){
+    while ((isp_cmd_t)chan_in_word(c_worker) == PROCESS_ROW) {
+        decimate_shard(shard);
+        chan_out_word(c_worker, RESP_OK);
+    }
+}
+#endif
+
+static
+void isp_stop_workers()
+{
+#if ISP_THREAD_COUNT > 1
+    for (unsigned w = 0; w < ISP_THREAD_COUNT - 1; w++) {
+        chan_out_word(isp_worker_chan[w], ISP_STOP);
+    }
+#endif
+}
+
+void isp_main(chanend_t c_isp, chanend_t c_control){
+#if APP_YUV_ENABLED
+    isp_rgb_to_yuv_init(&yuv_conv);
+#endif
+#if APP_DPC_ENABLED
+    isp_dpc_init(&dpc_state, APP_DPC_THRESHOLD, dpc_left);
+#endif
+#if APP_TNR_ENABLED
+    isp_tnr_init(&tnr_state, tnr_prev, sizeof(tnr_prev));
+#endif
     while(1){
         isp_cmd_t cmd = isp_recieve_cmd(c_isp);
         switch(cmd){
@@ -376,7 +1037,11 @@ void isp_thread(chanend_t c_isp, chanend_t c_control){
             case PROCESS_EOF:
                 process_end_of_frame(c_isp, c_control);
                 break;
+            case SENSOR_UPDATE:
+                sensor_update(c_isp, c_control);
+                break;
             case ISP_STOP:
+                isp_stop_workers();
                 return;
             default:
                 xassert(0 && "Invalid command");
@@ -385,3 +1050,37 @@ void isp_thread(chanend_t c_isp, chanend_t c_control){
         }
     }
 }
+
+void isp_thread(chanend_t c_isp, chanend_t c_control){
+#if ISP_THREAD_COUNT > 1
+    channel_t c_workers[ISP_THREAD_COUNT - 1];
+    for (unsigned w = 0; w < ISP_THREAD_COUNT - 1; w++) {
+        c_workers[w] = chan_alloc();
+        xassert(c_workers[w].end_a != 0 && "Not enough chanends for the ISP workers");
+        isp_worker_chan[w] = c_workers[w].end_a;
+    }
+
+#if ISP_THREAD_COUNT == 2
+    PAR_JOBS(
+        PJOB(isp_main, (c_isp, c_control)),
+        PJOB(isp_worker, (c_workers[0].end_b, 1)));
+#elif ISP_THREAD_COUNT == 3
+    PAR_JOBS(
+        PJOB(isp_main, (c_isp, c_control)),
+        PJOB(isp_worker, (c_workers[0].end_b, 1)),
+        PJOB(isp_worker, (c_workers[1].end_b, 2)));
+#else
+    PAR_JOBS(
+        PJOB(isp_main, (c_isp, c_control)),
+        PJOB(isp_worker, (c_workers[0].end_b, 1)),
+        PJOB(isp_worker, (c_workers[1].end_b, 2)),
+        PJOB(isp_worker, (c_workers[2].end_b, 3)));
+#endif
+
+    for (unsigned w = 0; w < ISP_THREAD_COUNT - 1; w++) {
+        chan_free(c_workers[w]);
+    }
+#else
+    isp_main(c_isp, c_control);
+#endif
+}
@@ -0,0 +1,50 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+
+#include <xcore/assert.h>
+
+#include "isp_pyramid.h"
+#include "isp_image_vfilter.h"
+
+// Column k from a row of VPU split accumulators: blocks of 16 high halves
+// followed by 16 low halves. Two int8 rows sum within +-256, so the low half
+// alone holds them.
+#define PYR_COL_SUM(ACCS, K)  ((ACCS)[32 * ((K) >> 4) + 16 + ((K) & 0xF)])
+
+static inline
+int8_t mean4(
+    const int32_t sum)
+{
+  return (int8_t)((sum >= 0) ? (sum + 2) >> 2 : -((-sum + 2) >> 2));
+}
+
+void isp_pyramid_downscale_row(
+    int8_t* out,
+    const int8_t* top,
+    const int8_t* bot,
+    const unsigned w_in,
+    int16_t* accs)
+{
+  static const int8_t coef[16] __attribute__((aligned(4))) = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1};
+  xassert((w_in & 0x1) == 0);
+
+  if ((w_in % VPU_SIZE_16B) == 0
+      && ((uintptr_t)top & 0x3) == 0 && ((uintptr_t)bot & 0x3) == 0) {
+    // vertical sums on the VPU, read back without the saturating complete
+    xassert(((uintptr_t)accs & 0x3) == 0);
+    pixel_vfilter_acc_init(accs, 0, w_in);
+    pixel_vfilter_macc(accs, top, coef, w_in);
+    pixel_vfilter_macc(accs, bot, coef, w_in);
+    for (unsigned x = 0; x < w_in / 2; x++) {
+      out[x] = mean4(PYR_COL_SUM(accs, 2 * x) + PYR_COL_SUM(accs, 2 * x + 1));
+    }
+    return;
+  }
+
+  for (unsigned x = 0; x < w_in / 2; x++) {
+    out[x] = mean4(top[2 * x] + top[2 * x + 1] + bot[2 * x] + bot[2 * x + 1]);
+  }
+}
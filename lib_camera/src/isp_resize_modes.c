@@ -0,0 +1,277 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <xcore/assert.h>
+
+#include "isp_functions.h"
+#include "isp_image_vfilter.h"
+
+#define RESIZE_CH         3
+
+// Bias that maps uint8 pixels to int8 (v ^ 0x80 == v - 128) and back
+#define UINT8_BIAS        0x80
+#define UINT8_BIAS_WORD   0x80808080
+
+// Largest power of two factor of the VPU area path
+#define AREA_VPU_MAX_LOG2 3
+// Row chunk of the VPU area path, a multiple of 16 and of factor * channels
+#define AREA_VPU_CHUNK    (16 * (1 << AREA_VPU_MAX_LOG2) * RESIZE_CH)
+
+static inline
+int8_t div_round(
+  const int32_t sum,
+  const int32_t n)
+{
+  return (int8_t)((sum >= 0) ? (sum + n / 2) / n : -((-sum + n / 2) / n));
+}
+
+// Returns log2(f) for powers of two, -1 otherwise
+static inline
+int log2_exact(
+  const unsigned f)
+{
+  if (f == 0 || (f & (f - 1))) {
+    return -1;
+  }
+  return 31 - __builtin_clz(f);
+}
+
+// ----------------------------- Nearest -----------------------------
+
+static
+void resize_nearest(
+  const int8_t* img,
+  const unsigned in_width,
+  const unsigned in_height,
+  int8_t* out_img,
+  const unsigned out_width,
+  const unsigned out_height)
+{
+  const unsigned in_row_len = in_width * RESIZE_CH;
+  const unsigned f = in_width / out_width;
+
+  if (f > 0 && in_width == f * out_width && in_height == f * out_height) {
+    // integer factor: strided copy, no divisions
+    const unsigned x_step = f * RESIZE_CH;
+    const int8_t* src_row = &img[(f / 2) * in_row_len + (f / 2) * RESIZE_CH];
+    for (unsigned i = 0; i < out_height; i++) {
+      const int8_t* src = src_row;
+      for (unsigned j = 0; j < out_width; j++) {
+        *out_img++ = src[0];
+        *out_img++ = src[1];
+        *out_img++ = src[2];
+        src += x_step;
+      }
+      src_row += f * in_row_len;
+    }
+    return;
+  }
+
+  for (unsigned i = 0; i < out_height; i++) {
+    // source pixel holding the output pixel centre
+    const unsigned y = ((2 * i + 1) * in_height) / (2 * out_height);
+    const int8_t* src_row = &img[y * in_row_len];
+    for (unsigned j = 0; j < out_width; j++) {
+      const unsigned x = ((2 * j + 1) * in_width) / (2 * out_width);
+      const int8_t* src = &src_row[x * RESIZE_CH];
+      *out_img++ = src[0];
+      *out_img++ = src[1];
+      *out_img++ = src[2];
+    }
+  }
+}
+
+// ------------------------------- Area -------------------------------
+
+static
+void resize_area_scalar(
+  const int8_t* img,
+  const unsigned in_width,
+  const unsigned in_height,
+  int8_t* out_img,
+  const unsigned out_width,
+  const unsigned out_height,
+  const uint8_t bias)
+{
+  const unsigned in_row_len = in_width * RESIZE_CH;
+
+  for (unsigned i = 0; i < out_height; i++) {
+    const unsigned y0 = (i * in_height) / out_height;
+    unsigned y1 = ((i + 1) * in_height) / out_height;
+    y1 = (y1 > y0) ? y1 : y0 + 1;
+
+    for (unsigned j = 0; j < out_width; j++) {
+      const unsigned x0 = (j * in_width) / out_width;
+      unsigned x1 = ((j + 1) * in_width) / out_width;
+      x1 = (x1 > x0) ? x1 : x0 + 1;
+      const int32_t n = (y1 - y0) * (x1 - x0);
+
+      for (unsigned c = 0; c < RESIZE_CH; c++) {
+        int32_t sum = 0;
+        for (unsigned y = y0; y < y1; y++) {
+          const int8_t* src = &img[y * in_row_len + c];
+          for (unsigned x = x0; x < x1; x++) {
+            sum += (int8_t)(src[x * RESIZE_CH] ^ bias);
+          }
+        }
+        *out_img++ = div_round(sum, n) ^ bias;
+      }
+    }
+  }
+}
+
+// Copy a chunk of a row mapping it to int8, words at a time
+static
+void area_bias_copy(
+  int8_t* dst,
+  const int8_t* src,
+  const unsigned len)
+{
+  const uint32_t* s = (const uint32_t*)src;
+  uint32_t* d = (uint32_t*)dst;
+  for (unsigned k = 0; k < len / 4; k++) {
+    d[k] = s[k] ^ UINT8_BIAS_WORD;
+  }
+}
+
+// Sum of column k from a row of VPU split accumulators: blocks of 16 high
+// halves followed by 16 low halves. The sums of resize_area_vpu() stay within
+// +-2^15, so the low half alone holds them.
+#define AREA_COL_SUM(ACCS, K)  ((ACCS)[32 * ((K) >> 4) + 16 + ((K) & 0xF)])
+
+// Power of two factor f = 1 << f_log2. The column sums of the f rows are
+// accumulated on the VPU a chunk at a time, then groups of f columns are
+// added and the f * f sum is rounded once, as div_round() does.
+static
+void resize_area_vpu(
+  const int8_t* img,
+  const unsigned in_width,
+  int8_t* out_img,
+  const unsigned out_width,
+  const unsigned out_height,
+  const unsigned f_log2,
+  const uint8_t bias)
+{
+  int16_t accs[2 * AREA_VPU_CHUNK] __attribute__((aligned(4)));
+  int8_t row_biased[AREA_VPU_CHUNK] __attribute__((aligned(4)));
+  int8_t coef[16] __attribute__((aligned(4)));
+  memset(coef, 1, sizeof(coef));
+
+  const unsigned f = 1 << f_log2;
+  const unsigned in_row_len = in_width * RESIZE_CH;
+  const unsigned group = f * RESIZE_CH;
+  const unsigned sum_log2 = 2 * f_log2;
+  const int32_t half = 1 << (sum_log2 - 1);
+
+  for (unsigned i = 0; i < out_height; i++) {
+    const int8_t* src_rows = &img[i * f * in_row_len];
+
+    for (unsigned start = 0; start < in_row_len; start += AREA_VPU_CHUNK) {
+      const unsigned len = (in_row_len - start < AREA_VPU_CHUNK) ? in_row_len - start : AREA_VPU_CHUNK;
+
+      // vertical sums
+      pixel_vfilter_acc_init(accs, 0, len);
+      for (unsigned r = 0; r < f; r++) {
+        const int8_t* src = &src_rows[r * in_row_len + start];
+        if (bias) {
+          area_bias_copy(row_biased, src, len);
+          src = row_biased;
+        }
+        pixel_vfilter_macc(accs, src, coef, len);
+      }
+
+      // horizontal sums and mean
+      for (unsigned g = 0; g < len; g += group) {
+        for (unsigned c = 0; c < RESIZE_CH; c++) {
+          int32_t sum = 0;
+          for (unsigned x = c; x < group; x += RESIZE_CH) {
+            sum += AREA_COL_SUM(accs, g + x);
+          }
+          sum = (sum >= 0) ? (sum + half) >> sum_log2 : -((-sum + half) >> sum_log2);
+          *out_img++ = (int8_t)sum ^ bias;
+        }
+      }
+    }
+  }
+}
+
+static
+void resize_area(
+  const int8_t* img,
+  const unsigned in_width,
+  const unsigned in_height,
+  int8_t* out_img,
+  const unsigned out_width,
+  const unsigned out_height,
+  const uint8_t bias)
+{
+  const unsigned f = in_width / out_width;
+  const int f_log2 = log2_exact(f);
+  const unsigned in_row_len = in_width * RESIZE_CH;
+
+  if (f_log2 > 0 && f_log2 <= AREA_VPU_MAX_LOG2
+      && in_width == f * out_width && in_height == f * out_height
+      && (in_row_len & 0xF) == 0 && ((uintptr_t)img & 0x3) == 0) {
+    resize_area_vpu(img, in_width, out_img, out_width, out_height, f_log2, bias);
+    return;
+  }
+  resize_area_scalar(img, in_width, in_height, out_img, out_width, out_height, bias);
+}
+
+// ------------------------------- API -------------------------------
+
+void isp_resize_mode_int8(
+  const int8_t* img,
+  const unsigned in_width,
+  const unsigned in_height,
+  int8_t* out_img,
+  const unsigned out_width,
+  const unsigned out_height,
+  const isp_resize_mode_t mode)
+{
+  xassert(out_width > 0 && out_height > 0);
+  switch (mode) {
+    case ISP_RESIZE_BILINEAR:
+      isp_resize_int8(img, in_width, in_height, out_img, out_width, out_height);
+      break;
+    case ISP_RESIZE_NEAREST:
+      resize_nearest(img, in_width, in_height, out_img, out_width, out_height);
+      break;
+    case ISP_RESIZE_AREA:
+      resize_area(img, in_width, in_height, out_img, out_width, out_height, 0);
+      break;
+    default:
+      xassert(0 && "Unknown resize mode");
+      break;
+  }
+}
+
+void isp_resize_mode_uint8(
+  const uint8_t* img,
+  const unsigned in_width,
+  const unsigned in_height,
+  uint8_t* out_img,
+  const unsigned out_width,
+  const unsigned out_height,
+  const isp_resize_mode_t mode)
+{
+  xassert(out_width > 0 && out_height > 0);
+  switch (mode) {
+    case ISP_RESIZE_BILINEAR:
+      isp_resize_uint8(img, in_width, in_height, out_img, out_width, out_height);
+      break;
+    case ISP_RESIZE_NEAREST:
+      // nearest only copies, the sign doesn't matter
+      resize_nearest((const int8_t*)img, in_width, in_height, (int8_t*)out_img, out_width, out_height);
+      break;
+    case ISP_RESIZE_AREA:
+      resize_area((const int8_t*)img, in_width, in_height, (int8_t*)out_img, out_width, out_height, UINT8_BIAS);
+      break;
+    default:
+      xassert(0 && "Unknown resize mode");
+      break;
+  }
+}
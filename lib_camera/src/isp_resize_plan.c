@@ -0,0 +1,240 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <xcore/assert.h>
+
+#include "isp_functions.h"
+#include "isp_image_vfilter.h"
+
+#define RESIZE_ONE      (1 << ISP_RESIZE_WEIGHT_BITS)
+#define RESIZE_ROUND    (1 << (ISP_RESIZE_WEIGHT_BITS - 1))
+
+// Bias that maps uint8 pixels to int8 (v ^ 0x80 == v - 128) and back.
+// Bilinear weights sum to one, so interpolating biased pixels is exact.
+#define UINT8_BIAS      0x80
+
+static
+void resize_plan_axis(
+  const unsigned in_len,
+  const unsigned out_len,
+  const unsigned stride,
+  uint16_t* lo,
+  uint16_t* hi,
+  uint8_t* w)
+{
+  for (unsigned k = 0; k < out_len; k++) {
+    // position in Q7, floor as in isp_resize_*()
+    const unsigned pos = ((k * (in_len - 1)) << ISP_RESIZE_WEIGHT_BITS) / (out_len - 1);
+    const unsigned idx = pos >> ISP_RESIZE_WEIGHT_BITS;
+    const unsigned frac = pos & (RESIZE_ONE - 1);
+    lo[k] = idx * stride;
+    // no need to read the next sample when it has no weight
+    hi[k] = (frac == 0) ? lo[k] : (idx + 1) * stride;
+    w[k] = frac;
+  }
+}
+
+void isp_resize_plan_init(
+  isp_resize_plan_t* plan,
+  const unsigned in_width,
+  const unsigned in_height,
+  const unsigned out_width,
+  const unsigned out_height,
+  const unsigned channels)
+{
+  xassert(in_width >= 2 && in_width <= ISP_RESIZE_MAX_DIM);
+  xassert(in_height >= 2 && in_height <= ISP_RESIZE_MAX_DIM);
+  xassert(out_width >= 2 && out_width <= ISP_RESIZE_MAX_DIM);
+  xassert(out_height >= 2 && out_height <= ISP_RESIZE_MAX_DIM);
+  xassert(channels >= 1 && channels <= ISP_RESIZE_MAX_CHANNELS);
+
+  plan->in_width = in_width;
+  plan->in_height = in_height;
+  plan->out_width = out_width;
+  plan->out_height = out_height;
+  plan->channels = channels;
+  resize_plan_axis(in_width, out_width, channels, plan->x_lo, plan->x_hi, plan->x_w);
+  resize_plan_axis(in_height, out_height, 1, plan->y_lo, plan->y_hi, plan->y_w);
+}
+
+static inline
+int8_t resize_blend(
+  const int32_t a,
+  const int32_t b,
+  const int32_t wa,
+  const int32_t wb)
+{
+  return (int8_t)((a * wa + b * wb + RESIZE_ROUND) >> ISP_RESIZE_WEIGHT_BITS);
+}
+
+// Horizontal pass of one source row into a (biased) int8 row
+static
+void resize_hrow(
+  const isp_resize_plan_t* plan,
+  const int8_t* src,
+  int8_t* dst,
+  const uint8_t bias)
+{
+  const unsigned ch = plan->channels;
+  for (unsigned j = 0; j < plan->out_width; j++) {
+    const int8_t* a = &src[plan->x_lo[j]];
+    const int8_t* b = &src[plan->x_hi[j]];
+    const int32_t wb = plan->x_w[j];
+    const int32_t wa = RESIZE_ONE - wb;
+    for (unsigned c = 0; c < ch; c++) {
+      *dst++ = resize_blend((int8_t)(a[c] ^ bias), (int8_t)(b[c] ^ bias), wa, wb);
+    }
+  }
+}
+
+// Get the horizontally resized source row y from the two-row cache, filling
+// slot `fill` when it isn't there. Returns the slot holding the row.
+static
+unsigned resize_get_row(
+  isp_resize_plan_t* plan,
+  const int8_t* img,
+  const unsigned y,
+  const unsigned fill,
+  const uint8_t bias)
+{
+  for (unsigned k = 0; k < 2; k++) {
+    if (plan->row_tag[k] == (int)y) {
+      return k;
+    }
+  }
+  const unsigned in_row_len = plan->in_width * plan->channels;
+  resize_hrow(plan, &img[y * in_row_len], plan->rows[fill], bias);
+  plan->row_tag[fill] = y;
+  return fill;
+}
+
+static
+void resize_unbias(
+  int8_t* row,
+  const unsigned len,
+  const uint8_t bias)
+{
+  if (bias == 0) {
+    return;
+  }
+  unsigned k = 0;
+  if (((uintptr_t)row & 0x3) == 0) {
+    uint32_t* words = (uint32_t*)row;
+    for (; k < (len >> 2); k++) {
+      words[k] ^= bias * 0x01010101u;
+    }
+    k <<= 2;
+  }
+  for (; k < len; k++) {
+    row[k] ^= bias;
+  }
+}
+
+// Finish a row written by the VPU, a word (4 pixels) at a time. The VPU
+// saturates to -127, so only bytes at -127 are redone in case they are -128,
+// then the bias is removed from the whole word.
+static
+void resize_vpu_fixup(
+  int8_t* out_row,
+  const int8_t* row_lo,
+  const int8_t* row_hi,
+  const int32_t wa,
+  const int32_t wb,
+  const unsigned len,
+  const uint8_t bias)
+{
+  uint32_t* words = (uint32_t*)out_row;
+  const uint32_t bias4 = bias * 0x01010101u;
+  for (unsigned k = 0; k < (len >> 2); k++) {
+    uint32_t w = words[k];
+    const uint32_t x = w ^ 0x81818181u; // bytes at -127 become 0
+    if (((x - 0x01010101u) & ~x & 0x80808080u) != 0) {
+      for (unsigned b = 0; b < 4; b++) {
+        const unsigned i = 4 * k + b;
+        if ((int8_t)(w >> (8 * b)) == -127) {
+          const uint8_t v = resize_blend(row_lo[i], row_hi[i], wa, wb);
+          w = (w & ~(0xFFu << (8 * b))) | ((uint32_t)v << (8 * b));
+        }
+      }
+    }
+    words[k] = w ^ bias4;
+  }
+}
+
+static
+void resize_plan(
+  isp_resize_plan_t* plan,
+  const int8_t* img,
+  int8_t* out_img,
+  const uint8_t bias)
+{
+  const unsigned len = plan->out_width * plan->channels;
+  const unsigned use_vpu = ((len & 0xF) == 0) && (((uintptr_t)out_img & 0x3) == 0);
+  int16_t shifts[16] __attribute__((aligned(4)));
+  int8_t coef_lo[16] __attribute__((aligned(4)));
+  int8_t coef_hi[16] __attribute__((aligned(4)));
+  for (unsigned k = 0; k < 16; k++) {
+    shifts[k] = ISP_RESIZE_WEIGHT_BITS;
+  }
+
+  plan->row_tag[0] = -1;
+  plan->row_tag[1] = -1;
+
+  for (unsigned i = 0; i < plan->out_height; i++) {
+    const unsigned y_lo = plan->y_lo[i];
+    const unsigned y_hi = plan->y_hi[i];
+    const int32_t wb = plan->y_w[i];
+    int8_t* out_row = &out_img[i * len];
+
+    // Source rows only move forward, so the previous bottom row is often
+    // the next top row. Each source row is interpolated at most once.
+    const unsigned fill_lo = (plan->row_tag[0] == (int)y_hi) ? 1 : 0;
+    const unsigned s_lo = resize_get_row(plan, img, y_lo, fill_lo, bias);
+    const int8_t* row_lo = plan->rows[s_lo];
+
+    if (wb == 0) {
+      memcpy(out_row, row_lo, len);
+      resize_unbias(out_row, len, bias);
+      continue;
+    }
+
+    const unsigned s_hi = resize_get_row(plan, img, y_hi, 1 - s_lo, bias);
+    const int8_t* row_hi = plan->rows[s_hi];
+    const int32_t wa = RESIZE_ONE - wb;
+
+    if (use_vpu) {
+      // wa and wb are both in [1, 127] here, so they fit int8 coefficients
+      memset(coef_lo, wa, sizeof(coef_lo));
+      memset(coef_hi, wb, sizeof(coef_hi));
+      pixel_vfilter_acc_init(plan->accs, 0, len);
+      pixel_vfilter_macc(plan->accs, row_lo, coef_lo, len);
+      pixel_vfilter_macc(plan->accs, row_hi, coef_hi, len);
+      pixel_vfilter_complete(out_row, plan->accs, shifts, len);
+      resize_vpu_fixup(out_row, row_lo, row_hi, wa, wb, len, bias);
+    }
+    else {
+      for (unsigned k = 0; k < len; k++) {
+        out_row[k] = resize_blend(row_lo[k], row_hi[k], wa, wb) ^ bias;
+      }
+    }
+  }
+}
+
+void isp_resize_plan_int8(
+  isp_resize_plan_t* plan,
+  const int8_t* img,
+  int8_t* out_img)
+{
+  resize_plan(plan, img, out_img, 0);
+}
+
+void isp_resize_plan_uint8(
+  isp_resize_plan_t* plan,
+  const uint8_t* img,
+  uint8_t* out_img)
+{
+  resize_plan(plan, (const int8_t*)img, (int8_t*)out_img, UINT8_BIAS);
+}
@@ -0,0 +1,183 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <xcore/assert.h>
+
+#include "isp_sharpen.h"
+
+// Input row slot of row `row`, [CH][width]
+static inline
+int8_t* sharpen_input_row(
+    const sharpen_state_t* state,
+    const unsigned row)
+{
+  return &state->ring[(row % 2) * APP_IMAGE_CHANNEL_COUNT * state->width];
+}
+
+// Horizontally blurred row slot of row `row`, [CH][width]
+static inline
+int8_t* sharpen_blur_row(
+    const sharpen_state_t* state,
+    const unsigned row)
+{
+  return &state->ring[(2 + row % 3) * APP_IMAGE_CHANNEL_COUNT * state->width];
+}
+
+// Row `row` of the frame so far, mirrored at the top and bottom edges
+static inline
+unsigned sharpen_mirror_row(
+    const sharpen_state_t* state,
+    const int row)
+{
+  if (row < 0) {
+    return (state->rows_in > 1) ? 1 : 0;
+  }
+  if (row >= (int)state->rows_in) {
+    return (row >= 2) ? row - 2 : 0;
+  }
+  return row;
+}
+
+// [1 2 1] / 4 of each channel row of `input`, mirrored at the left and right
+// edges, into the blurred row slot
+static
+void sharpen_blur_h(
+    sharpen_state_t* state,
+    const int8_t input[],
+    const unsigned row)
+{
+  const unsigned width = state->width;
+  int8_t* left = &state->ring[5 * APP_IMAGE_CHANNEL_COUNT * width];
+  int8_t* right = &left[width];
+  int8_t* blur = sharpen_blur_row(state, row);
+  demosaic_tap_t taps[3];
+
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    const int8_t* pix = &input[c * width];
+    memcpy(&left[1], pix, width - 1);
+    left[0] = pix[1];
+    memcpy(right, &pix[1], width - 1);
+    right[width - 1] = pix[width - 2];
+
+    taps[0].pix = left;
+    taps[1].pix = pix;
+    taps[2].pix = right;
+    for (unsigned t = 0; t < 3; t++) {
+      taps[t].coef = state->coef_h[t];
+    }
+    pixel_demosaic_macc(&blur[c * width], taps, 3, state->shifts_h, width);
+  }
+}
+
+// Output row `row`, the rows around it are in the ring
+static
+void sharpen_row(
+    sharpen_state_t* state,
+    int8_t output[],
+    const unsigned row)
+{
+  const unsigned width = state->width;
+  const int8_t* input = sharpen_input_row(state, row);
+  const int8_t* blur[3] = {
+    sharpen_blur_row(state, sharpen_mirror_row(state, (int)row - 1)),
+    sharpen_blur_row(state, row),
+    sharpen_blur_row(state, sharpen_mirror_row(state, (int)row + 1)),
+  };
+  const unsigned centre_taps = state->centre_taps;
+  demosaic_tap_t taps[SHARPEN_TAP_MAX];
+
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    for (unsigned t = 0; t < centre_taps; t++) {
+      taps[t].pix = &input[c * width];
+      taps[t].coef = state->coef_v[t];
+    }
+    for (unsigned t = 0; t < 3; t++) {
+      taps[centre_taps + t].pix = &blur[t][c * width];
+      taps[centre_taps + t].coef = state->coef_v[centre_taps + t];
+    }
+    pixel_demosaic_macc(&output[c * width], taps, centre_taps + 3,
+                        state->shifts_v, width);
+  }
+}
+
+
+void isp_sharpen_frame_init(
+    sharpen_state_t* state,
+    const unsigned strength,
+    const unsigned width,
+    int8_t* ring)
+{
+  xassert(strength >= 1 && strength <= SHARPEN_STRENGTH_MAX);
+  xassert((width % 16) == 0 && width >= 16);
+  xassert(((uintptr_t)ring & 0x3) == 0);
+
+  state->strength = strength;
+  state->width = width;
+  state->rows_in = 0;
+  state->rows_out = 0;
+  state->ring = ring;
+
+  static const int8_t blur[3] = {1, 2, 1};
+  for (unsigned t = 0; t < 3; t++) {
+    memset(state->coef_h[t], blur[t], 16);
+  }
+
+  // in + s * (in - B(in)) in Q6, with s = strength / 16: the centre gets
+  // 64 + 4 * strength, split in int8 taps, the blurred rows -strength * [1 2 1]
+  unsigned centre = (1 << SHARPEN_SHIFT) + 4 * strength;
+  unsigned t = 0;
+  while (centre > 0) {
+    const unsigned coef = (centre > INT8_MAX) ? INT8_MAX : centre;
+    memset(state->coef_v[t++], coef, 16);
+    centre -= coef;
+  }
+  state->centre_taps = t;
+  for (unsigned k = 0; k < 3; k++) {
+    memset(state->coef_v[t + k], -(int)(blur[k] * strength), 16);
+  }
+
+  for (unsigned k = 0; k < 16; k++) {
+    state->shifts_h[k] = 2;
+    state->shifts_v[k] = SHARPEN_SHIFT;
+  }
+}
+
+
+unsigned isp_sharpen_push_row(
+    sharpen_state_t* state,
+    int8_t output[],
+    const int8_t input[],
+    unsigned* row_index)
+{
+  const unsigned row = state->rows_in;
+  memcpy(sharpen_input_row(state, row), input, APP_IMAGE_CHANNEL_COUNT * state->width);
+  sharpen_blur_h(state, input, row);
+  state->rows_in++;
+
+  // The row above has the row below it now
+  if (row == 0) {
+    return 0;
+  }
+  *row_index = state->rows_out;
+  sharpen_row(state, output, state->rows_out);
+  state->rows_out++;
+  return 1;
+}
+
+
+unsigned isp_sharpen_drain(
+    sharpen_state_t* state,
+    int8_t output[],
+    unsigned* row_index)
+{
+  if (state->rows_out >= state->rows_in) {
+    return 0;
+  }
+  *row_index = state->rows_out;
+  sharpen_row(state, output, state->rows_out);
+  state->rows_out++;
+  return 1;
+}
@@ -85,6 +85,21 @@ void stats_compute_histograms(
     compute_hist_channel(&histograms->histogram_blue,  pix_out[2], width);
 }
 
+void stats_compute_histograms_luma(
+    histograms_t *histograms,
+    const uint32_t width,
+    const int8_t luma[width])
+{
+    compute_hist_channel(&histograms->histogram_green, luma, width);
+}
+
+void stats_histograms_from_luma(
+    histograms_t* histograms)
+{
+    histograms->histogram_red  = histograms->histogram_green;
+    histograms->histogram_blue = histograms->histogram_green;
+}
+
 void stats_reset(
     histograms_t* histograms,
     statistics_t* stats)
@@ -125,3 +140,61 @@ float stats_compute_mean_skewness(statistics_t *stats)
   mean /= 3.0;
   return mean;
 }
+
+
+// ---------------------- Black level ----------------------
+void stats_black_level_row(
+    black_level_t* black_level,
+    const int8_t row[],
+    const unsigned width,
+    const unsigned row_index)
+{
+  // RG rows give red and green, GB rows blue
+  const unsigned odd = row_index & 1;
+  const unsigned c0 = odd ? CHAN_BLUE : CHAN_RED;
+  const unsigned x0 = odd ? 1 : 0;
+
+  for (unsigned x = x0; x < width; x += BLACK_LEVEL_STEP) {
+    black_level->sum[c0] += row[x] + 128;
+    black_level->count[c0]++;
+  }
+  if (!odd) {
+    for (unsigned x = 1; x < width; x += BLACK_LEVEL_STEP) {
+      black_level->sum[CHAN_GREEN] += row[x] + 128;
+      black_level->count[CHAN_GREEN]++;
+    }
+  }
+}
+
+void stats_black_level_frame_end(
+    black_level_t* black_level)
+{
+  // A frame cut short may not have reached every channel
+  unsigned complete = 1;
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    complete &= (black_level->count[c] != 0);
+  }
+
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    if (complete) {
+      const int32_t mean_q8 = (black_level->sum[c] << 8) / (int32_t)black_level->count[c];
+      if (black_level->valid) {
+        black_level->level_q8[c] += (mean_q8 - black_level->level_q8[c]) >> BLACK_LEVEL_AVG_SHIFT;
+      }
+      else {
+        black_level->level_q8[c] = mean_q8;
+      }
+    }
+    black_level->sum[c] = 0;
+    black_level->count[c] = 0;
+  }
+  black_level->valid |= complete;
+}
+
+float stats_black_level(
+    const black_level_t* black_level,
+    const unsigned channel)
+{
+  xassert(black_level->valid);
+  return black_level->level_q8[channel] * (1.0f / 256);
+}
@@ -0,0 +1,96 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <xcore/assert.h>
+
+#include "isp_tnr.h"
+
+
+void isp_tnr_init(
+    tnr_state_t* state,
+    int8_t* prev,
+    const size_t prev_bytes)
+{
+  xassert(((uintptr_t)prev & 0x3) == 0);
+
+  state->prev = prev;
+  state->prev_bytes = prev_bytes;
+  state->width = 0;
+  state->height = 0;
+  state->primed = 0;
+  state->seed = 0;
+  memset(state->vec[TNR_VEC_64], 1 << TNR_SHIFT, sizeof(state->vec[0]));
+  for (unsigned k = 0; k < 16; k++) {
+    state->shifts[k] = TNR_SHIFT;
+  }
+  isp_tnr_set(state, 0, 2);
+}
+
+
+int isp_tnr_set(
+    tnr_state_t* state,
+    const unsigned strength,
+    const unsigned threshold)
+{
+  if (strength > INT8_MAX || threshold < 2 || threshold > TNR_THRESHOLD_MAX) {
+    return -1;
+  }
+  // The kernel works on halved pixels
+  const int8_t t = threshold >> 1;
+
+  state->strength = strength;
+  state->threshold = threshold;
+  memset(state->vec[TNR_VEC_T], t, sizeof(state->vec[0]));
+  memset(state->vec[TNR_VEC_NEG_T], -t, sizeof(state->vec[0]));
+  memset(state->vec[TNR_VEC_T2], 2 * t, sizeof(state->vec[0]));
+  memset(state->vec[TNR_VEC_NEG_T2], -2 * t, sizeof(state->vec[0]));
+  memset(state->vec[TNR_VEC_COEF], -(int)strength, sizeof(state->vec[0]));
+  return 0;
+}
+
+
+unsigned isp_tnr_frame_init(
+    tnr_state_t* state,
+    const unsigned width,
+    const unsigned height)
+{
+  xassert((width % 16) == 0);
+
+  const unsigned fits = (APP_IMAGE_CHANNEL_COUNT * width * height <= state->prev_bytes);
+  if (state->strength == 0 || !fits) {
+    // Nothing goes into the buffer this frame
+    state->primed = 0;
+    return 0;
+  }
+
+  state->seed = !state->primed || width != state->width || height != state->height;
+  state->width = width;
+  state->height = height;
+  state->primed = 1;
+  return 1;
+}
+
+
+void isp_tnr_apply(
+    tnr_state_t* state,
+    int8_t row[],
+    const unsigned y)
+{
+  xassert(y < state->height);
+  xassert(((uintptr_t)row & 0x3) == 0);
+
+  const unsigned width = state->width;
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    int8_t* prev = &state->prev[(c * state->height + y) * width];
+    int8_t* pix = &row[c * width];
+    if (state->seed) {
+      memcpy(prev, pix, width);
+    }
+    else {
+      pixel_tnr_blend(pix, prev, pix, state->vec, state->shifts, width);
+    }
+  }
+}
@@ -0,0 +1,179 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <xcore/assert.h>
+
+#include "isp_yuv_rgb.h"
+#include "isp_demosaic.h" // pixel_demosaic_macc()
+
+// The matrices of rgb_to_yuv.S and yuv_to_rgb.S, in 1/256
+static
+const int16_t rgb_to_yuv_matrix[APP_IMAGE_CHANNEL_COUNT][APP_IMAGE_CHANNEL_COUNT] = {
+  {  77,  150,   29},
+  { -43,  -85,  128},
+  { 128, -107,  -21},
+};
+
+static
+const int16_t yuv_to_rgb_matrix[APP_IMAGE_CHANNEL_COUNT][APP_IMAGE_CHANNEL_COUNT] = {
+  { 256,    0,  292},
+  { 256, -101, -149},
+  { 256,  520,    0},
+};
+
+// Quantise a matrix in 1/256 to `shift` fractional bits, coefficients beyond
+// int8 are split over several taps of the same input channel
+static
+void color_conv_init(
+    color_conv_t* conv,
+    const int16_t matrix[APP_IMAGE_CHANNEL_COUNT][APP_IMAGE_CHANNEL_COUNT],
+    const unsigned shift)
+{
+  const int32_t half = (shift < 8) ? (1 << (7 - shift)) : 0;
+
+  memset(conv, 0, sizeof(color_conv_t));
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    unsigned n = 0;
+    for (unsigned j = 0; j < APP_IMAGE_CHANNEL_COUNT; j++) {
+      // Rounded half away from zero
+      const int32_t m = matrix[c][j];
+      int32_t q = (m >= 0) ? (m + half) >> (8 - shift) : -((-m + half) >> (8 - shift));
+      while (q != 0) {
+        const int32_t part = (q > INT8_MAX) ? INT8_MAX : (q < -INT8_MAX) ? -INT8_MAX : q;
+        xassert(n < YUV_RGB_TAP_MAX);
+        conv->tap_in[c][n] = j;
+        memset(conv->coef[c][n], (int8_t)part, 16);
+        q -= part;
+        n++;
+      }
+    }
+    conv->tap_count[c] = n;
+  }
+
+  for (unsigned k = 0; k < 16; k++) {
+    conv->shifts[k] = shift;
+  }
+}
+
+
+void isp_rgb_to_yuv_init(
+    color_conv_t* conv)
+{
+  color_conv_init(conv, rgb_to_yuv_matrix, 8);
+}
+
+
+void isp_yuv_to_rgb_init(
+    color_conv_t* conv)
+{
+  // Q7 saves two taps per channel, for 1 bit of precision
+  color_conv_init(conv, yuv_to_rgb_matrix, 7);
+}
+
+
+void isp_color_convert_planar(
+    const color_conv_t* conv,
+    int8_t output[],
+    const int8_t input[],
+    const unsigned pix_count,
+    const unsigned plane_stride)
+{
+  xassert((pix_count % 16) == 0 && pix_count > 0);
+  xassert((plane_stride % 4) == 0 && plane_stride >= pix_count);
+  xassert(output != input);
+  xassert((((uintptr_t)output | (uintptr_t)input) & 0x3) == 0);
+
+  demosaic_tap_t taps[YUV_RGB_TAP_MAX];
+
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    const unsigned tap_count = conv->tap_count[c];
+    for (unsigned t = 0; t < tap_count; t++) {
+      taps[t].pix = &input[conv->tap_in[c][t] * plane_stride];
+      taps[t].coef = &conv->coef[c][t][0];
+    }
+    pixel_demosaic_macc(&output[c * plane_stride], taps, tap_count,
+                        conv->shifts, pix_count);
+  }
+}
+
+
+void isp_color_convert_interleaved(
+    const color_conv_t* conv,
+    int8_t output[],
+    const int8_t input[],
+    const unsigned pix_count)
+{
+  xassert((pix_count % 16) == 0);
+
+  __attribute__((aligned(4))) int8_t planes_in[APP_IMAGE_CHANNEL_COUNT * YUV_RGB_BLOCK];
+  __attribute__((aligned(4))) int8_t planes_out[APP_IMAGE_CHANNEL_COUNT * YUV_RGB_BLOCK];
+
+  for (unsigned k0 = 0; k0 < pix_count; k0 += YUV_RGB_BLOCK) {
+    const unsigned n = (pix_count - k0 < YUV_RGB_BLOCK) ? pix_count - k0 : YUV_RGB_BLOCK;
+    const int8_t* pix_in = &input[k0 * APP_IMAGE_CHANNEL_COUNT];
+    int8_t* pix_out = &output[k0 * APP_IMAGE_CHANNEL_COUNT];
+
+    for (unsigned k = 0; k < n; k++) {
+      for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+        planes_in[c * YUV_RGB_BLOCK + k] = pix_in[k * APP_IMAGE_CHANNEL_COUNT + c];
+      }
+    }
+    isp_color_convert_planar(conv, planes_out, planes_in, n, YUV_RGB_BLOCK);
+    for (unsigned k = 0; k < n; k++) {
+      for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+        pix_out[k * APP_IMAGE_CHANNEL_COUNT + c] = planes_out[c * YUV_RGB_BLOCK + k];
+      }
+    }
+  }
+}
+
+
+void isp_yuv_pack_row(
+    uint8_t image[],
+    const yuv_format_t format,
+    const unsigned width,
+    const unsigned height,
+    const int8_t yuv_row[],
+    int8_t chroma[],
+    const unsigned row)
+{
+  xassert((width % 4) == 0 && row < height);
+  xassert((((uintptr_t)image | (uintptr_t)yuv_row) & 0x3) == 0);
+
+  // Y, int8 to uint8 four pixels at a time
+  uint32_t* y_out = (uint32_t*)&image[row * width];
+  const uint32_t* y_in = (const uint32_t*)yuv_row;
+  for (unsigned k = 0; k < width / 4; k++) {
+    y_out[k] = y_in[k] ^ 0x80808080;
+  }
+
+  const int8_t* u = &yuv_row[width];
+  const int8_t* v = &yuv_row[2 * width];
+  uint8_t* uv_plane = &image[width * height];
+
+  if (format == YUV_FORMAT_422) {
+    uint8_t* uv = &uv_plane[row * width];
+    for (unsigned x = 0; x < width; x += 2) {
+      uv[x] = (uint8_t)(((u[x] + u[x + 1] + 1) >> 1) + 128);
+      uv[x + 1] = (uint8_t)(((v[x] + v[x + 1] + 1) >> 1) + 128);
+    }
+    return;
+  }
+
+  xassert(format == YUV_FORMAT_NV12);
+  if ((row & 1) == 0) {
+    for (unsigned x = 0; x < width; x += 2) {
+      chroma[x] = (u[x] + u[x + 1] + 1) >> 1;
+      chroma[x + 1] = (v[x] + v[x + 1] + 1) >> 1;
+    }
+    return;
+  }
+  uint8_t* uv = &uv_plane[(row / 2) * width];
+  for (unsigned x = 0; x < width; x += 2) {
+    uv[x] = (uint8_t)(((2 * chroma[x] + u[x] + u[x + 1] + 2) >> 2) + 128);
+    uv[x + 1] = (uint8_t)(((2 * chroma[x + 1] + v[x] + v[x + 1] + 2) >> 2) + 128);
+  }
+}
@@ -13,6 +13,7 @@
 #include "camera_api.h"
 #include "camera_utils.h"
 #include "sensor.h"
+#include "sensor_control.h"
 
 // Contains the local state info for the packet handler thread.
 static frame_state_t ph_state = {
@@ -23,6 +24,9 @@ static frame_state_t ph_state = {
 };
 static row_info_t row_info;
 
+// Current sensor mode, selects the expected data type and frame height
+static camera_mode_t ph_mode = CAMERA_MODE_DEFAULT;
+
 // -------- Error handling --------
 static
 void handle_unknown_packet(
@@ -34,7 +38,7 @@ void handle_unknown_packet(
 static
 void handle_no_expected_lines()
 {
-  if(ph_state.in_line_number >= SENSOR_RAW_IMAGE_HEIGHT_PIXELS){
+  if(ph_state.in_line_number >= MODE_HEIGHT_PIXELS(ph_mode.resolution)){
     // We've received more lines of image data than we expected.
     #ifdef ASSERT_ON_TOO_MANY_LINES
           xassert(0 && "Recieved too many lines");
@@ -88,6 +92,28 @@ void handle_frame_end(
   xassert(resp == RESP_OK && "Error in ISP process EOF\n"); 
 }
 
+static
+void handle_sensor_request(
+    chanend_t c_isp)
+{
+  uint32_t encoded_cmd;
+  if(!camera_check_sensor_cmd(&encoded_cmd)) return;
+
+  if(DECODE_CMD(encoded_cmd) == SENSOR_SET_MODE){
+    uint16_t arg = DECODE_ARG(encoded_cmd);
+    ph_mode.resolution = (resolution_t)MODE_DECODE_RES(arg);
+    ph_mode.pixel_format = (pixel_format_t)MODE_DECODE_FMT(arg);
+    ph_mode.binning = MODE_DECODE_BINNING(arg);
+    // Drop anything until the first frame in the new mode
+    ph_state.wait_for_frame_start = 1;
+  }
+
+  // The ISP forwards it to the sensor and applies it at the next frame start
+  isp_cmd_t resp = isp_send_cmd(c_isp, SENSOR_UPDATE);
+  xassert(resp == RESP_OK && "Error in ISP sensor update\n");
+  isp_send_sensor_cmd(c_isp, encoded_cmd);
+}
+
 
 static
 void handle_packet(
@@ -113,18 +139,21 @@ void handle_packet(
       handle_frame_start(c_isp);   
       break;
 
-    case MIPI_EXPECTED_FORMAT:     
-      handle_no_expected_lines();
-      handle_pixel_data(pkt, c_isp);
-      ph_state.in_line_number++;
-      break;
-
     case MIPI_DT_FRAME_END:   
       handle_frame_end(pkt, c_isp);
+      // Sensor changes are only applied between frames
+      handle_sensor_request(c_isp);
       break;
 
-    default:              
-      handle_unknown_packet(data_type);   
+    default:
+      if(data_type == (mipi_data_type_t)ph_mode.pixel_format){
+        handle_no_expected_lines();
+        handle_pixel_data(pkt, c_isp);
+        ph_state.in_line_number++;
+      }
+      else{
+        handle_unknown_packet(data_type);
+      }
       break;
   }
 }
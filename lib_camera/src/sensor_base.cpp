@@ -4,6 +4,7 @@
 #include <stdio.h>
 
 #include "sensor_base.hpp"
+#include "sensor_i2c_mock.h"
 
 using namespace sensor;
 
@@ -12,6 +13,10 @@ SensorBase::SensorBase(i2c_config_t _conf) : i2c_cfg(_conf) {
 }
 
 void SensorBase::i2c_init() {
+#if SENSOR_I2C_MOCK
+  i2c_mock_reset(this->i2c_cfg.speed);
+  puts("\nI2C mock initialized...");
+#else
   i2c_master_init(
     this->i2c_cfg.i2c_ctx_ptr,
     this->i2c_cfg.p_scl, 1, 0xC,
@@ -19,9 +24,14 @@ void SensorBase::i2c_init() {
     this->i2c_cfg.speed);
   delay_milliseconds(100);
   puts("\nI2C initialized...");
+#endif
 }
 
 uint16_t SensorBase::i2c_read(uint16_t reg) {
+#if SENSOR_I2C_MOCK
+  uint16_t result = i2c_mock_read_reg8_addr16(reg) << 8;
+  result |= i2c_mock_read_reg8_addr16(reg + 1);
+#else
   i2c_regop_res_t op_code;
 
   uint16_t result = read_reg16(
@@ -31,25 +41,25 @@ uint16_t SensorBase::i2c_read(uint16_t reg) {
     &op_code);
 
   xassert((op_code == I2C_REGOP_SUCCESS) && "Could not read from I2C");
+#endif
   return result;
 }
 
 int SensorBase::i2c_write_line(i2c_line_t line) {
-  i2c_regop_res_t op_code = write_reg8_addr16(
-    this->i2c_cfg.i2c_ctx_ptr,
-    this->i2c_cfg.device_addr,
-    line.reg_addr,
-    line.reg_val);
-  return op_code != I2C_REGOP_SUCCESS ? -1 : 0;
+  return this->i2c_write_line(line.reg_addr, (uint8_t)line.reg_val);
 }
 
 int SensorBase::i2c_write_line(uint16_t reg, uint8_t val) {
+#if SENSOR_I2C_MOCK
+  return i2c_mock_write_reg8_addr16(reg, val);
+#else
   i2c_regop_res_t op_code = write_reg8_addr16(
     this->i2c_cfg.i2c_ctx_ptr,
     this->i2c_cfg.device_addr,
     reg,
     val);
   return op_code != I2C_REGOP_SUCCESS ? -1 : 0;
+#endif
 }
 
 int SensorBase::i2c_write_table(i2c_table_t table) {
@@ -63,10 +73,15 @@ int SensorBase::i2c_write_table(i2c_table_t table) {
     
     // pause if we reset the device
     if (address == sleep_adr) {
-      delay_ticks(sleep_ticks);
+      #if SENSOR_I2C_MOCK
+        i2c_mock_delay(sleep_ticks);
+      #else
+        delay_ticks(sleep_ticks);
+      #endif
       #if PRINT_I2C_REG
         printf("sleeping...\n");
       #endif
+      continue;
     }
 
     // if continuous mode
@@ -91,33 +106,9 @@ int SensorBase::i2c_write_table(i2c_table_t table) {
   return ret != I2C_REGOP_SUCCESS ? -1 : 0;
 }
 
-int SensorBase::initialize() {
-  xassert(0 && "Sensor Exception: Make sure your initialize() method is implemented and called from the derived class");
-  return -1;
-}
-
-int SensorBase::stream_start() {
-  xassert(0 && "Sensor Exception: Make sure your stream_start() method is implemented and called from the derived class");
-  return -1;
-}
-
-int SensorBase::stream_stop() {
-  xassert(0 && "Sensor Exception: Make sure your stream_stop() method is implemented and called from the derived class");
-  return -1;
-}
-
-int SensorBase::set_exposure(uint32_t dBGain) {
-  (void)dBGain;
-  xassert(0 && "Sensor Exception: Make sure your set_exposure() method is implemented and called from the derived class");
-  return -1;
-}
-
-int SensorBase::configure() {
-  xassert(0 && "Sensor Exception: Make sure your configure() method is implemented and called from the derived class");
-  return -1;
-}
-
-void SensorBase::control(chanend_t c_control) {
-  (void)c_control;
-  xassert(0 && "Sensor Exception: Make sure your control() method is implemented and called from the derived class");
+int SensorBase::i2c_write_reg16(uint16_t reg, uint16_t val) {
+  int ret = 0;
+  ret |= this->i2c_write_line(reg,     (uint8_t)(val >> 8));
+  ret |= this->i2c_write_line(reg + 1, (uint8_t)(val));
+  return ret;
 }
@@ -2,7 +2,14 @@
 // This Software is subject to the terms of the XMOS Public Licence: Version 1.
 
 #include "sensor_control.h"
+
+// Sensor driver selection, resolved at compile time
+#if (CONFIG_IMX219_SUPPORT)
 #include "imx219.hpp"
+typedef sensor::IMX219 sensor_driver_t;
+#else
+#error "No sensor selected, see CONFIG_*_SUPPORT in sensor.h"
+#endif
 
 using namespace sensor;
 
@@ -17,10 +24,10 @@ void sensor_control(chanend_t c_control) {
   i2c_conf.p_sda = XS1_PORT_4E;
   i2c_conf.i2c_ctx_ptr = &i2c_ctx;
 
-  const bool binning = true;
+  const bool binning = CONFIG_BINNING;
   const bool centralise = true;
 
-  IMX219 snsr(
+  sensor_driver_t snsr(
     i2c_conf, 
     (resolution_t)CONFIG_MODE, 
     (pixel_format_t)CONFIG_MIPI_FORMAT, 
@@ -0,0 +1,176 @@
+// Copyright 2023-2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <string.h>
+
+#include <xcore/assert.h>
+
+#include "sensor_i2c_mock.h"
+
+// Only built for the tests, the register map and log stay out of the firmware
+#if SENSOR_I2C_MOCK
+
+// IMX219 registers with the behaviour emulated by the mock
+#define MOCK_REG_MODEL_ID       0x0000
+#define MOCK_REG_MODE_SELECT    0x0100
+#define MOCK_REG_SW_RESET       0x0103
+
+typedef struct {
+  uint16_t reg;
+  uint8_t val;
+} mock_reg_t;
+
+// IMX219 power-up values, any other register reads as 0 until written
+static
+const mock_reg_t imx219_reset_values[] = {
+  {MOCK_REG_MODEL_ID,     0x02},
+  {MOCK_REG_MODEL_ID + 1, 0x19},
+  {MOCK_REG_MODE_SELECT,  0x00},
+  {0x0162,                0x0D}, // LINE_LENGTH_A
+  {0x0163,                0x78},
+};
+
+static mock_reg_t reg_map[I2C_MOCK_MAX_REGS];
+static unsigned reg_count = 0;
+
+static i2c_mock_transaction_t log_buff[I2C_MOCK_LOG_SIZE];
+static unsigned log_count = 0;
+
+static unsigned bus_speed_khz = 400;
+static uint32_t bus_time = 0;
+static uint32_t sim_time = 0;
+
+static
+mock_reg_t* reg_find(
+    const uint16_t reg)
+{
+  for (unsigned k = 0; k < reg_count; k++) {
+    if (reg_map[k].reg == reg) {
+      return &reg_map[k];
+    }
+  }
+  return NULL;
+}
+
+static
+void reg_set(
+    const uint16_t reg,
+    const uint8_t val)
+{
+  mock_reg_t* entry = reg_find(reg);
+  if (entry == NULL) {
+    xassert(reg_count < I2C_MOCK_MAX_REGS && "I2C mock register map is full");
+    entry = &reg_map[reg_count++];
+    entry->reg = reg;
+  }
+  entry->val = val;
+}
+
+static
+void reg_map_reset()
+{
+  reg_count = 0;
+  const unsigned n = sizeof(imx219_reset_values) / sizeof(mock_reg_t);
+  for (unsigned k = 0; k < n; k++) {
+    reg_set(imx219_reset_values[k].reg, imx219_reset_values[k].val);
+  }
+}
+
+static
+void log_transaction(
+    const uint16_t reg,
+    const uint8_t val,
+    const uint8_t is_read)
+{
+  const unsigned bits = is_read ? I2C_MOCK_READ_BITS : I2C_MOCK_WRITE_BITS;
+  const uint32_t ticks = I2C_MOCK_TICKS(bits, bus_speed_khz);
+  bus_time += ticks;
+  sim_time += ticks;
+
+  if (log_count < I2C_MOCK_LOG_SIZE) {
+    i2c_mock_transaction_t* t = &log_buff[log_count];
+    t->reg = reg;
+    t->val = val;
+    t->is_read = is_read;
+    t->time = sim_time;
+  }
+  log_count++;
+}
+
+void i2c_mock_reset(
+    const unsigned speed_khz)
+{
+  xassert(speed_khz > 0);
+  bus_speed_khz = speed_khz;
+  bus_time = 0;
+  sim_time = 0;
+  log_count = 0;
+  memset(log_buff, 0, sizeof(log_buff));
+  reg_map_reset();
+}
+
+int i2c_mock_write_reg8_addr16(
+    const uint16_t reg,
+    const uint8_t val)
+{
+  log_transaction(reg, val, 0);
+  if (reg == MOCK_REG_SW_RESET && (val & 0x01)) {
+    // Reset self-clears
+    reg_map_reset();
+    return 0;
+  }
+  reg_set(reg, val);
+  return 0;
+}
+
+uint8_t i2c_mock_read_reg8_addr16(
+    const uint16_t reg)
+{
+  uint8_t val = i2c_mock_get_reg(reg);
+  log_transaction(reg, val, 1);
+  return val;
+}
+
+void i2c_mock_delay(
+    const unsigned ticks)
+{
+  sim_time += ticks;
+}
+
+unsigned i2c_mock_get_transaction_count()
+{
+  return log_count;
+}
+
+const i2c_mock_transaction_t* i2c_mock_get_transaction(
+    const unsigned index)
+{
+  xassert(index < I2C_MOCK_LOG_SIZE);
+  return &log_buff[index];
+}
+
+uint32_t i2c_mock_get_time()
+{
+  return sim_time;
+}
+
+uint32_t i2c_mock_get_bus_time()
+{
+  return bus_time;
+}
+
+uint8_t i2c_mock_get_reg(
+    const uint16_t reg)
+{
+  mock_reg_t* entry = reg_find(reg);
+  return (entry == NULL) ? 0 : entry->val;
+}
+
+uint16_t i2c_mock_get_reg16(
+    const uint16_t reg)
+{
+  return ((uint16_t)i2c_mock_get_reg(reg) << 8) | i2c_mock_get_reg(reg + 1);
+}
+
+#endif // SENSOR_I2C_MOCK
@@ -13,16 +13,21 @@ using namespace sensor;
 #include "imx219_reg.h"
 
 IMX219::IMX219(i2c_config_t _conf,resolution_t _res, pixel_format_t _pix_fmt, bool _binning, bool _centralize)
-        : sensor::SensorBase(_conf), frame_res(_res), pix_fmt(_pix_fmt),
-        binning_2x2(_binning) {
+        : SensorDriver<IMX219>(_conf), frame_res(_res), pix_fmt(_pix_fmt),
+        binning_2x2(_binning), centralise(_centralize),
+        line_length(LINE_LENGTH_MIN), frame_length(0), target_fps(0), isp_row_ticks(0),
+        test_pattern(TEST_PATTERN_NONE) {
   this->get_x_y_len();
   this->get_offsets_and_check_ranges(_centralize);
   this->adjust_offsets();
 }
 
 IMX219::IMX219(i2c_config_t _conf,resolution_t _res, pixel_format_t _pix_fmt, bool _binning, uint16_t _x_offset, uint16_t _y_offset)
-        : sensor::SensorBase(_conf), frame_res(_res), pix_fmt(_pix_fmt),
-        binning_2x2(_binning), x_offset(_x_offset), y_offset(_y_offset) {
+        : SensorDriver<IMX219>(_conf), frame_res(_res), pix_fmt(_pix_fmt),
+        binning_2x2(_binning), x_offset(_x_offset), y_offset(_y_offset),
+        centralise(false),
+        line_length(LINE_LENGTH_MIN), frame_length(0), target_fps(0), isp_row_ticks(0),
+        test_pattern(TEST_PATTERN_NONE) {
   this->get_x_y_len();
   this->check_ranges();
   this->adjust_offsets();
@@ -47,83 +52,129 @@ int IMX219::stream_stop() {
   return this->i2c_write_table(GET_TABLE(stop_regs));
 }
 
+int IMX219::set_fps(uint16_t fps) {
+  if(fps == 0) {
+    puts("Warning: frame rate has to be greater than 0");
+    return 0;
+  }
+  return this->apply_timing(this->line_length, fps);
+}
+
+int IMX219::set_line_length(uint16_t _line_length) {
+  return this->apply_timing(_line_length, this->target_fps);
+}
+
+int IMX219::set_test_pattern(sensor_test_pattern_t pattern) {
+  if(pattern > TEST_PATTERN_PN9) {
+    puts("Warning: unknown test pattern");
+    return 0;
+  }
+  this->test_pattern = pattern;
+  int ret = 0;
+  if(pattern != TEST_PATTERN_NONE) {
+    ret |= this->write_test_pattern_window();
+  }
+  if(pattern == TEST_PATTERN_SOLID) {
+    for(unsigned k = 0; k < 4; k++) {
+      ret |= this->i2c_write_reg16(TEST_DATA_RED_REG + 2 * k, TEST_PATTERN_SOLID_VALUE);
+    }
+  }
+  ret |= this->i2c_write_reg16(TEST_PATTERN_MODE_REG, (uint16_t)pattern);
+  return ret;
+}
+
+int IMX219::write_test_pattern_window() {
+  int ret = 0;
+  ret |= this->i2c_write_reg16(TP_WINDOW_WIDTH_REG, this->x_len);
+  ret |= this->i2c_write_reg16(TP_WINDOW_HEIGHT_REG, this->y_len);
+  return ret;
+}
+
+void IMX219::set_isp_row_time(uint16_t ticks) {
+  this->isp_row_ticks = ticks;
+  if(!this->timing_fits(this->line_length, this->frame_length)) {
+    printf("Warning: ISP row time (%d ticks) exceeds the line period\n", ticks);
+  }
+}
+
+bool IMX219::timing_fits(uint16_t _line_length, uint32_t _frame_length) {
+  if((_line_length < LINE_LENGTH_MIN) || (_line_length > LINE_LENGTH_MAX)) {
+    return false;
+  }
+  if((_frame_length != 0) &&
+     ((_frame_length < (uint32_t)(this->y_len + FRM_BLANKING_MIN)) || (_frame_length > FRM_LENGTH_MAX))) {
+    return false;
+  }
+  // The packet handler waits for the ISP on every row
+  uint32_t line_ticks = ((uint64_t)_line_length * REF_CLK_HZ) / PIXEL_RATE_HZ;
+  return this->isp_row_ticks <= line_ticks;
+}
+
+int IMX219::apply_timing(uint16_t _line_length, uint16_t fps) {
+  uint32_t _frame_length = this->frame_length;
+  if(fps != 0) {
+    _frame_length = PIXEL_RATE_HZ / ((uint32_t)_line_length * fps);
+  }
+  if(!this->timing_fits(_line_length, _frame_length)) {
+    puts("Warning: sensor timing rejected, keeping current settings");
+    return 0;
+  }
+  this->line_length = _line_length;
+  this->frame_length = (uint16_t)_frame_length;
+  this->target_fps = fps;
+
+  int ret = 0;
+  ret |= this->i2c_write_reg16(LINE_LENGTH_REG, this->line_length);
+  if(this->frame_length != 0) {
+    ret |= this->i2c_write_reg16(FRM_LENGTH_REG, this->frame_length);
+  }
+  return ret;
+}
+
 int IMX219::set_exposure(uint32_t dBGain) {
-  i2c_table_t exposure_regs = this->get_exp_gains_table(dBGain);
-  return this->i2c_write_table(exposure_regs);
+  return this->write_exp_gains(dBGain);
 }
 
 int IMX219::configure() {
-  i2c_table_t frame_size_regs = this->get_res_table();
-  i2c_table_t pix_format_regs = this->get_pxl_fmt_table();
-  i2c_line_t binning_reg[1] = {{BINNING_MODE_REG, 0}};
-  binning_reg[0].reg_val = (this->binning_2x2) ? BINNING_2X2 : BINNING_NONE;
-
   int ret = 0;
   // Apply default values of current mode
-  ret |= this->i2c_write_table(frame_size_regs);
+  ret |= this->write_res();
   // set frame format register
-  ret |= this->i2c_write_table(pix_format_regs);
-  // set binning
-  ret |= this->i2c_write_table(GET_TABLE(binning_reg));
+  ret |= this->write_pxl_fmt();
+  // set binning (H and V)
+  ret |= this->i2c_write_reg16(BINNING_MODE_REG,
+    (this->binning_2x2) ? BINNING_2X2 : BINNING_NONE);
   return ret;
 }
 
-void IMX219::control(chanend_t c_control) {
-  // Init the I2C sensor first configuration
+int IMX219::set_mode(resolution_t _res, pixel_format_t _pix_fmt, bool _binning) {
+  this->frame_res = _res;
+  this->pix_fmt = _pix_fmt;
+  this->binning_2x2 = _binning;
+  this->get_x_y_len();
+  if(this->centralise) {
+    this->get_offsets_and_check_ranges(true);
+  } else {
+    this->check_ranges();
+  }
+  this->adjust_offsets();
+
   int ret = 0;
-  ret |= this->initialize();
-  delay_milliseconds(100);
+  ret |= this->stream_stop();
   ret |= this->configure();
-  delay_milliseconds(600);
-  ret |= this->stream_start();
-  delay_milliseconds(600);
-  xassert((ret == 0) && "Could not initialise camera");
-  puts("\nCamera_started and configured...");
-
-  // store the response
-  uint32_t encoded_response;
-  sensor_control_t cmd;
-  uint8_t arg;
-
-  // sensor control logic
-  while(1) {
-    encoded_response = chan_in_word(c_control);
-    chan_out_word(c_control, 0);
-    cmd = (sensor_control_t) DECODE_CMD(encoded_response);
-
-    #if ENABLE_PRINT_SENSOR_CONTROL
-      printf("--------------- Received command %d\n", cmd);
-    #endif
-    
-    switch (cmd)
-    {
-    case SENSOR_INIT:
-      ret = this->initialize();
-      break;
-    case SENSOR_CONFIG:
-      //TODO reimplement when dynamic configuration is supported
-      ret = this->configure();
-      break;
-    case SENSOR_STREAM_START:
-      ret = this->stream_start();
-      break;
-    case SENSOR_STREAM_STOP:
-      ret = this->stream_stop();            
-      break;
-    case SENSOR_SET_EXPOSURE:
-      arg = DECODE_ARG(encoded_response);
-      ret = this->set_exposure(arg);
-      break;
-    default:
-      break;
-    }
-    xassert((ret == 0) && "Could not perform I2C write");
+  if(this->frame_length != 0) {
+    // Frame length limits depend on the frame height
+    ret |= this->apply_timing(this->line_length, this->target_fps);
   }
+  if(this->test_pattern != TEST_PATTERN_NONE) {
+    // The pattern window has to follow the new output size
+    ret |= this->write_test_pattern_window();
+  }
+  ret |= this->stream_start();
+  return ret;
 }
 
-i2c_table_t IMX219::get_exp_gains_table(uint32_t dBGain) {
-  static i2c_line_t exposure_regs[5];
-  static i2c_table_t exposure_table = {exposure_regs, 5};
+int IMX219::write_exp_gains(uint32_t dBGain) {
   uint16_t time, dgain;
   uint8_t again;
   if (dBGain > GAIN_MAX_DB)
@@ -150,18 +201,20 @@ i2c_table_t IMX219::get_exp_gains_table(uint32_t dBGain) {
       dgain = gain_digital_gains[dBGain - INTEGRATION_TIMES - ANALOGUE_GAINS + 1];
     }
   }
-  exposure_regs[0] = {0x0157, again};
-  exposure_regs[1] = {0x0158, (uint8_t)(dgain >> 8)};
-  exposure_regs[2] = {0x0159, (uint8_t)(dgain)};
-  exposure_regs[3] = {0x015A, (uint8_t)(time >> 8)};
-  exposure_regs[4] = {0x015B, (uint8_t)(time)};
-  return exposure_table;
+  // Integration time can't exceed the frame length
+  if((this->frame_length != 0) && (time > this->frame_length - FRM_LENGTH_EXPOSURE_MARGIN))
+  {
+    time = this->frame_length - FRM_LENGTH_EXPOSURE_MARGIN;
+  }
+  int ret = 0;
+  ret |= this->i2c_write_line(ANA_GAIN_GLOBAL_REG, again);
+  ret |= this->i2c_write_reg16(DIG_GAIN_GLOBAL_REG, dgain);
+  ret |= this->i2c_write_reg16(COARSE_INTEG_TIME_REG, time);
+  return ret;
 }
 
-i2c_table_t IMX219::get_pxl_fmt_table() {
-  static i2c_line_t format_regs[3];
-  static i2c_table_t format_table = {format_regs, 3};
-  uint16_t val = 0;
+int IMX219::write_pxl_fmt() {
+  uint8_t val = 0;
   if(pix_fmt == FMT_RAW8) {
     val = 0x08;
   } else if(pix_fmt == FMT_RAW10) {
@@ -169,35 +222,29 @@ i2c_table_t IMX219::get_pxl_fmt_table() {
   } else {
     xassert(0 && "Pixel format has to be either RAW8 or RAW10");
   }
-  format_regs[0] = {0x018c, val};
-  format_regs[1] = {0x018d, val};
-  format_regs[2] = {0x0309, val};
-  return format_table;
+  int ret = 0;
+  ret |= this->i2c_write_line(CSI_DATA_FORMAT_REG, val);
+  ret |= this->i2c_write_line(CSI_DATA_FORMAT_REG + 1, val);
+  ret |= this->i2c_write_line(OPPXCK_DIV_REG, val);
+  return ret;
 }
 
-i2c_table_t IMX219::get_res_table() {
-  static i2c_line_t resolution_regs[12];
-  static i2c_table_t resolution_table = {resolution_regs, 12};
+int IMX219::write_res() {
   uint16_t x_full_len = (this->binning_2x2) ? this->x_len * 2 : this->x_len;
   uint16_t y_full_len = (this->binning_2x2) ? this->y_len * 2 : this->y_len;
   uint16_t x_end = this->x_offset + x_full_len - 1;
   uint16_t y_end = this->y_offset + y_full_len - 1;
+  int ret = 0;
   // x start - end
-  resolution_regs[0]  = {0x0164, (uint8_t)(this->x_offset >> 8)};
-  resolution_regs[1]  = {0x0165, (uint8_t)(this->x_offset)};
-  resolution_regs[2]  = {0x0166, (uint8_t)(x_end >> 8)};
-  resolution_regs[3]  = {0x0167, (uint8_t)(x_end)};
+  ret |= this->i2c_write_reg16(X_ADD_STA_REG, this->x_offset);
+  ret |= this->i2c_write_reg16(X_ADD_END_REG, x_end);
   // y start - end
-  resolution_regs[4]  = {0x0168, (uint8_t)(this->y_offset >> 8)};
-  resolution_regs[5]  = {0x0169, (uint8_t)(this->y_offset)};
-  resolution_regs[6]  = {0x016a, (uint8_t)(y_end >> 8)};
-  resolution_regs[7]  = {0x016b, (uint8_t)(y_end)};
+  ret |= this->i2c_write_reg16(Y_ADD_STA_REG, this->y_offset);
+  ret |= this->i2c_write_reg16(Y_ADD_END_REG, y_end);
   // x, y len (non binned)
-  resolution_regs[8]  = {0x016c, (uint8_t)(this->x_len >> 8)};
-  resolution_regs[9]  = {0x016d, (uint8_t)(this->x_len)};
-  resolution_regs[10] = {0x016e, (uint8_t)(this->y_len >> 8)};
-  resolution_regs[11] = {0x016f, (uint8_t)(this->y_len)};
-  return resolution_table;
+  ret |= this->i2c_write_reg16(X_OUTPUT_SIZE_REG, this->x_len);
+  ret |= this->i2c_write_reg16(Y_OUTPUT_SIZE_REG, this->y_len);
+  return ret;
 }
 
 void IMX219::get_x_y_len() {
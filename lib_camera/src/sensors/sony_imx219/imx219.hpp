@@ -11,7 +11,7 @@
 
 namespace sensor {
 
-class IMX219 : public SensorBase {
+class IMX219 : public SensorDriver<IMX219> {
 
   private:
 
@@ -28,6 +28,29 @@ class IMX219 : public SensorBase {
     uint16_t x_len, y_len;
     uint16_t x_offset, y_offset;
 
+    /**
+     * @brief If set, offsets are recalculated to centralise the frame on every mode change
+     */
+    bool centralise;
+
+    /**
+     * @brief Frame timing: line length in pixel clocks, frame length in lines
+     * (0 keeps the sensor default) and target frame rate (0 if not set)
+     */
+    uint16_t line_length;
+    uint16_t frame_length;
+    uint16_t target_fps;
+
+    /**
+     * @brief Worst-case ISP processing time of one row, in reference clock ticks
+     */
+    uint16_t isp_row_ticks;
+
+    /**
+     * @brief Current test pattern, its window is re-sent on every mode change
+     */
+    sensor_test_pattern_t test_pattern;
+
     /**
      * @brief Get X and Y lenghts
      */
@@ -51,25 +74,53 @@ class IMX219 : public SensorBase {
     void adjust_offsets();
 
     /**
-     * @brief Get pixel format register table
+     * @brief Checks that the given timing is within sensor limits and that
+     * the ISP can process a row within one line period
+     *
+     * @param _line_length  Line length in pixel clocks
+     * @param _frame_length Frame length in lines, 0 for the sensor default
+     * @returns             true if the timing can be used
+     */
+    bool timing_fits(uint16_t _line_length, uint32_t _frame_length);
+
+    /**
+     * @brief Validates and applies line length and frame rate, keeps the current
+     * timing and prints a warning if they don't fit
+     *
+     * @param _line_length  Line length in pixel clocks
+     * @param fps           Target frame rate, 0 to keep the current frame length
+     * @returns             0 if succeeded or rejected, -1 if I2C failed
+     */
+    int apply_timing(uint16_t _line_length, uint16_t fps);
+
+    /**
+     * @brief Write the test pattern window, which has to match the output size
+     *
+     * @returns           0 if succeeded, -1 if failed
+     */
+    int write_test_pattern_window();
+
+    /**
+     * @brief Write pixel format registers
      *
-     * @param format_regs Pointer to I2C line structure to fill
+     * @returns           0 if succeeded, -1 if failed
      */
-    i2c_table_t get_pxl_fmt_table();
+    int write_pxl_fmt();
 
     /**
-     * @brief Get resolution register table
+     * @brief Write frame window (offsets, ends and output size) registers
      *
-     * @param resolution_regs Pointer to I2C line structure to fill
+     * @returns           0 if succeeded, -1 if failed
      */
-    i2c_table_t get_res_table();
+    int write_res();
 
     /**
-     * @brief Get exposure gains register table
+     * @brief Write exposure gains registers
      *
      * @param dBGain      Exposure gain in dB, can enable different types of camera gain
+     * @returns           0 if succeeded, -1 if failed
      */
-    i2c_table_t get_exp_gains_table(uint32_t dBGain);
+    int write_exp_gains(uint32_t dBGain);
 
   public:
 
@@ -135,11 +186,52 @@ class IMX219 : public SensorBase {
     int configure();
 
     /**
-     * @brief Control thread intry, will initialise and configure sensor inside
+     * @brief Change sensor resolution, RAW format and binning mode while running.
+     * Stops the stream, reconfigures the sensor and restarts the stream.
+     *
+     * @param _res        Resolution config
+     * @param _pix_fmt    RAW format
+     * @param _binning    2x2 binning mode
+     * @returns           0 if succeeded, -1 if failed
+     */
+    int set_mode(resolution_t _res, pixel_format_t _pix_fmt, bool _binning);
+
+    /**
+     * @brief Set frame rate by changing the frame length.
+     * Rejected with a warning if the frame length is out of range.
+     *
+     * @param fps         Frames per second
+     * @returns           0 if succeeded or rejected, -1 if I2C failed
+     */
+    int set_fps(uint16_t fps);
+
+    /**
+     * @brief Set line length. If a frame rate has been set, the frame length
+     * is recalculated to keep it. Rejected with a warning if the ISP row time
+     * no longer fits in the line period.
+     *
+     * @param _line_length Line length in pixel clocks (>= 3448)
+     * @returns           0 if succeeded or rejected, -1 if I2C failed
+     */
+    int set_line_length(uint16_t _line_length);
+
+    /**
+     * @brief Replace the image with a built-in test pattern. Unknown
+     * patterns are rejected with a warning. The pattern window follows
+     * later mode changes.
+     *
+     * @param pattern     Test pattern, TEST_PATTERN_NONE for the image
+     * @returns           0 if succeeded or rejected, -1 if I2C failed
+     */
+    int set_test_pattern(sensor_test_pattern_t pattern);
+
+    /**
+     * @brief Set the worst-case ISP processing time of one row, used to
+     * validate the line period
      *
-     * @param c_control   Control channel
+     * @param ticks       Row time in reference clock ticks
      */
-    void control(chanend_t c_control);
+    void set_isp_row_time(uint16_t ticks);
 
 }; // IMX219
 
@@ -19,6 +19,29 @@
 #define BINNING_NONE	    0x0000
 #define BINNING_2X2		    0x0101
 
+// Frame window
+#define X_ADD_STA_REG     0x0164
+#define X_ADD_END_REG     0x0166
+#define Y_ADD_STA_REG     0x0168
+#define Y_ADD_END_REG     0x016a
+#define X_OUTPUT_SIZE_REG 0x016c
+#define Y_OUTPUT_SIZE_REG 0x016e
+
+// Pixel format
+#define CSI_DATA_FORMAT_REG 0x018c
+#define OPPXCK_DIV_REG      0x0309
+
+// Exposure
+#define ANA_GAIN_GLOBAL_REG   0x0157
+#define DIG_GAIN_GLOBAL_REG   0x0158
+#define COARSE_INTEG_TIME_REG 0x015a
+
+// Test pattern
+#define TEST_PATTERN_MODE_REG   0x0600
+#define TEST_DATA_RED_REG       0x0602 // then GREENR, BLUE, GREENB, 10-bit each
+#define TP_WINDOW_WIDTH_REG     0x0624
+#define TP_WINDOW_HEIGHT_REG    0x0626
+
 // Sensor limits
 #define SENSOR_X_LIM      3280
 #define SENSOR_Y_LIM      2464
@@ -34,6 +57,21 @@
 #define PLL_VT_MPY          0x0040 // pll multiplier
 #endif
 
+// Frame timing
+// pixel rate = EXCK / PREPLLCK_VT_DIV * PLL_VT_MPY / VTPXCK_DIV * 2 (two pixel pipes)
+#define EXCK_FREQ_HZ        24000000
+#define VTPXCK_DIV          0x0A
+#define PIXEL_RATE_HZ       ((EXCK_FREQ_HZ / PREDVIDE_2) * PLL_VT_MPY / VTPXCK_DIV * 2)
+#define REF_CLK_HZ          100000000 // reference timer, used for ISP row times
+
+#define FRM_LENGTH_REG      0x0160
+#define LINE_LENGTH_REG     0x0162
+#define LINE_LENGTH_MIN     0x0D78    // 3448, also the power-up value set in imx219_common_regs
+#define LINE_LENGTH_MAX     0x7FF0
+#define FRM_LENGTH_MAX      0xFFFF
+#define FRM_BLANKING_MIN    32        // minimum vertical blanking, in lines
+#define FRM_LENGTH_EXPOSURE_MARGIN 4  // integration time must be <= frame length - 4
+
 // Gain params
 #define GAIN_MIN_DB         0
 #define GAIN_MAX_DB         84
@@ -42,8 +80,8 @@
 #define GAIN_DB             40
 #endif
 
-// --------- REG GROUP definitions ----------------------------------------------------
-static i2c_line_t imx219_common_regs[] = {
+// --------- REG GROUP definitions (constexpr, read-only) ------------------------------
+static constexpr i2c_line_t imx219_common_regs[] = {
   {0x0103, 0x01},   /* software_reset       1, reset the chip */
   {SLEEP, TRSTUS},  /* software_reset       1, reset the chip */
 
@@ -99,15 +137,15 @@ static i2c_line_t imx219_common_regs[] = {
   {0x012b, 0x00},
 };
 
-static i2c_line_t imx219_lanes_regs[] = {
+static constexpr i2c_line_t imx219_lanes_regs[] = {
   {CSI_LANE_MODE_REG, CSI_LANE_MODE_2_LANES}
 };
 
-static i2c_line_t start_regs[] = {
+static constexpr i2c_line_t start_regs[] = {
   {0x0100, 0x01}, /* mode select streaming on */
 };
 
-static i2c_line_t stop_regs[] = {
+static constexpr i2c_line_t stop_regs[] = {
   {0x0100, 0x00}, /* mode select streaming off */
 };
 
@@ -116,7 +154,7 @@ static i2c_line_t stop_regs[] = {
 #define ANALOGUE_GAINS 20
 #define DIGITAL_GAINS 25
 
-static uint16_t gain_integration_times[INTEGRATION_TIMES] = {
+static constexpr uint16_t gain_integration_times[INTEGRATION_TIMES] = {
   0x00a, 0x00b, 0x00c, 0x00e,
   0x010, 0x012, 0x014, 0x016,
   0x019, 0x01c, 0x020, 0x024,
@@ -130,7 +168,7 @@ static uint16_t gain_integration_times[INTEGRATION_TIMES] = {
   0x400,
 };
 
-static uint8_t gain_analogue_gains[ANALOGUE_GAINS + 1] = {
+static constexpr uint8_t gain_analogue_gains[ANALOGUE_GAINS + 1] = {
    0,   28,  53,  75,
    95, 112, 128, 142,
   155, 166, 175, 184,
@@ -139,7 +177,7 @@ static uint8_t gain_analogue_gains[ANALOGUE_GAINS + 1] = {
   231,
 };
 
-static uint16_t gain_digital_gains[DIGITAL_GAINS + 1] = {
+static constexpr uint16_t gain_digital_gains[DIGITAL_GAINS + 1] = {
   0x0100, 0x011f, 0x0142, 0x0169,
   0x0195, 0x01c7, 0x01fe, 0x023d,
   0x0283, 0x02d1, 0x0329, 0x038c,
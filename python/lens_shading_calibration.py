@@ -0,0 +1,120 @@
+# Copyright 2024 XMOS LIMITED.
+# This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+"""
+Lens shading calibration from flat-field captures.
+
+Capture a few images of a uniformly lit, featureless target (a diffuser over
+the lens works) with the lens shading correction off, at the output size the
+grid is for. Each capture is a decimated R G B image as read by
+decode_downsampled.py. The grid is written as a C header for
+camera_set_lens_shading():
+
+    python lens_shading_calibration.py --input flat0.bin flat1.bin --width 160 --height 120
+
+Node (r, k) of the grid sits on pixel (r * (height - 1) / (grid_h - 1),
+k * (width - 1) / (grid_w - 1)), as in isp_lsc_apply().
+"""
+import argparse
+
+import numpy as np
+
+from decode_downsampled import decode_downsampled_image
+
+LSC_GAIN_MAX = 2.98
+
+
+def load_flat_field(files, width, height, dtype):
+    imgs = [decode_downsampled_image(f, width, height, dtype, plot=False).astype(np.float64) for f in files]
+    return np.mean(imgs, axis=0)
+
+
+def node_means(img, grid_w, grid_h):
+    """Mean of each channel in a cell sized window around each node"""
+    height, width, channels = img.shape
+    half_x = max(1, int(round((width - 1) / (grid_w - 1) / 2)))
+    half_y = max(1, int(round((height - 1) / (grid_h - 1) / 2)))
+    means = np.zeros((channels, grid_h, grid_w))
+    for r in range(grid_h):
+        y = int(round(r * (height - 1) / (grid_h - 1)))
+        y0, y1 = max(0, y - half_y), min(height, y + half_y + 1)
+        for k in range(grid_w):
+            x = int(round(k * (width - 1) / (grid_w - 1)))
+            x0, x1 = max(0, x - half_x), min(width, x + half_x + 1)
+            means[:, r, k] = img[y0:y1, x0:x1, :].reshape(-1, channels).mean(axis=0)
+    return means
+
+
+def compute_grid(img, grid_w, grid_h):
+    """Gains bringing each channel to its level at the centre of the image"""
+    height, width, _ = img.shape
+    means = node_means(img, grid_w, grid_h)
+    cy, cx = height // 2, width // 2
+    wy, wx = max(1, height // 10), max(1, width // 10)
+    centre = img[cy - wy:cy + wy, cx - wx:cx + wx, :].reshape(-1, img.shape[2]).mean(axis=0)
+    grid = centre[:, None, None] / np.maximum(means, 1.0)
+    clipped = np.count_nonzero(grid > LSC_GAIN_MAX)
+    if clipped:
+        print(f"warning: {clipped} gains clipped to {LSC_GAIN_MAX}")
+    return np.clip(grid, 0.0, LSC_GAIN_MAX)
+
+
+def apply_grid(img, grid):
+    """Bilinear interpolation of the grid at each pixel, as on the device"""
+    height, width, _ = img.shape
+    _, grid_h, grid_w = grid.shape
+    gy = np.arange(height) * (grid_h - 1) / (height - 1)
+    gx = np.arange(width) * (grid_w - 1) / (width - 1)
+    j = np.minimum(gy.astype(int), grid_h - 2)
+    i = np.minimum(gx.astype(int), grid_w - 2)
+    fy = (gy - j)[:, None]
+    fx = (gx - i)[None, :]
+    out = np.empty_like(img)
+    for c in range(grid.shape[0]):
+        g = grid[c]
+        top = g[j][:, i] * (1 - fx) + g[j][:, i + 1] * fx
+        bot = g[j + 1][:, i] * (1 - fx) + g[j + 1][:, i + 1] * fx
+        out[:, :, c] = img[:, :, c] * (top * (1 - fy) + bot * fy)
+    return np.clip(out, 0, 255)
+
+
+def non_uniformity(img):
+    """Worst channel min / max of the node means, 1.0 is flat"""
+    means = node_means(img, 16, 12)
+    return min(m.min() / m.max() for m in means)
+
+
+def write_header(grid, output_name):
+    channels, grid_h, grid_w = grid.shape
+    with open(output_name, "w") as f:
+        f.write("// Generated by lens_shading_calibration.py\n")
+        f.write("#pragma once\n\n")
+        f.write('#include "isp_lsc.h"\n\n')
+        f.write(f"#if LSC_GRID_W != {grid_w} || LSC_GRID_H != {grid_h}\n")
+        f.write(f'# error "Lens shading grid is {grid_w}x{grid_h}"\n')
+        f.write("#endif\n\n")
+        f.write(f"static const float lsc_grid[{channels}][LSC_GRID_H][LSC_GRID_W] = {{\n")
+        for c in range(channels):
+            f.write("  {\n")
+            for r in range(grid_h):
+                f.write("    {" + ", ".join(f"{v:.4f}f" for v in grid[c, r]) + "},\n")
+            f.write("  },\n")
+        f.write("};\n")
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--input", help="flat-field captures", nargs="+", default=["capture.bin"])
+    parser.add_argument("--width", help="image width", default=160, type=int)
+    parser.add_argument("--height", help="image height", default=120, type=int)
+    parser.add_argument("--dtype", help="image dtype", default="uint8")
+    parser.add_argument("--grid-w", help="LSC_GRID_W", default=16, type=int)
+    parser.add_argument("--grid-h", help="LSC_GRID_H", default=12, type=int)
+    parser.add_argument("--output", help="output header", default="lens_shading_grid.h")
+    args = parser.parse_args()
+
+    flat = load_flat_field(args.input, args.width, args.height, args.dtype)
+    grid = compute_grid(flat, args.grid_w, args.grid_h)
+    print(f"non-uniformity before: {non_uniformity(flat):.3f}, after: {non_uniformity(apply_grid(flat, grid)):.3f}")
+    write_header(grid, args.output)
+    print(f"written {args.output}")
@@ -0,0 +1,70 @@
+# Copyright 2024 XMOS LIMITED.
+# This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+"""
+Reference of the ISP sharpening (camera_set_sharpen()).
+
+The reference is the 3x3 unsharp mask
+
+    out = in + s * (in - B(in)),  B = [1 2 1]^T [1 2 1] / 16
+
+with the edges mirrored (cv2.BORDER_REFLECT_101). The device model repeats the
+integer steps of isp_sharpen_push_row() on int8 pixels. Both are compared on a
+decimated capture taken with the sharpening off; a capture of the same scene
+with the sharpening on can be compared too:
+
+    python sharpen_reference.py --input plain.bin --sharpened sharp.bin --strength 16
+"""
+import argparse
+
+import cv2
+import numpy as np
+
+from decode_downsampled import decode_downsampled_image
+from utils import peak_signal_noise_ratio
+
+SHARPEN_SHIFT = 6
+BLUR = np.array([1, 2, 1])
+
+
+def sharpen_float(img, strength):
+    """Unsharp mask on real uint8 values, strength in 1/16"""
+    kernel = np.outer(BLUR, BLUR) / 16.0
+    img = img.astype(np.float64)
+    blur = cv2.filter2D(img, -1, kernel, borderType=cv2.BORDER_REFLECT_101)
+    out = img + strength / 16.0 * (img - blur)
+    return np.clip(np.rint(out), 1, 255).astype(np.uint8)
+
+
+def sharpen_device(img, strength):
+    """The integer steps of the ISP on int8 pixels"""
+    pix = img.astype(np.int32) - 128
+    # [1 2 1] / 4 across each row, rounded and saturated by the VPU
+    padded = np.pad(pix, ((0, 0), (1, 1), (0, 0)), mode="reflect")
+    blur_h = (padded[:, :-2] + 2 * padded[:, 1:-1] + padded[:, 2:] + 2) >> 2
+    blur_h = np.clip(blur_h, -127, 127)
+    # then down the columns, with the centre row
+    padded = np.pad(blur_h, ((1, 1), (0, 0), (0, 0)), mode="reflect")
+    blur = padded[:-2] + 2 * padded[1:-1] + padded[2:]
+    acc = ((1 << SHARPEN_SHIFT) + 4 * strength) * pix - strength * blur
+    out = np.clip((acc + (1 << (SHARPEN_SHIFT - 1))) >> SHARPEN_SHIFT, -127, 127)
+    return (out + 128).astype(np.uint8)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--input", help="capture with the sharpening off", default="capture.bin")
+    parser.add_argument("--sharpened", help="capture with the sharpening on", default=None)
+    parser.add_argument("--width", help="image width", default=160, type=int)
+    parser.add_argument("--height", help="image height", default=120, type=int)
+    parser.add_argument("--dtype", help="image dtype", default="uint8")
+    parser.add_argument("--strength", help="strength in 1/16", default=16, type=int)
+    args = parser.parse_args()
+
+    img = decode_downsampled_image(args.input, args.width, args.height, args.dtype, plot=False)
+    ref = sharpen_float(img, args.strength)
+    model = sharpen_device(img, args.strength)
+    print(f"device model vs reference: {peak_signal_noise_ratio(ref, model):.1f} dB")
+    if args.sharpened:
+        dev = decode_downsampled_image(args.sharpened, args.width, args.height, args.dtype, plot=False)
+        print(f"device vs reference: {peak_signal_noise_ratio(ref, dev):.1f} dB")
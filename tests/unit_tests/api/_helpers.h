@@ -16,6 +16,12 @@
 // Common difinitions
 #define CT_INT 127 // int conversion
 
+// Reference clock ticks of the shortest IMX219 line, 3448 pixel clocks at
+// 153.6 MHz. The stages on the decimated rows are held to one line per 160
+// output pixels, a quarter of the time between output rows at factor 4.
+#define LINE_PERIOD_TICKS   (2244)
+#define ROW_BUDGET_TICKS(width)  (LINE_PERIOD_TICKS * (width) / 160)
+
 // --------------------------- Image creation -----------------------------------------
 #define CREATE_IMG_UINT8(name, h, w, c)      \
 struct name {                                \
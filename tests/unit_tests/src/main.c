@@ -23,6 +23,14 @@ int main(
   RUN_TEST_GROUP(stats_test);
   RUN_TEST_GROUP(resize_group);
   RUN_TEST_GROUP(crop_group);
+  RUN_TEST_GROUP(isp_demosaic);
+  RUN_TEST_GROUP(isp_ccm);
+  RUN_TEST_GROUP(isp_lsc);
+  RUN_TEST_GROUP(isp_dpc);
+  RUN_TEST_GROUP(isp_tnr);
+  RUN_TEST_GROUP(isp_sharpen);
+  RUN_TEST_GROUP(isp_pyramid);
+  RUN_TEST_GROUP(sensor_mock);
   
   return UNITY_END();
 }
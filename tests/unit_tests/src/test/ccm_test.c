@@ -0,0 +1,173 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unity_fixture.h"
+
+#include "camera_main.h"
+#include "isp_ccm.h"
+#include "_helpers.h"
+
+TEST_GROUP_RUNNER(isp_ccm) {
+  RUN_TEST_CASE(isp_ccm, isp_ccm__identity);
+  RUN_TEST_CASE(isp_ccm, isp_ccm__reference);
+  RUN_TEST_CASE(isp_ccm, isp_ccm__range);
+  RUN_TEST_CASE(isp_ccm, isp_ccm__timing);
+}
+
+TEST_GROUP(isp_ccm);
+TEST_SETUP(isp_ccm) { fflush(stdout); }
+TEST_TEAR_DOWN(isp_ccm) {}
+
+#define TEST_W  64
+
+static const float ccm_identity[3][3] = {
+  {1.0f, 0.0f, 0.0f},
+  {0.0f, 1.0f, 0.0f},
+  {0.0f, 0.0f, 1.0f},
+};
+
+// A typical sensor to sRGB matrix, rows sum to 1
+static const float ccm_srgb[3][3] = {
+  { 1.72f, -0.55f, -0.17f},
+  {-0.32f,  1.51f, -0.19f},
+  { 0.05f, -0.63f,  1.58f},
+};
+
+// Output channel c of pixel x on uint8 values, from independently rounded
+// coefficients, saturated like the VPU
+static
+int8_t ref_ccm(
+    const float matrix[3][3],
+    const int8_t input[],
+    const unsigned width,
+    const unsigned c,
+    const unsigned x)
+{
+  int32_t sum = 0;
+  for (unsigned j = 0; j < 3; j++) {
+    const float scaled = matrix[c][j] * (1 << CCM_SHIFT);
+    const int32_t q = (int32_t)((scaled >= 0) ? (scaled + 0.5f) : (scaled - 0.5f));
+    sum += q * (input[j * width + x] + 128);
+  }
+  int32_t v = ((sum + (1 << (CCM_SHIFT - 1))) >> CCM_SHIFT) - 128;
+  v = (v > 127) ? 127 : (v < -127) ? -127 : v;
+  return (int8_t)v;
+}
+
+
+// The identity only saturates -128
+TEST(isp_ccm, isp_ccm__identity)
+{
+  isp_ccm_t ccm;
+  __attribute__((aligned(4))) int8_t input[3 * TEST_W];
+  __attribute__((aligned(4))) int8_t output[3 * TEST_W];
+  __attribute__((aligned(4))) int8_t expected[3 * TEST_W];
+
+  TEST_ASSERT_EQUAL_INT(0, isp_ccm_init(&ccm, ccm_identity));
+  TEST_ASSERT_EQUAL_UINT(1, ccm.enabled);
+
+  fill_array_rand_int8(input, sizeof(input));
+  input[0] = -128;
+  for (unsigned k = 0; k < sizeof(input); k++) {
+    expected[k] = (input[k] == -128) ? -127 : input[k];
+  }
+  isp_ccm_apply(output, input, &ccm, TEST_W);
+  TEST_ASSERT_EQUAL_INT8_ARRAY(expected, output, sizeof(output));
+}
+
+
+// Random rows and matrices match a scalar implementation on uint8 values
+TEST(isp_ccm, isp_ccm__reference)
+{
+  isp_ccm_t ccm;
+  float matrix[3][3];
+  __attribute__((aligned(4))) int8_t input[3 * TEST_W];
+  __attribute__((aligned(4))) int8_t output[3 * TEST_W];
+  __attribute__((aligned(4))) int8_t expected[TEST_W];
+
+  for (unsigned iter = 0; iter < 20; iter++) {
+    // Off-diagonal terms in [-0.35, 0.35], the diagonal makes up a row sum in
+    // [0.8, 1.2]
+    for (unsigned c = 0; c < 3; c++) {
+      float row_sum = 0.8f + 0.4f * (rand() % 1001) / 1000.0f;
+      for (unsigned j = 0; j < 3; j++) {
+        if (j == c) continue;
+        matrix[c][j] = -0.35f + 0.7f * (rand() % 1001) / 1000.0f;
+        row_sum -= matrix[c][j];
+      }
+      matrix[c][c] = row_sum;
+    }
+    const float (*m)[3] = (iter == 0) ? ccm_srgb : (const float (*)[3])matrix;
+    TEST_ASSERT_EQUAL_INT(0, isp_ccm_init(&ccm, m));
+
+    fill_array_rand_int8(input, sizeof(input));
+    isp_ccm_apply(output, input, &ccm, TEST_W);
+
+    for (unsigned c = 0; c < 3; c++) {
+      for (unsigned x = 0; x < TEST_W; x++) {
+        expected[x] = ref_ccm(m, input, TEST_W, c, x);
+      }
+      TEST_ASSERT_EQUAL_INT8_ARRAY(expected, &output[c * TEST_W], TEST_W);
+    }
+  }
+}
+
+
+// Matrices the int8 coefficients can't hold are refused
+TEST(isp_ccm, isp_ccm__range)
+{
+  static const float big_coef[3][3] = {
+    {2.5f, -1.0f, -0.5f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+  static const float big_sum[3][3] = {
+    {1.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f}, {0.5f, 0.5f, 1.5f}};
+  static const float negative_sum[3][3] = {
+    {1.0f, 0.0f, 0.0f}, {-1.0f, -0.5f, 0.0f}, {0.0f, 0.0f, 1.0f}};
+  isp_ccm_t ccm;
+
+  TEST_ASSERT_EQUAL_INT(-1, isp_ccm_init(&ccm, big_coef));
+  TEST_ASSERT_EQUAL_INT(-1, isp_ccm_init(&ccm, big_sum));
+  TEST_ASSERT_EQUAL_INT(-1, isp_ccm_init(&ccm, negative_sum));
+  TEST_ASSERT_EQUAL_INT(0, isp_ccm_init(&ccm, NULL));
+  TEST_ASSERT_EQUAL_UINT(0, ccm.enabled);
+}
+
+
+// Ticks per decimated row, within ROW_BUDGET_TICKS()
+TEST(isp_ccm, isp_ccm__timing)
+{
+  static const unsigned widths[3] = {160, 320, 640};
+  __attribute__((aligned(4))) static int8_t input[3 * 640];
+  __attribute__((aligned(4))) static int8_t output[3 * 640];
+  isp_ccm_t ccm;
+
+  static const char func_name[] = "isp_ccm_apply()";
+  static const char row1_head[] = "width:   ";
+  static const char row2_head[] = "ticks:   ";
+  unsigned timing[3];
+
+  fill_array_rand_int8(input, sizeof(input));
+  TEST_ASSERT_EQUAL_INT(0, isp_ccm_init(&ccm, ccm_srgb));
+
+  for (unsigned k = 0; k < 3; k++) {
+    unsigned ts = measure_time();
+    isp_ccm_apply(output, input, &ccm, widths[k]);
+    unsigned te = measure_time();
+    timing[k] = te - ts;
+  }
+
+  printf("\n\t%s timing (ticks/row):\n", func_name);
+  printf("\t\t%s", row1_head);
+  for(int k = 0; k < 3; k++)   printf("%10u", widths[k]);
+  printf("\n\t\t%s", row2_head);
+  for(int k = 0; k < 3; k++)   printf("%10u", timing[k]);
+  printf("\n\n");
+
+  for (unsigned k = 0; k < 3; k++) {
+    TEST_ASSERT_LESS_OR_EQUAL_UINT(ROW_BUDGET_TICKS(widths[k]), timing[k]);
+  }
+}
@@ -25,6 +25,10 @@ TEST_GROUP_RUNNER(color_conversion) {
   RUN_TEST_CASE(color_conversion, conversion__yuv_to_rgb);
   RUN_TEST_CASE(color_conversion, conversion__rgb_to_yuv);
   RUN_TEST_CASE(color_conversion, conversion__timming);
+  RUN_TEST_CASE(color_conversion, conversion__planar_row);
+  RUN_TEST_CASE(color_conversion, conversion__interleaved);
+  RUN_TEST_CASE(color_conversion, conversion__throughput);
+  RUN_TEST_CASE(color_conversion, conversion__yuv_pack);
 }
 TEST_GROUP(color_conversion);
 TEST_SETUP(color_conversion) { fflush(stdout); print_separator("color_conversion");}
@@ -118,3 +122,218 @@ TEST(color_conversion, conversion__timming)
     static const char func_name2[] = "Color conversion non VPU";
     PRINT_NAME_TIME(func_name2, non_vpu_conv_time);
 }
+
+
+// Row and frame conversions, against the per-pixel calls
+#define ROW_W         64
+#define ROW_DELTA     2   // quantisation difference to the per-pixel calls
+#define FRAME_PIX     (APP_IMAGE_WIDTH_PIXELS * APP_IMAGE_HEIGHT_PIXELS)
+
+__attribute__((aligned(4))) static int8_t frame_in[APP_IMAGE_CHANNEL_COUNT * FRAME_PIX];
+__attribute__((aligned(4))) static int8_t frame_out[APP_IMAGE_CHANNEL_COUNT * FRAME_PIX];
+__attribute__((aligned(4))) static int8_t frame_row_in[APP_IMAGE_CHANNEL_COUNT * APP_IMAGE_WIDTH_PIXELS];
+__attribute__((aligned(4))) static int8_t frame_row_out[APP_IMAGE_CHANNEL_COUNT * APP_IMAGE_WIDTH_PIXELS];
+
+static
+void conv_init(
+    color_conv_t* conv,
+    const unsigned to_yuv)
+{
+  if (to_yuv) {
+    isp_rgb_to_yuv_init(conv);
+  }
+  else {
+    isp_yuv_to_rgb_init(conv);
+  }
+}
+
+// Per-pixel conversion of `pix_count` pixels with planes `stride` apart
+static
+void convert_per_pixel(
+    int8_t output[],
+    const int8_t input[],
+    const unsigned pix_count,
+    const unsigned stride,
+    const unsigned to_yuv)
+{
+  for (unsigned k = 0; k < pix_count; k++) {
+    const int a = input[k];
+    const int b = input[stride + k];
+    const int c = input[2 * stride + k];
+    const int packed = to_yuv ? rgb_to_yuv(a, b, c) : yuv_to_rgb(a, b, c);
+    output[k] = (int8_t)GET_R(packed);
+    output[stride + k] = (int8_t)GET_G(packed);
+    output[2 * stride + k] = (int8_t)GET_B(packed);
+  }
+}
+
+
+// Rows and whole [CH][H][W] images match the per-pixel calls
+TEST(color_conversion, conversion__planar_row)
+{
+  __attribute__((aligned(4))) int8_t row_in[APP_IMAGE_CHANNEL_COUNT * ROW_W];
+  __attribute__((aligned(4))) int8_t row_out[APP_IMAGE_CHANNEL_COUNT * ROW_W];
+  int8_t expected[APP_IMAGE_CHANNEL_COUNT * ROW_W];
+  color_conv_t conv;
+
+  for (unsigned to_yuv = 0; to_yuv < 2; to_yuv++) {
+    conv_init(&conv, to_yuv);
+
+    // Chroma kept in range of the YUV to RGB matrix, it saturates otherwise
+    fill_array_rand_int8(row_in, sizeof(row_in));
+    if (!to_yuv) {
+      for (unsigned k = ROW_W; k < sizeof(row_in); k++) {
+        row_in[k] /= 3;
+      }
+    }
+    isp_color_convert_planar(&conv, row_out, row_in, ROW_W, ROW_W);
+    convert_per_pixel(expected, row_in, ROW_W, ROW_W, to_yuv);
+    for (unsigned k = 0; k < sizeof(row_out); k++) {
+      TEST_ASSERT_INT_WITHIN(ROW_DELTA, expected[k], row_out[k]);
+    }
+
+    // A whole image in one call is its rows in one call each
+    fill_array_rand_int8(frame_in, sizeof(frame_in));
+    isp_color_convert_planar(&conv, frame_out, frame_in, FRAME_PIX, FRAME_PIX);
+    const unsigned w = APP_IMAGE_WIDTH_PIXELS;
+    for (unsigned y = 0; y < APP_IMAGE_HEIGHT_PIXELS; y++) {
+      const unsigned offset = y * w;
+      for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+        memcpy(&frame_row_in[c * w], &frame_in[c * FRAME_PIX + offset], w);
+      }
+      isp_color_convert_planar(&conv, frame_row_out, frame_row_in, w, w);
+      for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+        TEST_ASSERT_EQUAL_INT8_ARRAY(&frame_row_out[c * w], &frame_out[c * FRAME_PIX + offset], w);
+      }
+    }
+  }
+}
+
+
+// Interleaved pixels, in place too, match the planar conversion
+TEST(color_conversion, conversion__interleaved)
+{
+  // Not a multiple of the deinterleaved block
+  enum { N = YUV_RGB_BLOCK + 48 };
+  __attribute__((aligned(4))) int8_t planar_in[APP_IMAGE_CHANNEL_COUNT * N];
+  __attribute__((aligned(4))) int8_t planar_out[APP_IMAGE_CHANNEL_COUNT * N];
+  int8_t pix[N][APP_IMAGE_CHANNEL_COUNT];
+  int8_t pix_out[N][APP_IMAGE_CHANNEL_COUNT];
+  color_conv_t conv;
+
+  for (unsigned to_yuv = 0; to_yuv < 2; to_yuv++) {
+    conv_init(&conv, to_yuv);
+    fill_array_rand_int8(planar_in, sizeof(planar_in));
+    for (unsigned k = 0; k < N; k++) {
+      for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+        pix[k][c] = planar_in[c * N + k];
+      }
+    }
+    isp_color_convert_planar(&conv, planar_out, planar_in, N, N);
+
+    isp_color_convert_interleaved(&conv, &pix_out[0][0], &pix[0][0], N);
+    isp_color_convert_interleaved(&conv, &pix[0][0], &pix[0][0], N);
+    for (unsigned k = 0; k < N; k++) {
+      for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+        TEST_ASSERT_EQUAL_INT8(planar_out[c * N + k], pix_out[k][c]);
+        TEST_ASSERT_EQUAL_INT8(planar_out[c * N + k], pix[k][c]);
+      }
+    }
+  }
+}
+
+
+// Ticks per pixel of a [CH][H][W] image: per-pixel calls, [CH][W] rows, and
+// the whole image in one call
+TEST(color_conversion, conversion__throughput)
+{
+  static const char* names[4] = {
+    "per-pixel calls", "planar rows", "planar frame", "interleaved frame"};
+  static const unsigned w = APP_IMAGE_WIDTH_PIXELS;
+  unsigned timing[2][4];
+  color_conv_t conv;
+
+  fill_array_rand_int8(frame_in, sizeof(frame_in));
+  for (unsigned to_yuv = 0; to_yuv < 2; to_yuv++) {
+    conv_init(&conv, to_yuv);
+
+    unsigned ts = measure_time();
+    convert_per_pixel(frame_out, frame_in, FRAME_PIX, FRAME_PIX, to_yuv);
+    timing[to_yuv][0] = measure_time() - ts;
+
+    ts = measure_time();
+    for (unsigned y = 0; y < APP_IMAGE_HEIGHT_PIXELS; y++) {
+      const unsigned row = y * APP_IMAGE_CHANNEL_COUNT * w;
+      isp_color_convert_planar(&conv, &frame_out[row], &frame_in[row], w, w);
+    }
+    timing[to_yuv][1] = measure_time() - ts;
+
+    ts = measure_time();
+    isp_color_convert_planar(&conv, frame_out, frame_in, FRAME_PIX, FRAME_PIX);
+    timing[to_yuv][2] = measure_time() - ts;
+
+    ts = measure_time();
+    isp_color_convert_interleaved(&conv, frame_out, frame_in, FRAME_PIX);
+    timing[to_yuv][3] = measure_time() - ts;
+  }
+
+  printf("\n\tColour conversion throughput (%ux%ux%u, ticks/pixel):\n",
+         APP_IMAGE_WIDTH_PIXELS, APP_IMAGE_HEIGHT_PIXELS, APP_IMAGE_CHANNEL_COUNT);
+  printf("\t\t%-20s%12s%12s\n", "", "YUV to RGB", "RGB to YUV");
+  for (unsigned i = 0; i < 4; i++) {
+    printf("\t\t%-20s%12.2f%12.2f\n", names[i],
+           (float)timing[0][i] / FRAME_PIX, (float)timing[1][i] / FRAME_PIX);
+  }
+  printf("\n");
+}
+
+
+// Semi-planar images from Y U V rows, odd height so NV12 drops the last chroma
+TEST(color_conversion, conversion__yuv_pack)
+{
+  enum { PACK_W = 32, PACK_H = 5 };
+  static const yuv_format_t formats[2] = {YUV_FORMAT_422, YUV_FORMAT_NV12};
+  __attribute__((aligned(4))) int8_t rows[PACK_H][APP_IMAGE_CHANNEL_COUNT][PACK_W];
+  __attribute__((aligned(4))) uint8_t image[YUV_IMAGE_BYTES(YUV_FORMAT_422, PACK_W, PACK_H) + 4];
+  int8_t chroma[PACK_W];
+
+  TEST_ASSERT_EQUAL_UINT(PACK_W * PACK_H * 2, YUV_IMAGE_BYTES(YUV_FORMAT_422, PACK_W, PACK_H));
+  TEST_ASSERT_EQUAL_UINT(PACK_W * PACK_H + PACK_W * 2, YUV_IMAGE_BYTES(YUV_FORMAT_NV12, PACK_W, PACK_H));
+  fill_array_rand_int8(&rows[0][0][0], sizeof(rows));
+
+  for (unsigned f = 0; f < 2; f++) {
+    const yuv_format_t format = formats[f];
+    const unsigned bytes = YUV_IMAGE_BYTES(format, PACK_W, PACK_H);
+    memset(image, 0xA5, sizeof(image));
+    for (unsigned y = 0; y < PACK_H; y++) {
+      isp_yuv_pack_row(image, format, PACK_W, PACK_H, &rows[y][0][0], chroma, y);
+    }
+
+    for (unsigned y = 0; y < PACK_H; y++) {
+      for (unsigned x = 0; x < PACK_W; x++) {
+        TEST_ASSERT_EQUAL_UINT8(rows[y][0][x] + 128, image[y * PACK_W + x]);
+      }
+    }
+    const uint8_t* uv = &image[PACK_W * PACK_H];
+    const unsigned uv_rows = (format == YUV_FORMAT_NV12) ? PACK_H / 2 : PACK_H;
+    for (unsigned r = 0; r < uv_rows; r++) {
+      for (unsigned x = 0; x < PACK_W; x += 2) {
+        for (unsigned c = 1; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+          int32_t expected;
+          if (format == YUV_FORMAT_422) {
+            expected = (rows[r][c][x] + rows[r][c][x + 1] + 1) >> 1;
+          }
+          else {
+            const int32_t top = (rows[2 * r][c][x] + rows[2 * r][c][x + 1] + 1) >> 1;
+            expected = (2 * top + rows[2 * r + 1][c][x] + rows[2 * r + 1][c][x + 1] + 2) >> 2;
+          }
+          TEST_ASSERT_EQUAL_UINT8(expected + 128, uv[r * PACK_W + x + c - 1]);
+        }
+      }
+    }
+    // Nothing past the image
+    for (unsigned k = bytes; k < sizeof(image); k++) {
+      TEST_ASSERT_EQUAL_UINT8(0xA5, image[k]);
+    }
+  }
+}
@@ -23,6 +23,12 @@
 
 TEST_GROUP_RUNNER(crop_group) {
     RUN_TEST_CASE(crop_group, crop__time);
+    RUN_TEST_CASE(crop_group, crop__in_place);  // isp_crop_uint8 keeps the cropped pixels
+    RUN_TEST_CASE(crop_group, crop__view);      // crop views, copy and CHW conversion
+    RUN_TEST_CASE(crop_group, crop__view_resize); // resize a view without compacting it
+    RUN_TEST_CASE(crop_group, crop__and_resize);  // batched ROIs match resizing each view
+    RUN_TEST_CASE(crop_group, crop__and_resize_shared); // ROIs sharing their interpolated rows
+    RUN_TEST_CASE(crop_group, crop__and_resize_time); // batched ROIs against a resize of each view
 }
 TEST_GROUP(crop_group);
 TEST_SETUP(crop_group) {
@@ -33,6 +39,17 @@ TEST_TEAR_DOWN(crop_group) {}
 
 // ------------------------------- Tests -------------------------------------
 
+#define N_ROIS 4
+#define ROI_OUT 64
+
+// Overlapping detection boxes in a 160x120 frame
+static const isp_roi_t test_rois[N_ROIS] = {
+    {.x = 0,   .y = 0,  .width = 40, .height = 40},
+    {.x = 20,  .y = 10, .width = 50, .height = 30},
+    {.x = 96,  .y = 60, .width = 60, .height = 60},
+    {.x = 30,  .y = 30, .width = 17, .height = 90},
+};
+
 TEST(crop_group, crop__time){
     CREATE_IMG_UINT8(img, 64, 64, 3);
 
@@ -41,3 +58,174 @@ TEST(crop_group, crop__time){
     unsigned t2 = get_reference_time();
     printf("crop__time: %d\n", t2-t1);
 }
+
+TEST(crop_group, crop__in_place){
+    CREATE_IMG_UINT8(img, 64, 64, 3);
+    CREATE_IMG_UINT8(ref, 64, 64, 3);
+    fill_array_rand_uint8(ref.ptr, ref.size);
+    memcpy(img.ptr, ref.ptr, img.size);
+
+    isp_crop_uint8(img.ptr, img.width, img.height, 10, 12, 50, 42);
+    const unsigned out_width = 40;
+    for (unsigned y = 0; y < 30; y++) {
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(&ref.data[y + 12][10][0], &img.ptr[y * out_width * 3], out_width * 3);
+    }
+}
+
+TEST(crop_group, crop__view){
+    CREATE_IMG_UINT8(img, 64, 64, 3);
+    CREATE_IMG_UINT8(planar, 20, 30, 3);
+    CREATE_IMG_UINT8(back, 20, 30, 3);
+    fill_array_rand_uint8(img.ptr, img.size);
+
+    isp_image_t src, view, chw, hwc;
+    isp_image_init(&src, img.ptr, img.width, img.height, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+
+    // a view costs no copy and leaves the source alone
+    unsigned t1 = get_reference_time();
+    isp_image_crop(&src, &view, 5, 7, 30, 20);
+    unsigned t2 = get_reference_time();
+    printf("crop__view time: %d\n", t2 - t1);
+    TEST_ASSERT_EQUAL_PTR(&img.data[7][5][0], view.data);
+    TEST_ASSERT_EQUAL_UINT32(src.row_stride, view.row_stride);
+
+    // compact into planar, then back to interleaved
+    isp_image_init(&chw, planar.ptr, 30, 20, 3, ISP_LAYOUT_CHW, ISP_TYPE_UINT8);
+    isp_image_init(&hwc, back.ptr, 30, 20, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+    isp_image_copy(&view, &chw);
+    isp_image_copy(&chw, &hwc);
+    for (unsigned y = 0; y < 20; y++) {
+        for (unsigned x = 0; x < 30; x++) {
+            for (unsigned c = 0; c < 3; c++) {
+                TEST_ASSERT_EQUAL_UINT8(img.data[y + 7][x + 5][c], planar.ptr[c * 30 * 20 + y * 30 + x]);
+                TEST_ASSERT_EQUAL_UINT8(img.data[y + 7][x + 5][c], back.data[y][x][c]);
+            }
+        }
+    }
+}
+
+TEST(crop_group, crop__view_resize){
+    CREATE_IMG_UINT8(img, 64, 64, 3);
+    CREATE_IMG_UINT8(compact, 40, 40, 3);
+    CREATE_IMG_UINT8(out_view, 24, 24, 3);
+    CREATE_IMG_UINT8(out_compact, 24, 24, 3);
+    fill_array_rand_uint8(img.ptr, img.size);
+
+    isp_image_t src, view, cmp, o_view, o_cmp;
+    isp_image_init(&src, img.ptr, img.width, img.height, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+    isp_image_crop(&src, &view, 10, 12, 40, 40);
+    isp_image_init(&cmp, compact.ptr, 40, 40, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+    isp_image_copy(&view, &cmp);
+    isp_image_init(&o_view, out_view.ptr, 24, 24, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+    isp_image_init(&o_cmp, out_compact.ptr, 24, 24, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+
+    // the view is read in place, results match the compacted copy exactly
+    const isp_resize_mode_t modes[] = {ISP_RESIZE_BILINEAR, ISP_RESIZE_NEAREST, ISP_RESIZE_AREA};
+    for (unsigned m = 0; m < 3; m++) {
+        isp_resize_image(&view, &o_view, modes[m]);
+        isp_resize_image(&cmp, &o_cmp, modes[m]);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(out_compact.ptr, out_view.ptr, out_view.size);
+    }
+}
+
+TEST(crop_group, crop__and_resize){
+    static CREATE_IMG_UINT8(img, 120, 160, 3);
+    static uint8_t outs[N_ROIS][ROI_OUT * ROI_OUT * 3];
+    static uint8_t ref[ROI_OUT * ROI_OUT * 3];
+    fill_array_rand_uint8(img.ptr, img.size);
+
+    isp_image_t src, dsts[N_ROIS];
+    isp_image_init(&src, img.ptr, img.width, img.height, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+    for (unsigned b = 0; b < N_ROIS; b++) {
+        isp_image_init(&dsts[b], outs[b], ROI_OUT, ROI_OUT, 3, ISP_LAYOUT_CHW, ISP_TYPE_UINT8);
+    }
+    isp_crop_and_resize(&src, test_rois, dsts, N_ROIS);
+
+    // same arithmetic as the strided resize of each view (planar output)
+    for (unsigned b = 0; b < N_ROIS; b++) {
+        isp_image_t view, out;
+        isp_image_crop(&src, &view, test_rois[b].x, test_rois[b].y, test_rois[b].width, test_rois[b].height);
+        isp_image_init(&out, ref, ROI_OUT, ROI_OUT, 3, ISP_LAYOUT_CHW, ISP_TYPE_UINT8);
+        isp_resize_image(&view, &out, ISP_RESIZE_BILINEAR);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(ref, outs[b], sizeof(ref));
+    }
+}
+
+// Boxes with the same columns (tracking a moving object, tiles of a column)
+// and an upscaled box, where consecutive output rows read the same rows
+TEST(crop_group, crop__and_resize_shared){
+    static const isp_roi_t rois[N_ROIS] = {
+        {.x = 24, .y = 0,  .width = 48, .height = 48},
+        {.x = 24, .y = 31, .width = 48, .height = 48},
+        {.x = 24, .y = 70, .width = 48, .height = 50},
+        {.x = 100, .y = 7, .width = 20, .height = 20},
+    };
+    static CREATE_IMG_UINT8(img, 120, 160, 3);
+    static uint8_t outs[N_ROIS][ROI_OUT * ROI_OUT * 3];
+    static uint8_t ref[ROI_OUT * ROI_OUT * 3];
+    fill_array_rand_uint8(img.ptr, img.size);
+
+    isp_image_t src, dsts[N_ROIS];
+    isp_image_init(&src, img.ptr, img.width, img.height, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+    for (unsigned b = 0; b < N_ROIS; b++) {
+        isp_image_init(&dsts[b], outs[b], ROI_OUT, ROI_OUT, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+    }
+    isp_crop_and_resize(&src, rois, dsts, N_ROIS);
+
+    for (unsigned b = 0; b < N_ROIS; b++) {
+        isp_image_t view, out;
+        isp_image_crop(&src, &view, rois[b].x, rois[b].y, rois[b].width, rois[b].height);
+        isp_image_init(&out, ref, ROI_OUT, ROI_OUT, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+        isp_resize_image(&view, &out, ISP_RESIZE_BILINEAR);
+        TEST_ASSERT_EQUAL_UINT8_ARRAY(ref, outs[b], sizeof(ref));
+    }
+}
+
+// Ticks of a resize of each view, of isp_crop_and_resize() called per box
+// and of one batched call
+static void crop_and_resize_time(
+    const char* name,
+    const isp_image_t* src,
+    const isp_roi_t rois[],
+    const isp_image_t dsts[])
+{
+    unsigned t1 = get_reference_time();
+    for (unsigned b = 0; b < N_ROIS; b++) {
+        isp_image_t view;
+        isp_image_crop(src, &view, rois[b].x, rois[b].y, rois[b].width, rois[b].height);
+        isp_resize_image(&view, &dsts[b], ISP_RESIZE_BILINEAR);
+    }
+    unsigned t2 = get_reference_time();
+    for (unsigned b = 0; b < N_ROIS; b++) {
+        isp_crop_and_resize(src, &rois[b], &dsts[b], 1);
+    }
+    unsigned t3 = get_reference_time();
+    isp_crop_and_resize(src, rois, dsts, N_ROIS);
+    unsigned t4 = get_reference_time();
+
+    printf("crop__and_resize %s, %d ROIs to %dx%d, per view: %d, per box: %d, batched: %d\n",
+        name, N_ROIS, ROI_OUT, ROI_OUT, t2 - t1, t3 - t2, t4 - t3);
+}
+
+// Overlapping boxes with different columns only gain over the per-view
+// resize. Boxes with the same columns also gain over a call per box.
+TEST(crop_group, crop__and_resize_time){
+    static const isp_roi_t column_rois[N_ROIS] = {
+        {.x = 24, .y = 0,  .width = 48, .height = 48},
+        {.x = 24, .y = 20, .width = 48, .height = 48},
+        {.x = 24, .y = 40, .width = 48, .height = 48},
+        {.x = 24, .y = 60, .width = 48, .height = 48},
+    };
+    static CREATE_IMG_UINT8(img, 120, 160, 3);
+    static uint8_t outs[N_ROIS][ROI_OUT * ROI_OUT * 3];
+    fill_array_rand_uint8(img.ptr, img.size);
+
+    isp_image_t src, dsts[N_ROIS];
+    isp_image_init(&src, img.ptr, img.width, img.height, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+    for (unsigned b = 0; b < N_ROIS; b++) {
+        isp_image_init(&dsts[b], outs[b], ROI_OUT, ROI_OUT, 3, ISP_LAYOUT_HWC, ISP_TYPE_UINT8);
+    }
+
+    crop_and_resize_time("overlapping", &src, test_rois, dsts);
+    crop_and_resize_time("same columns", &src, column_rois, dsts);
+}
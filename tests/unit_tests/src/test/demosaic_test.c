@@ -0,0 +1,215 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unity_fixture.h"
+
+#include "camera_main.h"
+#include "isp_demosaic.h"
+#include "_helpers.h"
+
+TEST_GROUP_RUNNER(isp_demosaic) {
+  RUN_TEST_CASE(isp_demosaic, isp_demosaic__flat);
+  RUN_TEST_CASE(isp_demosaic, isp_demosaic__reference);
+  RUN_TEST_CASE(isp_demosaic, isp_demosaic__timing);
+}
+
+TEST_GROUP(isp_demosaic);
+TEST_SETUP(isp_demosaic) { fflush(stdout); }
+TEST_TEAR_DOWN(isp_demosaic) {}
+
+#define TEST_W  80
+#define TEST_H  24
+
+__attribute__((aligned(4)))
+static int8_t lines[DEMOSAIC_LINES_BYTES(TEST_W)];
+
+// RGGB colour of a pixel
+static
+unsigned bayer_colour(
+    const int y,
+    const int x)
+{
+  if ((y & 1) == 0) {
+    return (x & 1) ? CHAN_GREEN : CHAN_RED;
+  }
+  return (x & 1) ? CHAN_BLUE : CHAN_GREEN;
+}
+
+// Pixel of a w x h raw image, mirrored at the edges
+static
+int32_t px(
+    const int8_t* img,
+    const int w,
+    const int h,
+    int y,
+    int x)
+{
+  y = (y < 0) ? -y : (y >= h) ? 2 * (h - 1) - y : y;
+  x = (x < 0) ? -x : (x >= w) ? 2 * (w - 1) - x : x;
+  return img[y * w + x];
+}
+
+// Channel c at (y, x), from the textbook formulas of each interpolation
+static
+int8_t ref_demosaic(
+    const int8_t* img,
+    const int w,
+    const int h,
+    const demosaic_mode_t mode,
+    const int y,
+    const int x,
+    const unsigned c)
+{
+#define P(DY, DX) px(img, w, h, y + (DY), x + (DX))
+  const unsigned site = bayer_colour(y, x);
+  const int32_t cross = P(-1, 0) + P(1, 0) + P(0, -1) + P(0, 1);
+  const int32_t diag = P(-1, -1) + P(-1, 1) + P(1, -1) + P(1, 1);
+  const int32_t far_h = P(0, -2) + P(0, 2);
+  const int32_t far_v = P(-2, 0) + P(2, 0);
+  int32_t sum;
+
+  if (site == c) {
+    sum = 16 * P(0, 0);
+  }
+  else if (c == CHAN_GREEN) {
+    sum = (mode == DEMOSAIC_BILINEAR) ? 4 * cross
+        : 8 * P(0, 0) + 4 * cross - 2 * (far_h + far_v);
+  }
+  else if (site != CHAN_GREEN) {
+    sum = (mode == DEMOSAIC_BILINEAR) ? 4 * diag
+        : 12 * P(0, 0) + 4 * diag - 3 * (far_h + far_v);
+  }
+  else {
+    // c is on the left and right of this green pixel, or above and below it
+    const unsigned horizontal = (bayer_colour(y, x + 1) == c);
+    const int32_t near = horizontal ? P(0, -1) + P(0, 1) : P(-1, 0) + P(1, 0);
+    const int32_t far_same = horizontal ? far_h : far_v;
+    const int32_t far_other = horizontal ? far_v : far_h;
+    sum = (mode == DEMOSAIC_BILINEAR) ? 8 * near
+        : 10 * P(0, 0) + 8 * near - 2 * (far_same + diag) + far_other;
+  }
+#undef P
+
+  int32_t v = (sum + 8) >> 4;
+  v = (v > 127) ? 127 : (v < -127) ? -127 : v;
+  return (int8_t)v;
+}
+
+
+// A flat colour comes out unchanged, edges included
+TEST(isp_demosaic, isp_demosaic__flat)
+{
+  static const int8_t colour[3] = {-50, 20, 90};
+  demosaic_state_t state;
+  __attribute__((aligned(4))) int8_t raw[TEST_W];
+  __attribute__((aligned(4))) int8_t out[3][TEST_W];
+  __attribute__((aligned(4))) int8_t expected[TEST_W];
+
+  for (demosaic_mode_t mode = DEMOSAIC_BILINEAR; mode <= DEMOSAIC_GRADIENT; mode++) {
+    isp_demosaic_init(&state, mode, TEST_W, lines);
+
+    unsigned rows = 0;
+    for (unsigned y = 0; y < TEST_H + state.radius; y++) {
+      unsigned row;
+      unsigned new_row;
+      if (y < TEST_H) {
+        for (unsigned x = 0; x < TEST_W; x++) {
+          raw[x] = colour[bayer_colour(y, x)];
+        }
+        new_row = isp_demosaic_push_row(&state, &out[0][0], raw, &row);
+      }
+      else {
+        new_row = isp_demosaic_drain(&state, &out[0][0], &row);
+      }
+      if (!new_row) continue;
+
+      TEST_ASSERT_EQUAL_UINT(rows, row);
+      for (unsigned c = 0; c < 3; c++) {
+        memset(expected, colour[c], TEST_W);
+        TEST_ASSERT_EQUAL_INT8_ARRAY(expected, out[c], TEST_W);
+      }
+      rows++;
+    }
+    TEST_ASSERT_EQUAL_UINT(TEST_H, rows);
+    TEST_ASSERT_EQUAL_UINT(0, isp_demosaic_drain(&state, &out[0][0], &rows));
+  }
+}
+
+
+// Random raw frames match a scalar implementation of the formulas
+TEST(isp_demosaic, isp_demosaic__reference)
+{
+  static int8_t img[TEST_H][TEST_W];
+  demosaic_state_t state;
+  __attribute__((aligned(4))) int8_t out[3][TEST_W];
+  __attribute__((aligned(4))) int8_t expected[TEST_W];
+
+  for (demosaic_mode_t mode = DEMOSAIC_BILINEAR; mode <= DEMOSAIC_GRADIENT; mode++) {
+    fill_array_rand_int8(&img[0][0], sizeof(img));
+    isp_demosaic_init(&state, mode, TEST_W, lines);
+
+    unsigned row;
+    unsigned y = 0;
+    while (1) {
+      unsigned new_row = (y < TEST_H)
+          ? isp_demosaic_push_row(&state, &out[0][0], img[y], &row)
+          : isp_demosaic_drain(&state, &out[0][0], &row);
+      if (y++ >= TEST_H && !new_row) break;
+      if (!new_row) continue;
+
+      for (unsigned c = 0; c < 3; c++) {
+        for (unsigned x = 0; x < TEST_W; x++) {
+          expected[x] = ref_demosaic(&img[0][0], TEST_W, TEST_H, mode, row, x, c);
+        }
+        TEST_ASSERT_EQUAL_INT8_ARRAY(expected, out[c], TEST_W);
+      }
+    }
+    TEST_ASSERT_EQUAL_UINT(TEST_H, state.rows_out);
+  }
+}
+
+
+// Ticks per row of a 640x480 frame, drain included
+TEST(isp_demosaic, isp_demosaic__timing)
+{
+  static const unsigned width = 640;
+  static const unsigned height = 480;
+
+  __attribute__((aligned(4))) static int8_t big_lines[DEMOSAIC_LINES_BYTES(640)];
+  __attribute__((aligned(4))) static int8_t raw[2][640];
+  __attribute__((aligned(4))) static int8_t out[3][640];
+  demosaic_state_t state;
+
+  static const char func_name[] = "isp_demosaic_push_row()";
+  static const char row1_head[] = "mode:    ";
+  static const char row2_head[] = "ticks:   ";
+  static const char* mode_names[2] = {"bilinear", "gradient"};
+  unsigned timing[2];
+
+  fill_array_rand_int8(&raw[0][0], sizeof(raw));
+
+  for (demosaic_mode_t mode = DEMOSAIC_BILINEAR; mode <= DEMOSAIC_GRADIENT; mode++) {
+    unsigned row;
+    isp_demosaic_init(&state, mode, width, big_lines);
+
+    unsigned ts = measure_time();
+    for (unsigned y = 0; y < height; y++) {
+      isp_demosaic_push_row(&state, &out[0][0], raw[y & 1], &row);
+    }
+    while (isp_demosaic_drain(&state, &out[0][0], &row));
+    unsigned te = measure_time();
+    timing[mode - DEMOSAIC_BILINEAR] = (te - ts) / height;
+  }
+
+  printf("\n\t%s timing (ticks/row, %ux%u):\n", func_name, width, height);
+  printf("\t\t%s", row1_head);
+  for(int k = 0; k < 2; k++)   printf("%10s", mode_names[k]);
+  printf("\n\t\t%s", row2_head);
+  for(int k = 0; k < 2; k++)   printf("%10u", timing[k]);
+  printf("\n\n");
+}
@@ -0,0 +1,226 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unity_fixture.h"
+
+#include "camera_main.h"
+#include "isp_dpc.h"
+#include "_helpers.h"
+
+TEST_GROUP_RUNNER(isp_dpc) {
+  RUN_TEST_CASE(isp_dpc, isp_dpc__smooth);
+  RUN_TEST_CASE(isp_dpc, isp_dpc__hot_cold);
+  RUN_TEST_CASE(isp_dpc, isp_dpc__reference);
+  RUN_TEST_CASE(isp_dpc, isp_dpc__static);
+  RUN_TEST_CASE(isp_dpc, isp_dpc__timing);
+}
+
+TEST_GROUP(isp_dpc);
+TEST_SETUP(isp_dpc) { fflush(stdout); }
+TEST_TEAR_DOWN(isp_dpc) {}
+
+#define TEST_W        64
+#define THRESHOLD     32
+
+__attribute__((aligned(4)))
+static int8_t left[DPC_LEFT_BYTES(1280)];
+
+// Rows are read from 4 bytes before to 16 bytes after them
+__attribute__((aligned(4)))
+static int8_t raw_buff[4 + 1280 + 16];
+static int8_t* const raw = &raw_buff[4];
+
+static inline
+int32_t max32(int32_t a, int32_t b) { return (a > b) ? a : b; }
+
+static inline
+int32_t min32(int32_t a, int32_t b) { return (a < b) ? a : b; }
+
+// Clamp of the halved pixel between its halved neighbours, as in pixel_dpc()
+static
+int8_t ref_dpc(
+    const int8_t* row,
+    const unsigned x,
+    const unsigned threshold)
+{
+  const int32_t th = threshold >> 1;
+  const int32_t hl = row[x - 2] >> 1;
+  const int32_t hr = row[x + 2] >> 1;
+  const int32_t hp = row[x] >> 1;
+  const int32_t eh = max32(hp - (max32(hl, hr) + th), 0);
+  const int32_t el = max32(min32(hl, hr) - (hp + th), 0);
+  int32_t v = row[x] - 2 * (eh - el);
+  v = (v > 127) ? 127 : (v < -127) ? -127 : v;
+  return (int8_t)v;
+}
+
+
+// Smooth rows come out unchanged
+TEST(isp_dpc, isp_dpc__smooth)
+{
+  dpc_state_t state;
+  __attribute__((aligned(4))) int8_t out[TEST_W];
+
+  isp_dpc_init(&state, THRESHOLD, left);
+  isp_dpc_frame_start(&state);
+
+  for (unsigned y = 0; y < 8; y++) {
+    for (unsigned x = 0; x < TEST_W; x++) {
+      // A different ramp in each colour
+      raw[x] = (x & 1) ? (int8_t)(-100 + 3 * x) : (int8_t)(90 - 2 * x + y);
+    }
+    isp_dpc_row(&state, out, raw, TEST_W, y);
+    TEST_ASSERT_EQUAL_INT8_ARRAY(raw, out, TEST_W);
+  }
+}
+
+
+// Isolated hot and cold pixels are pulled to their neighbours +- threshold
+TEST(isp_dpc, isp_dpc__hot_cold)
+{
+  static const int8_t colour[2] = {-40, 30};
+  static const unsigned hot[] = {6, 17, 40};
+  static const unsigned cold[] = {9, 22, 51};
+  dpc_state_t state;
+  __attribute__((aligned(4))) int8_t out[TEST_W];
+
+  isp_dpc_init(&state, THRESHOLD, left);
+  isp_dpc_frame_start(&state);
+
+  for (unsigned x = 0; x < TEST_W; x++) {
+    raw[x] = colour[x & 1];
+  }
+  for (unsigned k = 0; k < 3; k++) {
+    raw[hot[k]] = 127;
+    raw[cold[k]] = -128;
+  }
+  isp_dpc_row(&state, out, raw, TEST_W, 0);
+
+  for (unsigned x = 0; x < TEST_W; x++) {
+    int32_t expected = colour[x & 1];
+    for (unsigned k = 0; k < 3; k++) {
+      if (x == hot[k])  expected += THRESHOLD;
+      if (x == cold[k]) expected -= THRESHOLD;
+    }
+    // Only clamped pixels lose their LSB
+    const unsigned delta = (expected != colour[x & 1]) ? 1 : 0;
+    TEST_ASSERT_INT_WITHIN(delta, expected, out[x]);
+  }
+}
+
+
+// Random rows match the halved clamp, the row ends are never changed
+TEST(isp_dpc, isp_dpc__reference)
+{
+  static const unsigned thresholds[] = {1, 8, 32, 127};
+  dpc_state_t state;
+  __attribute__((aligned(4))) int8_t out[TEST_W];
+  __attribute__((aligned(4))) int8_t expected[TEST_W];
+
+  isp_dpc_init(&state, THRESHOLD, left);
+
+  for (unsigned t = 0; t < sizeof(thresholds) / sizeof(thresholds[0]); t++) {
+    isp_dpc_set_threshold(&state, thresholds[t]);
+    isp_dpc_frame_start(&state);
+    for (unsigned y = 0; y < 16; y++) {
+      fill_array_rand_int8(raw_buff, sizeof(raw_buff));
+      for (unsigned x = 0; x < TEST_W; x++) {
+        // -128 saturates on the VPU
+        raw[x] = (raw[x] == -128) ? -127 : raw[x];
+        expected[x] = (x < 2 || x >= TEST_W - 2) ? raw[x] : ref_dpc(raw, x, thresholds[t]);
+      }
+      isp_dpc_row(&state, out, raw, TEST_W, y);
+      TEST_ASSERT_EQUAL_INT8_ARRAY(expected, out, TEST_W);
+    }
+  }
+}
+
+
+// Listed pixels are replaced by the mean of their neighbours, nothing else is
+// touched with the dynamic detection off
+TEST(isp_dpc, isp_dpc__static)
+{
+  static const dpc_defect_t defects[] = {
+    {.x = 0, .y = 1}, {.x = 5, .y = 1}, {.x = 63, .y = 1},
+    {.x = 20, .y = 4},
+    {.x = 2, .y = 6}, {.x = 33, .y = 6},
+  };
+  static const unsigned count = sizeof(defects) / sizeof(defects[0]);
+  static const dpc_defect_t unsorted[] = {{.x = 5, .y = 3}, {.x = 4, .y = 3}};
+  dpc_state_t state;
+  dpc_defect_list_t list;
+  __attribute__((aligned(4))) int8_t out[TEST_W];
+  __attribute__((aligned(4))) int8_t expected[TEST_W];
+
+  TEST_ASSERT_EQUAL_INT(-1, isp_dpc_defect_list_init(&list, unsorted, 2));
+  TEST_ASSERT_EQUAL_INT(-1, isp_dpc_defect_list_init(&list, NULL, 2));
+  TEST_ASSERT_EQUAL_INT(0, isp_dpc_defect_list_init(&list, defects, count));
+
+  isp_dpc_init(&state, 0, left);
+  state.list = list;
+
+  for (unsigned frame = 0; frame < 2; frame++) {
+    isp_dpc_frame_start(&state);
+    for (unsigned y = 0; y < 8; y++) {
+      // Row 4 doesn't come, its defect is skipped
+      if (y == 4) continue;
+
+      fill_array_rand_int8(raw, TEST_W);
+      memcpy(expected, raw, TEST_W);
+      for (unsigned k = 0; k < count; k++) {
+        if (defects[k].y != y) continue;
+        const unsigned x = defects[k].x;
+        expected[x] = (x < 2) ? raw[x + 2]
+            : (x >= TEST_W - 2) ? raw[x - 2]
+            : (int8_t)((raw[x - 2] + raw[x + 2] + 1) >> 1);
+      }
+      isp_dpc_row(&state, out, raw, TEST_W, y);
+      TEST_ASSERT_EQUAL_INT8_ARRAY(expected, out, TEST_W);
+    }
+  }
+}
+
+
+// Ticks per raw row, with the dynamic detection and with a static list only
+TEST(isp_dpc, isp_dpc__timing)
+{
+  static const unsigned widths[2] = {640, 1280};
+  static const unsigned reps = 64;
+  __attribute__((aligned(4))) static int8_t out[1280];
+  dpc_state_t state;
+
+  static const char func_name[] = "isp_dpc_row()";
+  static const char row1_head[] = "width:    ";
+  static const char row2_head[] = "dynamic:  ";
+  static const char row3_head[] = "static:   ";
+  unsigned timing[2][2];
+
+  fill_array_rand_int8(raw_buff, sizeof(raw_buff));
+
+  for (unsigned w = 0; w < 2; w++) {
+    for (unsigned threshold = 0; threshold < 2; threshold++) {
+      isp_dpc_init(&state, threshold ? THRESHOLD : 0, left);
+      isp_dpc_frame_start(&state);
+      unsigned ts = measure_time();
+      for (unsigned y = 0; y < reps; y++) {
+        isp_dpc_row(&state, out, raw, widths[w], y);
+      }
+      unsigned te = measure_time();
+      timing[threshold][w] = (te - ts) / reps;
+    }
+  }
+
+  printf("\n\t%s timing (ticks/row):\n", func_name);
+  printf("\t\t%s", row1_head);
+  for(int k = 0; k < 2; k++)   printf("%8u", widths[k]);
+  printf("\n\t\t%s", row2_head);
+  for(int k = 0; k < 2; k++)   printf("%8u", timing[1][k]);
+  printf("\n\t\t%s", row3_head);
+  for(int k = 0; k < 2; k++)   printf("%8u", timing[0][k]);
+  printf("\n\n");
+}
@@ -0,0 +1,223 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unity_fixture.h"
+
+#include "camera_main.h"
+#include "isp_lsc.h"
+#include "_helpers.h"
+
+TEST_GROUP_RUNNER(isp_lsc) {
+  RUN_TEST_CASE(isp_lsc, isp_lsc__unity);
+  RUN_TEST_CASE(isp_lsc, isp_lsc__reference);
+  RUN_TEST_CASE(isp_lsc, isp_lsc__row_order);
+  RUN_TEST_CASE(isp_lsc, isp_lsc__range);
+  RUN_TEST_CASE(isp_lsc, isp_lsc__timing);
+}
+
+TEST_GROUP(isp_lsc);
+TEST_SETUP(isp_lsc) { fflush(stdout); }
+TEST_TEAR_DOWN(isp_lsc) {}
+
+#define TEST_W  64
+#define TEST_H  24
+// Gains are applied in Q6 after two interpolations
+#define LSC_DELTA  4
+
+__attribute__((aligned(4)))
+static int8_t rows[LSC_ROWS_BYTES(640)];
+
+static float grid[3][LSC_GRID_H][LSC_GRID_W];
+
+// Radial vignetting, strongest in red
+static
+void fill_vignetting(
+    const float strength)
+{
+  for (unsigned c = 0; c < 3; c++) {
+    for (unsigned r = 0; r < LSC_GRID_H; r++) {
+      for (unsigned k = 0; k < LSC_GRID_W; k++) {
+        const float dy = (float)r / (LSC_GRID_H - 1) - 0.5f;
+        const float dx = (float)k / (LSC_GRID_W - 1) - 0.5f;
+        grid[c][r][k] = 1.0f + strength * (3 - c) / 3.0f * 2.0f * (dx * dx + dy * dy);
+      }
+    }
+  }
+}
+
+// Bilinear gain of the grid at pixel (x, y) of a w x h frame
+static
+float ref_gain(
+    const unsigned c,
+    const unsigned w,
+    const unsigned h,
+    const unsigned x,
+    const unsigned y)
+{
+  const float gx = (float)x * (LSC_GRID_W - 1) / (w - 1);
+  const float gy = (float)y * (LSC_GRID_H - 1) / (h - 1);
+  unsigned i = (unsigned)gx;
+  unsigned j = (unsigned)gy;
+  i = (i >= LSC_GRID_W - 1) ? LSC_GRID_W - 2 : i;
+  j = (j >= LSC_GRID_H - 1) ? LSC_GRID_H - 2 : j;
+  const float fx = gx - i;
+  const float fy = gy - j;
+  const float top = grid[c][j][i] * (1 - fx) + grid[c][j][i + 1] * fx;
+  const float bot = grid[c][j + 1][i] * (1 - fx) + grid[c][j + 1][i + 1] * fx;
+  return top * (1 - fy) + bot * fy;
+}
+
+
+// Gains of 1 only saturate -128
+TEST(isp_lsc, isp_lsc__unity)
+{
+  isp_lsc_t lsc;
+  lsc_state_t state;
+  __attribute__((aligned(4))) int8_t row[3 * TEST_W];
+  __attribute__((aligned(4))) int8_t expected[3 * TEST_W];
+
+  fill_vignetting(0.0f);
+  TEST_ASSERT_EQUAL_INT(0, isp_lsc_init(&lsc, grid));
+  isp_lsc_frame_init(&state, &lsc, TEST_W, TEST_H, rows);
+
+  for (unsigned y = 0; y < TEST_H; y++) {
+    fill_array_rand_int8(row, sizeof(row));
+    row[y] = -128;
+    for (unsigned k = 0; k < sizeof(row); k++) {
+      expected[k] = (row[k] == -128) ? -127 : row[k];
+    }
+    isp_lsc_apply(&state, row, y);
+    TEST_ASSERT_EQUAL_INT8_ARRAY(expected, row, sizeof(row));
+  }
+}
+
+
+// A vignetting grid matches a floating point bilinear interpolation
+TEST(isp_lsc, isp_lsc__reference)
+{
+  isp_lsc_t lsc;
+  lsc_state_t state;
+  __attribute__((aligned(4))) int8_t row[3 * TEST_W];
+  __attribute__((aligned(4))) int8_t input[3 * TEST_W];
+
+  fill_vignetting(1.5f);
+  TEST_ASSERT_EQUAL_INT(0, isp_lsc_init(&lsc, grid));
+  isp_lsc_frame_init(&state, &lsc, TEST_W, TEST_H, rows);
+
+  for (unsigned y = 0; y < TEST_H; y++) {
+    fill_array_rand_int8(input, sizeof(input));
+    memcpy(row, input, sizeof(row));
+    isp_lsc_apply(&state, row, y);
+
+    for (unsigned c = 0; c < 3; c++) {
+      for (unsigned x = 0; x < TEST_W; x++) {
+        const float u = (input[c * TEST_W + x] + 128) * ref_gain(c, TEST_W, TEST_H, x, y);
+        int32_t expected = (int32_t)(u + 0.5f) - 128;
+        expected = (expected > 127) ? 127 : (expected < -127) ? -127 : expected;
+        TEST_ASSERT_INT_WITHIN(LSC_DELTA, expected, row[c * TEST_W + x]);
+      }
+    }
+  }
+}
+
+
+// Rows out of order give the same output as in order
+TEST(isp_lsc, isp_lsc__row_order)
+{
+  static const unsigned order[8] = {23, 0, 1, 12, 13, 14, 2, 22};
+  static int8_t frame[TEST_H][3 * TEST_W];
+  isp_lsc_t lsc;
+  lsc_state_t state;
+  __attribute__((aligned(4))) int8_t row[3 * TEST_W];
+  __attribute__((aligned(4))) int8_t input[3 * TEST_W];
+
+  fill_vignetting(1.0f);
+  TEST_ASSERT_EQUAL_INT(0, isp_lsc_init(&lsc, grid));
+  fill_array_rand_int8(input, sizeof(input));
+
+  isp_lsc_frame_init(&state, &lsc, TEST_W, TEST_H, rows);
+  for (unsigned y = 0; y < TEST_H; y++) {
+    memcpy(frame[y], input, sizeof(input));
+    isp_lsc_apply(&state, frame[y], y);
+  }
+
+  isp_lsc_frame_init(&state, &lsc, TEST_W, TEST_H, rows);
+  for (unsigned k = 0; k < 8; k++) {
+    memcpy(row, input, sizeof(input));
+    isp_lsc_apply(&state, row, order[k]);
+    TEST_ASSERT_EQUAL_INT8_ARRAY(frame[order[k]], row, sizeof(row));
+  }
+}
+
+
+// Gains the Q6 row gains can't hold are refused
+TEST(isp_lsc, isp_lsc__range)
+{
+  isp_lsc_t lsc;
+
+  fill_vignetting(1.0f);
+  grid[1][5][7] = 3.5f;
+  TEST_ASSERT_EQUAL_INT(-1, isp_lsc_init(&lsc, grid));
+  grid[1][5][7] = -0.1f;
+  TEST_ASSERT_EQUAL_INT(-1, isp_lsc_init(&lsc, grid));
+  grid[1][5][7] = LSC_GAIN_MAX;
+  TEST_ASSERT_EQUAL_INT(0, isp_lsc_init(&lsc, grid));
+  TEST_ASSERT_EQUAL_UINT(1, lsc.enabled);
+  TEST_ASSERT_EQUAL_INT(0, isp_lsc_init(&lsc, NULL));
+  TEST_ASSERT_EQUAL_UINT(0, lsc.enabled);
+}
+
+
+// Mean and worst ticks per row over a frame, the worst rows expand a grid row.
+// The mean is within ROW_BUDGET_TICKS().
+TEST(isp_lsc, isp_lsc__timing)
+{
+  static const unsigned widths[3] = {160, 320, 640};
+  __attribute__((aligned(4))) static int8_t row[3 * 640];
+  isp_lsc_t lsc;
+  lsc_state_t state;
+
+  static const char func_name[] = "isp_lsc_apply()";
+  static const char row1_head[] = "width:   ";
+  static const char row2_head[] = "mean:    ";
+  static const char row3_head[] = "worst:   ";
+  unsigned mean[3];
+  unsigned worst[3];
+
+  fill_vignetting(1.5f);
+  TEST_ASSERT_EQUAL_INT(0, isp_lsc_init(&lsc, grid));
+  fill_array_rand_int8(row, sizeof(row));
+
+  for (unsigned k = 0; k < 3; k++) {
+    const unsigned height = widths[k] * 3 / 4;
+    unsigned total = 0;
+    worst[k] = 0;
+    isp_lsc_frame_init(&state, &lsc, widths[k], height, rows);
+    for (unsigned y = 0; y < height; y++) {
+      unsigned ts = measure_time();
+      isp_lsc_apply(&state, row, y);
+      unsigned te = measure_time();
+      total += te - ts;
+      worst[k] = (te - ts > worst[k]) ? te - ts : worst[k];
+    }
+    mean[k] = total / height;
+  }
+
+  printf("\n\t%s timing (ticks/row):\n", func_name);
+  printf("\t\t%s", row1_head);
+  for(int k = 0; k < 3; k++)   printf("%10u", widths[k]);
+  printf("\n\t\t%s", row2_head);
+  for(int k = 0; k < 3; k++)   printf("%10u", mean[k]);
+  printf("\n\t\t%s", row3_head);
+  for(int k = 0; k < 3; k++)   printf("%10u", worst[k]);
+  printf("\n\n");
+
+  for (unsigned k = 0; k < 3; k++) {
+    TEST_ASSERT_LESS_OR_EQUAL_UINT(ROW_BUDGET_TICKS(widths[k]), mean[k]);
+  }
+}
@@ -27,6 +27,10 @@ TEST_GROUP_RUNNER(pixel_hfilter) {
   RUN_TEST_CASE(pixel_hfilter, pixel_hfilter_update_scale__case3);
   RUN_TEST_CASE(pixel_hfilter, pixel_hfilter_update_scale__case4);
   RUN_TEST_CASE(pixel_hfilter, pixel_hfilter_update_scale__timing);
+  RUN_TEST_CASE(pixel_hfilter, pixel_hfilter_update_scale_dec__factors);
+  RUN_TEST_CASE(pixel_hfilter, pixel_hfilter_update_black_level__flat);
+  RUN_TEST_CASE(pixel_hfilter, pixel_hfilter_update_black_level__default);
+  RUN_TEST_CASE(pixel_hfilter, pixel_hfilter_update_luma__flat);
 
   // RUN_TEST_CASE(pixel_hfilter, pixel_hfilter__case1);
 }
@@ -278,7 +282,8 @@ TEST(pixel_hfilter, pixel_hfilter_update_scale__case1)
 
   const unsigned exp_shift = 9;
   const int32_t shift_scale = 1 << exp_shift;
-  const int32_t exp_acc_init = - 128 * shift_scale - SENSOR_BLACK_LEVEL * shift_scale;
+  // no gain, so no black level either
+  const int32_t exp_acc_init = - 128 * shift_scale;
 
   TEST_ASSERT_EQUAL_INT8(0, state.coef[0 + offset]);
   TEST_ASSERT_EQUAL_INT8(0, state.coef[2 + offset]);
@@ -304,7 +309,8 @@ TEST(pixel_hfilter, pixel_hfilter_update_scale__case2)
 
   const unsigned exp_shift = 7;
   const int32_t shift_scale = 1 << exp_shift;
-  const int32_t exp_acc_init = - SENSOR_BLACK_LEVEL * shift_scale;
+  const int32_t sum_q = 0x1B + 0x4B + 0x1B;
+  const int32_t exp_acc_init = 128 * (sum_q - shift_scale) - SENSOR_BLACK_LEVEL * sum_q;
 
   TEST_ASSERT_EQUAL_INT8(0x1B, state.coef[0 + offset]);
   TEST_ASSERT_EQUAL_INT8(0x4B, state.coef[2 + offset]);
@@ -330,7 +336,8 @@ TEST(pixel_hfilter, pixel_hfilter_update_scale__case3)
 
   const unsigned exp_shift = 7;
   const int32_t shift_scale = 1 << exp_shift;
-  const int32_t exp_acc_init = 128 * (gain - 1.0f) * shift_scale - SENSOR_BLACK_LEVEL * shift_scale;
+  const int32_t sum_q = 0x20 + 0x59 + 0x20;
+  const int32_t exp_acc_init = 128 * (sum_q - shift_scale) - SENSOR_BLACK_LEVEL * sum_q;
 
   TEST_ASSERT_EQUAL_INT8(0x20, state.coef[0 + offset]);
   TEST_ASSERT_EQUAL_INT8(0x59, state.coef[2 + offset]);
@@ -356,7 +363,8 @@ TEST(pixel_hfilter, pixel_hfilter_update_scale__case4)
 
   const unsigned exp_shift = 8;
   const int32_t shift_scale = 1 << exp_shift;
-  const int32_t exp_acc_init = 128 * (gain - 1.0f) * shift_scale - SENSOR_BLACK_LEVEL * shift_scale;
+  const int32_t sum_q = 0x2B + 0x77 + 0x2B;
+  const int32_t exp_acc_init = 128 * (sum_q - shift_scale) - SENSOR_BLACK_LEVEL * sum_q;
 
   TEST_ASSERT_EQUAL_INT8(0x2B, state.coef[0 + offset]);
   TEST_ASSERT_EQUAL_INT8(0x77, state.coef[2 + offset]);
@@ -385,3 +393,164 @@ TEST(pixel_hfilter, pixel_hfilter_update_scale__timing)
 
   printf("\n\t%s timing: %u ticks\n\n", func_name, te - ts);
 }
+
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+TEST(pixel_hfilter, pixel_hfilter_update_scale_dec__factors)
+{
+  hfilter_state_t state;
+  hfilter_state_t expected;
+
+  const float gain = 1.2f;
+  const size_t offset = 1;
+
+  // factor 4 is the default filter
+  memset(&expected, 0, sizeof(expected));
+  pixel_hfilter_update_scale(&expected, gain, offset);
+  memset(&state, 0x55, sizeof(state));
+  pixel_hfilter_update_scale_dec(&state, gain, offset, 4);
+  TEST_ASSERT_EQUAL_INT8_ARRAY(expected.coef, state.coef, 32);
+  TEST_ASSERT_EQUAL_UINT(expected.shift, state.shift);
+  TEST_ASSERT_EQUAL_INT32(expected.acc_init, state.acc_init);
+
+  // factor 8 has 5 taps, and clears the taps of a previous factor
+  pixel_hfilter_update_scale_dec(&state, gain, offset, 8);
+  TEST_ASSERT_EQUAL_INT8(state.coef[0 + offset], state.coef[8 + offset]);
+  TEST_ASSERT_EQUAL_INT8(state.coef[2 + offset], state.coef[6 + offset]);
+  TEST_ASSERT_GREATER_THAN_INT8(state.coef[2 + offset], state.coef[4 + offset]);
+  TEST_ASSERT_EQUAL_INT8(0, state.coef[10 + offset]);
+  TEST_ASSERT_EQUAL_INT8(0, state.coef[1 - offset]);
+
+  // factor 2 is almost a pass-through
+  pixel_hfilter_update_scale_dec(&state, gain, offset, 2);
+  TEST_ASSERT_EQUAL_INT8(state.coef[0 + offset], state.coef[4 + offset]);
+  TEST_ASSERT_GREATER_THAN_INT8(8 * state.coef[0 + offset], state.coef[2 + offset]);
+  TEST_ASSERT_EQUAL_INT8(0, state.coef[6 + offset]);
+  TEST_ASSERT_EQUAL_INT8(0, state.coef[8 + offset]);
+}
+
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+TEST(pixel_hfilter, pixel_hfilter_update_black_level__flat)
+{
+  static const unsigned output_count = 16;
+  static const float black_levels[3] = {0.0f, 16.0f, 41.5f};
+  static const unsigned dec_factors[3] = {2, 4, 8};
+
+  __attribute__((aligned(4))) int8_t input[32 + 8 * (output_count - 1)];
+  __attribute__((aligned(4))) int8_t output[output_count];
+  hfilter_state_t state;
+
+  const float gain = 1.4f;
+  const unsigned offset = 0;
+  const int u = 120;  // raw uint8 value of the flat row
+  memset(input, u - 128, sizeof(input));
+
+  for (unsigned d = 0; d < 3; d++) {
+    for (unsigned b = 0; b < 3; b++) {
+      pixel_hfilter_update_scale_dec(&state, gain, offset, dec_factors[d]);
+      pixel_hfilter_update_black_level(&state, black_levels[b]);
+
+      pixel_hfilter(output, input, state.coef, state.acc_init, state.shift,
+                    dec_factors[d], output_count);
+
+      // the black level comes off before the gain
+      const int expected = (int)(gain * (u - black_levels[b]) + 0.5f) - 128;
+      for (unsigned k = 0; k < output_count; k++) {
+        TEST_ASSERT_INT_WITHIN(2, expected, output[k]);
+      }
+    }
+  }
+}
+
+
+// A measured black level equal to SENSOR_BLACK_LEVEL leaves the output of
+// the default filter unchanged
+TEST(pixel_hfilter, pixel_hfilter_update_black_level__default)
+{
+  static const unsigned output_count = 16;
+  static const unsigned dec_factors[3] = {2, 4, 8};
+  static const float gains[4] = {0.8f, 1.0f, 1.4f, 2.5f};
+
+  __attribute__((aligned(4))) int8_t input[32 + 8 * (output_count - 1)];
+  __attribute__((aligned(4))) int8_t expected[output_count];
+  __attribute__((aligned(4))) int8_t output[output_count];
+  hfilter_state_t state;
+
+  for (unsigned k = 0; k < sizeof(input); k++) {
+    input[k] = (rand() % 256) - 128;
+  }
+
+  for (unsigned d = 0; d < 3; d++) {
+    for (unsigned g = 0; g < 4; g++) {
+      for (unsigned offset = 0; offset < 2; offset++) {
+        pixel_hfilter_update_scale_dec(&state, gains[g], offset, dec_factors[d]);
+        const int32_t acc_init = state.acc_init;
+        pixel_hfilter(expected, input, state.coef, state.acc_init, state.shift,
+                      dec_factors[d], output_count);
+
+        pixel_hfilter_update_black_level(&state, SENSOR_BLACK_LEVEL);
+        pixel_hfilter(output, input, state.coef, state.acc_init, state.shift,
+                      dec_factors[d], output_count);
+
+        TEST_ASSERT_EQUAL_INT32(acc_init, state.acc_init);
+        TEST_ASSERT_EQUAL_INT8_ARRAY(expected, output, output_count);
+      }
+    }
+  }
+}
+
+
+// The two rows of a flat Bayer image sum to its luma
+TEST(pixel_hfilter, pixel_hfilter_update_luma__flat)
+{
+  static const unsigned output_count = 16;
+  static const unsigned dec_factors[3] = {2, 4, 8};
+  static const float weight[3] = {0.299f, 0.587f, 0.114f};
+  static const float gains[2][3] = {{1.0f, 1.0f, 1.0f}, {1.6f, 1.0f, 1.3f}};
+  static const int raw[3] = {200, 120, 60};   // raw uint8 R, G, B
+  static const float black = 16.0f;
+
+  __attribute__((aligned(4))) int8_t input[2][32 + 8 * (output_count - 1)];
+  __attribute__((aligned(4))) int8_t output[2][output_count];
+  hfilter_state_t state;
+
+  // RG then GB row
+  static const unsigned colour[2][2] = {{0, 1}, {1, 2}};
+  for (unsigned p = 0; p < 2; p++) {
+    for (unsigned k = 0; k < sizeof(input[0]); k++) {
+      input[p][k] = raw[colour[p][k & 1]] - 128;
+    }
+  }
+
+  for (unsigned g = 0; g < 2; g++) {
+    float luma = 0;
+    for (unsigned c = 0; c < 3; c++) {
+      luma += weight[c] * gains[g][c] * (raw[c] - black);
+    }
+    const int expected = (int)(luma + 0.5f) - 128;
+
+    for (unsigned d = 0; d < 3; d++) {
+      for (unsigned p = 0; p < 2; p++) {
+        float gain[2];
+        float share = 0;
+        for (unsigned s = 0; s < 2; s++) {
+          const unsigned c = colour[p][s];
+          const float w = (c == 1) ? 0.5f * weight[c] : weight[c];
+          gain[s] = w * gains[g][c];
+          share += w;
+        }
+        const float black_level[2] = {black, black};
+        pixel_hfilter_update_luma(&state, gain, black_level, 128 * share, dec_factors[d]);
+        pixel_hfilter(output[p], input[p], state.coef, state.acc_init, state.shift,
+                      dec_factors[d], output_count);
+      }
+
+      for (unsigned k = 0; k < output_count; k++) {
+        TEST_ASSERT_INT_WITHIN(2, expected, output[0][k] + output[1][k]);
+      }
+    }
+  }
+}
@@ -8,9 +8,12 @@
 #include <assert.h>
 #include <stdarg.h>
 
+#include <xcore/parallel.h>
+
 #include "unity_fixture.h"
 
 #include "camera_main.h"
+#include "_helpers.h"
 
 TEST_GROUP_RUNNER(pixel_vfilter) {
   RUN_TEST_CASE(pixel_vfilter, pixel_vfilter_acc_init__case0);
@@ -26,6 +29,14 @@ TEST_GROUP_RUNNER(pixel_vfilter) {
   RUN_TEST_CASE(pixel_vfilter, pixel_vfilter_macc__case2);
   RUN_TEST_CASE(pixel_vfilter, pixel_vfilter_macc__case3);
   RUN_TEST_CASE(pixel_vfilter, pixel_vfilter_macc__timing);
+
+  RUN_TEST_CASE(pixel_vfilter, image_vfilter_bank__dc_gain);
+  RUN_TEST_CASE(pixel_vfilter, image_vfilter_bank__row_timing);
+
+  RUN_TEST_CASE(pixel_vfilter, image_vfilter_process_row_hfilter__case0);
+
+  RUN_TEST_CASE(pixel_vfilter, image_vfilter_row_columns__case0);
+  RUN_TEST_CASE(pixel_vfilter, image_vfilter_row_columns__thread_timing);
 }
 
 #define ACC_HI(X)     (((X)>>16)&0xFFFF)
@@ -591,3 +602,326 @@ TEST(pixel_vfilter, pixel_vfilter_macc__timing)
   for(int k = 0; k < max_blocks; k++)   printf("%8u", timing[k]);
   printf("\n\n");
 }
+
+
+
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+// Each bank keeps flat rows flat and outputs height / factor rows
+TEST(pixel_vfilter, image_vfilter_bank__dc_gain)
+{
+  static const unsigned width = 64;
+  static const unsigned in_rows = 240; // same-colour rows of a VGA frame
+
+  static vfilter_acc_t accs[VFILTER_ACC_COUNT_MAX];
+  __attribute__((aligned(4))) int8_t row[64];
+  __attribute__((aligned(4))) int8_t out[64];
+
+  for (unsigned k = 0; k < width; k++) {
+    row[k] = (int8_t)(3 * k - 90);
+  }
+
+  for (unsigned f = 2; f <= 8; f *= 2) {
+    const vfilter_bank_t* bank = image_vfilter_bank(f);
+    TEST_ASSERT_EQUAL_UINT(f / 2, bank->dec_factor);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT(VFILTER_ACC_COUNT_MAX, bank->acc_count);
+
+    image_vfilter_frame_init(accs, bank, width);
+
+    unsigned out_rows = 0;
+    for (unsigned r = 0; r < in_rows; r++) {
+      if (image_vfilter_process_row(out, accs, row, bank, width)) {
+        // the first row misses the taps above the image
+        if (out_rows > 0) {
+          TEST_ASSERT_EQUAL_INT8_ARRAY(row, out, width);
+        }
+        out_rows++;
+      }
+    }
+    if (out_rows < 2 * in_rows / f) {
+      TEST_ASSERT_EQUAL_UINT(1, image_vfilter_drain(out, accs, bank, width));
+      out_rows++;
+    }
+    TEST_ASSERT_EQUAL_UINT(2 * in_rows / f, out_rows);
+  }
+}
+
+
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+// ISP cost of a 1280 pixel sensor row for each decimation factor: the
+// horizontal filter and the vertical filter for the channels of the row,
+// averaged over a row pair (RG row then GB row). The two-stage path writes
+// the horizontal filter output to a row and reads it back for each vertical
+// tap (the ISP default). image_vfilter_process_row_hfilter() runs the path
+// of the build, so it times the fused pass in the `fused` test build
+// (ISP_FUSED_FILTER=1) and repeats the two-stage one otherwise. The luma-only mode (camera_set_luma()) filters each row once
+// into a single channel, through image_vfilter_row_columns() as in the ISP.
+TEST(pixel_vfilter, image_vfilter_bank__row_timing)
+{
+  static const unsigned row_pairs = 16;
+
+  static vfilter_acc_t accs[APP_IMAGE_CHANNEL_COUNT][VFILTER_ACC_COUNT_MAX];
+  static hfilter_state_t hf[APP_IMAGE_CHANNEL_COUNT];
+  __attribute__((aligned(4))) static int8_t input[MIPI_MAX_IMAGE_WIDTH_PIXELS + 32];
+  __attribute__((aligned(4))) static int8_t hf_row[APP_MAX_IMAGE_WIDTH_PIXELS];
+  __attribute__((aligned(4))) static int8_t out[APP_MAX_IMAGE_WIDTH_PIXELS];
+
+  static const char func_name[] = "image_vfilter_bank() row";
+  static const char row1_head[] = "dec_factor:";
+  static const char row2_head[] = "width:     ";
+  static const char row3_head[] = "two-stage: ";
+#if ISP_FUSED_FILTER
+  static const char row4_head[] = "fused:     ";
+#else
+  static const char row4_head[] = "two-stage: ";
+#endif
+  static const char row5_head[] = "luma:      ";
+
+  unsigned factors[3] = {2, 4, 8};
+  unsigned widths[3];
+  unsigned timing[3][3];
+
+  for (unsigned i = 0; i < 3; i++) {
+    const unsigned f = factors[i];
+    const unsigned width = MIPI_MAX_IMAGE_WIDTH_PIXELS / f;
+    widths[i] = width;
+    timing[0][i] = timing[1][i] = timing[2][i] = 0;
+    if (f < APP_DECIMATION_FACTOR_MIN) {
+      continue;
+    }
+
+    const vfilter_bank_t* bank = image_vfilter_bank(f);
+    for (unsigned fused = 0; fused < 2; fused++) {
+      for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+        pixel_hfilter_update_scale_dec(&hf[c], 1.0f, (c == 0) ? 0 : 1, f);
+        image_vfilter_frame_init(&accs[c][0], bank, width);
+      }
+
+      unsigned ts = measure_time();
+      for (unsigned r = 0; r < 2 * row_pairs; r++) {
+        const unsigned c_first = (r & 1) ? CHAN_BLUE : CHAN_RED;
+        const unsigned c_last = (r & 1) ? CHAN_BLUE : CHAN_GREEN;
+        for (unsigned c = c_first; c <= c_last; c++) {
+          if (fused) {
+            image_vfilter_process_row_hfilter(out, &accs[c][0], input, &hf[c], f, bank, width);
+          }
+          else {
+            pixel_hfilter(hf_row, input, hf[c].coef, hf[c].acc_init, hf[c].shift, f, width);
+            image_vfilter_process_row(out, &accs[c][0], hf_row, bank, width);
+          }
+        }
+      }
+      unsigned te = measure_time();
+      timing[fused][i] = (te - ts) / (2 * row_pairs);
+    }
+
+    // Luma: the RG row starts the vertical taps, the GB row adds to the same
+    // taps and completes the output row
+    static const float luma_gain[2] = {0.3f, 0.3f};
+    static const float luma_black[2] = {0.0f, 0.0f};
+    pixel_hfilter_update_luma(&hf[0], luma_gain, luma_black, 76.8f, f);
+    pixel_hfilter_update_luma(&hf[1], luma_gain, luma_black, 76.8f, f);
+    image_vfilter_frame_init(&accs[0][0], bank, width);
+    vfilter_row_t row;
+    int16_t* complete = NULL;
+
+    unsigned ts = measure_time();
+    for (unsigned r = 0; r < 2 * row_pairs; r++) {
+      if ((r & 1) == 0) {
+        image_vfilter_row_begin(&row, &accs[0][0], bank);
+        complete = row.complete;
+        row.complete = NULL;
+      }
+      else {
+        row.complete = complete;
+      }
+      image_vfilter_row_columns(out, &row, input, &hf[r & 1], f, bank, 0, width);
+    }
+    unsigned te = measure_time();
+    timing[2][i] = (te - ts) / (2 * row_pairs);
+  }
+
+  printf("\n\t%s timing (ticks/row):\n", func_name);
+  printf("\t\t%s", row1_head);
+  for(int k = 0; k < 3; k++)   printf("%8u", factors[k]);
+  printf("\n\t\t%s", row2_head);
+  for(int k = 0; k < 3; k++)   printf("%8u", widths[k]);
+  printf("\n\t\t%s", row3_head);
+  for(int k = 0; k < 3; k++)   printf("%8u", timing[0][k]);
+  printf("\n\t\t%s", row4_head);
+  for(int k = 0; k < 3; k++)   printf("%8u", timing[1][k]);
+  printf("\n\t\t%s", row5_head);
+  for(int k = 0; k < 3; k++)   printf("%8u", timing[2][k]);
+  printf("\n\n");
+}
+
+
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+// image_vfilter_process_row_hfilter() matches pixel_hfilter() +
+// image_vfilter_process_row(), the fused kernel in the `fused` test build
+TEST(pixel_vfilter, image_vfilter_process_row_hfilter__case0)
+{
+  static const unsigned width = 64;
+  static const unsigned in_rows = 40;
+
+  static vfilter_acc_t accs[2][VFILTER_ACC_COUNT_MAX];
+  hfilter_state_t hf;
+  __attribute__((aligned(4))) static int8_t input[8 * 64 + 32];
+  __attribute__((aligned(4))) int8_t hf_row[64];
+  __attribute__((aligned(4))) int8_t expected[64];
+  __attribute__((aligned(4))) int8_t actual[64];
+
+  for (unsigned f = 2; f <= 8; f *= 2) {
+    const vfilter_bank_t* bank = image_vfilter_bank(f);
+    pixel_hfilter_update_scale_dec(&hf, 1.3f, 1, f);
+    image_vfilter_frame_init(&accs[0][0], bank, width);
+    image_vfilter_frame_init(&accs[1][0], bank, width);
+
+    for (unsigned r = 0; r < in_rows; r++) {
+      fill_array_rand_int8(input, sizeof(input));
+
+      pixel_hfilter(hf_row, input, hf.coef, hf.acc_init, hf.shift, f, width);
+      unsigned exp_row = image_vfilter_process_row(expected, &accs[0][0], hf_row, bank, width);
+      unsigned act_row = image_vfilter_process_row_hfilter(actual, &accs[1][0], input, &hf, f, bank, width);
+
+      TEST_ASSERT_EQUAL_UINT(exp_row, act_row);
+      if (exp_row) {
+        TEST_ASSERT_EQUAL_INT8_ARRAY(expected, actual, width);
+      }
+    }
+  }
+}
+
+
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+// Column ranges, in any order and with either ISP_FUSED_FILTER, match the
+// whole row of image_vfilter_process_row_hfilter()
+TEST(pixel_vfilter, image_vfilter_row_columns__case0)
+{
+  static const unsigned width = 96;
+  static const unsigned in_rows = 40;
+  static const unsigned cols[4] = {0, 32, 48, 96};
+
+  static vfilter_acc_t accs[2][VFILTER_ACC_COUNT_MAX];
+  hfilter_state_t hf;
+  vfilter_row_t row;
+  __attribute__((aligned(4))) static int8_t input[8 * 96 + 32];
+  __attribute__((aligned(4))) int8_t expected[96];
+  __attribute__((aligned(4))) int8_t actual[96];
+
+  for (unsigned f = 2; f <= 8; f *= 2) {
+    const vfilter_bank_t* bank = image_vfilter_bank(f);
+    pixel_hfilter_update_scale_dec(&hf, 0.8f, 0, f);
+    image_vfilter_frame_init(&accs[0][0], bank, width);
+    image_vfilter_frame_init(&accs[1][0], bank, width);
+
+    for (unsigned r = 0; r < in_rows; r++) {
+      fill_array_rand_int8(input, sizeof(input));
+
+      unsigned exp_row = image_vfilter_process_row_hfilter(expected, &accs[0][0], input, &hf, f, bank, width);
+      unsigned act_row = image_vfilter_row_begin(&row, &accs[1][0], bank);
+      for (int k = 2; k >= 0; k--) {
+        image_vfilter_row_columns(actual, &row, input, &hf, f, bank, cols[k], cols[k + 1] - cols[k]);
+      }
+
+      TEST_ASSERT_EQUAL_UINT(exp_row, act_row);
+      if (exp_row) {
+        TEST_ASSERT_EQUAL_INT8_ARRAY(expected, actual, width);
+      }
+    }
+  }
+}
+
+
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+///////////////////////////////////////////////
+static vfilter_row_t shard_row;
+static hfilter_state_t shard_hf;
+static const vfilter_bank_t* shard_bank;
+static unsigned shard_cols[5];
+__attribute__((aligned(4))) static int8_t shard_input[MIPI_MAX_IMAGE_WIDTH_PIXELS + 32];
+__attribute__((aligned(4))) static int8_t shard_out[APP_MAX_IMAGE_WIDTH_PIXELS];
+
+DECLARE_JOB(vfilter_shard_job, (unsigned));
+void vfilter_shard_job(unsigned shard)
+{
+  image_vfilter_row_columns(shard_out, &shard_row, shard_input, &shard_hf,
+                            APP_DECIMATION_FACTOR, shard_bank,
+                            shard_cols[shard], shard_cols[shard + 1] - shard_cols[shard]);
+}
+
+// Rows of the default output split between 1 to 4 threads, as ISP_THREAD_COUNT
+// does, give the same output. Threads are started for every row here, the ISP
+// starts them once.
+TEST(pixel_vfilter, image_vfilter_row_columns__thread_timing)
+{
+  static const unsigned row_count = 32;
+  static const unsigned width = APP_IMAGE_WIDTH_PIXELS;
+  static vfilter_acc_t accs[VFILTER_ACC_COUNT_MAX];
+
+  static const char func_name[] = "image_vfilter_row_columns() row";
+  static const char row1_head[] = "threads:";
+  static const char row2_head[] = "ticks:  ";
+
+  unsigned timing[4];
+  uint32_t checksum[4];
+
+  fill_array_rand_int8(shard_input, sizeof(shard_input));
+  shard_bank = image_vfilter_bank(APP_DECIMATION_FACTOR);
+  pixel_hfilter_update_scale_dec(&shard_hf, 1.0f, 0, APP_DECIMATION_FACTOR);
+
+  for (unsigned n = 1; n <= 4; n++) {
+    for (unsigned s = 0; s <= n; s++) {
+      shard_cols[s] = 16 * (((width / 16) * s) / n);
+    }
+    image_vfilter_frame_init(accs, shard_bank, width);
+    checksum[n - 1] = 0;
+
+    unsigned ts = measure_time();
+    for (unsigned r = 0; r < row_count; r++) {
+      const unsigned new_row = image_vfilter_row_begin(&shard_row, accs, shard_bank);
+      switch (n) {
+        case 1:
+          vfilter_shard_job(0);
+          break;
+        case 2:
+          PAR_JOBS(PJOB(vfilter_shard_job, (0)), PJOB(vfilter_shard_job, (1)));
+          break;
+        case 3:
+          PAR_JOBS(PJOB(vfilter_shard_job, (0)), PJOB(vfilter_shard_job, (1)),
+                   PJOB(vfilter_shard_job, (2)));
+          break;
+        default:
+          PAR_JOBS(PJOB(vfilter_shard_job, (0)), PJOB(vfilter_shard_job, (1)),
+                   PJOB(vfilter_shard_job, (2)), PJOB(vfilter_shard_job, (3)));
+          break;
+      }
+      if (new_row) {
+        for (unsigned x = 0; x < width; x++) {
+          checksum[n - 1] = 31 * checksum[n - 1] + (uint8_t)shard_out[x];
+        }
+      }
+    }
+    unsigned te = measure_time();
+    timing[n - 1] = (te - ts) / row_count;
+  }
+
+  printf("\n\t%s timing (ticks/row, width %u):\n", func_name, width);
+  printf("\t\t%s", row1_head);
+  for(int k = 0; k < 4; k++)   printf("%8u", k + 1);
+  printf("\n\t\t%s", row2_head);
+  for(int k = 0; k < 4; k++)   printf("%8u", timing[k]);
+  printf("\n\n");
+
+  for (unsigned n = 2; n <= 4; n++) {
+    TEST_ASSERT_EQUAL_UINT32(checksum[0], checksum[n - 1]);
+  }
+}
@@ -0,0 +1,151 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "unity_fixture.h"
+
+#include "camera_main.h"
+#include "isp_pyramid.h"
+#include "_helpers.h"
+
+TEST_GROUP_RUNNER(isp_pyramid) {
+  RUN_TEST_CASE(isp_pyramid, isp_pyramid__levels);
+  RUN_TEST_CASE(isp_pyramid, isp_pyramid__extremes);
+  RUN_TEST_CASE(isp_pyramid, isp_pyramid__scalar);
+}
+
+TEST_GROUP(isp_pyramid);
+TEST_SETUP(isp_pyramid) { fflush(stdout); }
+TEST_TEAR_DOWN(isp_pyramid) {}
+
+#define CH    APP_IMAGE_CHANNEL_COUNT
+#define W0    APP_PYRAMID_WIDTH(0)
+#define H0    APP_PYRAMID_HEIGHT(0)
+
+__attribute__((aligned(4)))
+static int8_t levels[APP_PYRAMID_LEVELS][CH * H0 * W0];
+__attribute__((aligned(4)))
+static int8_t expected[APP_PYRAMID_LEVELS][CH * H0 * W0];
+__attribute__((aligned(4)))
+static int16_t accs[2 * W0];
+
+// The 2x2 mean, the sum rounded once with halves away from zero
+static
+int8_t ref_mean(
+    const int8_t a,
+    const int8_t b,
+    const int8_t c,
+    const int8_t d)
+{
+  const int32_t sum = a + b + c + d;
+  return (int8_t)((sum >= 0) ? (sum + 2) / 4 : -((-sum + 2) / 4));
+}
+
+// Level k of `lv` from level k - 1, scalar
+static
+void ref_level(
+    int8_t lv[APP_PYRAMID_LEVELS][CH * H0 * W0],
+    const unsigned k)
+{
+  const unsigned w_in = APP_PYRAMID_WIDTH(k - 1);
+  const unsigned h_in = APP_PYRAMID_HEIGHT(k - 1);
+  for (unsigned c = 0; c < CH; c++) {
+    const int8_t* in = &lv[k - 1][c * h_in * w_in];
+    int8_t* out = &lv[k][c * (h_in / 2) * (w_in / 2)];
+    for (unsigned y = 0; y < h_in / 2; y++) {
+      for (unsigned x = 0; x < w_in / 2; x++) {
+        const int8_t* p = &in[2 * y * w_in + 2 * x];
+        out[y * (w_in / 2) + x] = ref_mean(p[0], p[1], p[w_in], p[w_in + 1]);
+      }
+    }
+  }
+}
+
+
+// Each level matches the scalar 2x2 mean of the level below
+TEST(isp_pyramid, isp_pyramid__levels)
+{
+  srand(11);
+  fill_array_rand_int8(levels[0], CH * H0 * W0);
+  memcpy(expected[0], levels[0], CH * H0 * W0);
+
+  for (unsigned k = 1; k < APP_PYRAMID_LEVELS; k++) {
+    const unsigned w_in = APP_PYRAMID_WIDTH(k - 1);
+    const unsigned h_in = APP_PYRAMID_HEIGHT(k - 1);
+    for (unsigned c = 0; c < CH; c++) {
+      const int8_t* in = &levels[k - 1][c * h_in * w_in];
+      int8_t* out = &levels[k][c * (h_in / 2) * (w_in / 2)];
+      for (unsigned y = 0; y < h_in / 2; y++) {
+        isp_pyramid_downscale_row(&out[y * (w_in / 2)], &in[2 * y * w_in],
+                                  &in[(2 * y + 1) * w_in], w_in, accs);
+      }
+    }
+    ref_level(expected, k);
+
+    const unsigned len = CH * APP_PYRAMID_HEIGHT(k) * APP_PYRAMID_WIDTH(k);
+    TEST_ASSERT_EQUAL_INT8_ARRAY(expected[k], levels[k], len);
+  }
+}
+
+
+// Blocks at the ends of the range keep -128, which the VPU saturation alone
+// would turn into -127, and round halves away from zero
+TEST(isp_pyramid, isp_pyramid__extremes)
+{
+  static const int8_t blocks[][4] = {
+    {-128, -128, -128, -128},
+    {-128, -128, -128, -127},
+    {-128, -127, -127, -127},
+    { 127,  127,  127,  127},
+    {-128,  127, -128,  127},
+    {  -1,   -1,    0,    0},
+    {   1,    1,    0,    0},
+    {  -3,   -3,   -3,   -2},
+  };
+  const unsigned n = sizeof(blocks) / sizeof(blocks[0]);
+  __attribute__((aligned(4))) int8_t top[32];
+  __attribute__((aligned(4))) int8_t bot[32];
+  int8_t out[16];
+
+  for (unsigned x = 0; x < 16; x++) {
+    const int8_t* b = blocks[x % n];
+    top[2 * x] = b[0];
+    top[2 * x + 1] = b[1];
+    bot[2 * x] = b[2];
+    bot[2 * x + 1] = b[3];
+  }
+  isp_pyramid_downscale_row(out, top, bot, 32, accs);
+
+  for (unsigned x = 0; x < 16; x++) {
+    const int8_t* b = blocks[x % n];
+    TEST_ASSERT_EQUAL_INT8(ref_mean(b[0], b[1], b[2], b[3]), out[x]);
+  }
+  TEST_ASSERT_EQUAL_INT8(-128, out[0]);
+  TEST_ASSERT_EQUAL_INT8(-128, out[1]);
+}
+
+
+// Rows the VPU can't take, of a width not a multiple of 16 or unaligned, give
+// the same pixels
+TEST(isp_pyramid, isp_pyramid__scalar)
+{
+  __attribute__((aligned(4))) int8_t rows[2][64 + 4];
+  int8_t out_vpu[32];
+  int8_t out_scalar[32];
+
+  srand(5);
+  fill_array_rand_int8(&rows[0][0], sizeof(rows));
+  isp_pyramid_downscale_row(out_vpu, &rows[0][0], &rows[1][0], 64, accs);
+
+  isp_pyramid_downscale_row(out_scalar, &rows[0][0], &rows[1][0], 40, accs);
+  TEST_ASSERT_EQUAL_INT8_ARRAY(out_vpu, out_scalar, 20);
+
+  memmove(&rows[0][1], &rows[0][0], 64);
+  memmove(&rows[1][1], &rows[1][0], 64);
+  isp_pyramid_downscale_row(out_scalar, &rows[0][1], &rows[1][1], 64, accs);
+  TEST_ASSERT_EQUAL_INT8_ARRAY(out_vpu, out_scalar, 32);
+}
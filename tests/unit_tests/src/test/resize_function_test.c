@@ -15,6 +15,7 @@
 #include "camera_io_utils.h"
 #include "unity_fixture.h"
 #include "isp_functions.h"
+#include "camera_utils.h"
 #include "_helpers.h" // fill random array
 
 // get_reference_time();
@@ -23,6 +24,23 @@
 
 #define DELTA_PIXEL 1 // allowed rounding error
 
+// Resize plans are large, keep them out of the stack
+static isp_resize_plan_t plan;
+
+// ImageNet normalisation, int8 tensor
+static const float t_mean[3] = {0.485f, 0.456f, 0.406f};
+static const float t_std[3] = {0.229f, 0.224f, 0.225f};
+static const float t_scale[3] = {0.0186f, 0.0186f, 0.0186f};
+static const int32_t t_zero_point[3] = {-14, -14, -14};
+
+static int8_t quantise_ref(const uint8_t pixel, const unsigned c) {
+    const float real = (pixel / 255.0f - t_mean[c]) / t_std[c];
+    const float q = real / t_scale[c];
+    int32_t qi = (int32_t)((q >= 0) ? q + 0.5f : q - 0.5f) + t_zero_point[c];
+    qi = (qi > INT8_MAX) ? INT8_MAX : qi;
+    return (int8_t)((qi < INT8_MIN) ? INT8_MIN : qi);
+}
+
 unsigned t1 = 0, t2 = 0, t3 = 0, t4 = 0, t5 = 0;
 unsigned t1t = 0, t2t = 0, t3t = 0, t4t = 0, t5t = 0;
 
@@ -33,6 +51,17 @@ TEST_GROUP_RUNNER(resize_group) {
     RUN_TEST_CASE(resize_group, resize__uint8);     // test uint8 resize, constant and time
     RUN_TEST_CASE(resize_group, resize__int8);      // test int8 resize, constant and time
     RUN_TEST_CASE(resize_group, resize__upsample);  // test upsample a real image, save and decode    
+    RUN_TEST_CASE(resize_group, resize__plan_constant); // test plan resize, constant int8 and uint8
+    RUN_TEST_CASE(resize_group, resize__plan_compare);  // test plan resize against isp_resize_uint8
+    RUN_TEST_CASE(resize_group, resize__plan_time);     // plan resize throughput, typical NN input sizes
+    RUN_TEST_CASE(resize_group, resize__modes_constant); // test nearest and area, constant int8 and uint8
+    RUN_TEST_CASE(resize_group, resize__modes_area);     // test area VPU path is bit-exact with the scalar path
+    RUN_TEST_CASE(resize_group, resize__modes_time);     // compare modes time with bilinear
+    RUN_TEST_CASE(resize_group, resize__tensor);         // fused tensor against resize then quantise
+    RUN_TEST_CASE(resize_group, resize__tensor_letterbox); // letterbox borders
+    RUN_TEST_CASE(resize_group, resize__tensor_bound);   // largest gain and offset quantise without overflow
+    RUN_TEST_CASE(resize_group, resize__tensor_lut);     // capture lookup tables against the quantisation
+    RUN_TEST_CASE(resize_group, resize__tensor_time);    // fused tensor against separate steps
 }
 TEST_GROUP(resize_group);
 TEST_SETUP(resize_group){
@@ -200,3 +229,338 @@ TEST(resize_group, resize__upsample) {
     //system(cmd);
     printf("Run the cmd >> : %s\n", cmd);
 }
+
+
+TEST(resize_group, resize__plan_constant) {
+    CREATE_IMG_UINT8(img, 64, 64, 3);
+    CREATE_IMG_UINT8(img_out, 80, 80, 3);
+    CREATE_IMG_INT8(img_s, 64, 64, 3);
+    CREATE_IMG_INT8(img_s_out, 80, 80, 3);
+
+    isp_resize_plan_init(&plan, img.width, img.height, img_out.width, img_out.height, 3);
+
+    const uint8_t vals_u[] = {0, 1, 127, 128, 200, UINT8_MAX};
+    for (unsigned i = 0; i < sizeof(vals_u); i++) {
+        memset(img.ptr, vals_u[i], img.size);
+        isp_resize_plan_uint8(&plan, img.ptr, img_out.ptr);
+        for (unsigned k = 0; k < img_out.size; k++) {
+            TEST_ASSERT_EQUAL_UINT8(vals_u[i], img_out.ptr[k]);
+        }
+    }
+
+    const int8_t vals_s[] = {INT8_MIN, -127, -1, 0, 1, INT8_MAX};
+    for (unsigned i = 0; i < sizeof(vals_s); i++) {
+        memset(img_s.ptr, vals_s[i], img_s.size);
+        isp_resize_plan_int8(&plan, img_s.ptr, img_s_out.ptr);
+        for (unsigned k = 0; k < img_s_out.size; k++) {
+            TEST_ASSERT_EQUAL_INT8(vals_s[i], img_s_out.ptr[k]);
+        }
+    }
+}
+
+TEST(resize_group, resize__plan_compare) {
+    static CREATE_IMG_UINT8(img, 120, 160, 3);
+    static CREATE_IMG_UINT8(img_ref, 96, 96, 3);
+    static CREATE_IMG_UINT8(img_out, 96, 96, 3);
+
+    // smooth gradient, the Q7 weights of the plan add at most one LSB here
+    for (unsigned y = 0; y < img.height; y++) {
+        for (unsigned x = 0; x < img.width; x++) {
+            for (unsigned c = 0; c < img.channels; c++) {
+                img.data[y][x][c] = (x + y) / 2 + c * 40;
+            }
+        }
+    }
+
+    isp_resize_uint8(img.ptr, img.width, img.height, img_ref.ptr, img_ref.width, img_ref.height);
+    isp_resize_plan_init(&plan, img.width, img.height, img_out.width, img_out.height, 3);
+    isp_resize_plan_uint8(&plan, img.ptr, img_out.ptr);
+    for (unsigned k = 0; k < img_out.size; k++) {
+        TEST_ASSERT_UINT8_WITHIN(DELTA_PIXEL, img_ref.ptr[k], img_out.ptr[k]);
+    }
+
+    // unaligned output takes the scalar path, results must be identical
+    static uint8_t out_unaligned[96 * 96 * 3 + 1] __attribute__((aligned(4)));
+    isp_resize_plan_uint8(&plan, img.ptr, &out_unaligned[1]);
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(img_out.ptr, &out_unaligned[1], img_out.size);
+}
+
+TEST(resize_group, resize__plan_time) {
+    // 160x120 -> 96x96 RGB, against the float implementation
+    static CREATE_IMG_UINT8(img, 120, 160, 3);
+    static CREATE_IMG_UINT8(img_out, 96, 96, 3);
+    fill_array_rand_uint8(img.ptr, img.size);
+
+    t1 = get_reference_time();
+    isp_resize_uint8(img.ptr, img.width, img.height, img_out.ptr, img_out.width, img_out.height);
+    t2 = get_reference_time();
+    isp_resize_plan_init(&plan, img.width, img.height, img_out.width, img_out.height, 3);
+    t3 = get_reference_time();
+    isp_resize_plan_uint8(&plan, img.ptr, img_out.ptr);
+    t4 = get_reference_time();
+    printf("Time resize 160x120->96x96 float: %u, plan init: %u, plan: %u\n", t2 - t1, t3 - t2, t4 - t3);
+
+    // 224x224 outputs share one buffer. A 320x240 RGB input would not fit
+    // next to the test app, so that size is timed on a single plane.
+    static uint8_t buf[224 * 224 * 3] __attribute__((aligned(4)));
+    uint8_t* l_in = buf;
+    uint8_t* l_out = &buf[320 * 240];
+    fill_array_rand_uint8(l_in, 320 * 240);
+
+    isp_resize_plan_init(&plan, 320, 240, 224, 224, 1);
+    t1 = get_reference_time();
+    isp_resize_plan_uint8(&plan, l_in, l_out);
+    t2 = get_reference_time();
+    printf("Time resize 320x240->224x224 plan (1 plane): %u\n", t2 - t1);
+
+    // 160x120 -> 224x224 RGB, the default camera output to a model input
+    isp_resize_plan_init(&plan, img.width, img.height, 224, 224, 3);
+    t1 = get_reference_time();
+    isp_resize_plan_uint8(&plan, img.ptr, buf);
+    t2 = get_reference_time();
+    printf("Time resize 160x120->224x224 plan (RGB): %u\n", t2 - t1);
+}
+
+TEST(resize_group, resize__modes_constant) {
+    static CREATE_IMG_UINT8(img, 64, 64, 3);
+    static CREATE_IMG_UINT8(img_out, 16, 16, 3);
+    static CREATE_IMG_INT8(img_s, 64, 64, 3);
+    static CREATE_IMG_INT8(img_s_out, 24, 24, 3); // non integer factor
+
+    const isp_resize_mode_t modes[] = {ISP_RESIZE_NEAREST, ISP_RESIZE_AREA};
+    const uint8_t vals_u[] = {0, 1, 127, 128, 200, UINT8_MAX};
+    const int8_t vals_s[] = {INT8_MIN, -127, -1, 0, 1, INT8_MAX};
+
+    for (unsigned m = 0; m < sizeof(modes) / sizeof(modes[0]); m++) {
+        for (unsigned i = 0; i < sizeof(vals_u); i++) {
+            memset(img.ptr, vals_u[i], img.size);
+            isp_resize_mode_uint8(img.ptr, img.width, img.height,
+                img_out.ptr, img_out.width, img_out.height, modes[m]);
+            for (unsigned k = 0; k < img_out.size; k++) {
+                TEST_ASSERT_EQUAL_UINT8(vals_u[i], img_out.ptr[k]);
+            }
+        }
+        for (unsigned i = 0; i < sizeof(vals_s); i++) {
+            memset(img_s.ptr, vals_s[i], img_s.size);
+            isp_resize_mode_int8(img_s.ptr, img_s.width, img_s.height,
+                img_s_out.ptr, img_s_out.width, img_s_out.height, modes[m]);
+            for (unsigned k = 0; k < img_s_out.size; k++) {
+                TEST_ASSERT_EQUAL_INT8(vals_s[i], img_s_out.ptr[k]);
+            }
+        }
+    }
+}
+
+TEST(resize_group, resize__modes_area) {
+    static CREATE_IMG_UINT8(img, 120, 160, 3);
+    static CREATE_IMG_UINT8(img_out, 30, 40, 3);
+    static uint8_t in_unaligned[120 * 160 * 3 + 1] __attribute__((aligned(4)));
+    static uint8_t out_ref[30 * 40 * 3];
+    fill_array_rand_uint8(img.ptr, img.size);
+
+    // unaligned input takes the scalar path
+    memcpy(&in_unaligned[1], img.ptr, img.size);
+    isp_resize_mode_uint8(&in_unaligned[1], img.width, img.height,
+        out_ref, img_out.width, img_out.height, ISP_RESIZE_AREA);
+    isp_resize_mode_uint8(img.ptr, img.width, img.height,
+        img_out.ptr, img_out.width, img_out.height, ISP_RESIZE_AREA);
+
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(out_ref, img_out.ptr, img_out.size);
+
+    // int8, with the -128 and 127 extremes that the VPU saturation used to move
+    int8_t* img_s = (int8_t*)img.ptr;
+    for (unsigned k = 0; k < img.size; k++) {
+        const unsigned r = rand() % 4;
+        img_s[k] = (r == 0) ? INT8_MIN : (r == 1) ? INT8_MAX : (int8_t)rand();
+    }
+    memcpy(&in_unaligned[1], img.ptr, img.size);
+    isp_resize_mode_int8((int8_t*)&in_unaligned[1], img.width, img.height,
+        (int8_t*)out_ref, img_out.width, img_out.height, ISP_RESIZE_AREA);
+    isp_resize_mode_int8(img_s, img.width, img.height,
+        (int8_t*)img_out.ptr, img_out.width, img_out.height, ISP_RESIZE_AREA);
+    TEST_ASSERT_EQUAL_INT8_ARRAY((int8_t*)out_ref, (int8_t*)img_out.ptr, img_out.size);
+}
+
+TEST(resize_group, resize__modes_time) {
+    static CREATE_IMG_UINT8(img, 120, 160, 3);
+    static CREATE_IMG_UINT8(img_out, 30, 40, 3);
+    static CREATE_IMG_UINT8(img_nn, 96, 96, 3);
+    fill_array_rand_uint8(img.ptr, img.size);
+
+    const isp_resize_mode_t modes[] = {ISP_RESIZE_BILINEAR, ISP_RESIZE_NEAREST, ISP_RESIZE_AREA};
+    const char* names[] = {"bilinear", "nearest", "area"};
+
+    for (unsigned m = 0; m < 3; m++) {
+        // integer factor (4)
+        t1 = get_reference_time();
+        isp_resize_mode_uint8(img.ptr, img.width, img.height,
+            img_out.ptr, img_out.width, img_out.height, modes[m]);
+        t2 = get_reference_time();
+        // non integer factor
+        isp_resize_mode_uint8(img.ptr, img.width, img.height,
+            img_nn.ptr, img_nn.width, img_nn.height, modes[m]);
+        t3 = get_reference_time();
+        printf("Time resize %s 160x120->40x30: %u, 160x120->96x96: %u\n", names[m], t2 - t1, t3 - t2);
+    }
+}
+
+TEST(resize_group, resize__tensor) {
+    // decimated frame from the camera is int8
+    static CREATE_IMG_INT8(img, 120, 160, 3);
+    static CREATE_IMG_INT8(resized, 96, 96, 3);
+    static CREATE_IMG_INT8(tensor, 3, 96, 96); // CHW
+    fill_array_rand_int8(img.ptr, img.size);
+
+    isp_tensor_quant_t quant;
+    isp_tensor_quant_init(&quant, 3, t_mean, t_std, t_scale, t_zero_point, 0);
+
+    isp_image_t src, dst, ref;
+    isp_image_init(&src, img.ptr, img.width, img.height, 3, ISP_LAYOUT_HWC, ISP_TYPE_INT8);
+    isp_image_init(&dst, tensor.ptr, 96, 96, 3, ISP_LAYOUT_CHW, ISP_TYPE_INT8);
+    isp_resize_to_tensor(&src, NULL, &dst, &quant, 0);
+
+    // reference: strided resize (same interpolation), then float quantisation
+    isp_image_init(&ref, resized.ptr, 96, 96, 3, ISP_LAYOUT_CHW, ISP_TYPE_INT8);
+    isp_resize_image(&src, &ref, ISP_RESIZE_BILINEAR);
+    for (unsigned k = 0; k < resized.size; k++) {
+        const unsigned c = k / (96 * 96);
+        const int8_t expected = quantise_ref((uint8_t)(resized.ptr[k] + 128), c);
+        TEST_ASSERT_INT8_WITHIN(DELTA_PIXEL, expected, tensor.ptr[k]);
+    }
+}
+
+TEST(resize_group, resize__tensor_letterbox) {
+    static CREATE_IMG_INT8(img, 120, 160, 3);
+    static CREATE_IMG_INT8(tensor, 96, 96, 3);
+    fill_array_rand_int8(img.ptr, img.size);
+
+    isp_tensor_quant_t quant;
+    isp_tensor_quant_init(&quant, 3, t_mean, t_std, t_scale, t_zero_point, 114);
+    for (unsigned c = 0; c < 3; c++) {
+        TEST_ASSERT_INT8_WITHIN(DELTA_PIXEL, quantise_ref(114, c), quant.pad[c]);
+    }
+
+    isp_image_t src, dst;
+    isp_image_init(&src, img.ptr, img.width, img.height, 3, ISP_LAYOUT_HWC, ISP_TYPE_INT8);
+    isp_image_init(&dst, tensor.ptr, 96, 96, 3, ISP_LAYOUT_HWC, ISP_TYPE_INT8);
+
+    // 4:3 into a square: 96x72 image, 12 rows of border above and below
+    isp_resize_to_tensor(&src, NULL, &dst, &quant, 1);
+    for (unsigned y = 0; y < 96; y++) {
+        if (y >= 12 && y < 84) {
+            continue;
+        }
+        for (unsigned x = 0; x < 96; x++) {
+            for (unsigned c = 0; c < 3; c++) {
+                TEST_ASSERT_EQUAL_INT8(quant.pad[c], tensor.data[y][x][c]);
+            }
+        }
+    }
+
+    // portrait ROI: 48x96 image, 24 columns of border left and right
+    const isp_roi_t roi = {.x = 10, .y = 0, .width = 60, .height = 120};
+    isp_resize_to_tensor(&src, &roi, &dst, &quant, 1);
+    for (unsigned y = 0; y < 96; y++) {
+        for (unsigned x = 0; x < 96; x++) {
+            if (x >= 24 && x < 72) {
+                continue;
+            }
+            for (unsigned c = 0; c < 3; c++) {
+                TEST_ASSERT_EQUAL_INT8(quant.pad[c], tensor.data[y][x][c]);
+            }
+        }
+    }
+}
+
+TEST(resize_group, resize__tensor_bound) {
+    static CREATE_IMG_INT8(img, 16, 16, 3);
+    static CREATE_IMG_INT8(tensor, 8, 8, 3);
+
+    // q = pixel * 100 - 7260: gain * 255 + |offset| = 32760, just under
+    // the 2^15 - 1 isp_tensor_quant_init() allows
+    const float mean[3] = {0.28470588f, 0.28470588f, 0.28470588f};
+    const float std[3] = {1.0f, 1.0f, 1.0f};
+    const float scale[3] = {1.0f / 25500, 1.0f / 25500, 1.0f / 25500};
+    const int32_t zero_point[3] = {0, 0, 0};
+    isp_tensor_quant_t quant;
+    isp_tensor_quant_init(&quant, 3, mean, std, scale, zero_point, 0);
+
+    isp_image_t src, dst;
+    isp_image_init(&src, img.ptr, img.width, img.height, 3, ISP_LAYOUT_HWC, ISP_TYPE_INT8);
+    isp_image_init(&dst, tensor.ptr, 8, 8, 3, ISP_LAYOUT_HWC, ISP_TYPE_INT8);
+
+    // pixel and expected q, saturated at both ends
+    const uint8_t pixels[5] = {0, 72, 73, 74, 255};
+    const int8_t expected[5] = {-128, -60, 40, 127, 127};
+    for (unsigned k = 0; k < 5; k++) {
+        memset(img.ptr, pixels[k] - 128, img.size);
+        isp_resize_to_tensor(&src, NULL, &dst, &quant, 0);
+        for (unsigned i = 0; i < tensor.size; i++) {
+            TEST_ASSERT_EQUAL_INT8(expected[k], tensor.ptr[i]);
+        }
+    }
+}
+
+TEST(resize_group, resize__tensor_lut) {
+    isp_tensor_quant_t quant;
+    isp_tensor_quant_init(&quant, 3, t_mean, t_std, t_scale, t_zero_point, 0);
+
+    // gamma that negates the int8 pixel, easy to tell from none
+    int8_t gamma[256];
+    for (unsigned k = 0; k < 256; k++) {
+        gamma[k] = (int8_t)(127 - (int)k);
+    }
+
+    static int8_t lut[3][256], lut_gamma[3][256];
+    isp_tensor_quant_lut(&quant, NULL, lut);
+    isp_tensor_quant_lut(&quant, gamma, lut_gamma);
+
+    for (unsigned c = 0; c < 3; c++) {
+        for (unsigned k = 0; k < 256; k++) {
+            const int32_t pixel = (int32_t)k - 128;
+            const int32_t pixel_g = -((pixel < -127) ? -127 : pixel);
+
+            // same rounding as isp_resize_to_tensor()
+            int32_t q = ((pixel + 128) * quant.mul[c] + quant.add[c]
+                        + (1 << (ISP_TENSOR_QUANT_BITS - 1))) >> ISP_TENSOR_QUANT_BITS;
+            int32_t q_g = ((pixel_g + 128) * quant.mul[c] + quant.add[c]
+                          + (1 << (ISP_TENSOR_QUANT_BITS - 1))) >> ISP_TENSOR_QUANT_BITS;
+            q = (q > INT8_MAX) ? INT8_MAX : (q < INT8_MIN) ? INT8_MIN : q;
+            q_g = (q_g > INT8_MAX) ? INT8_MAX : (q_g < INT8_MIN) ? INT8_MIN : q_g;
+            TEST_ASSERT_EQUAL_INT8(q, lut[c][k]);
+            TEST_ASSERT_EQUAL_INT8(q_g, lut_gamma[c][k]);
+
+            // and the float model input quantisation
+            TEST_ASSERT_INT8_WITHIN(DELTA_PIXEL, quantise_ref((uint8_t)k, c), lut[c][k]);
+            TEST_ASSERT_INT8_WITHIN(DELTA_PIXEL, quantise_ref((uint8_t)(pixel_g + 128), c), lut_gamma[c][k]);
+        }
+    }
+}
+
+TEST(resize_group, resize__tensor_time) {
+    static CREATE_IMG_INT8(img, 120, 160, 3);
+    static CREATE_IMG_UINT8(img_u, 120, 160, 3);
+    static CREATE_IMG_UINT8(resized, 96, 96, 3);
+    static CREATE_IMG_INT8(tensor, 96, 96, 3);
+    fill_array_rand_int8(img.ptr, img.size);
+
+    // separate steps: convert, resize, normalise and quantise
+    t1 = get_reference_time();
+    vect_int8_to_uint8(img_u.ptr, img.ptr, img.size);
+    isp_resize_uint8(img_u.ptr, img_u.width, img_u.height, resized.ptr, resized.width, resized.height);
+    for (unsigned k = 0; k < resized.size; k++) {
+        tensor.ptr[k] = quantise_ref(resized.ptr[k], k % 3);
+    }
+    t2 = get_reference_time();
+
+    isp_tensor_quant_t quant;
+    isp_tensor_quant_init(&quant, 3, t_mean, t_std, t_scale, t_zero_point, 0);
+    isp_image_t src, dst;
+    isp_image_init(&src, img.ptr, img.width, img.height, 3, ISP_LAYOUT_HWC, ISP_TYPE_INT8);
+    isp_image_init(&dst, tensor.ptr, 96, 96, 3, ISP_LAYOUT_HWC, ISP_TYPE_INT8);
+    t3 = get_reference_time();
+    isp_resize_to_tensor(&src, NULL, &dst, &quant, 0);
+    t4 = get_reference_time();
+
+    printf("Time tensor 160x120->96x96 separate: %u, fused: %u\n", t2 - t1, t4 - t3);
+}
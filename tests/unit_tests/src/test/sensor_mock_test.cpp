@@ -0,0 +1,236 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+// Sensor control tests, built with SENSOR_I2C_MOCK=1 so the IMX219 driver
+// talks to the mock I2C backend (see sensor_i2c_mock.h).
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "unity_fixture.h"
+
+#include "_helpers.h"
+#include "camera_utils.h"
+#include "sensor_control.h"
+#include "sensor_i2c_mock.h"
+#include "imx219.hpp"
+
+#if !SENSOR_I2C_MOCK
+# error Sensor tests need SENSOR_I2C_MOCK=1
+#endif
+
+// Expected transactions
+#define INIT_WRITES       48  // common regs (42), lanes (1), exposure (5)
+#define CONFIG_WRITES     17  // frame window (12), pixel format (3), binning (2)
+#define EXPOSURE_WRITES   5
+#define SW_RESET_SLEEP    (200 * 100)
+#define WRITE_TICKS       I2C_MOCK_TICKS(I2C_MOCK_WRITE_BITS, I2C_DEV_SPEED)
+
+static
+sensor::i2c_config_t get_mock_config()
+{
+  sensor::i2c_config_t conf;
+  conf.device_addr = I2C_DEV_ADDR;
+  conf.speed = I2C_DEV_SPEED;
+  conf.p_scl = 0;
+  conf.p_sda = 0;
+  conf.i2c_ctx_ptr = NULL;
+  return conf;
+}
+
+static
+void check_sequence(
+  const uint16_t regs[],
+  const unsigned len)
+{
+  TEST_ASSERT_EQUAL_UINT(len, i2c_mock_get_transaction_count());
+  for (unsigned k = 0; k < len; k++) {
+    const i2c_mock_transaction_t* t = i2c_mock_get_transaction(k);
+    TEST_ASSERT_EQUAL_HEX16(regs[k], t->reg);
+    TEST_ASSERT_EQUAL_UINT8(0, t->is_read);
+  }
+}
+
+extern "C" {
+
+// --------------------------- Unity -----------------------------------------
+
+TEST_GROUP_RUNNER(sensor_mock) {
+  RUN_TEST_CASE(sensor_mock, sensor_mock__initialize);
+  RUN_TEST_CASE(sensor_mock, sensor_mock__configure);
+  RUN_TEST_CASE(sensor_mock, sensor_mock__exposure);
+  RUN_TEST_CASE(sensor_mock, sensor_mock__stream);
+  RUN_TEST_CASE(sensor_mock, sensor_mock__timing);
+  RUN_TEST_CASE(sensor_mock, sensor_mock__test_pattern);
+}
+TEST_GROUP(sensor_mock);
+TEST_SETUP(sensor_mock) {
+  fflush(stdout);
+  print_separator("sensor_mock");
+}
+TEST_TEAR_DOWN(sensor_mock) {}
+
+// ------------------------------- Tests -------------------------------------
+
+TEST(sensor_mock, sensor_mock__initialize)
+{
+  sensor::IMX219 snsr(get_mock_config(), RES_640_480, FMT_RAW8, true, true);
+
+  TEST_ASSERT_EQUAL(0, snsr.initialize());
+
+  // Starts with a software reset, the sleep is not an I2C write
+  const i2c_mock_transaction_t* t = i2c_mock_get_transaction(0);
+  TEST_ASSERT_EQUAL_HEX16(0x0103, t->reg);
+  TEST_ASSERT_EQUAL_HEX8(0x01, t->val);
+  TEST_ASSERT_EQUAL_UINT(INIT_WRITES, i2c_mock_get_transaction_count());
+  for (unsigned k = 0; k < INIT_WRITES; k++) {
+    TEST_ASSERT_NOT_EQUAL(0xFFFF, i2c_mock_get_transaction(k)->reg);
+  }
+
+  // Register map
+  TEST_ASSERT_EQUAL_HEX8(0x00, i2c_mock_get_reg(0x0100));     // standby
+  TEST_ASSERT_EQUAL_HEX16(0x1800, i2c_mock_get_reg16(0x012A)); // EXCK 24 MHz
+  TEST_ASSERT_EQUAL_HEX16(0x0040, i2c_mock_get_reg16(0x0306)); // PLL_VT_MPY
+  TEST_ASSERT_EQUAL_HEX16(0x0D78, i2c_mock_get_reg16(0x0162)); // line length
+  TEST_ASSERT_EQUAL_HEX8(0x01, i2c_mock_get_reg(0x0114));     // 2 lanes
+  TEST_ASSERT_EQUAL_HEX16(0x0400, i2c_mock_get_reg16(0x015A)); // GAIN_DB 40
+
+  // Bus time
+  uint32_t bus_time = i2c_mock_get_bus_time();
+  TEST_ASSERT_EQUAL_UINT32(INIT_WRITES * WRITE_TICKS, bus_time);
+  TEST_ASSERT_EQUAL_UINT32(bus_time + SW_RESET_SLEEP, i2c_mock_get_time());
+  PRINT_NAME_TIME("initialize() bus time", (unsigned)bus_time);
+}
+
+TEST(sensor_mock, sensor_mock__configure)
+{
+  sensor::IMX219 snsr(get_mock_config(), RES_640_480, FMT_RAW8, true, true);
+
+  TEST_ASSERT_EQUAL(0, snsr.configure());
+  TEST_ASSERT_EQUAL_UINT(CONFIG_WRITES, i2c_mock_get_transaction_count());
+
+  // 640x480 binned 2x2 and centralised on the 3280x2464 array
+  TEST_ASSERT_EQUAL_UINT16(1000, i2c_mock_get_reg16(0x0164));
+  TEST_ASSERT_EQUAL_UINT16(2279, i2c_mock_get_reg16(0x0166));
+  TEST_ASSERT_EQUAL_UINT16(752,  i2c_mock_get_reg16(0x0168));
+  TEST_ASSERT_EQUAL_UINT16(1711, i2c_mock_get_reg16(0x016A));
+  TEST_ASSERT_EQUAL_UINT16(640,  i2c_mock_get_reg16(0x016C));
+  TEST_ASSERT_EQUAL_UINT16(480,  i2c_mock_get_reg16(0x016E));
+  TEST_ASSERT_EQUAL_HEX8(0x08, i2c_mock_get_reg(0x018C));
+  TEST_ASSERT_EQUAL_HEX8(0x08, i2c_mock_get_reg(0x018D));
+  TEST_ASSERT_EQUAL_HEX8(0x08, i2c_mock_get_reg(0x0309));
+  TEST_ASSERT_EQUAL_HEX16(0x0101, i2c_mock_get_reg16(0x0174));
+
+  uint32_t bus_time = i2c_mock_get_bus_time();
+  TEST_ASSERT_EQUAL_UINT32(CONFIG_WRITES * WRITE_TICKS, bus_time);
+  PRINT_NAME_TIME("configure() bus time", (unsigned)bus_time);
+}
+
+TEST(sensor_mock, sensor_mock__exposure)
+{
+  sensor::IMX219 snsr(get_mock_config(), RES_640_480, FMT_RAW8, true, true);
+  static const uint16_t exposure_seq[EXPOSURE_WRITES] = {
+    0x0157, 0x0158, 0x0159, 0x015A, 0x015B
+  };
+
+  // Integration time only
+  TEST_ASSERT_EQUAL(0, snsr.set_exposure(0));
+  check_sequence(exposure_seq, EXPOSURE_WRITES);
+  TEST_ASSERT_EQUAL_HEX16(0x000A, i2c_mock_get_reg16(0x015A));
+  TEST_ASSERT_EQUAL_HEX8(0, i2c_mock_get_reg(0x0157));
+  TEST_ASSERT_EQUAL_HEX16(0x0100, i2c_mock_get_reg16(0x0158));
+
+  // Analogue gain on top of the longest integration time
+  i2c_mock_reset(I2C_DEV_SPEED);
+  TEST_ASSERT_EQUAL(0, snsr.set_exposure(60));
+  check_sequence(exposure_seq, EXPOSURE_WRITES);
+  TEST_ASSERT_EQUAL_HEX16(0x0400, i2c_mock_get_reg16(0x015A));
+  TEST_ASSERT_EQUAL_UINT8(231, i2c_mock_get_reg(0x0157));
+  TEST_ASSERT_EQUAL_HEX16(0x0100, i2c_mock_get_reg16(0x0158));
+
+  // Digital gain, values above the maximum are clamped
+  i2c_mock_reset(I2C_DEV_SPEED);
+  TEST_ASSERT_EQUAL(0, snsr.set_exposure(200));
+  check_sequence(exposure_seq, EXPOSURE_WRITES);
+  TEST_ASSERT_EQUAL_UINT8(231, i2c_mock_get_reg(0x0157));
+  TEST_ASSERT_EQUAL_HEX16(0x0FD9, i2c_mock_get_reg16(0x0158));
+
+  uint32_t bus_time = i2c_mock_get_bus_time();
+  TEST_ASSERT_EQUAL_UINT32(EXPOSURE_WRITES * WRITE_TICKS, bus_time);
+  PRINT_NAME_TIME("set_exposure() bus time", (unsigned)bus_time);
+}
+
+TEST(sensor_mock, sensor_mock__stream)
+{
+  sensor::IMX219 snsr(get_mock_config(), RES_640_480, FMT_RAW8, true, true);
+
+  TEST_ASSERT_EQUAL(0, snsr.stream_start());
+  TEST_ASSERT_EQUAL_HEX8(0x01, i2c_mock_get_reg(0x0100));
+  TEST_ASSERT_EQUAL(0, snsr.stream_stop());
+  TEST_ASSERT_EQUAL_HEX8(0x00, i2c_mock_get_reg(0x0100));
+  TEST_ASSERT_EQUAL_UINT(2, i2c_mock_get_transaction_count());
+}
+
+TEST(sensor_mock, sensor_mock__timing)
+{
+  sensor::IMX219 snsr(get_mock_config(), RES_640_480, FMT_RAW8, true, true);
+
+  // 153.6 MHz / (3448 * 30)
+  TEST_ASSERT_EQUAL(0, snsr.set_fps(30));
+  TEST_ASSERT_EQUAL_UINT16(3448, i2c_mock_get_reg16(0x0162));
+  TEST_ASSERT_EQUAL_UINT16(1484, i2c_mock_get_reg16(0x0160));
+
+  // Too short for 480 lines, rejected without writes
+  unsigned count = i2c_mock_get_transaction_count();
+  TEST_ASSERT_EQUAL(0, snsr.set_fps(200));
+  TEST_ASSERT_EQUAL_UINT(count, i2c_mock_get_transaction_count());
+  TEST_ASSERT_EQUAL_UINT16(1484, i2c_mock_get_reg16(0x0160));
+
+  // Longer lines keep the frame rate
+  TEST_ASSERT_EQUAL(0, snsr.set_line_length(6896));
+  TEST_ASSERT_EQUAL_UINT16(6896, i2c_mock_get_reg16(0x0162));
+  TEST_ASSERT_EQUAL_UINT16(742, i2c_mock_get_reg16(0x0160));
+
+  // ISP row time fits 6896 (4489 ticks) but not 3448 (2244 ticks) clocks per line
+  snsr.set_isp_row_time(3000);
+  count = i2c_mock_get_transaction_count();
+  TEST_ASSERT_EQUAL(0, snsr.set_line_length(3448));
+  TEST_ASSERT_EQUAL_UINT(count, i2c_mock_get_transaction_count());
+  TEST_ASSERT_EQUAL_UINT16(6896, i2c_mock_get_reg16(0x0162));
+}
+
+TEST(sensor_mock, sensor_mock__test_pattern)
+{
+  sensor::IMX219 snsr(get_mock_config(), RES_640_480, FMT_RAW8, true, true);
+
+  TEST_ASSERT_EQUAL(0, snsr.set_test_pattern(TEST_PATTERN_COLOUR_BARS));
+  TEST_ASSERT_EQUAL_HEX16(0x0002, i2c_mock_get_reg16(0x0600));
+  TEST_ASSERT_EQUAL_UINT16(640, i2c_mock_get_reg16(0x0624));
+  TEST_ASSERT_EQUAL_UINT16(480, i2c_mock_get_reg16(0x0626));
+
+  TEST_ASSERT_EQUAL(0, snsr.set_test_pattern(TEST_PATTERN_SOLID));
+  TEST_ASSERT_EQUAL_HEX16(0x0001, i2c_mock_get_reg16(0x0600));
+  TEST_ASSERT_EQUAL_HEX16(TEST_PATTERN_SOLID_VALUE, i2c_mock_get_reg16(0x0602));
+  TEST_ASSERT_EQUAL_HEX16(TEST_PATTERN_SOLID_VALUE, i2c_mock_get_reg16(0x0608));
+
+  // Unknown patterns are rejected without writes
+  unsigned count = i2c_mock_get_transaction_count();
+  TEST_ASSERT_EQUAL(0, snsr.set_test_pattern((sensor_test_pattern_t)5));
+  TEST_ASSERT_EQUAL_UINT(count, i2c_mock_get_transaction_count());
+  TEST_ASSERT_EQUAL_HEX16(0x0001, i2c_mock_get_reg16(0x0600));
+
+  // The window follows a mode change
+  TEST_ASSERT_EQUAL(0, snsr.set_mode(RES_1280_960, FMT_RAW8, true));
+  TEST_ASSERT_EQUAL_HEX16(0x0001, i2c_mock_get_reg16(0x0600));
+  TEST_ASSERT_EQUAL_UINT16(1280, i2c_mock_get_reg16(0x0624));
+  TEST_ASSERT_EQUAL_UINT16(960, i2c_mock_get_reg16(0x0626));
+
+  TEST_ASSERT_EQUAL(0, snsr.set_test_pattern(TEST_PATTERN_NONE));
+  TEST_ASSERT_EQUAL_HEX16(0x0000, i2c_mock_get_reg16(0x0600));
+
+  // and is left alone once the pattern is off
+  TEST_ASSERT_EQUAL(0, snsr.set_mode(RES_640_480, FMT_RAW8, true));
+  TEST_ASSERT_EQUAL_UINT16(1280, i2c_mock_get_reg16(0x0624));
+}
+
+} // extern "C"
@@ -0,0 +1,234 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "unity_fixture.h"
+
+#include "camera_main.h"
+#include "isp_sharpen.h"
+#include "_helpers.h"
+
+TEST_GROUP_RUNNER(isp_sharpen) {
+  RUN_TEST_CASE(isp_sharpen, isp_sharpen__flat);
+  RUN_TEST_CASE(isp_sharpen, isp_sharpen__reference);
+  RUN_TEST_CASE(isp_sharpen, isp_sharpen__psnr);
+  RUN_TEST_CASE(isp_sharpen, isp_sharpen__timing);
+}
+
+TEST_GROUP(isp_sharpen);
+TEST_SETUP(isp_sharpen) { fflush(stdout); }
+TEST_TEAR_DOWN(isp_sharpen) {}
+
+#define TEST_W      32
+#define TEST_H      12
+#define ROW_BYTES   (APP_IMAGE_CHANNEL_COUNT * TEST_W)
+
+__attribute__((aligned(4)))
+static int8_t ring[SHARPEN_RING_BYTES(TEST_W)];
+
+__attribute__((aligned(4)))
+static int8_t frame[TEST_H][ROW_BYTES];
+__attribute__((aligned(4)))
+static int8_t result[TEST_H][ROW_BYTES];
+
+static inline
+int32_t sat8(int32_t v) { return (v > 127) ? 127 : (v < -127) ? -127 : v; }
+
+// Pixel of channel c, mirrored at the edges
+static
+int32_t px(
+    const int y,
+    const int x,
+    const unsigned c)
+{
+  const int yy = (y < 0) ? -y : (y >= TEST_H) ? 2 * (TEST_H - 1) - y : y;
+  const int xx = (x < 0) ? -x : (x >= TEST_W) ? 2 * (TEST_W - 1) - x : x;
+  return frame[yy][c * TEST_W + xx];
+}
+
+// Horizontal [1 2 1] / 4 of row y, rounded as pixel_demosaic_macc() does
+static
+int32_t ref_blur_h(
+    const int y,
+    const int x,
+    const unsigned c)
+{
+  const int yy = (y < 0) ? -y : (y >= TEST_H) ? 2 * (TEST_H - 1) - y : y;
+  return sat8((px(yy, x - 1, c) + 2 * px(yy, x, c) + px(yy, x + 1, c) + 2) >> 2);
+}
+
+// The integer steps of isp_sharpen_push_row()
+static
+int8_t ref_sharpen(
+    const int y,
+    const int x,
+    const unsigned c,
+    const int32_t strength)
+{
+  const int32_t blur = ref_blur_h(y - 1, x, c) + 2 * ref_blur_h(y, x, c)
+                     + ref_blur_h(y + 1, x, c);
+  const int32_t acc = (64 + 4 * strength) * px(y, x, c) - strength * blur;
+  return (int8_t)sat8((acc + 32) >> 6);
+}
+
+// Unsharp mask on real values, as python/sharpen_reference.py
+static
+float float_sharpen(
+    const int y,
+    const int x,
+    const unsigned c,
+    const float s)
+{
+  static const float k[3] = {0.25f, 0.5f, 0.25f};
+  float blur = 0;
+  for (int dy = -1; dy <= 1; dy++) {
+    for (int dx = -1; dx <= 1; dx++) {
+      blur += k[dy + 1] * k[dx + 1] * px(y + dy, x + dx, c);
+    }
+  }
+  const float v = px(y, x, c) + s * (px(y, x, c) - blur);
+  return (v > 127) ? 127 : (v < -127) ? -127 : v;
+}
+
+// Run `frame` through the stage into `result`, checking the row order
+static
+void run_frame(
+    const unsigned strength)
+{
+  sharpen_state_t state;
+  unsigned row;
+  unsigned rows = 0;
+
+  isp_sharpen_frame_init(&state, strength, TEST_W, ring);
+  for (unsigned y = 0; y < TEST_H; y++) {
+    if (isp_sharpen_push_row(&state, result[rows], frame[y], &row)) {
+      TEST_ASSERT_EQUAL_UINT(rows, row);
+      rows++;
+    }
+  }
+  while (isp_sharpen_drain(&state, result[rows], &row)) {
+    TEST_ASSERT_EQUAL_UINT(rows, row);
+    rows++;
+  }
+  TEST_ASSERT_EQUAL_UINT(TEST_H, rows);
+}
+
+
+// A flat colour comes out unchanged, edges included
+TEST(isp_sharpen, isp_sharpen__flat)
+{
+  static const int8_t colour[3] = {-100, 7, 120};
+
+  for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+    for (unsigned y = 0; y < TEST_H; y++) {
+      memset(&frame[y][c * TEST_W], colour[c], TEST_W);
+    }
+  }
+
+  for (unsigned strength = 1; strength <= SHARPEN_STRENGTH_MAX; strength++) {
+    run_frame(strength);
+    TEST_ASSERT_EQUAL_INT8_ARRAY(&frame[0][0], &result[0][0], sizeof(frame));
+  }
+}
+
+
+// Random frames match a scalar implementation, at the strength extremes
+TEST(isp_sharpen, isp_sharpen__reference)
+{
+  static const unsigned strengths[] = {1, 16, 29, SHARPEN_STRENGTH_MAX};
+  __attribute__((aligned(4))) int8_t expected[ROW_BYTES];
+
+  for (unsigned i = 0; i < sizeof(strengths) / sizeof(strengths[0]); i++) {
+    fill_array_rand_int8(&frame[0][0], sizeof(frame));
+    run_frame(strengths[i]);
+
+    for (unsigned y = 0; y < TEST_H; y++) {
+      for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+        for (unsigned x = 0; x < TEST_W; x++) {
+          expected[c * TEST_W + x] = ref_sharpen(y, x, c, strengths[i]);
+        }
+      }
+      TEST_ASSERT_EQUAL_INT8_ARRAY(expected, result[y], ROW_BYTES);
+    }
+  }
+}
+
+
+// PSNR against the real valued unsharp mask, on a textured frame
+TEST(isp_sharpen, isp_sharpen__psnr)
+{
+  static const unsigned strengths[] = {8, 16, 32, SHARPEN_STRENGTH_MAX};
+  static const float psnr_min = 40.0f;
+
+  for (unsigned y = 0; y < TEST_H; y++) {
+    for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+      for (unsigned x = 0; x < TEST_W; x++) {
+        const float v = 60.0f * sinf(0.45f * x + 0.3f * c) * cosf(0.35f * y)
+                      + (float)((rand() % 17) - 8);
+        frame[y][c * TEST_W + x] = (int8_t)lrintf(v);
+      }
+    }
+  }
+
+  printf("\n\tisp_sharpen PSNR against the float unsharp mask (dB):\n");
+  for (unsigned i = 0; i < sizeof(strengths) / sizeof(strengths[0]); i++) {
+    run_frame(strengths[i]);
+
+    double se = 0;
+    for (unsigned y = 0; y < TEST_H; y++) {
+      for (unsigned c = 0; c < APP_IMAGE_CHANNEL_COUNT; c++) {
+        for (unsigned x = 0; x < TEST_W; x++) {
+          const float d = result[y][c * TEST_W + x]
+                        - float_sharpen(y, x, c, strengths[i] / 16.0f);
+          se += d * d;
+        }
+      }
+    }
+    const double mse = se / (TEST_H * ROW_BYTES);
+    const double psnr = 10 * log10(255.0 * 255.0 / mse);
+    printf("\t\tstrength %2u/16: %.1f\n", strengths[i], psnr);
+    TEST_ASSERT_TRUE(psnr > psnr_min);
+  }
+  printf("\n");
+}
+
+
+// Ticks per output row of the decimated frame, drain included. A row is
+// within ROW_BUDGET_TICKS().
+TEST(isp_sharpen, isp_sharpen__timing)
+{
+  __attribute__((aligned(4)))
+  static int8_t big_ring[SHARPEN_RING_BYTES(APP_IMAGE_WIDTH_PIXELS)];
+  __attribute__((aligned(4)))
+  static int8_t row[2][APP_IMAGE_CHANNEL_COUNT * APP_IMAGE_WIDTH_PIXELS];
+  __attribute__((aligned(4)))
+  static int8_t out[APP_IMAGE_CHANNEL_COUNT * APP_IMAGE_WIDTH_PIXELS];
+  sharpen_state_t state;
+  unsigned row_index;
+
+  static const char func_name[] = "isp_sharpen_push_row()";
+
+  fill_array_rand_int8(&row[0][0], sizeof(row));
+  isp_sharpen_frame_init(&state, SHARPEN_STRENGTH_MAX, APP_IMAGE_WIDTH_PIXELS, big_ring);
+
+  unsigned ts = measure_time();
+  for (unsigned y = 0; y < APP_IMAGE_HEIGHT_PIXELS; y++) {
+    isp_sharpen_push_row(&state, out, row[y & 1], &row_index);
+  }
+  while (isp_sharpen_drain(&state, out, &row_index));
+  unsigned te = measure_time();
+
+  printf("\n\t%s timing (%ux%ux%u):\n", func_name,
+         APP_IMAGE_WIDTH_PIXELS, APP_IMAGE_HEIGHT_PIXELS, APP_IMAGE_CHANNEL_COUNT);
+  printf("\t\tticks/frame: %u\n", te - ts);
+  printf("\t\tticks/row:   %u\n", (te - ts) / APP_IMAGE_HEIGHT_PIXELS);
+  printf("\t\tring:        %u bytes\n\n", (unsigned)SHARPEN_RING_BYTES(APP_IMAGE_WIDTH_PIXELS));
+
+  TEST_ASSERT_LESS_OR_EQUAL_UINT(ROW_BUDGET_TICKS(APP_IMAGE_WIDTH_PIXELS),
+                                 (te - ts) / APP_IMAGE_HEIGHT_PIXELS);
+}
@@ -34,6 +34,7 @@ TEST_GROUP_RUNNER(stats_test) {
   RUN_TEST_CASE(stats_test, stats_test__basic);
   RUN_TEST_CASE(stats_test, stats_test__constants);
   RUN_TEST_CASE(stats_test, stats_test__edge);
+  RUN_TEST_CASE(stats_test, stats_test__black_level);
 }
 
 
@@ -143,3 +144,44 @@ TEST(stats_test, stats_test__edge){
   printf("Testing stats [edge cases]\n");
   generic_test(filler_edge);
 }
+
+// Each channel is measured on its own pixels, then averaged over frames
+TEST(stats_test, stats_test__black_level){
+  static const int levels[2][3] = {{12, 18, 15}, {20, 26, 23}};
+  black_level_t black_level;
+  int8_t row[2][WIDTH];
+
+  memset(&black_level, 0, sizeof(black_level));
+
+  for (unsigned frame = 0; frame < 64; frame++) {
+    const int* level = levels[frame != 0];
+    for (unsigned x = 0; x < WIDTH; x += 2) {
+      row[0][x] = level[CHAN_RED] - 128;
+      row[0][x + 1] = level[CHAN_GREEN] - 128;
+      row[1][x] = 127;  // green of GB rows isn't used
+      row[1][x + 1] = level[CHAN_BLUE] - 128;
+    }
+    for (unsigned y = 0; y < 4; y++) {
+      stats_black_level_row(&black_level, row[y & 1], WIDTH, y);
+    }
+    stats_black_level_frame_end(&black_level);
+
+    // the first frame sets the level, the next ones move it a fraction
+    if (frame == 0 || frame == 1) {
+      for (unsigned c = 0; c < 3; c++) {
+        const float expected = (frame == 0) ? levels[0][c]
+            : levels[0][c] + (levels[1][c] - levels[0][c]) / (float)(1 << BLACK_LEVEL_AVG_SHIFT);
+        TEST_ASSERT_FLOAT_WITHIN(0.01f, expected, stats_black_level(&black_level, c));
+      }
+    }
+  }
+  for (unsigned c = 0; c < 3; c++) {
+    TEST_ASSERT_FLOAT_WITHIN(0.1f, levels[1][c], stats_black_level(&black_level, c));
+  }
+
+  // a frame without blue leaves the level alone
+  stats_black_level_row(&black_level, row[0], WIDTH, 0);
+  stats_black_level_frame_end(&black_level);
+  TEST_ASSERT_FLOAT_WITHIN(0.1f, levels[1][CHAN_RED], stats_black_level(&black_level, CHAN_RED));
+  TEST_ASSERT_EQUAL_UINT(0, black_level.count[CHAN_RED]);
+}
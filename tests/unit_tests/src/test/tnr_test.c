@@ -0,0 +1,277 @@
+// Copyright 2024 XMOS LIMITED.
+// This Software is subject to the terms of the XMOS Public Licence: Version 1.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "unity_fixture.h"
+
+#include "camera_main.h"
+#include "isp_tnr.h"
+#include "_helpers.h"
+
+TEST_GROUP_RUNNER(isp_tnr) {
+  RUN_TEST_CASE(isp_tnr, isp_tnr__still);
+  RUN_TEST_CASE(isp_tnr, isp_tnr__noise);
+  RUN_TEST_CASE(isp_tnr, isp_tnr__motion);
+  RUN_TEST_CASE(isp_tnr, isp_tnr__reference);
+  RUN_TEST_CASE(isp_tnr, isp_tnr__seed);
+  RUN_TEST_CASE(isp_tnr, isp_tnr__range);
+  RUN_TEST_CASE(isp_tnr, isp_tnr__timing);
+}
+
+TEST_GROUP(isp_tnr);
+TEST_SETUP(isp_tnr) { fflush(stdout); }
+TEST_TEAR_DOWN(isp_tnr) {}
+
+#define TEST_W      32
+#define TEST_H      8
+#define STRENGTH    96
+#define THRESHOLD   16
+
+__attribute__((aligned(4)))
+static int8_t prev[TNR_PREV_BYTES];
+
+// Rows are read 16 bytes past their end
+__attribute__((aligned(4)))
+static int8_t frame[TEST_H][APP_IMAGE_CHANNEL_COUNT * TEST_W + 16];
+
+static inline
+int32_t clip(int32_t x, int32_t t) { return (x > t) ? t : (x < -t) ? -t : x; }
+
+// The blend of pixel_tnr_blend()
+static
+int8_t ref_tnr(
+    const int8_t cur,
+    const int8_t last,
+    const unsigned strength,
+    const unsigned threshold)
+{
+  const int32_t t = threshold >> 1;
+  const int32_t hd = (cur >> 1) - (last >> 1);
+  const int32_t g = 2 * clip(hd, t) - clip(hd, 2 * t);
+  int32_t v = (64 * cur - (int32_t)strength * g + 32) >> 6;
+  v = (v > 127) ? 127 : (v < -127) ? -127 : v;
+  return (int8_t)v;
+}
+
+// Run the rows of `frame` through the denoise, as the ISP does
+static
+void run_frame(
+    tnr_state_t* state,
+    const unsigned width,
+    const unsigned height)
+{
+  TEST_ASSERT_EQUAL_UINT(1, isp_tnr_frame_init(state, width, height));
+  for (unsigned y = 0; y < height; y++) {
+    isp_tnr_apply(state, frame[y], y);
+  }
+}
+
+
+// A still frame comes out unchanged, the first one only fills the buffer
+TEST(isp_tnr, isp_tnr__still)
+{
+  tnr_state_t state;
+  static int8_t expected[TEST_H][APP_IMAGE_CHANNEL_COUNT * TEST_W + 16];
+
+  isp_tnr_init(&state, prev, sizeof(prev));
+  TEST_ASSERT_EQUAL_INT(0, isp_tnr_set(&state, STRENGTH, THRESHOLD));
+
+  fill_array_rand_int8(&expected[0][0], sizeof(expected));
+  for (unsigned y = 0; y < TEST_H; y++) {
+    for (unsigned x = 0; x < APP_IMAGE_CHANNEL_COUNT * TEST_W; x++) {
+      expected[y][x] = (expected[y][x] == -128) ? -127 : expected[y][x];
+    }
+  }
+
+  for (unsigned f = 0; f < 4; f++) {
+    memcpy(frame, expected, sizeof(frame));
+    run_frame(&state, TEST_W, TEST_H);
+    TEST_ASSERT_EQUAL_UINT(f == 0, state.seed);
+    for (unsigned y = 0; y < TEST_H; y++) {
+      TEST_ASSERT_EQUAL_INT8_ARRAY(expected[y], frame[y], APP_IMAGE_CHANNEL_COUNT * TEST_W);
+    }
+  }
+}
+
+
+// Noise on a still scene drops to about sqrt((128 - s) / (128 + s)), a little
+// less with the blend rounding to whole pixels
+TEST(isp_tnr, isp_tnr__noise)
+{
+  static const unsigned frames = 64;
+  static const int8_t scene = 20;
+  tnr_state_t state;
+  double err_in = 0;
+  double err_out = 0;
+  unsigned count = 0;
+
+  isp_tnr_init(&state, prev, sizeof(prev));
+  TEST_ASSERT_EQUAL_INT(0, isp_tnr_set(&state, STRENGTH, THRESHOLD));
+
+  srand(7);
+  for (unsigned f = 0; f < frames; f++) {
+    for (unsigned y = 0; y < TEST_H; y++) {
+      for (unsigned x = 0; x < APP_IMAGE_CHANNEL_COUNT * TEST_W; x++) {
+        const int n = (rand() % 13) - 6;
+        frame[y][x] = scene + n;
+        // Past the settling frames
+        if (f >= 16) err_in += n * n;
+      }
+    }
+    run_frame(&state, TEST_W, TEST_H);
+    if (f < 16) continue;
+    for (unsigned y = 0; y < TEST_H; y++) {
+      for (unsigned x = 0; x < APP_IMAGE_CHANNEL_COUNT * TEST_W; x++) {
+        const int e = frame[y][x] - scene;
+        err_out += e * e;
+        count++;
+      }
+    }
+  }
+
+  const float ratio = sqrtf((float)(err_out / err_in));
+  const float expected = sqrtf((128.0f - STRENGTH) / (128.0f + STRENGTH));
+  TEST_ASSERT_FLOAT_WITHIN(0.2f, expected, ratio);
+  TEST_ASSERT_EQUAL_UINT(APP_IMAGE_CHANNEL_COUNT * TEST_W * TEST_H * (frames - 16), count);
+}
+
+
+// Changes past twice the threshold are taken whole, at once
+TEST(isp_tnr, isp_tnr__motion)
+{
+  tnr_state_t state;
+
+  isp_tnr_init(&state, prev, sizeof(prev));
+  TEST_ASSERT_EQUAL_INT(0, isp_tnr_set(&state, STRENGTH, THRESHOLD));
+
+  memset(frame, -60, sizeof(frame));
+  run_frame(&state, TEST_W, TEST_H);
+  run_frame(&state, TEST_W, TEST_H);
+
+  memset(frame, -60 + 2 * THRESHOLD + 2, sizeof(frame));
+  run_frame(&state, TEST_W, TEST_H);
+  for (unsigned y = 0; y < TEST_H; y++) {
+    for (unsigned x = 0; x < APP_IMAGE_CHANNEL_COUNT * TEST_W; x++) {
+      TEST_ASSERT_EQUAL_INT8(-60 + 2 * THRESHOLD + 2, frame[y][x]);
+    }
+  }
+}
+
+
+// Random frames match a scalar implementation of the blend, and the output
+// becomes the previous frame
+TEST(isp_tnr, isp_tnr__reference)
+{
+  static const unsigned strengths[] = {1, 64, 96, 127};
+  static const unsigned thresholds[] = {2, 16, 40, TNR_THRESHOLD_MAX};
+  static int8_t last[TEST_H][APP_IMAGE_CHANNEL_COUNT * TEST_W];
+  static int8_t expected[TEST_H][APP_IMAGE_CHANNEL_COUNT * TEST_W];
+  tnr_state_t state;
+
+  isp_tnr_init(&state, prev, sizeof(prev));
+
+  for (unsigned k = 0; k < 4; k++) {
+    TEST_ASSERT_EQUAL_INT(0, isp_tnr_set(&state, strengths[k], thresholds[k]));
+    for (unsigned f = 0; f < 3; f++) {
+      fill_array_rand_int8(&frame[0][0], sizeof(frame));
+      for (unsigned y = 0; y < TEST_H; y++) {
+        for (unsigned x = 0; x < APP_IMAGE_CHANNEL_COUNT * TEST_W; x++) {
+          expected[y][x] = ref_tnr(frame[y][x], last[y][x], strengths[k], thresholds[k]);
+        }
+      }
+      run_frame(&state, TEST_W, TEST_H);
+      for (unsigned y = 0; y < TEST_H; y++) {
+        // The first frame only fills the buffer
+        if (!state.seed) {
+          TEST_ASSERT_EQUAL_INT8_ARRAY(expected[y], frame[y], APP_IMAGE_CHANNEL_COUNT * TEST_W);
+        }
+        memcpy(last[y], frame[y], sizeof(last[y]));
+      }
+    }
+  }
+}
+
+
+// The buffer is filled again after a size change or a pause, and frames
+// that don't fit it aren't filtered
+TEST(isp_tnr, isp_tnr__seed)
+{
+  tnr_state_t state;
+
+  isp_tnr_init(&state, prev, sizeof(prev));
+  TEST_ASSERT_EQUAL_UINT(0, isp_tnr_frame_init(&state, TEST_W, TEST_H));
+  TEST_ASSERT_EQUAL_INT(0, isp_tnr_set(&state, STRENGTH, THRESHOLD));
+
+  TEST_ASSERT_EQUAL_UINT(1, isp_tnr_frame_init(&state, TEST_W, TEST_H));
+  TEST_ASSERT_EQUAL_UINT(1, state.seed);
+  TEST_ASSERT_EQUAL_UINT(1, isp_tnr_frame_init(&state, TEST_W, TEST_H));
+  TEST_ASSERT_EQUAL_UINT(0, state.seed);
+  TEST_ASSERT_EQUAL_UINT(1, isp_tnr_frame_init(&state, TEST_W, TEST_H / 2));
+  TEST_ASSERT_EQUAL_UINT(1, state.seed);
+
+  TEST_ASSERT_EQUAL_INT(0, isp_tnr_set(&state, 0, THRESHOLD));
+  TEST_ASSERT_EQUAL_UINT(0, isp_tnr_frame_init(&state, TEST_W, TEST_H / 2));
+  TEST_ASSERT_EQUAL_INT(0, isp_tnr_set(&state, STRENGTH, THRESHOLD));
+  TEST_ASSERT_EQUAL_UINT(1, isp_tnr_frame_init(&state, TEST_W, TEST_H / 2));
+  TEST_ASSERT_EQUAL_UINT(1, state.seed);
+
+  TEST_ASSERT_EQUAL_UINT(0, isp_tnr_frame_init(&state, 2 * APP_IMAGE_WIDTH_PIXELS, APP_IMAGE_HEIGHT_PIXELS));
+  TEST_ASSERT_EQUAL_UINT(1, isp_tnr_frame_init(&state, APP_IMAGE_WIDTH_PIXELS, APP_IMAGE_HEIGHT_PIXELS));
+  TEST_ASSERT_EQUAL_UINT(1, state.seed);
+}
+
+
+TEST(isp_tnr, isp_tnr__range)
+{
+  tnr_state_t state;
+  isp_tnr_init(&state, prev, sizeof(prev));
+
+  TEST_ASSERT_EQUAL_INT(-1, isp_tnr_set(&state, 128, THRESHOLD));
+  TEST_ASSERT_EQUAL_INT(-1, isp_tnr_set(&state, STRENGTH, 1));
+  TEST_ASSERT_EQUAL_INT(-1, isp_tnr_set(&state, STRENGTH, TNR_THRESHOLD_MAX + 1));
+  TEST_ASSERT_EQUAL_INT(0, isp_tnr_set(&state, 127, TNR_THRESHOLD_MAX));
+  TEST_ASSERT_EQUAL_INT(0, isp_tnr_set(&state, 0, 2));
+}
+
+
+// Ticks per frame of the default output size, and the buffer size. A row is
+// within ROW_BUDGET_TICKS().
+TEST(isp_tnr, isp_tnr__timing)
+{
+  __attribute__((aligned(4)))
+  static int8_t row[APP_IMAGE_CHANNEL_COUNT * APP_IMAGE_WIDTH_PIXELS + 16];
+  tnr_state_t state;
+
+  static const char func_name[] = "isp_tnr_apply()";
+
+  fill_array_rand_int8(row, sizeof(row));
+  isp_tnr_init(&state, prev, sizeof(prev));
+  TEST_ASSERT_EQUAL_INT(0, isp_tnr_set(&state, STRENGTH, THRESHOLD));
+
+  // The first frame only copies
+  isp_tnr_frame_init(&state, APP_IMAGE_WIDTH_PIXELS, APP_IMAGE_HEIGHT_PIXELS);
+  for (unsigned y = 0; y < APP_IMAGE_HEIGHT_PIXELS; y++) {
+    isp_tnr_apply(&state, row, y);
+  }
+
+  isp_tnr_frame_init(&state, APP_IMAGE_WIDTH_PIXELS, APP_IMAGE_HEIGHT_PIXELS);
+  unsigned ts = measure_time();
+  for (unsigned y = 0; y < APP_IMAGE_HEIGHT_PIXELS; y++) {
+    isp_tnr_apply(&state, row, y);
+  }
+  unsigned te = measure_time();
+
+  printf("\n\t%s timing (%ux%ux%u):\n", func_name,
+         APP_IMAGE_WIDTH_PIXELS, APP_IMAGE_HEIGHT_PIXELS, APP_IMAGE_CHANNEL_COUNT);
+  printf("\t\tticks/frame: %u\n", te - ts);
+  printf("\t\tticks/row:   %u\n", (te - ts) / APP_IMAGE_HEIGHT_PIXELS);
+  printf("\t\tbuffer:      %u bytes\n\n", (unsigned)TNR_PREV_BYTES);
+
+  TEST_ASSERT_LESS_OR_EQUAL_UINT(ROW_BUDGET_TICKS(APP_IMAGE_WIDTH_PIXELS),
+                                 (te - ts) / APP_IMAGE_HEIGHT_PIXELS);
+}